@@ -1114,7 +1114,8 @@ void application::loop()
 	{
 		if (scene)
 		{
-			poll_actions();
+			if (not scene->syncs_actions)
+				poll_actions();
 			if (auto tmp = last_scene.lock(); scene != tmp)
 			{
 				if (tmp)
@@ -1227,10 +1228,15 @@ void application::push_scene(std::shared_ptr<scene> s)
 
 void application::poll_actions()
 {
+	auto scene = instance().current_scene();
+	if (not scene)
+		return;
+
 	std::array<XrActionSet, 2> action_sets{
 	        instance().xr_actionset,
-	        instance().current_scene()->current_meta.actionset};
+	        scene->current_meta.actionset};
 
+	std::lock_guard lock(instance().actions_mutex);
 	instance().xr_session.sync_actions(action_sets);
 }
 
@@ -1245,7 +1251,10 @@ std::optional<std::pair<XrTime, bool>> application::read_action_bool(XrAction ac
 	};
 
 	XrActionStateBoolean state{XR_TYPE_ACTION_STATE_BOOLEAN};
-	CHECK_XR(xrGetActionStateBoolean(instance().xr_session, &get_info, &state));
+	{
+		std::lock_guard lock(instance().actions_mutex);
+		CHECK_XR(xrGetActionStateBoolean(instance().xr_session, &get_info, &state));
+	}
 
 	if (!state.isActive)
 		return {};
@@ -1264,7 +1273,10 @@ std::optional<std::pair<XrTime, float>> application::read_action_float(XrAction
 	};
 
 	XrActionStateFloat state{XR_TYPE_ACTION_STATE_FLOAT};
-	CHECK_XR(xrGetActionStateFloat(instance().xr_session, &get_info, &state));
+	{
+		std::lock_guard lock(instance().actions_mutex);
+		CHECK_XR(xrGetActionStateFloat(instance().xr_session, &get_info, &state));
+	}
 
 	if (!state.isActive)
 		return {};
@@ -1283,7 +1295,10 @@ std::optional<std::pair<XrTime, XrVector2f>> application::read_action_vec2(XrAct
 	};
 
 	XrActionStateVector2f state{XR_TYPE_ACTION_STATE_VECTOR2F};
-	CHECK_XR(xrGetActionStateVector2f(instance().xr_session, &get_info, &state));
+	{
+		std::lock_guard lock(instance().actions_mutex);
+		CHECK_XR(xrGetActionStateVector2f(instance().xr_session, &get_info, &state));
+	}
 
 	if (!state.isActive)
 		return {};
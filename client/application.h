@@ -144,6 +144,7 @@ class application : public singleton<application>
 	bool server_tcp_only = false;
 
 	std::mutex scene_stack_lock;
+	std::mutex actions_mutex;
 	std::vector<std::shared_ptr<scene>> scene_stack;
 	std::weak_ptr<scene> last_scene;
 	std::chrono::nanoseconds last_scene_cpu_time;
@@ -19,12 +19,28 @@
 
 #include "audio.h"
 
+#include "application.h"
 #include "utils/named_thread.h"
 #include "wivrn_client.h"
 #include "xr/instance.h"
 
 #include "spdlog/spdlog.h"
 #include <aaudio/AAudio.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+// Level of the speaker buffer held by adjusting the playback speed when the
+// video latency is unknown, in seconds
+static const double target_buffer_level = 0.03;
+// Data is not discarded below this level, to absorb the network jitter
+static const double min_buffer_level = 0.01;
+// Bounds of the delay between audio production on the server and playout
+static const std::chrono::milliseconds min_av_delay{0};
+static const std::chrono::milliseconds max_av_delay{300};
+// Larger errors are corrected by discarding data or inserting silence
+static const double max_speed_error = 0.05;
+static const std::chrono::seconds speaker_step_interval{1};
 
 void wivrn::android::audio::exit()
 {
@@ -53,66 +69,141 @@ int32_t wivrn::android::audio::speaker_data_cb(AAudioStream * stream, void * use
 		return AAUDIO_CALLBACK_RESULT_STOP;
 	}
 
-	size_t frame_size = AAudioStream_getChannelCount(stream) * sizeof(uint16_t);
+	const size_t num_channels = AAudioStream_getChannelCount(stream);
+	const size_t frame_size = num_channels * sizeof(uint16_t);
+	const int32_t sample_rate = AAudioStream_getSampleRate(stream);
+	auto & resampler = *self->speaker_resampler;
+
+	auto now = std::chrono::steady_clock::now();
+	double dt = std::chrono::duration<double>(now - self->speaker_last_callback).count();
+	self->speaker_last_callback = now;
+
+	double level = (double(self->buffer_size_bytes / frame_size) + resampler.buffered()) / sample_rate;
+
+	// Play the audio with the same delay as the video when it is known,
+	// otherwise only keep the buffer at the target level
+	XrDuration video_latency = self->video_latency;
+	std::optional<double> delay = video_latency > 0 ? self->speaker_delay(stream, sample_rate) : std::nullopt;
+	if (delay.has_value() != self->speaker_av_sync)
+	{
+		self->speaker_av_sync = delay.has_value();
+		self->speaker_controller.reset();
+	}
 
-	while (num_frames != 0)
+	double measured = level;
+	auto target = std::chrono::duration<double>(target_buffer_level);
+	if (delay)
 	{
-		// remaining bytes in existing buffer
-		ptrdiff_t tmp_remain = self->speaker_tmp.payload.size_bytes();
-		// limit to requested frames
-		tmp_remain = std::min<ptrdiff_t>(tmp_remain, num_frames * frame_size);
-		if (tmp_remain)
+		measured = *delay;
+		target = std::clamp<std::chrono::duration<double>>(std::chrono::nanoseconds(video_latency) + self->av_offset, min_av_delay, max_av_delay);
+	}
+	self->speaker_controller.set_target(target);
+	double correction = self->speaker_controller.update(measured, dt);
+	resampler.set_ratio((1 + self->speaker_drift) * (1 + correction));
+
+	// The resampler only corrects small errors, discard data or insert silence for larger ones
+	double error = self->speaker_controller.measured() - target.count();
+	if (now > self->next_speaker_step and std::abs(error) > max_speed_error)
+	{
+		if (error > 0)
 		{
-			memcpy(audio_data, self->speaker_tmp.payload.data(), tmp_remain);
-			self->speaker_tmp.payload = self->speaker_tmp.payload.subspan(tmp_remain);
-			audio_data += tmp_remain;
-			num_frames -= tmp_remain / frame_size;
-			self->buffer_size_bytes.fetch_sub(tmp_remain);
+			size_t min_buffer_size = frame_size * sample_rate * min_buffer_level;
+			size_t discarded = 0;
+			while (error > 0 and self->buffer_size_bytes > min_buffer_size and self->output_buffer.size() > 1)
+			{
+				auto tmp = self->output_buffer.read();
+				if (not tmp)
+					break;
+				self->buffer_size_bytes.fetch_sub(tmp->payload.size_bytes());
+				error -= double(tmp->payload.size_bytes() / frame_size) / sample_rate;
+				discarded += tmp->payload.size_bytes();
+			}
+			self->speaker_discarded_bytes.fetch_add(discarded);
 		}
 		else
 		{
-			if (auto tmp = self->output_buffer.read())
-			{
-				self->speaker_tmp = std::move(*tmp);
-			}
-			else
-			{
-				// Buffer underrun: add 5ms buffer
-				size_t target_buffer_size = frame_size * AAudioStream_getSampleRate(stream) * 0.005;
-#if __cpp_lib_shared_ptr_arrays >= 201707L
-				self->speaker_tmp.data.c = std::make_shared<uint8_t[]>(target_buffer_size, 0);
-#else
-				self->speaker_tmp.data.c.reset(new uint8_t[target_buffer_size]());
-#endif
-				self->speaker_tmp.payload = std::span(self->speaker_tmp.data.c.get(), target_buffer_size);
-				self->buffer_size_bytes += target_buffer_size;
-				spdlog::debug("Audio sync: underrun, add {} bytes buffer",
-				              target_buffer_size);
-			}
+			size_t size = std::min(frame_size * size_t(-error * sample_rate), self->speaker_silence.size());
+			self->push_speaker_data(std::span(self->speaker_silence).first(size), frame_size, std::nullopt);
+			self->speaker_silence_bytes.fetch_add(size);
 		}
+		self->speaker_controller.reset();
+		self->next_speaker_step = now + speaker_step_interval;
 	}
 
-	// If we have more than 50ms of buffered data, discard some data
-	if (self->buffer_size_bytes > frame_size * AAudioStream_getSampleRate(stream) * 0.05)
+	self->stats_buffer_level = level;
+	self->stats_correction = correction;
+	self->stats_av_offset = delay ? *delay - video_latency * 1e-9 : NAN;
+
+	std::span<int16_t> output((int16_t *)audio_data, num_frames * num_channels);
+	size_t written = 0;
+	while (true)
 	{
-		// discard excess data until we only have 30ms left
-		size_t target_buffer_size = frame_size * AAudioStream_getSampleRate(stream) * 0.03;
-		while (self->buffer_size_bytes > target_buffer_size and self->output_buffer.size() > 1)
+		written += resampler.pull(output.subspan(written * num_channels));
+		if (written == size_t(num_frames))
+			break;
+
+		if (auto tmp = self->output_buffer.read())
 		{
-			auto tmp = self->output_buffer.read();
-			if (not tmp)
-				break;
-			auto prev = self->buffer_size_bytes.fetch_sub(tmp->payload.size_bytes());
-			spdlog::info("Audio sync: discard {} bytes (buffer {} target {})",
-			             tmp->payload.size_bytes(),
-			             prev,
-			             target_buffer_size);
+			self->push_speaker_data(tmp->payload, frame_size, tmp->timestamp);
+			self->buffer_size_bytes.fetch_sub(tmp->payload.size_bytes());
+		}
+		else
+		{
+			// Buffer underrun: add 5ms buffer
+			size_t size = std::min(frame_size * (sample_rate * 5 / 1000), self->speaker_silence.size());
+			self->push_speaker_data(std::span(self->speaker_silence).first(size), frame_size, std::nullopt);
+			self->speaker_underrun_bytes.fetch_add(size);
 		}
 	}
 
 	return AAUDIO_CALLBACK_RESULT_CONTINUE;
 }
 
+void wivrn::android::audio::push_speaker_data(std::span<const uint8_t> data, size_t frame_size, std::optional<XrTime> timestamp)
+{
+	speaker_resampler->push(data);
+	speaker_pushed_frames += data.size() / frame_size;
+	if (timestamp)
+	{
+		speaker_timestamps[(speaker_timestamps_begin + speaker_timestamps_size) % speaker_timestamps.size()] = {speaker_pushed_frames, *timestamp};
+		if (speaker_timestamps_size < speaker_timestamps.size())
+			++speaker_timestamps_size;
+		else
+			speaker_timestamps_begin = (speaker_timestamps_begin + 1) % speaker_timestamps.size();
+	}
+}
+
+std::optional<double> wivrn::android::audio::speaker_delay(AAudioStream * stream, int32_t sample_rate)
+{
+	if (speaker_timestamps_size == 0)
+		return std::nullopt;
+
+	// Index of the next frame out of the resampler, and its production time
+	// from the timestamp of the packet it belongs to
+	double head = speaker_pushed_frames - speaker_resampler->buffered();
+	while (speaker_timestamps_size > 1 and speaker_timestamps[speaker_timestamps_begin].first < head)
+	{
+		speaker_timestamps_begin = (speaker_timestamps_begin + 1) % speaker_timestamps.size();
+		--speaker_timestamps_size;
+	}
+	auto [end, timestamp] = speaker_timestamps[speaker_timestamps_begin];
+	double produced = timestamp - (end - head) * 1e9 / sample_rate;
+
+	// The next frame will be written at index frames_written
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	int64_t monotonic_now = ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+	int64_t frame_position;
+	int64_t frame_time;
+	double output_latency;
+	if (AAudioStream_getTimestamp(stream, CLOCK_MONOTONIC, &frame_position, &frame_time) == AAUDIO_OK)
+		output_latency = (AAudioStream_getFramesWritten(stream) - frame_position) * 1e9 / sample_rate + frame_time - monotonic_now;
+	else
+		output_latency = AAudioStream_getBufferSizeInFrames(stream) * 1e9 / sample_rate;
+
+	return (instance.now() + output_latency - produced) * 1e-9;
+}
+
 int32_t wivrn::android::audio::microphone_data_cb(AAudioStream * stream, void * userdata, void * audio_data_v, int32_t num_frames)
 {
 	auto self = (wivrn::android::audio *)userdata;
@@ -238,7 +329,10 @@ void wivrn::android::audio::microphone_error_cb(AAudioStream * stream, void * us
 }
 
 wivrn::android::audio::audio(const wivrn::to_headset::audio_stream_description & desc, wivrn_session & session, xr::instance & instance) :
-        session(session), instance(instance)
+        speaker_controller(std::chrono::duration<double>(target_buffer_level)),
+        av_offset(std::chrono::milliseconds(application::get_config().av_sync_offset_ms)),
+        session(session),
+        instance(instance)
 {
 	AAudioStreamBuilder * builder;
 	aaudio_result_t result = AAudio_createStreamBuilder(&builder);
@@ -249,7 +343,14 @@ wivrn::android::audio::audio(const wivrn::to_headset::audio_stream_description &
 		build_microphone(builder, desc.microphone->sample_rate, desc.microphone->num_channels);
 
 	if (desc.speaker)
+	{
+		speaker_resampler.emplace(desc.speaker->num_channels);
+		speaker_resampler->reserve(desc.speaker->sample_rate * max_av_delay.count() * 2 / 1000);
+		speaker_drift_estimator.emplace(desc.speaker->sample_rate);
+		// Largest correction: the maximum delay
+		speaker_silence.resize(desc.speaker->num_channels * sizeof(uint16_t) * desc.speaker->sample_rate * max_av_delay.count() / 1000);
 		build_speaker(builder, desc.speaker->sample_rate, desc.speaker->num_channels);
+	}
 
 	AAudioStreamBuilder_delete(builder);
 }
@@ -268,8 +369,36 @@ wivrn::android::audio::~audio()
 void wivrn::android::audio::operator()(wivrn::audio_data && data)
 {
 	auto size = data.payload.size_bytes();
+	if (speaker_drift_estimator)
+	{
+		// Timestamps are in the headset clock, but produced at the rate of the server audio clock
+		const size_t frame_size = speaker_resampler->channels() * sizeof(uint16_t);
+		speaker_drift_estimator->add(data.timestamp, size / frame_size);
+		speaker_drift = speaker_drift_estimator->drift();
+	}
+
 	if (output_buffer.write(std::move(data)))
 		buffer_size_bytes.fetch_add(size);
+
+	if (size_t discarded = speaker_discarded_bytes.exchange(0))
+		spdlog::info("Audio sync: discard {} bytes", discarded);
+	if (size_t silence = speaker_silence_bytes.exchange(0))
+		spdlog::info("Audio sync: add {} bytes of silence", silence);
+	if (size_t underrun = speaker_underrun_bytes.exchange(0))
+		spdlog::debug("Audio sync: underrun, add {} bytes buffer", underrun);
+}
+
+std::optional<wivrn::audio_sync_stats> wivrn::android::audio::get_sync_stats() const
+{
+	if (not speaker)
+		return std::nullopt;
+
+	return audio_sync_stats{
+	        .buffer_level = stats_buffer_level,
+	        .drift = float(speaker_drift),
+	        .correction = stats_correction,
+	        .av_offset = stats_av_offset,
+	};
 }
 
 void wivrn::android::audio::get_audio_description(wivrn::from_headset::headset_info_packet & info)
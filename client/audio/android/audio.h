@@ -19,9 +19,14 @@
 
 #pragma once
 
+#include "audio_resampler.h"
 #include "utils/ring_buffer.h"
 #include "wivrn_packets.h"
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <optional>
+#include <vector>
 
 struct AAudioStreamStruct;
 struct AAudioStreamBuilderStruct;
@@ -51,7 +56,40 @@ class audio
 	utils::ring_buffer<wivrn::audio_data, 100> output_buffer;
 	std::atomic<size_t> buffer_size_bytes;
 
-	wivrn::audio_data speaker_tmp;
+	// Compensates the drift between the server and headset audio clocks
+	std::optional<wivrn::audio_resampler> speaker_resampler;
+	wivrn::audio_drift_controller speaker_controller;
+	std::optional<wivrn::audio_drift_estimator> speaker_drift_estimator; // Only used by the network thread
+	std::atomic<double> speaker_drift = 0;
+	std::chrono::steady_clock::time_point speaker_last_callback;
+
+	// Audio is played with the same delay as the video, plus av_offset
+	std::atomic<XrDuration> video_latency = 0;
+	std::chrono::nanoseconds av_offset;
+	// Frames pushed to the resampler, and timestamp of the last frame of the
+	// most recent packets, the oldest ones are overwritten when it is full
+	uint64_t speaker_pushed_frames = 0;
+	std::array<std::pair<uint64_t, XrTime>, 256> speaker_timestamps;
+	size_t speaker_timestamps_begin = 0;
+	size_t speaker_timestamps_size = 0;
+	bool speaker_av_sync = false;
+	std::chrono::steady_clock::time_point next_speaker_step;
+	// Allocated once, the speaker callback must not allocate
+	std::vector<uint8_t> speaker_silence;
+
+	// Corrections made by the speaker callback, logged from the network thread
+	std::atomic<size_t> speaker_discarded_bytes = 0;
+	std::atomic<size_t> speaker_silence_bytes = 0;
+	std::atomic<size_t> speaker_underrun_bytes = 0;
+
+	std::atomic<float> stats_buffer_level = 0;
+	std::atomic<float> stats_correction = 0;
+	std::atomic<float> stats_av_offset = 0;
+
+	// Time between the production of the next speaker sample on the server and its playout
+	std::optional<double> speaker_delay(AAudioStreamStruct *, int32_t sample_rate);
+	void push_speaker_data(std::span<const uint8_t> data, size_t frame_size, std::optional<XrTime> timestamp);
+
 	AAudioStreamStruct * speaker = nullptr;
 	std::atomic<bool> speaker_stop_ack = false;
 	AAudioStreamStruct * microphone = nullptr;
@@ -72,6 +110,14 @@ public:
 
 	void operator()(wivrn::audio_data &&);
 
+	std::optional<wivrn::audio_sync_stats> get_sync_stats() const;
+
+	// Measured latency between the production of a frame on the server and its display
+	void set_video_latency(XrDuration latency)
+	{
+		video_latency = latency;
+	}
+
 	static void get_audio_description(wivrn::from_headset::headset_info_packet & info);
 };
 } // namespace wivrn::android
@@ -1,5 +1,7 @@
+#include "audio_resampler.h"
 #include "wivrn_packets.h"
 #include <AudioToolbox/AudioQueue.h>
+#include <optional>
 
 class wivrn_session;
 
@@ -22,6 +24,13 @@ public:
 
 	void operator()(wivrn::audio_data &&);
 
+	std::optional<wivrn::audio_sync_stats> get_sync_stats() const
+	{
+		return std::nullopt;
+	}
+
+	void set_video_latency(XrDuration) {}
+
 	static void get_audio_description(wivrn::from_headset::headset_info_packet& info);
 	static void request_mic_permission();
 };
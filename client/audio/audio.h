@@ -33,9 +33,11 @@ using audio = ::wivrn::apple::audio;
 }
 #else
 
+#include "audio_resampler.h"
 #include "wivrn_client.h"
 #include "wivrn_packets.h"
 #include "xr/instance.h"
+#include <optional>
 
 namespace wivrn
 {
@@ -49,6 +51,13 @@ public:
 
 	void operator()(wivrn::audio_data &&) {}
 
+	std::optional<wivrn::audio_sync_stats> get_sync_stats() const
+	{
+		return std::nullopt;
+	}
+
+	void set_video_latency(XrDuration) {}
+
 	static void get_audio_description(wivrn::from_headset::headset_info_packet & info) {}
 };
 } // namespace wivrn
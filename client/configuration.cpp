@@ -21,6 +21,7 @@
 
 #include "application.h"
 #include "hardware.h"
+#include <algorithm>
 #include <fstream>
 #include <magic_enum.hpp>
 #include <simdjson.h>
@@ -172,6 +173,21 @@ configuration::configuration(xr::system & system)
 		if (auto val = root["passthrough_enabled"]; val.is_bool())
 			passthrough_enabled = val.get_bool();
 
+		if (auto val = root["single_pass_reprojection"]; val.is_bool())
+			single_pass_reprojection = val.get_bool();
+
+		if (auto val = root["frame_extrapolation"]; val.is_bool())
+			frame_extrapolation = val.get_bool();
+
+		if (auto val = root["av_sync_offset_ms"]; val.is_int64())
+			av_sync_offset_ms = val.get_int64();
+
+		if (auto val = root["decode_queue_depth"]; val.is_int64())
+			decode_queue_depth = std::clamp<int64_t>(val.get_int64(), 1, wivrn::decode_queue_settings::max_depth);
+
+		if (auto val = root["frame_drop_policy"]; val.is_string())
+			frame_drop_policy = magic_enum::enum_cast<wivrn::frame_drop_policy>((std::string_view)val).value_or(wivrn::frame_drop_policy::drop_oldest);
+
 		for (const auto & [i, name]: magic_enum::enum_entries<feature>())
 		{
 			if (auto val = root[name]; val.is_bool())
@@ -191,6 +207,11 @@ configuration::configuration(xr::system & system)
 		resolution_scale = 1.4;
 		show_performance_metrics = false;
 		passthrough_enabled = system.passthrough_supported() == xr::system::passthrough_type::color;
+		single_pass_reprojection = true;
+		frame_extrapolation = false;
+		av_sync_offset_ms = 0;
+		decode_queue_depth = 3;
+		frame_drop_policy = wivrn::frame_drop_policy::drop_oldest;
 	}
 }
 
@@ -233,6 +254,11 @@ void configuration::save()
 		json << ",\"preferred_refresh_rate\":" << preferred_refresh_rate;
 	json << ",\"resolution_scale\":" << resolution_scale;
 	json << ",\"passthrough_enabled\":" << std::boolalpha << passthrough_enabled;
+	json << ",\"single_pass_reprojection\":" << std::boolalpha << single_pass_reprojection;
+	json << ",\"frame_extrapolation\":" << std::boolalpha << frame_extrapolation;
+	json << ",\"av_sync_offset_ms\":" << av_sync_offset_ms;
+	json << ",\"decode_queue_depth\":" << decode_queue_depth;
+	json << ",\"frame_drop_policy\":\"" << magic_enum::enum_name(frame_drop_policy) << "\"";
 	for (auto & [key, value]: features)
 		json << "," << key << ":" << std::boolalpha << value;
 	json << "}";
@@ -21,6 +21,7 @@
 
 #include "hardware.h"
 #include "wivrn_discover.h"
+#include "wivrn_packets.h"
 
 #include <map>
 #include <mutex>
@@ -49,6 +50,15 @@ public:
 	float resolution_scale = 1.4;
 	bool show_performance_metrics = false;
 	bool passthrough_enabled = false;
+	// Unfoveate the decoded images directly to the swapchain
+	bool single_pass_reprojection = true;
+	// Extrapolate frames from the motion between the two last frames when a frame is late
+	bool frame_extrapolation = false;
+	// Delay of the audio compared with the video, in milliseconds
+	int av_sync_offset_ms = 0;
+	// Decoded frames kept for display, fewer frames reduce latency, more frames absorb network jitter
+	int decode_queue_depth = 3;
+	wivrn::frame_drop_policy frame_drop_policy = wivrn::frame_drop_policy::drop_oldest;
 
 	bool check_feature(feature f) const;
 	void set_feature(feature f, bool state);
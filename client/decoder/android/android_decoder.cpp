@@ -82,6 +82,7 @@ decoder::decoder(
         vk::raii::PhysicalDevice & physical_device,
         const wivrn::to_headset::video_stream_description::item & description,
         float fps,
+        uint8_t queue_depth,
         uint8_t stream_index,
         std::weak_ptr<scenes::stream> weak_scene,
         shard_accumulator * accumulator) :
@@ -95,7 +96,7 @@ decoder::decoder(
 	              description.video_height,
 	              AIMAGE_FORMAT_PRIVATE,
 	              AHARDWAREBUFFER_USAGE_CPU_READ_NEVER | AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
-	              scenes::stream::image_buffer_size + 2 /* maxImages */,
+	              scenes::stream::decoded_image_count(queue_depth) /* maxImages */,
 	              &ir),
 	      "AImageReader_newWithUsage");
 	image_reader.reset(ir, AImageReader_deleter{});
@@ -143,6 +143,7 @@ public:
 	        vk::raii::PhysicalDevice & physical_device,
 	        const wivrn::to_headset::video_stream_description::item & description,
 	        float fps,
+	        uint8_t queue_depth,
 	        uint8_t stream_index,
 	        std::weak_ptr<scenes::stream> scene,
 	        shard_accumulator * accumulator);
@@ -8,7 +8,7 @@ using UnitType = wivrn::apple::decoder::DecodeState::UnitType;
 #define ENABLE_YCBCR 0 // VK_KHR_sampler_ycbcr_conversion appears to broken in MoltenVK
 
 wivrn::apple::decoder::decoder(vk::raii::Device &device, vk::raii::PhysicalDevice &physical_device,
-		const wivrn::to_headset::video_stream_description::item &description, const float fps, const uint8_t stream_index,
+		const wivrn::to_headset::video_stream_description::item &description, const float fps, const uint8_t queue_depth, const uint8_t stream_index,
 		const std::weak_ptr<scenes::stream> scene, wivrn::shard_accumulator *const accumulator) :
 		description(description), device(device), weak_scene(scene), accumulator(accumulator),
 		ycbcr_conversion(device, {
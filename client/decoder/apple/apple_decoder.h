@@ -51,7 +51,7 @@ namespace wivrn::apple {
 		std::span<uint8_t> frameData = {};
 		struct frame_info pendingInfo = {};
 		decoder(vk::raii::Device& device, vk::raii::PhysicalDevice &physical_device,
-			const wivrn::to_headset::video_stream_description::item &description, float fps, uint8_t stream_index,
+			const wivrn::to_headset::video_stream_description::item &description, float fps, uint8_t queue_depth, uint8_t stream_index,
 			std::weak_ptr<scenes::stream> scene, wivrn::shard_accumulator *accumulator);
 		decoder(const decoder&) = delete;
 		decoder(decoder&&) = delete;
@@ -74,14 +74,17 @@ decoder::decoder(
         vk::raii::PhysicalDevice & physical_device,
         const wivrn::to_headset::video_stream_description::item & description,
         float fps,
+        uint8_t queue_depth,
         uint8_t stream_index,
         std::weak_ptr<scenes::stream> scene,
         shard_accumulator * accumulator) :
         device(device), description(description), codec(nullptr, free_codec_context), sws(nullptr, sws_freeContext), weak_scene(scene), accumulator(accumulator)
 {
+	const int image_count = scenes::stream::decoded_image_count(queue_depth);
+	decoded_images.resize(image_count);
 	free_images.resize(image_count);
 
-	for (uint32_t i = 0; i < image_count; i++)
+	for (int i = 0; i < image_count; i++)
 	{
 		free_images[i] = i;
 
@@ -65,7 +65,6 @@ public:
 	};
 
 private:
-	static const int image_count = 12;
 	struct image
 	{
 		image_allocation image;
@@ -78,7 +77,7 @@ private:
 	vk::raii::Device & device;
 	vk::raii::Sampler rgb_sampler = nullptr;
 
-	std::array<image, image_count> decoded_images;
+	std::vector<image> decoded_images;
 	vk::Extent2D extent{};
 	std::vector<int> free_images;
 
@@ -98,6 +97,7 @@ public:
 	        vk::raii::PhysicalDevice & physical_device,
 	        const wivrn::to_headset::video_stream_description::item & description,
 	        float fps,
+	        uint8_t queue_depth,
 	        uint8_t stream_index,
 	        std::weak_ptr<scenes::stream> scene,
 	        shard_accumulator * accumulator);
@@ -38,6 +38,8 @@ void shard_set::reset(uint64_t frame_index)
 {
 	min_for_reconstruction = -1;
 	data.clear();
+	nack_index = 0;
+	nack_end = false;
 
 	uint8_t stream_index = feedback.stream_index;
 	feedback = {};
@@ -121,11 +123,18 @@ void shard_accumulator::push_shard(video_stream_data_shard && shard)
 	}
 	else if (frame_diff == 0)
 	{
+		// Shards are sent in order, a gap means they were lost
+		bool gap = shard.shard_idx > current.data.size();
 		auto shard_idx = current.insert(std::move(shard));
+		if (gap)
+			send_nack(current, false);
 		try_submit_frame(shard_idx);
 	}
 	else if (frame_diff == 1)
 	{
+		// Current frame should be complete when the next one starts
+		if (next.empty())
+			send_nack(current, true);
 		next.insert(std::move(shard));
 		if (is_complete(next))
 		{
@@ -200,14 +209,63 @@ void shard_accumulator::try_submit_frame(uint16_t shard_idx)
 		return;
 	}
 
+	// Let the server know the picture is fully refreshed
+	if (data_shards.front()->flags & video_stream_data_shard::recovery_point)
+	{
+		current.feedback.recovered = true;
+		references_valid = true;
+	}
+
+	// Acknowledge now rather than in the feedback, which is only sent once
+	// the frame is displayed: by then the frame may have left the encoder's DPB
+	if (references_valid and desc().ack_frames)
+	{
+		if (auto scene = weak_scene.lock())
+			scene->send_ack({
+			        .stream_index = current.feedback.stream_index,
+			        .frame_index = current.frame_index(),
+			});
+	}
+
 	// Try to extract a frame
 	decoder->frame_completed(current.feedback, timing_info, *data_shards.front()->view_info);
 
 	advance();
 }
 
+void shard_accumulator::send_nack(shard_set & shards, bool end_of_frame)
+{
+	wivrn::from_headset::video_nack nack{
+	        .stream_index = shards.feedback.stream_index,
+	        .frame_index = shards.frame_index(),
+	};
+
+	for (size_t idx = shards.nack_index; idx < shards.data.size(); ++idx)
+	{
+		if (not shards.data[idx])
+			nack.shards.push_back(idx);
+	}
+	shards.nack_index = shards.data.size();
+
+	bool end_received = not shards.data.empty() and shards.data.back() and shards.data.back()->flags & video_stream_data_shard::end_of_frame;
+	if (end_of_frame and not end_received and not shards.nack_end)
+	{
+		nack.missing_from = shards.data.size();
+		shards.nack_end = true;
+	}
+
+	if (nack.shards.empty() and not nack.missing_from)
+		return;
+
+	auto scene = weak_scene.lock();
+	if (scene)
+		scene->send_nack(nack);
+}
+
 void shard_accumulator::send_feedback(wivrn::from_headset::feedback & feedback)
 {
+	// Only called for lost frames, the next ones reference corrupted pictures
+	references_valid = false;
 	if (not feedback.received_last_packet)
 		feedback.received_first_packet = application::now();
 	auto scene = weak_scene.lock();
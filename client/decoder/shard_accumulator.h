@@ -51,6 +51,9 @@ public:
 	{
 		size_t min_for_reconstruction = -1;
 		std::vector<std::optional<data_shard>> data;
+		// Missing shards before this index were already requested
+		uint16_t nack_index = 0;
+		bool nack_end = false;
 		void reset(uint64_t frame_index);
 		bool empty() const;
 
@@ -74,6 +77,8 @@ private:
 	shard_set current;
 	shard_set next;
 	std::weak_ptr<scenes::stream> weak_scene;
+	// No frame was lost since the last recovery point
+	bool references_valid = false;
 
 public:
 	explicit shard_accumulator(
@@ -81,9 +86,10 @@ public:
 	        vk::raii::PhysicalDevice & physical_device,
 	        const wivrn::to_headset::video_stream_description::item & description,
 	        float fps,
+	        uint8_t queue_depth,
 	        std::weak_ptr<scenes::stream> scene,
 	        uint8_t stream_index) :
-	        decoder(std::make_shared<decoder_impl>(device, physical_device, description, fps, stream_index, scene, this)),
+	        decoder(std::make_shared<decoder_impl>(device, physical_device, description, fps, queue_depth, stream_index, scene, this)),
 	        current(stream_index),
 	        next(stream_index),
 	        weak_scene(scene)
@@ -114,6 +120,8 @@ private:
 	void try_submit_frame(std::optional<uint16_t> shard_idx);
 	void try_submit_frame(uint16_t shard_idx);
 	void send_feedback(wivrn::from_headset::feedback & feedback);
+	// Request missing shards, including the end of the frame if end_of_frame
+	void send_nack(shard_set & shards, bool end_of_frame);
 	void advance();
 };
 } // namespace wivrn
@@ -23,6 +23,7 @@
 #include "xr/session.h"
 #include "xr/swapchain.h"
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <unordered_map>
@@ -75,6 +76,9 @@ protected:
 	xr::session & session;
 	XrViewConfigurationType viewconfig;
 	bool focused = false;
+	// Actions are synchronized by a thread of the scene, the render loop
+	// must not call xrSyncActions or it would consume changedSinceLastSync
+	std::atomic<bool> syncs_actions = false;
 
 	vk::raii::Instance & vk_instance;
 	vk::raii::Device & device;
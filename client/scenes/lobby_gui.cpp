@@ -421,6 +421,38 @@ void scenes::lobby::gui_settings()
 	vibrate_on_hover();
 	ImGui::EndDisabled();
 
+	if (ImGui::Checkbox(_S("Enable frame extrapolation"), &config.frame_extrapolation))
+		config.save();
+	vibrate_on_hover();
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("%s", _S("Synthesize a frame from the motion in the last frames when a frame is late"));
+
+	ImGui::SliderInt(_S("Audio delay"), &config.av_sync_offset_ms, -100, 100, "%d ms");
+	if (ImGui::IsItemDeactivatedAfterEdit())
+		config.save();
+	vibrate_on_hover();
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("%s", _S("Delay of the sound compared with the image, applied at the next connection"));
+
+	ImGui::SliderInt(_S("Decoded frames queue"), &config.decode_queue_depth, 1, wivrn::decode_queue_settings::max_depth, "%d");
+	if (ImGui::IsItemDeactivatedAfterEdit())
+		config.save();
+	vibrate_on_hover();
+	if (ImGui::IsItemHovered())
+		ImGui::SetTooltip("%s", _S("Fewer frames reduce the latency, more frames absorb the network jitter, applied at the next connection"));
+
+	{
+		bool drop_late = config.frame_drop_policy == wivrn::frame_drop_policy::drop_late;
+		if (ImGui::Checkbox(_S("Drop late frames"), &drop_late))
+		{
+			config.frame_drop_policy = drop_late ? wivrn::frame_drop_policy::drop_late : wivrn::frame_drop_policy::drop_oldest;
+			config.save();
+		}
+		vibrate_on_hover();
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("%s", _S("Never display a frame after its display time if a newer frame is available, applied at the next connection"));
+	}
+
 	if (ImGui::Checkbox(_S("Show performance metrics"), &config.show_performance_metrics))
 		config.save();
 	vibrate_on_hover();
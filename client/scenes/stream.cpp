@@ -35,6 +35,7 @@
 #include <mutex>
 #include <ranges>
 #include <thread>
+#include <tuple>
 #include <vulkan/vulkan_raii.hpp>
 
 using namespace wivrn;
@@ -133,6 +134,10 @@ std::shared_ptr<scenes::stream> scenes::stream::create(std::unique_ptr<wivrn_ses
 		info.microphone = {};
 
 	info.supported_codecs = decoder_impl::supported_codecs();
+	info.decode_queue = {
+	        .depth = uint8_t(config.decode_queue_depth),
+	        .drop_policy = config.frame_drop_policy,
+	};
 
 	self->network_session->send_control(info);
 
@@ -239,6 +244,9 @@ scenes::stream::~stream()
 	if (tracking_thread && tracking_thread->joinable())
 		tracking_thread->join();
 
+	if (input_thread && input_thread->joinable())
+		input_thread->join();
+
 	if (network_thread.joinable())
 		network_thread.join();
 }
@@ -250,22 +258,22 @@ void scenes::stream::push_blit_handle(shard_accumulator * decoder, std::shared_p
 		return;
 
 	{
+		// Only held exclusively when the decoders are replaced
 		std::shared_lock lock(decoder_mutex);
-		std::unique_lock frame_lock(frames_mutex);
 		const auto stream = handle->feedback.stream_index;
 		if (stream < decoders.size())
 		{
 			assert(decoder == decoders[stream].decoder.get());
 			handle->feedback.received_from_decoder = application::now();
-			std::swap(handle, decoders[stream].latest_frames[handle->feedback.frame_index % decoders[stream].latest_frames.size()]);
-		}
+			// Gives back the oldest frame if the render thread did not take it
+			handle = decoders[stream].decoded_frames->write(std::move(handle)).value_or(nullptr);
+			if (handle)
+				handle->feedback.queue_time = application::now() - handle->feedback.received_from_decoder;
 
-		if (state_ != state::streaming && std::all_of(decoders.begin(), decoders.end(), [](accumulator_images & i) {
-			    return i.latest_frames.back();
-		    }))
-		{
-			state_ = state::streaming;
-			spdlog::info("Stream scene ready at t={}", application::now());
+			const uint32_t all_streams = (1u << decoders.size()) - 1;
+			auto expected = state::initializing;
+			if ((streams_ready.fetch_or(1u << stream) | (1u << stream)) == all_streams and state_.compare_exchange_strong(expected, state::streaming))
+				spdlog::info("Stream scene ready at t={}", application::now());
 		}
 	}
 
@@ -275,74 +283,90 @@ void scenes::stream::push_blit_handle(shard_accumulator * decoder, std::shared_p
 	}
 }
 
-std::vector<uint64_t> scenes::stream::accumulator_images::frames() const
+void scenes::stream::drop_frame(accumulator_images & decoder, std::shared_ptr<shard_accumulator::blit_handle> handle)
 {
-	std::vector<uint64_t> result;
-	for (const auto & frame: latest_frames)
+	if (not handle->feedback.blitted)
 	{
-		if (frame)
-			result.push_back(frame->feedback.frame_index);
+		handle->feedback.queue_time = application::now() - handle->feedback.received_from_decoder;
+		dropped_frames.push_back(handle->feedback);
 	}
-	return result;
+
+	// Releasing the frame is done by the decoder thread when possible
+	decoder.decoded_frames->recycle(std::move(handle));
 }
 
-std::vector<std::shared_ptr<shard_accumulator::blit_handle>> scenes::stream::common_frame(XrTime display_time)
+void scenes::stream::receive_frames(XrTime display_time)
 {
-	if (decoders.empty())
-		return {};
-	std::unique_lock lock(frames_mutex);
-	thread_local std::vector<shard_accumulator::blit_handle *> common_frames;
-	common_frames.clear();
-	for (size_t i = 0; i < decoders.size(); ++i)
+	for (auto & decoder: decoders)
 	{
-		if (i == 0)
+		auto & frames = decoder.latest_frames;
+		while (auto handle = decoder.decoded_frames->read())
 		{
-			for (const auto & h: decoders[i].latest_frames)
-				if (h)
-					common_frames.push_back(h.get());
+			auto it = std::ranges::upper_bound(frames, (*handle)->feedback.frame_index, {}, [](const auto & frame) {
+				return frame->feedback.frame_index;
+			});
+			frames.insert(it, std::move(*handle));
+
+			if (frames.size() > decode_queue.depth)
+			{
+				drop_frame(decoder, std::move(frames.front()));
+				frames.erase(frames.begin());
+			}
 		}
-		else
+
+		if (decode_queue.drop_policy != frame_drop_policy::drop_late)
+			continue;
+
+		// A late frame is useless if the next one is on time, or if there is a
+		// more recent late frame to display and one to extrapolate from
+		auto late = [display_time](const auto & frame) { return frame->view_info.display_time < display_time; };
+		while (frames.size() > 1 and late(frames[0]) and (frames.size() > 2 or not late(frames[1])))
 		{
-			// clang-format off
-			std::erase_if(common_frames,
-				[this, i](auto & left)
-				{
-					return std::none_of(
-						decoders[i].latest_frames.cbegin(), decoders[i].latest_frames.cend(),
-						[&left](auto & right)
-						{
-							return left->feedback.frame_index == right->feedback.frame_index;
-						});
-				});
-			// clang-format on
+			drop_frame(decoder, std::move(frames.front()));
+			frames.erase(frames.begin());
 		}
 	}
+}
+
+std::vector<uint64_t> scenes::stream::accumulator_images::frames() const
+{
+	std::vector<uint64_t> result;
+	for (const auto & frame: latest_frames)
+		result.push_back(frame->feedback.frame_index);
+	return result;
+}
+
+std::vector<std::shared_ptr<shard_accumulator::blit_handle>> scenes::stream::common_frame(XrTime display_time)
+{
+	if (decoders.empty())
+		return {};
+
 	std::optional<uint64_t> frame_index;
-	if (not common_frames.empty())
+	XrDuration min_delta = std::numeric_limits<XrDuration>::max();
+	for (const auto & candidate: decoders[0].latest_frames)
 	{
-		const auto deltaTime = [display_time](shard_accumulator::blit_handle *const frame) {
-			return (frame != nullptr) ? std::abs(frame->view_info.display_time - display_time) : std::numeric_limits<XrTime>::max();
-		};
-		auto min = common_frames.cbegin();
-		for(auto first = min, last = common_frames.cend(); ++first != last;)
-			if (deltaTime(*first) < deltaTime(*min))
-				min = first;
-		assert(*min);
-		frame_index = (*min)->feedback.frame_index;
+		const uint64_t index = candidate->feedback.frame_index;
+		if (not std::all_of(decoders.begin() + 1, decoders.end(), [index](const accumulator_images & i) {
+			    return i.frame(index);
+		    }))
+			continue;
+
+		XrDuration delta = std::abs(candidate->view_info.display_time - display_time);
+		if (delta < min_delta)
+		{
+			min_delta = delta;
+			frame_index = index;
+		}
 	}
-	else
+
+	if (not frame_index)
 	{
 		spdlog::warn("Failed to find a common frame for all decoders, dumping available frames per decoder");
 		for (const auto & decoder: decoders)
 		{
 			std::string frames;
-			for (const auto & frame: decoder.latest_frames)
-			{
-				if (frame)
-					frames += " " + std::to_string(frame->feedback.frame_index);
-				else
-					frames += " -";
-			}
+			for (uint64_t index: decoder.frames())
+				frames += " " + std::to_string(index);
 			spdlog::warn(frames);
 		}
 	}
@@ -355,17 +379,19 @@ std::vector<std::shared_ptr<shard_accumulator::blit_handle>> scenes::stream::com
 
 std::shared_ptr<shard_accumulator::blit_handle> scenes::stream::accumulator_images::frame(std::optional<uint64_t> id) const
 {
-	for (auto it = latest_frames.rbegin(); it != latest_frames.rend(); ++it)
-	{
-		if (not *it)
-			continue;
-
-		if (id and (*it)->feedback.frame_index != *id)
-			continue;
-
-		return *it;
-	}
-	return nullptr;
+	if (latest_frames.empty())
+		return nullptr;
+
+	// Most recent frame
+	if (not id)
+		return latest_frames.back();
+
+	auto it = std::ranges::lower_bound(latest_frames, *id, {}, [](const auto & frame) {
+		return frame->feedback.frame_index;
+	});
+	if (it == latest_frames.end() or (*it)->feedback.frame_index != *id)
+		return nullptr;
+	return *it;
 }
 
 void scenes::stream::render(const XrFrameState & frame_state)
@@ -383,11 +409,12 @@ void scenes::stream::render(const XrFrameState & frame_state)
 		session.begin_frame();
 		session.end_frame(frame_state.predictedDisplayTime, {});
 
-		std::unique_lock lock(frames_mutex);
 		for (auto & i: decoders)
 		{
-			for (auto & frame: i.latest_frames)
-				frame.reset();
+			while (i.decoded_frames->read())
+			{
+			}
+			i.latest_frames.clear();
 		}
 
 		return;
@@ -397,6 +424,7 @@ void scenes::stream::render(const XrFrameState & frame_state)
 		application::pop_scene();
 
 	assert(not swapchains.empty());
+	const bool single_pass = application::get_config().single_pass_reprojection;
 	for (auto & i: decoders)
 	{
 		if (auto sampler = i.decoder->sampler(); sampler and not *i.blit_pipeline)
@@ -424,6 +452,13 @@ void scenes::stream::render(const XrFrameState & frame_state)
 			                                         .pSetLayouts = &*i.descriptor_set_layout,
 			                                 })[0]
 			                           .release();
+			i.previous_descriptor_set = device.allocateDescriptorSets(
+			                                          vk::DescriptorSetAllocateInfo{
+			                                                  .descriptorPool = *blit_descriptor_pool,
+			                                                  .descriptorSetCount = 1,
+			                                                  .pSetLayouts = &*i.descriptor_set_layout,
+			                                          })[0]
+			                                    .release();
 
 			const auto & description = i.decoder->desc();
 			vk::Extent2D image_size = i.decoder->image_size();
@@ -515,6 +550,12 @@ void scenes::stream::render(const XrFrameState & frame_state)
 
 			i.blit_pipeline = vk::raii::Pipeline(device, application::get_pipeline_cache(), pipeline_info);
 		}
+
+		if (single_pass and *i.descriptor_set_layout and not *i.single_pass_pipeline)
+		{
+			std::tie(i.single_pass_layout, i.single_pass_pipeline) =
+			        reprojector->create_single_pass_pipeline(*i.descriptor_set_layout, need_srgb_conversion(guess_model()));
+		}
 	}
 
 	if (device.waitForFences(*fence, VK_TRUE, UINT64_MAX) == vk::Result::eTimeout)
@@ -562,16 +603,57 @@ void scenes::stream::render(const XrFrameState & frame_state)
 
 	// Keep a reference to the resources needed to blit the images until vkWaitForFences
 	std::vector<std::shared_ptr<shard_accumulator::blit_handle>> blit_handles;
+	std::vector<std::shared_ptr<shard_accumulator::blit_handle>> previous_handles;
 
 	command_buffer.resetQueryPool(*query_pool, 0, size_gpu_timestamps);
 	command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *query_pool, 0);
 
+	if (extrapolation)
+		extrapolation->begin(command_buffer);
+
+	auto use_image = [&](vk::DescriptorSet descriptor_set, shard_accumulator::blit_handle & handle) {
+		vk::DescriptorImageInfo image_info{
+		        .imageView = *handle.image_view,
+		        .imageLayout = vk::ImageLayout::eGeneral,
+		};
+
+		vk::WriteDescriptorSet descriptor_write{
+		        .dstSet = descriptor_set,
+		        .dstBinding = 0,
+		        .dstArrayElement = 0,
+		        .descriptorCount = 1,
+		        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		        .pImageInfo = &image_info,
+		};
+
+		device.updateDescriptorSets(descriptor_write, {});
+		if (*handle.current_layout != vk::ImageLayout::eGeneral)
+		{
+			vk::ImageMemoryBarrier barrier{
+			        .srcAccessMask = vk::AccessFlagBits::eNone,
+			        .dstAccessMask = vk::AccessFlagBits::eMemoryRead,
+			        .oldLayout = *handle.current_layout,
+			        .newLayout = vk::ImageLayout::eGeneral,
+			        .image = handle.image,
+			        .subresourceRange = {
+			                .aspectMask = vk::ImageAspectFlagBits::eColor,
+			                .levelCount = 1,
+			                .layerCount = 1,
+			        },
+			};
+
+			command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, barrier);
+			*handle.current_layout = vk::ImageLayout::eGeneral;
+		}
+	};
+
 	std::array<XrPosef, 2> pose{};
 	std::array<XrFovf, 2> fov{};
 	std::array<wivrn::to_headset::foveation_parameter, 2> foveation{};
 	{
 		// Search for frame with desired display time on all decoders
 		// If no such frame exists, use the latest frame for each decoder
+		receive_frames(frame_state.predictedDisplayTime);
 		blit_handles = common_frame(frame_state.predictedDisplayTime);
 
 		// Blit images from the decoders
@@ -581,125 +663,235 @@ void scenes::stream::render(const XrFrameState & frame_state)
 				continue;
 
 			blit_handle->feedback.blitted = application::now();
+			if (blit_handle->feedback.times_displayed == 0)
+				blit_handle->feedback.queue_time = blit_handle->feedback.blitted - blit_handle->feedback.received_from_decoder;
 			if (blit_handle->feedback.blitted - blit_handle->feedback.received_from_decoder > 1'000'000'000)
 				state_ = stream::state::stalled;
 			++blit_handle->feedback.times_displayed;
 			blit_handle->feedback.displayed = frame_state.predictedDisplayTime;
 
+			// Latency of the video pipeline, from the encoder to the display
+			if (blit_handle->feedback.times_displayed == 1 and audio_handle)
+			{
+				XrDuration latency = blit_handle->feedback.displayed - blit_handle->timing_info.encode_begin;
+				video_latency = video_latency ? (video_latency * 7 + latency) / 8 : latency;
+				audio_handle->set_video_latency(video_latency);
+			}
+
 			pose = blit_handle->view_info.pose;
 			fov = blit_handle->view_info.fov;
 			foveation = blit_handle->view_info.foveation;
 
-			vk::DescriptorImageInfo image_info{
-			        .imageView = *blit_handle->image_view,
-			        .imageLayout = vk::ImageLayout::eGeneral,
-			};
+			use_image(i.descriptor_set, *blit_handle);
+		}
+	}
 
-			vk::WriteDescriptorSet descriptor_write{
-			        .dstSet = i.descriptor_set,
-			        .dstBinding = 0,
-			        .dstArrayElement = 0,
-			        .descriptorCount = 1,
-			        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-			        .pImageInfo = &image_info,
-			};
+	// When the frame is displayed again, extrapolate it from the motion
+	// between the frame and the one before
+	float extrapolation_factor = 0;
+	if (extrapolation and not blit_handles.empty())
+	{
+		for (auto [i, blit_handle]: utils::zip(decoders, blit_handles))
+		{
+			if (not blit_handle or blit_handle->feedback.times_displayed <= 1 or blit_handle->feedback.frame_index == 0)
+				break;
 
-			device.updateDescriptorSets(descriptor_write, {});
-			if (*blit_handle->current_layout != vk::ImageLayout::eGeneral)
-			{
-				vk::ImageMemoryBarrier barrier{
-				        .srcAccessMask = vk::AccessFlagBits::eNone,
-				        .dstAccessMask = vk::AccessFlagBits::eMemoryRead,
-				        .oldLayout = *blit_handle->current_layout,
-				        .newLayout = vk::ImageLayout::eGeneral,
-				        .image = blit_handle->image,
-				        .subresourceRange = {
-				                .aspectMask = vk::ImageAspectFlagBits::eColor,
-				                .levelCount = 1,
-				                .layerCount = 1,
-				        },
-				};
+			auto previous = i.frame(blit_handle->feedback.frame_index - 1);
+			if (not previous)
+				break;
 
-				command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, barrier);
-				*blit_handle->current_layout = vk::ImageLayout::eGeneral;
+			previous_handles.push_back(std::move(previous));
+		}
+
+		if (previous_handles.size() == blit_handles.size())
+		{
+			XrTime current = blit_handles[0]->view_info.display_time;
+			XrTime period = current - previous_handles[0]->view_info.display_time;
+			if (period > 0 and frame_state.predictedDisplayTime > current)
+				extrapolation_factor = std::min(1.f, float(frame_state.predictedDisplayTime - current) / period);
+		}
+
+		if (extrapolation_factor > 0)
+		{
+			for (auto [i, previous]: utils::zip(decoders, previous_handles))
+				use_image(i.previous_descriptor_set, *previous);
+			++extrapolated_frames;
+		}
+	}
+
+	// Correct the position of the head when the depth of the frame was received
+	bool use_depth = false;
+	float depth_min_distance = 0;
+	std::array<XrPosef, 2> display_pose{};
+	if (reprojector->has_depth() and not blit_handles.empty() and blit_handles[0])
+	{
+		{
+			std::unique_lock lock(depth_mutex);
+			uint64_t frame_index = blit_handles[0]->feedback.frame_index;
+			if (auto & frame = depth_frames[frame_index % depth_frames.size()]; frame and frame->frame_idx == frame_index)
+			{
+				depth_values = frame->values;
+				depth_min_distance = frame->min_distance;
+				use_depth = true;
 			}
 		}
+
+		if (use_depth)
+		{
+			auto [flags, views] = session.locate_views(viewconfig, frame_state.predictedDisplayTime, application::space(xr::spaces::world));
+			const XrViewStateFlags valid = XR_VIEW_STATE_POSITION_VALID_BIT | XR_VIEW_STATE_ORIENTATION_VALID_BIT;
+			use_depth = (flags & valid) == valid and views.size() == view_count;
+			for (auto [i, view]: utils::zip(display_pose, views))
+				i = view.pose;
+		}
 	}
 
-	uint16_t x_offset = 0;
-	for (auto & out: decoder_output)
+	if (single_pass and extrapolation_factor == 0 and not use_depth)
 	{
-		command_buffer.beginRenderPass(
-		        {
-		                .renderPass = *blit_render_pass,
-		                .framebuffer = *out.frame_buffer,
-		                .renderArea = {
-		                        .offset = {0, 0},
-		                        .extent = out.size,
-		                },
-		                .clearValueCount = 0,
-		        },
-		        vk::SubpassContents::eInline);
+		// Sample the decoded images from the reprojection shader, without the intermediate images
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 1);
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 2);
+		reprojector->set_foveation(foveation);
 
-		for (const auto & decoder: decoders)
+		std::vector<stream_reprojection::tile> tiles;
+		for (size_t view = 0; view < view_count; view++)
 		{
-			if (not *decoder.blit_pipeline)
-				continue;
+			const vk::Extent2D & view_size = decoder_output[view].size;
+			const int view_x0 = view * view_size.width;
 
-			command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *decoder.blit_pipeline);
-
-			const auto & description = decoder.decoder->desc();
-			int x0 = description.offset_x - x_offset;
-			int y0 = description.offset_y;
-			int x1 = x0 + description.width;
-			int y1 = y0 + description.height;
-
-			vk::Viewport viewport{
-			        .x = (float)x0,
-			        .y = (float)y0,
-			        .width = (float)description.width,
-			        .height = (float)description.height,
-			        .minDepth = 0,
-			        .maxDepth = 1,
-			};
+			tiles.clear();
+			for (const auto & decoder: decoders)
+			{
+				if (not *decoder.single_pass_pipeline)
+					continue;
+
+				const auto & description = decoder.decoder->desc();
+				vk::Extent2D image_size = decoder.decoder->image_size();
+
+				int x0 = std::max<int>(description.offset_x, view_x0);
+				int x1 = std::min<int>(description.offset_x + description.width, view_x0 + view_size.width);
+				int y0 = std::max<int>(description.offset_y, 0);
+				int y1 = std::min<int>(description.offset_y + description.height, view_size.height);
+
+				if (x0 >= x1 or y0 >= y1)
+					continue;
+
+				tiles.push_back({
+				        .layout = *decoder.single_pass_layout,
+				        .pipeline = *decoder.single_pass_pipeline,
+				        .descriptor_set = decoder.descriptor_set,
+				        .view_min = {float(x0 - view_x0) / view_size.width, float(y0) / view_size.height},
+				        .view_max = {float(x1 - view_x0) / view_size.width, float(y1) / view_size.height},
+				        .image_min = {float(x0 - description.offset_x) / image_size.width, float(y0 - description.offset_y) / image_size.height},
+				        .image_max = {float(x1 - description.offset_x) / image_size.width, float(y1 - description.offset_y) / image_size.height},
+				});
+			}
 
-			x0 = std::clamp<int>(x0, 0, out.size.width);
-			x1 = std::clamp<int>(x1, 0, out.size.width);
-			y0 = std::clamp<int>(y0, 0, out.size.height);
-			y1 = std::clamp<int>(y1, 0, out.size.height);
+			size_t destination_index = view * swapchains[0].images().size() + image_indices[view];
+			reprojector->reproject(command_buffer, tiles, view, destination_index);
+		}
 
-			vk::Rect2D scissor{
-			        .offset = {.x = x0, .y = y0},
-			        .extent = {.width = (uint32_t)(x1 - x0), .height = (uint32_t)(y1 - y0)},
-			};
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 3);
+	}
+	else
+	{
+		auto blit = [&](auto framebuffer, vk::DescriptorSet accumulator_images::*descriptor_set) {
+			uint16_t x_offset = 0;
+			for (auto && [view, out]: utils::enumerate(decoder_output))
+			{
+				command_buffer.beginRenderPass(
+				        {
+				                .renderPass = *blit_render_pass,
+				                .framebuffer = framebuffer(view),
+				                .renderArea = {
+				                        .offset = {0, 0},
+				                        .extent = out.size,
+				                },
+				                .clearValueCount = 0,
+				        },
+				        vk::SubpassContents::eInline);
+
+				for (const auto & decoder: decoders)
+				{
+					if (not *decoder.blit_pipeline)
+						continue;
+
+					command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *decoder.blit_pipeline);
+
+					const auto & description = decoder.decoder->desc();
+					int x0 = description.offset_x - x_offset;
+					int y0 = description.offset_y;
+					int x1 = x0 + description.width;
+					int y1 = y0 + description.height;
+
+					vk::Viewport viewport{
+					        .x = (float)x0,
+					        .y = (float)y0,
+					        .width = (float)description.width,
+					        .height = (float)description.height,
+					        .minDepth = 0,
+					        .maxDepth = 1,
+					};
+
+					x0 = std::clamp<int>(x0, 0, out.size.width);
+					x1 = std::clamp<int>(x1, 0, out.size.width);
+					y0 = std::clamp<int>(y0, 0, out.size.height);
+					y1 = std::clamp<int>(y1, 0, out.size.height);
+
+					vk::Rect2D scissor{
+					        .offset = {.x = x0, .y = y0},
+					        .extent = {.width = (uint32_t)(x1 - x0), .height = (uint32_t)(y1 - y0)},
+					};
+
+					command_buffer.setViewport(0, viewport);
+					command_buffer.setScissor(0, scissor);
+
+					command_buffer.bindDescriptorSets(
+					        vk::PipelineBindPoint::eGraphics,
+					        *decoder.blit_pipeline_layout,
+					        0,
+					        decoder.*descriptor_set,
+					        nullptr);
+					command_buffer.draw(3, 1, 0, 0);
+				}
+				command_buffer.endRenderPass();
+				x_offset += out.size.width;
+			}
+		};
+
+		blit([&](size_t view) { return *decoder_output[view].frame_buffer; }, &accumulator_images::descriptor_set);
+		if (extrapolation_factor > 0)
+			blit([&](size_t view) { return extrapolation->previous_framebuffer(view); }, &accumulator_images::previous_descriptor_set);
 
-			command_buffer.setViewport(0, viewport);
-			command_buffer.setScissor(0, scissor);
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 1);
 
-			command_buffer.bindDescriptorSets(
-			        vk::PipelineBindPoint::eGraphics,
-			        *decoder.blit_pipeline_layout,
-			        0,
-			        decoder.descriptor_set,
-			        nullptr);
-			command_buffer.draw(3, 1, 0, 0);
+		if (extrapolation_factor > 0)
+			extrapolation->estimate_motion(command_buffer);
+
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 2);
+		reprojector->set_foveation(foveation);
+		reprojector->set_extrapolation(extrapolation_factor);
+		if (use_depth)
+		{
+			reprojector->set_depth(command_buffer, depth_values, depth_min_distance, pose, fov, display_pose);
+			// The images are now seen from the display pose
+			pose = display_pose;
+		}
+		else
+		{
+			reprojector->clear_depth();
 		}
-		command_buffer.endRenderPass();
-		x_offset += out.size.width;
-	}
 
-	command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 1);
-	reprojector->set_foveation(foveation);
+		// Unfoveate the image to the real pose
+		for (size_t view = 0; view < view_count; view++)
+		{
+			size_t destination_index = view * swapchains[0].images().size() + image_indices[view];
+			reprojector->reproject(command_buffer, view, destination_index);
+		}
 
-	// Unfoveate the image to the real pose
-	for (size_t view = 0; view < view_count; view++)
-	{
-		size_t destination_index = view * swapchains[0].images().size() + image_indices[view];
-		reprojector->reproject(command_buffer, view, destination_index);
+		command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 3);
 	}
 
-	command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, 2);
-
 	command_buffer.end();
 	vk::SubmitInfo submit_info;
 	submit_info.setCommandBuffers(*command_buffer);
@@ -766,7 +958,7 @@ void scenes::stream::render(const XrFrameState & frame_state)
 	// Network operations may be blocking, do them once everything was submitted
 	{
 		std::vector<serialization_packet> packets;
-		packets.reserve(blit_handles.size());
+		packets.reserve(blit_handles.size() + dropped_frames.size());
 		for (const auto & handle: blit_handles)
 		{
 			if (handle)
@@ -775,6 +967,12 @@ void scenes::stream::render(const XrFrameState & frame_state)
 				wivrn_session::control_socket_t::serialize(packet, handle->feedback);
 			}
 		}
+		for (const auto & feedback: dropped_frames)
+		{
+			auto & packet = packets.emplace_back();
+			wivrn_session::control_socket_t::serialize(packet, feedback);
+		}
+		dropped_frames.clear();
 		if (not packets.empty())
 		{
 			try
@@ -788,23 +986,15 @@ void scenes::stream::render(const XrFrameState & frame_state)
 		}
 	}
 
-	read_actions();
-
 	if (plots_toggle_1 and plots_toggle_2)
 	{
-		XrActionStateGetInfo get_info{
-		        .type = XR_TYPE_ACTION_STATE_GET_INFO,
-		        .action = plots_toggle_1,
-		};
-
-		XrActionStateBoolean state_1{XR_TYPE_ACTION_STATE_BOOLEAN};
-		CHECK_XR(xrGetActionStateBoolean(session, &get_info, &state_1));
-		get_info.action = plots_toggle_2;
-		XrActionStateBoolean state_2{XR_TYPE_ACTION_STATE_BOOLEAN};
-		CHECK_XR(xrGetActionStateBoolean(session, &get_info, &state_2));
-
-		if (state_1.currentState and state_2.currentState and (state_1.changedSinceLastSync or state_2.changedSinceLastSync))
+		// Actions are synchronized by the input thread, several times per
+		// frame: detect the press here rather than with changedSinceLastSync
+		bool pressed = application::read_action_bool(plots_toggle_1).value_or(std::pair{0, false}).second and
+		               application::read_action_bool(plots_toggle_2).value_or(std::pair{0, false}).second;
+		if (pressed and not plots_toggle_pressed)
 			plots_visible = not plots_visible;
+		plots_toggle_pressed = pressed;
 	}
 
 	query_pool_filled = true;
@@ -820,6 +1010,7 @@ void scenes::stream::setup(const to_headset::video_stream_description & descript
 	std::unique_lock lock(decoder_mutex);
 
 	decoders.clear();
+	streams_ready = 0;
 
 	if (description.items.empty())
 	{
@@ -862,13 +1053,19 @@ void scenes::stream::setup(const to_headset::video_stream_description & descript
 		blit_render_pass = vk::raii::RenderPass(device, renderpass_info);
 	}
 
-	// Create outputs for the decoders
+	// Create outputs for the decoders, the single pass reprojection only needs
+	// them when extrapolating or with depth
+	const auto & config = application::get_config();
+	const bool two_pass = not config.single_pass_reprojection or config.frame_extrapolation or description.depth;
 	vk::Extent3D decoder_out_size{video_width, video_height, 1};
 	for (size_t i = 0; i < view_count; i++)
 	{
-		decoder_output[i].format = vk::Format::eA8B8G8R8SrgbPack32;
-		decoder_output[i].size.width = video_width;
-		decoder_output[i].size.height = video_height;
+		decoder_output[i] = renderpass_output{
+		        .size = {video_width, video_height},
+		        .format = vk::Format::eA8B8G8R8SrgbPack32,
+		};
+		if (not two_pass)
+			continue;
 
 		vk::ImageCreateInfo image_info{
 		        .flags = vk::ImageCreateFlags{},
@@ -918,20 +1115,39 @@ void scenes::stream::setup(const to_headset::video_stream_description & descript
 		        });
 	}
 
+	extrapolation.reset();
+	if (config.frame_extrapolation)
 	{
+		std::vector<vk::ImageView> current_images;
+		for (renderpass_output & i: decoder_output)
+			current_images.push_back(*i.image_view);
+
+		extrapolation.emplace(device, current_images, decoder_output[0].size, decoder_output[0].format, *blit_render_pass);
+	}
+
+	{
+		// Current and previous frames
 		vk::DescriptorPoolSize pool_size{
 		        .type = vk::DescriptorType::eCombinedImageSampler,
-		        .descriptorCount = uint32_t(description.items.size()),
+		        .descriptorCount = uint32_t(2 * description.items.size()),
 		};
 		blit_descriptor_pool = vk::raii::DescriptorPool(
 		        device,
 		        vk::DescriptorPoolCreateInfo{
-		                .maxSets = uint32_t(description.items.size()),
+		                .maxSets = uint32_t(2 * description.items.size()),
 		                .poolSizeCount = 1,
 		                .pPoolSizes = &pool_size,
 		        });
 	}
 
+	decode_queue = {
+	        .depth = std::clamp<uint8_t>(description.decode_queue.depth, 1, decode_queue_settings::max_depth),
+	        .drop_policy = description.decode_queue.drop_policy,
+	};
+	spdlog::info("Decoded frames queue of {} frames, {}",
+	             decode_queue.depth,
+	             decode_queue.drop_policy == frame_drop_policy::drop_late ? "dropping late frames" : "dropping oldest frames");
+
 	for (const auto & [stream_index, item]: utils::enumerate(description.items))
 	{
 		spdlog::info("Creating decoder size {}x{} offset {},{}", item.width, item.height, item.offset_x, item.offset_y);
@@ -949,7 +1165,9 @@ void scenes::stream::setup(const to_headset::video_stream_description & descript
 		}
 
 		accumulator_images dec;
-		dec.decoder = std::make_unique<shard_accumulator>(device, physical_device, item, description.fps, shared_from_this(), stream_index);
+		dec.decoder = std::make_unique<shard_accumulator>(device, physical_device, item, description.fps, decode_queue.depth, shared_from_this(), stream_index);
+		dec.decoded_frames = std::make_unique<accumulator_images::frame_buffer>(decode_queue.depth);
+		dec.latest_frames.reserve(decode_queue.depth + 1);
 
 		decoders.push_back(std::move(dec));
 	}
@@ -991,10 +1209,26 @@ void scenes::stream::setup_reprojection_swapchain()
 	std::vector<vk::Image> images;
 	for (renderpass_output & i: decoder_output)
 	{
-		images.push_back(i.image);
+		if (i.image)
+			images.push_back(i.image);
+	}
+
+	// The single pass pipelines use the render pass of the reprojector
+	for (auto & i: decoders)
+	{
+		i.single_pass_pipeline = nullptr;
+		i.single_pass_layout = nullptr;
 	}
 
-	reprojector.emplace(device, physical_device, images, swapchain_images, extent, swapchains[0].format(), *video_stream_description);
+	reprojector.emplace(
+	        device,
+	        physical_device,
+	        images,
+	        swapchain_images,
+	        extent,
+	        swapchains[0].format(),
+	        *video_stream_description,
+	        extrapolation ? extrapolation->motion_images() : std::vector<vk::DescriptorImageInfo>{});
 }
 
 scene::meta & scenes::stream::get_meta_scene()
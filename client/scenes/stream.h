@@ -23,7 +23,9 @@
 #include "decoder/shard_accumulator.h"
 #include "render/imgui_impl.h"
 #include "scene.h"
+#include "stream_extrapolation.h"
 #include "stream_reprojection.h"
+#include "utils/lossy_ring_buffer.h"
 #include "wifi_lock.h"
 #include "wivrn_client.h"
 #include "wivrn_packets.h"
@@ -43,7 +45,15 @@ public:
 		streaming,
 		stalled
 	};
-	static const size_t image_buffer_size = 3;
+
+	// Decoded images alive at the same time for a queue depth: the queue of
+	// decoded frames and the hand-off ring (queue_depth each), the frames
+	// still blitted or used for extrapolation after they left the queue,
+	// and the frame being decoded
+	static constexpr int decoded_image_count(int queue_depth)
+	{
+		return 2 * queue_depth + 3;
+	}
 
 private:
 	static const size_t view_count = 2;
@@ -55,10 +65,20 @@ private:
 		std::unique_ptr<wivrn::shard_accumulator> decoder;
 		vk::raii::DescriptorSetLayout descriptor_set_layout = nullptr;
 		vk::DescriptorSet descriptor_set = nullptr;
+		// For the frame before the one in descriptor_set, when extrapolating
+		vk::DescriptorSet previous_descriptor_set = nullptr;
 		vk::raii::PipelineLayout blit_pipeline_layout = nullptr;
 		vk::raii::Pipeline blit_pipeline = nullptr;
-		// latest frames from oldest to most recent
-		std::array<std::shared_ptr<wivrn::shard_accumulator::blit_handle>, image_buffer_size> latest_frames;
+		// Unfoveates directly to the swapchain, created with the reprojector
+		vk::raii::PipelineLayout single_pass_layout = nullptr;
+		vk::raii::Pipeline single_pass_pipeline = nullptr;
+		// Written by the decoder thread, read by the render thread
+		using frame_buffer = utils::lossy_ring_buffer<std::shared_ptr<wivrn::shard_accumulator::blit_handle>>;
+		// Holds at most decode_queue.depth frames, the oldest ones are evicted
+		std::unique_ptr<frame_buffer> decoded_frames;
+		// Frames received by the render thread, from oldest to most recent,
+		// at most decode_queue.depth
+		std::vector<std::shared_ptr<wivrn::shard_accumulator::blit_handle>> latest_frames;
 
 		std::shared_ptr<wivrn::shard_accumulator::blit_handle> frame(std::optional<uint64_t> id) const;
 		std::vector<uint64_t> frames() const;
@@ -66,8 +86,11 @@ private:
 
 	wifi_lock::wifi wifi;
 
-	// for frames inside accumulator images
-	std::mutex frames_mutex;
+	// Feedback of the frames replaced in latest_frames before being displayed, sent at the end of the frame
+	std::vector<wivrn::from_headset::feedback> dropped_frames;
+	void drop_frame(accumulator_images &, std::shared_ptr<wivrn::shard_accumulator::blit_handle>);
+	// Moves the decoded frames to latest_frames and applies the drop policy
+	void receive_frames(XrTime display_time);
 	std::vector<std::shared_ptr<wivrn::shard_accumulator::blit_handle>> common_frame(XrTime display_time);
 
 	struct renderpass_output
@@ -91,14 +114,28 @@ private:
 
 	std::shared_mutex decoder_mutex;
 	std::optional<to_headset::video_stream_description> video_stream_description;
+	wivrn::decode_queue_settings decode_queue{}; // Locked by decoder_mutex
 	std::vector<accumulator_images> decoders; // Locked by decoder_mutex
 	vk::raii::DescriptorPool blit_descriptor_pool = nullptr;
 	vk::raii::RenderPass blit_render_pass = nullptr;
 
 	std::array<renderpass_output, view_count> decoder_output{};
 
+	std::optional<stream_extrapolation> extrapolation;
+
 	std::optional<stream_reprojection> reprojector;
 
+	// Decoded depth of the latest frames, it is received before the video
+	struct depth_frame
+	{
+		uint64_t frame_idx;
+		float min_distance;
+		std::vector<uint16_t> values;
+	};
+	std::mutex depth_mutex;
+	std::array<std::optional<depth_frame>, 2 * wivrn::decode_queue_settings::max_depth> depth_frames; // Locked by depth_mutex
+	std::vector<uint16_t> depth_values;
+
 	vk::raii::Fence fence = nullptr;
 	vk::raii::CommandBuffer command_buffer = nullptr;
 
@@ -111,7 +148,23 @@ private:
 	std::array<haptics_action, 2> haptics_actions;
 	std::vector<std::tuple<device_id, XrAction, XrActionType>> input_actions;
 
-	state state_ = state::initializing;
+	// Last value of each input sent to the server, vector2 actions use 2 values
+	struct input_state
+	{
+		float value;
+		XrTime last_change_time;
+		XrTime last_sent;
+		// Number of packets that will still carry this value
+		int repeats;
+	};
+	std::vector<input_state> input_states; // Only used by input_thread
+	XrTime last_input_keyframe = 0;
+	std::atomic<uint64_t> input_packets = 0;
+	std::optional<std::thread> input_thread;
+
+	std::atomic<state> state_ = state::initializing;
+	// Bit mask of the streams which produced a frame, reset when the decoders are replaced
+	std::atomic<uint32_t> streams_ready = 0;
 
 	std::vector<xr::swapchain> swapchains;
 	xr::swapchain swapchain_imgui;
@@ -123,6 +176,7 @@ private:
 	bool plots_visible = true;
 	XrAction plots_toggle_1 = XR_NULL_HANDLE;
 	XrAction plots_toggle_2 = XR_NULL_HANDLE;
+	bool plots_toggle_pressed = false;
 
 	// Keep a reference to the resources needed to blit the images until vkWaitForFences
 	std::vector<std::shared_ptr<wivrn::shard_accumulator::blit_handle>> current_blit_handles;
@@ -145,11 +199,14 @@ public:
 	void operator()(to_headset::tracking_control &&);
 	void operator()(to_headset::audio_stream_description &&);
 	void operator()(to_headset::video_stream_description &&);
+	void operator()(to_headset::video_stream_depth &&);
 	void operator()(audio_data &&);
 
 	void push_blit_handle(wivrn::shard_accumulator * decoder, std::shared_ptr<wivrn::shard_accumulator::blit_handle> handle);
 
 	void send_feedback(const wivrn::from_headset::feedback & feedback);
+	void send_nack(const wivrn::from_headset::video_nack & nack);
+	void send_ack(const wivrn::from_headset::video_ack & ack);
 
 	state current_state() const
 	{
@@ -166,7 +223,8 @@ public:
 private:
 	void process_packets();
 	void tracking();
-	void read_actions();
+	void input_sampling();
+	void read_actions(XrTime now);
 
 	void setup(const to_headset::video_stream_description &);
 	void setup_reprojection_swapchain();
@@ -179,16 +237,22 @@ private:
 	uint64_t bytes_received = 0;
 	float bandwidth_rx = 0;
 	float bandwidth_tx = 0;
+	uint64_t extrapolated_frames = 0;
+	XrDuration video_latency = 0;
+	uint64_t input_packets_sent = 0;
+	float input_packet_rate = 0;
 
 	struct gpu_timestamps
 	{
 		float gpu_barrier = 0;
+		float gpu_extrapolation = 0;
 		float gpu_time = 0;
 	};
 
 	struct global_metric //: gpu_timestamps
 	{
 		float gpu_barrier;
+		float gpu_extrapolation;
 		float gpu_time;
 		float cpu_time = 0;
 		float bandwidth_rx = 0;
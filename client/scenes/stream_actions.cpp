@@ -19,12 +19,95 @@
 
 #include "application.h"
 #include "stream.h"
+#include <cmath>
 #include <spdlog/spdlog.h>
+#include <thread>
 
-void scenes::stream::read_actions()
+namespace
+{
+// Actions are sampled at this period, independently of the frame rate
+const std::chrono::milliseconds input_sampling_period{2};
+
+// Minimum time between two packets carrying an analog value while it moves
+const XrDuration analog_period = 8'000'000;
+
+// All values are sent at this period, in case a packet was lost
+const XrDuration keyframe_period = 100'000'000;
+
+// Number of packets carrying each change, the stream channel may lose packets
+// Analog values are repeated at analog_period
+const int change_repeats = 3;
+} // namespace
+
+void scenes::stream::input_sampling()
+{
+	auto next = std::chrono::steady_clock::now();
+	while (not exiting)
+	{
+		try
+		{
+			if (application::is_focused())
+			{
+				application::poll_actions();
+				read_actions(instance.now());
+			}
+		}
+		catch (std::exception & e)
+		{
+			spdlog::warn("Exception while reading inputs: {}", e.what());
+		}
+
+		next = std::max(next + input_sampling_period, std::chrono::steady_clock::now());
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void scenes::stream::read_actions(XrTime now)
 {
 	from_headset::inputs inputs;
 
+	bool keyframe = now - last_input_keyframe >= keyframe_period;
+	if (keyframe)
+		last_input_keyframe = now;
+
+	if (input_states.empty())
+	{
+		size_t nb_values = 0;
+		for (const auto & [id, action, action_type]: input_actions)
+		{
+			if (action_type == XR_ACTION_TYPE_VECTOR2F_INPUT)
+				nb_values += 2;
+			else if (action_type != XR_ACTION_TYPE_POSE_INPUT)
+				nb_values++;
+		}
+
+		// NaN is different from any value, so that everything is sent the first time
+		input_states.resize(nb_values, {.value = NAN});
+	}
+
+	size_t index = 0;
+	auto update = [&](device_id id, float value, XrTime last_change_time, bool analog) {
+		auto & state = input_states[index++];
+		// Analog values move continuously, send them and their repeats at a lower rate
+		bool due = not analog or now - state.last_sent >= analog_period;
+		if (value != state.value or last_change_time != state.last_change_time)
+		{
+			if (due)
+			{
+				state.value = value;
+				state.last_change_time = last_change_time;
+				state.repeats = change_repeats;
+			}
+		}
+
+		if (keyframe or (state.repeats > 0 and due))
+		{
+			inputs.values.push_back({id, state.value, state.last_change_time});
+			state.last_sent = now;
+			state.repeats = std::max(state.repeats - 1, 0);
+		}
+	};
+
 	for (const auto & [id, action, action_type]: input_actions)
 	{
 		switch (action_type)
@@ -32,14 +115,18 @@ void scenes::stream::read_actions()
 			case XR_ACTION_TYPE_BOOLEAN_INPUT: {
 				auto value = application::read_action_bool(action);
 				if (value)
-					inputs.values.push_back({id, (float)value->second, value->first});
+					update(id, (float)value->second, value->first, false);
+				else
+					index++;
 			}
 			break;
 
 			case XR_ACTION_TYPE_FLOAT_INPUT: {
 				auto value = application::read_action_float(action);
 				if (value)
-					inputs.values.push_back({id, value->second, value->first});
+					update(id, value->second, value->first, true);
+				else
+					index++;
 			}
 			break;
 
@@ -47,9 +134,11 @@ void scenes::stream::read_actions()
 				auto value = application::read_action_vec2(action);
 				if (value)
 				{
-					inputs.values.push_back({id, value->second.x, value->first});
-					inputs.values.push_back({(device_id)((int)id + 1), value->second.y, value->first});
+					update(id, value->second.x, value->first, true);
+					update((device_id)((int)id + 1), value->second.y, value->first, true);
 				}
+				else
+					index += 2;
 			}
 			break;
 
@@ -58,9 +147,14 @@ void scenes::stream::read_actions()
 				break;
 		}
 	}
+
+	if (inputs.values.empty())
+		return;
+
 	try
 	{
 		network_session->send_stream(inputs);
+		++input_packets;
 	}
 	catch (std::exception & e)
 	{
@@ -0,0 +1,362 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stream_extrapolation.h"
+#include "application.h"
+#include "vk/shader.h"
+#include <array>
+#include <spdlog/spdlog.h>
+
+// Size of the blocks for motion estimation, in pixels
+static const int block_size = 32;
+// First step of the search, in pixels: motions up to 31 pixels per frame are found
+static const int search_step = 16;
+// Workgroup size of the motion estimation shader
+static const int local_size = 8;
+
+static const vk::Format motion_format = vk::Format::eR16G16B16A16Sfloat;
+
+stream_extrapolation::stream_extrapolation(
+        vk::raii::Device & device,
+        const std::vector<vk::ImageView> & current_images,
+        vk::Extent2D extent,
+        vk::Format format,
+        vk::RenderPass blit_render_pass) :
+        motion_extent{
+                .width = (extent.width + block_size - 1) / block_size,
+                .height = (extent.height + block_size - 1) / block_size,
+        }
+{
+	spdlog::info("Frame extrapolation: {}x{} motion vectors", motion_extent.width, motion_extent.height);
+
+	sampler = vk::raii::Sampler(device,
+	                            vk::SamplerCreateInfo{
+	                                    .magFilter = vk::Filter::eLinear,
+	                                    .minFilter = vk::Filter::eLinear,
+	                                    .mipmapMode = vk::SamplerMipmapMode::eNearest,
+	                                    .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+	                                    .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+	                                    .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+	                                    .maxAnisotropy = 1,
+	                                    .minLod = 0.0f,
+	                                    .maxLod = 0.0f,
+	                            });
+
+	std::array layout_binding{
+	        vk::DescriptorSetLayoutBinding{
+	                .binding = 0,
+	                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+	                .descriptorCount = 1,
+	                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+	        },
+	        vk::DescriptorSetLayoutBinding{
+	                .binding = 1,
+	                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+	                .descriptorCount = 1,
+	                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+	        },
+	        vk::DescriptorSetLayoutBinding{
+	                .binding = 2,
+	                .descriptorType = vk::DescriptorType::eStorageImage,
+	                .descriptorCount = 1,
+	                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+	        },
+	};
+
+	vk::DescriptorSetLayoutCreateInfo layout_info;
+	layout_info.setBindings(layout_binding);
+	descriptor_set_layout = vk::raii::DescriptorSetLayout(device, layout_info);
+
+	std::array pool_size{
+	        vk::DescriptorPoolSize{
+	                .type = vk::DescriptorType::eCombinedImageSampler,
+	                .descriptorCount = uint32_t(2 * current_images.size()),
+	        },
+	        vk::DescriptorPoolSize{
+	                .type = vk::DescriptorType::eStorageImage,
+	                .descriptorCount = uint32_t(current_images.size()),
+	        },
+	};
+
+	vk::DescriptorPoolCreateInfo pool_info{
+	        .maxSets = uint32_t(current_images.size()),
+	};
+	pool_info.setPoolSizes(pool_size);
+	descriptor_pool = vk::raii::DescriptorPool(device, pool_info);
+
+	// Create compute pipeline
+	vk::raii::ShaderModule shader = load_shader(device, "motion_estimation.comp");
+
+	vk::PipelineLayoutCreateInfo pipeline_layout_info;
+	pipeline_layout_info.setSetLayouts(*descriptor_set_layout);
+	layout = vk::raii::PipelineLayout(device, pipeline_layout_info);
+
+	int specialization_constants[] = {block_size, search_step};
+	std::array specialization_constants_desc{
+	        vk::SpecializationMapEntry{
+	                .constantID = 0,
+	                .offset = 0,
+	                .size = sizeof(int),
+	        },
+	        vk::SpecializationMapEntry{
+	                .constantID = 1,
+	                .offset = sizeof(int),
+	                .size = sizeof(int),
+	        },
+	};
+
+	vk::SpecializationInfo specialization_info;
+	specialization_info.setMapEntries(specialization_constants_desc);
+	specialization_info.setData<int>(specialization_constants);
+
+	pipeline = vk::raii::Pipeline(device,
+	                              application::get_pipeline_cache(),
+	                              vk::ComputePipelineCreateInfo{
+	                                      .stage = {
+	                                              .stage = vk::ShaderStageFlagBits::eCompute,
+	                                              .module = *shader,
+	                                              .pName = "main",
+	                                              .pSpecializationInfo = &specialization_info,
+	                                      },
+	                                      .layout = *layout,
+	                              });
+
+	// Create images
+	views.reserve(current_images.size());
+	for (vk::ImageView current: current_images)
+	{
+		view & v = views.emplace_back();
+
+		VmaAllocationCreateInfo alloc_info{
+		        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		};
+
+		v.previous = image_allocation{
+		        device,
+		        vk::ImageCreateInfo{
+		                .imageType = vk::ImageType::e2D,
+		                .format = format,
+		                .extent = {extent.width, extent.height, 1},
+		                .mipLevels = 1,
+		                .arrayLayers = 1,
+		                .samples = vk::SampleCountFlagBits::e1,
+		                .tiling = vk::ImageTiling::eOptimal,
+		                .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eColorAttachment,
+		                .sharingMode = vk::SharingMode::eExclusive,
+		                .initialLayout = vk::ImageLayout::eUndefined,
+		        },
+		        alloc_info};
+
+		v.previous_view = vk::raii::ImageView(device,
+		                                      vk::ImageViewCreateInfo{
+		                                              .image = vk::Image{v.previous},
+		                                              .viewType = vk::ImageViewType::e2D,
+		                                              .format = format,
+		                                              .subresourceRange = {
+		                                                      .aspectMask = vk::ImageAspectFlagBits::eColor,
+		                                                      .levelCount = 1,
+		                                                      .layerCount = 1,
+		                                              },
+		                                      });
+
+		v.previous_framebuffer = vk::raii::Framebuffer(device,
+		                                               vk::FramebufferCreateInfo{
+		                                                       .renderPass = blit_render_pass,
+		                                                       .attachmentCount = 1,
+		                                                       .pAttachments = &*v.previous_view,
+		                                                       .width = extent.width,
+		                                                       .height = extent.height,
+		                                                       .layers = 1,
+		                                               });
+
+		v.motion = image_allocation{
+		        device,
+		        vk::ImageCreateInfo{
+		                .imageType = vk::ImageType::e2D,
+		                .format = motion_format,
+		                .extent = {motion_extent.width, motion_extent.height, 1},
+		                .mipLevels = 1,
+		                .arrayLayers = 1,
+		                .samples = vk::SampleCountFlagBits::e1,
+		                .tiling = vk::ImageTiling::eOptimal,
+		                .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst,
+		                .sharingMode = vk::SharingMode::eExclusive,
+		                .initialLayout = vk::ImageLayout::eUndefined,
+		        },
+		        alloc_info};
+
+		v.motion_view = vk::raii::ImageView(device,
+		                                    vk::ImageViewCreateInfo{
+		                                            .image = vk::Image{v.motion},
+		                                            .viewType = vk::ImageViewType::e2D,
+		                                            .format = motion_format,
+		                                            .subresourceRange = {
+		                                                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+		                                                    .levelCount = 1,
+		                                                    .layerCount = 1,
+		                                            },
+		                                    });
+
+		v.descriptor_set = device.allocateDescriptorSets(
+		                                 vk::DescriptorSetAllocateInfo{
+		                                         .descriptorPool = *descriptor_pool,
+		                                         .descriptorSetCount = 1,
+		                                         .pSetLayouts = &*descriptor_set_layout,
+		                                 })[0]
+		                           .release();
+
+		vk::DescriptorImageInfo current_info{
+		        .sampler = *sampler,
+		        .imageView = current,
+		        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		};
+		vk::DescriptorImageInfo previous_info{
+		        .sampler = *sampler,
+		        .imageView = *v.previous_view,
+		        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		};
+		vk::DescriptorImageInfo motion_info{
+		        .imageView = *v.motion_view,
+		        .imageLayout = vk::ImageLayout::eGeneral,
+		};
+
+		std::array write{
+		        vk::WriteDescriptorSet{
+		                .dstSet = v.descriptor_set,
+		                .dstBinding = 0,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		                .pImageInfo = &current_info,
+		        },
+		        vk::WriteDescriptorSet{
+		                .dstSet = v.descriptor_set,
+		                .dstBinding = 1,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		                .pImageInfo = &previous_info,
+		        },
+		        vk::WriteDescriptorSet{
+		                .dstSet = v.descriptor_set,
+		                .dstBinding = 2,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eStorageImage,
+		                .pImageInfo = &motion_info,
+		        },
+		};
+
+		device.updateDescriptorSets(write, {});
+	}
+}
+
+vk::Framebuffer stream_extrapolation::previous_framebuffer(int view) const
+{
+	return *views.at(view).previous_framebuffer;
+}
+
+std::vector<vk::DescriptorImageInfo> stream_extrapolation::motion_images() const
+{
+	std::vector<vk::DescriptorImageInfo> result;
+	for (const auto & v: views)
+	{
+		result.push_back({
+		        .sampler = *sampler,
+		        .imageView = *v.motion_view,
+		        .imageLayout = vk::ImageLayout::eGeneral,
+		});
+	}
+	return result;
+}
+
+void stream_extrapolation::begin(vk::raii::CommandBuffer & command_buffer)
+{
+	if (initialized)
+		return;
+
+	vk::ImageSubresourceRange range{
+	        .aspectMask = vk::ImageAspectFlagBits::eColor,
+	        .levelCount = 1,
+	        .layerCount = 1,
+	};
+
+	std::vector<vk::ImageMemoryBarrier> barriers;
+	for (auto & v: views)
+	{
+		barriers.push_back({
+		        .srcAccessMask = vk::AccessFlagBits::eNone,
+		        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+		        .oldLayout = vk::ImageLayout::eUndefined,
+		        .newLayout = vk::ImageLayout::eGeneral,
+		        .image = vk::Image{v.motion},
+		        .subresourceRange = range,
+		});
+	}
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barriers);
+
+	for (auto & v: views)
+		command_buffer.clearColorImage(vk::Image{v.motion}, vk::ImageLayout::eGeneral, vk::ClearColorValue(0.f, 0.f, 0.f, 0.f), range);
+
+	command_buffer.pipelineBarrier(
+	        vk::PipelineStageFlagBits::eTransfer,
+	        vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader,
+	        {},
+	        vk::MemoryBarrier{
+	                .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+	                .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+	        },
+	        {},
+	        {});
+
+	initialized = true;
+}
+
+void stream_extrapolation::estimate_motion(vk::raii::CommandBuffer & command_buffer)
+{
+	// Wait for the blits, and for the previous reprojection to stop reading the motion images
+	command_buffer.pipelineBarrier(
+	        vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader,
+	        vk::PipelineStageFlagBits::eComputeShader,
+	        {},
+	        vk::MemoryBarrier{
+	                .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+	                .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+	        },
+	        {},
+	        {});
+
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+	for (const auto & v: views)
+	{
+		command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *layout, 0, v.descriptor_set, {});
+		command_buffer.dispatch(
+		        (motion_extent.width + local_size - 1) / local_size,
+		        (motion_extent.height + local_size - 1) / local_size,
+		        1);
+	}
+
+	command_buffer.pipelineBarrier(
+	        vk::PipelineStageFlagBits::eComputeShader,
+	        vk::PipelineStageFlagBits::eFragmentShader,
+	        {},
+	        vk::MemoryBarrier{
+	                .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+	                .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+	        },
+	        {},
+	        {});
+}
@@ -0,0 +1,78 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "vk/allocation.h"
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+// Estimates the motion between the two last decoded frames, so that the
+// reprojection can extrapolate a frame when no new frame is ready in time
+class stream_extrapolation
+{
+	struct view
+	{
+		// The previous frame is blitted like the current one
+		image_allocation previous;
+		vk::raii::ImageView previous_view = nullptr;
+		vk::raii::Framebuffer previous_framebuffer = nullptr;
+
+		// One motion vector per block
+		image_allocation motion;
+		vk::raii::ImageView motion_view = nullptr;
+
+		vk::DescriptorSet descriptor_set;
+	};
+
+	vk::Extent2D motion_extent;
+
+	vk::raii::Sampler sampler = nullptr;
+	vk::raii::DescriptorSetLayout descriptor_set_layout = nullptr;
+	vk::raii::DescriptorPool descriptor_pool = nullptr;
+	vk::raii::PipelineLayout layout = nullptr;
+	vk::raii::Pipeline pipeline = nullptr;
+
+	std::vector<view> views;
+
+	// Motion images are cleared before their first use
+	bool initialized = false;
+
+public:
+	// current_images are the outputs of the blit, one per view, in
+	// eShaderReadOnlyOptimal layout after blit_render_pass
+	stream_extrapolation(
+	        vk::raii::Device & device,
+	        const std::vector<vk::ImageView> & current_images,
+	        vk::Extent2D extent,
+	        vk::Format format,
+	        vk::RenderPass blit_render_pass);
+
+	// Where the previous frame of each view is blitted
+	vk::Framebuffer previous_framebuffer(int view) const;
+
+	// Motion images for the reprojection, in eGeneral layout
+	std::vector<vk::DescriptorImageInfo> motion_images() const;
+
+	// Must be called before any other command using the motion images
+	void begin(vk::raii::CommandBuffer & command_buffer);
+
+	// Previous and current frames must have been blitted
+	void estimate_motion(vk::raii::CommandBuffer & command_buffer);
+};
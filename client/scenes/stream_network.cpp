@@ -20,6 +20,7 @@
 #include "stream.h"
 
 #include "application.h"
+#include "depth_codec.h"
 #include "utils/named_thread.h"
 #include <spdlog/spdlog.h>
 
@@ -67,6 +68,39 @@ void scenes::stream::operator()(to_headset::video_stream_description && desc)
 	{
 		tracking_thread = utils::named_thread("tracking_thread", &stream::tracking, this);
 	}
+
+	if (not input_thread)
+	{
+		syncs_actions = true;
+		input_thread = utils::named_thread("input_thread", &stream::input_sampling, this);
+	}
+}
+
+void scenes::stream::operator()(to_headset::video_stream_depth && packet)
+{
+	{
+		std::shared_lock lock(decoder_mutex);
+		if (not video_stream_description or
+		    not video_stream_description->depth or
+		    video_stream_description->depth->width != packet.width or
+		    video_stream_description->depth->height != packet.height)
+			return;
+	}
+
+	depth_frame frame{
+	        .frame_idx = packet.frame_idx,
+	        .min_distance = packet.min_distance,
+	        .values = std::vector<uint16_t>(view_count * packet.width * packet.height),
+	};
+
+	if (not wivrn::depth_codec::decode(packet.data, packet.width, frame.values))
+	{
+		spdlog::warn("Invalid depth for frame {}", packet.frame_idx);
+		return;
+	}
+
+	std::unique_lock lock(depth_mutex);
+	depth_frames[packet.frame_idx % depth_frames.size()] = std::move(frame);
 }
 
 void scenes::stream::operator()(to_headset::timesync_query && query)
@@ -83,6 +117,30 @@ void scenes::stream::operator()(audio_data && data)
 		(*audio_handle)(std::move(data));
 }
 
+void scenes::stream::send_nack(const wivrn::from_headset::video_nack & nack)
+{
+	try
+	{
+		network_session->send_stream(nack);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Exception while sending nack packet: {}", e.what());
+	}
+}
+
+void scenes::stream::send_ack(const wivrn::from_headset::video_ack & ack)
+{
+	try
+	{
+		network_session->send_stream(ack);
+	}
+	catch (std::exception & e)
+	{
+		spdlog::warn("Exception while sending ack packet: {}", e.what());
+	}
+}
+
 void scenes::stream::send_feedback(const wivrn::from_headset::feedback & feedback)
 {
 	try
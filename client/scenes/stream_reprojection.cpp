@@ -20,11 +20,15 @@
 #include "stream_reprojection.h"
 #include "application.h"
 #include "utils/contains.h"
+#include "utils/ranges.h"
 #include "vk/allocation.h"
 #include "vk/pipeline.h"
 #include "vk/shader.h"
 #include <array>
+#include <cmath>
+#include <cstring>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <spdlog/spdlog.h>
 #include <vk_mem_alloc.h>
@@ -38,10 +42,78 @@ struct stream_reprojection::uniform
 	alignas(8) glm::vec2 b;
 	alignas(8) glm::vec2 lambda;
 	alignas(8) glm::vec2 xc;
+
+	float extrapolation;
+
+	float disparity_scale;
+	alignas(16) glm::vec4 fov_tan;
+	alignas(16) glm::mat4 reprojection;
+};
+
+struct stream_reprojection::push_constants
+{
+	// Foveation parameters
+	alignas(8) glm::vec2 a;
+	alignas(8) glm::vec2 b;
+	alignas(8) glm::vec2 lambda;
+	alignas(8) glm::vec2 xc;
+
+	alignas(8) glm::vec2 view_min;
+	alignas(8) glm::vec2 view_max;
+	alignas(8) glm::vec2 image_min;
+	alignas(8) glm::vec2 image_max;
 };
 
 const int nb_reprojection_vertices = 128;
 
+// Matrix from eye space to clip space, without near plane so that points at
+// infinity are kept
+static glm::mat4 projection_matrix(const glm::vec4 & fov_tan)
+{
+	float l = fov_tan.x;
+	float r = fov_tan.y;
+	float t = fov_tan.z;
+	float b = fov_tan.w;
+
+	// clang-format off
+	return glm::mat4{
+		{ 2/(r-l),     0,            0,    0 },
+		{ 0,           2/(b-t),      0,    0 },
+		{ (l+r)/(r-l), (t+b)/(b-t), -0.5, -1 },
+		{ 0,           0,            0,    0 }
+	};
+	// clang-format on
+}
+
+// Matrix from eye space to world space
+static glm::mat4 pose_matrix(const XrPosef & pose)
+{
+	const XrQuaternionf & q = pose.orientation;
+	const XrVector3f & pos = pose.position;
+
+	return glm::translate(glm::mat4(1), glm::vec3(pos.x, pos.y, pos.z)) * glm::mat4_cast(glm::quat(q.w, q.x, q.y, q.z));
+}
+
+template <typename T>
+static void fill_foveation(T & out, const wivrn::to_headset::foveation_parameter & foveation)
+{
+	if (foveation.x.scale < 1)
+	{
+		out.a.x = foveation.x.a;
+		out.b.x = foveation.x.b;
+		out.lambda.x = foveation.x.scale / foveation.x.a;
+		out.xc.x = foveation.x.center;
+	}
+
+	if (foveation.y.scale < 1)
+	{
+		out.a.y = foveation.y.a;
+		out.b.y = foveation.y.b;
+		out.lambda.y = foveation.y.scale / foveation.y.a;
+		out.xc.y = foveation.y.center;
+	}
+}
+
 stream_reprojection::stream_reprojection(
         vk::raii::Device & device,
         vk::raii::PhysicalDevice & physical_device,
@@ -49,7 +121,9 @@ stream_reprojection::stream_reprojection(
         std::vector<vk::Image> output_images_,
         vk::Extent2D extent,
         vk::Format format,
-        const wivrn::to_headset::video_stream_description & description) :
+        const wivrn::to_headset::video_stream_description & description,
+        std::vector<vk::DescriptorImageInfo> motion_images) :
+        device(device),
         input_images(std::move(input_images_)),
         output_images(std::move(output_images_)),
         extent(extent)
@@ -81,6 +155,67 @@ stream_reprojection::stream_reprojection(
 
 	sampler = vk::raii::Sampler(device, sampler_info);
 
+	if (description.depth)
+	{
+		depth_sampler = vk::raii::Sampler(device, vk::SamplerCreateInfo{
+		                                                  .magFilter = vk::Filter::eNearest,
+		                                                  .minFilter = vk::Filter::eNearest,
+		                                                  .mipmapMode = vk::SamplerMipmapMode::eNearest,
+		                                                  .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+		                                                  .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+		                                                  .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+		                                          });
+
+		depth_extent = vk::Extent2D{description.depth->width, description.depth->height};
+		depth.resize(input_images.size());
+		for (auto & view: depth)
+		{
+			view.image = image_allocation(
+			        device,
+			        vk::ImageCreateInfo{
+			                .imageType = vk::ImageType::e2D,
+			                .format = vk::Format::eR16Unorm,
+			                .extent = {depth_extent.width, depth_extent.height, 1},
+			                .mipLevels = 1,
+			                .arrayLayers = 1,
+			                .samples = vk::SampleCountFlagBits::e1,
+			                .tiling = vk::ImageTiling::eOptimal,
+			                .usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+			                .sharingMode = vk::SharingMode::eExclusive,
+			                .initialLayout = vk::ImageLayout::eUndefined,
+			        },
+			        VmaAllocationCreateInfo{
+			                .usage = VMA_MEMORY_USAGE_AUTO,
+			        });
+
+			view.image_view = vk::raii::ImageView(
+			        device,
+			        vk::ImageViewCreateInfo{
+			                .image = view.image,
+			                .viewType = vk::ImageViewType::e2D,
+			                .format = vk::Format::eR16Unorm,
+			                .subresourceRange = {
+			                        .aspectMask = vk::ImageAspectFlagBits::eColor,
+			                        .baseMipLevel = 0,
+			                        .levelCount = 1,
+			                        .baseArrayLayer = 0,
+			                        .layerCount = 1,
+			                },
+			        });
+
+			view.staging = buffer_allocation(
+			        device,
+			        vk::BufferCreateInfo{
+			                .size = depth_extent.width * depth_extent.height * sizeof(uint16_t),
+			                .usage = vk::BufferUsageFlagBits::eTransferSrc,
+			        },
+			        VmaAllocationCreateInfo{
+			                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			                .usage = VMA_MEMORY_USAGE_AUTO,
+			        });
+		}
+	}
+
 	size_t uniform_size = sizeof(uniform) + properties.limits.minUniformBufferOffsetAlignment - 1;
 	uniform_size = uniform_size - uniform_size % properties.limits.minUniformBufferOffsetAlignment;
 
@@ -94,10 +229,14 @@ stream_reprojection::stream_reprojection(
 	        .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 	};
 
-	buffer = buffer_allocation(device, create_info, alloc_info);
-	void * data = buffer.map();
-	for (size_t i = 0; i < input_images.size(); i++)
-		ubo.push_back(reinterpret_cast<uniform *>(reinterpret_cast<uintptr_t>(data) + i * uniform_size));
+	// No intermediate images when only the single pass reprojection is used
+	if (not input_images.empty())
+	{
+		buffer = buffer_allocation(device, create_info, alloc_info);
+		void * data = buffer.map();
+		for (size_t i = 0; i < input_images.size(); i++)
+			ubo.push_back(reinterpret_cast<uniform *>(reinterpret_cast<uintptr_t>(data) + i * uniform_size));
+	}
 
 	// Create VkDescriptorSetLayout
 	std::array layout_binding{
@@ -113,6 +252,18 @@ stream_reprojection::stream_reprojection(
 	                .descriptorCount = 1,
 	                .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
 	        },
+	        vk::DescriptorSetLayoutBinding{
+	                .binding = 2,
+	                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+	                .descriptorCount = 1,
+	                .stageFlags = vk::ShaderStageFlagBits::eFragment,
+	        },
+	        vk::DescriptorSetLayoutBinding{
+	                .binding = 3,
+	                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+	                .descriptorCount = 1,
+	                .stageFlags = vk::ShaderStageFlagBits::eVertex,
+	        },
 	};
 
 	vk::DescriptorSetLayoutCreateInfo layout_info;
@@ -123,7 +274,7 @@ stream_reprojection::stream_reprojection(
 	std::array pool_size{
 	        vk::DescriptorPoolSize{
 	                .type = vk::DescriptorType::eCombinedImageSampler,
-	                .descriptorCount = (uint32_t)input_images.size(),
+	                .descriptorCount = 3 * (uint32_t)input_images.size(),
 	        },
 	        vk::DescriptorPoolSize{
 	                .type = vk::DescriptorType::eUniformBuffer,
@@ -136,7 +287,8 @@ stream_reprojection::stream_reprojection(
 	pool_info.maxSets = input_images.size();
 	pool_info.setPoolSizes(pool_size);
 
-	descriptor_pool = vk::raii::DescriptorPool(device, pool_info);
+	if (not input_images.empty())
+		descriptor_pool = vk::raii::DescriptorPool(device, pool_info);
 
 	// Create image views and descriptor sets
 	input_image_views.reserve(input_images.size());
@@ -186,6 +338,22 @@ stream_reprojection::stream_reprojection(
 		};
 		offset += uniform_size;
 
+		// Without extrapolation the motion image is never sampled, bind the input image instead
+		vk::DescriptorImageInfo motion_info = image_info;
+		if (size_t index = descriptor_sets.size() - 1; index < motion_images.size())
+			motion_info = motion_images[index];
+
+		// Same for the depth
+		vk::DescriptorImageInfo depth_info = image_info;
+		if (size_t index = descriptor_sets.size() - 1; index < depth.size())
+		{
+			depth_info = vk::DescriptorImageInfo{
+			        .sampler = *depth_sampler,
+			        .imageView = *depth[index].image_view,
+			        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+			};
+		}
+
 		std::array write{
 		        vk::WriteDescriptorSet{
 		                .dstSet = descriptor_sets.back(),
@@ -203,6 +371,22 @@ stream_reprojection::stream_reprojection(
 		                .descriptorType = vk::DescriptorType::eUniformBuffer,
 		                .pBufferInfo = &buffer_info,
 		        },
+		        vk::WriteDescriptorSet{
+		                .dstSet = descriptor_sets.back(),
+		                .dstBinding = 2,
+		                .dstArrayElement = 0,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		                .pImageInfo = &motion_info,
+		        },
+		        vk::WriteDescriptorSet{
+		                .dstSet = descriptor_sets.back(),
+		                .dstBinding = 3,
+		                .dstArrayElement = 0,
+		                .descriptorCount = 1,
+		                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		                .pImageInfo = &depth_info,
+		        },
 		};
 
 		device.updateDescriptorSets(write, {});
@@ -237,6 +421,8 @@ stream_reprojection::stream_reprojection(
 	// Create graphics pipeline
 	vk::raii::ShaderModule vertex_shader = load_shader(device, "reprojection.vert");
 	vk::raii::ShaderModule fragment_shader = load_shader(device, "reprojection.frag");
+	single_pass_vertex_shader = load_shader(device, "reprojection_single_pass.vert");
+	single_pass_fragment_shader = load_shader(device, "reprojection_single_pass.frag");
 
 	vk::PipelineLayoutCreateInfo pipeline_layout_info;
 	pipeline_layout_info.setSetLayouts(*descriptor_set_layout);
@@ -380,22 +566,60 @@ void stream_reprojection::reproject(vk::raii::CommandBuffer & command_buffer, in
 	if (destination < 0 || destination >= (int)output_images.size())
 		throw std::runtime_error("Invalid destination image index");
 
-	if (foveation_parameters[source].x.scale < 1)
+	fill_foveation(*ubo[source], foveation_parameters[source]);
+	ubo[source]->extrapolation = extrapolation;
+	ubo[source]->disparity_scale = 0;
+
+	if (source < (int)depth.size())
 	{
-		ubo[source]->a.x = foveation_parameters[source].x.a;
-		ubo[source]->b.x = foveation_parameters[source].x.b;
-		ubo[source]->lambda.x = foveation_parameters[source].x.scale / foveation_parameters[source].x.a;
-		ubo[source]->xc.x = foveation_parameters[source].x.center;
+		auto & view = depth[source];
+		// The image is bound even if it was never uploaded
+		if (view.layout == vk::ImageLayout::eUndefined)
+			transition_depth(command_buffer, view, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		if (view.reprojection)
+		{
+			ubo[source]->disparity_scale = disparity_scale;
+			ubo[source]->fov_tan = view.fov_tan;
+			ubo[source]->reprojection = *view.reprojection;
+		}
 	}
 
-	if (foveation_parameters[source].y.scale < 1)
+	begin_render_pass(command_buffer, destination);
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline);
+	command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *layout, 0, descriptor_sets[source], {});
+	command_buffer.draw(6 * nb_reprojection_vertices * nb_reprojection_vertices, 1, 0, 0);
+	command_buffer.endRenderPass();
+}
+
+void stream_reprojection::reproject(vk::raii::CommandBuffer & command_buffer, std::span<const tile> tiles, int view, int destination)
+{
+	if (view < 0 || view >= (int)foveation_parameters.size())
+		throw std::runtime_error("Invalid view index");
+	if (destination < 0 || destination >= (int)output_images.size())
+		throw std::runtime_error("Invalid destination image index");
+
+	push_constants constants{};
+	fill_foveation(constants, foveation_parameters[view]);
+
+	begin_render_pass(command_buffer, destination);
+	for (const auto & tile: tiles)
 	{
-		ubo[source]->a.y = foveation_parameters[source].y.a;
-		ubo[source]->b.y = foveation_parameters[source].y.b;
-		ubo[source]->lambda.y = foveation_parameters[source].y.scale / foveation_parameters[source].y.a;
-		ubo[source]->xc.y = foveation_parameters[source].y.center;
+		constants.view_min = {tile.view_min[0], tile.view_min[1]};
+		constants.view_max = {tile.view_max[0], tile.view_max[1]};
+		constants.image_min = {tile.image_min[0], tile.image_min[1]};
+		constants.image_max = {tile.image_max[0], tile.image_max[1]};
+
+		command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, tile.pipeline);
+		command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, tile.layout, 0, tile.descriptor_set, {});
+		command_buffer.pushConstants<push_constants>(tile.layout, vk::ShaderStageFlagBits::eVertex, 0, constants);
+		command_buffer.draw(6 * nb_reprojection_vertices * nb_reprojection_vertices, 1, 0, 0);
 	}
+	command_buffer.endRenderPass();
+}
 
+void stream_reprojection::begin_render_pass(vk::raii::CommandBuffer & command_buffer, int destination)
+{
 	vk::ClearValue clear(vk::ClearColorValue(0, 0, 0, 0));
 	vk::RenderPassBeginInfo begin_info{
 	        .renderPass = *renderpass,
@@ -428,13 +652,183 @@ void stream_reprojection::reproject(vk::raii::CommandBuffer & command_buffer, in
 	        });
 
 	command_buffer.beginRenderPass(begin_info, vk::SubpassContents::eInline);
-	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline);
-	command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *layout, 0, descriptor_sets[source], {});
-	command_buffer.draw(6 * nb_reprojection_vertices * nb_reprojection_vertices, 1, 0, 0);
-	command_buffer.endRenderPass();
+}
+
+std::pair<vk::raii::PipelineLayout, vk::raii::Pipeline> stream_reprojection::create_single_pass_pipeline(vk::DescriptorSetLayout image_layout, bool do_srgb)
+{
+	vk::PushConstantRange push_constant_range{
+	        .stageFlags = vk::ShaderStageFlagBits::eVertex,
+	        .offset = 0,
+	        .size = sizeof(push_constants),
+	};
+
+	vk::PipelineLayoutCreateInfo pipeline_layout_info;
+	pipeline_layout_info.setSetLayouts(image_layout);
+	pipeline_layout_info.setPushConstantRanges(push_constant_range);
+
+	vk::raii::PipelineLayout pipeline_layout(device, pipeline_layout_info);
+
+	int specialization_constants[] = {
+	        foveation_parameters[0].x.scale < 1,
+	        foveation_parameters[0].y.scale < 1,
+	        nb_reprojection_vertices,
+	        nb_reprojection_vertices,
+	        do_srgb,
+	};
+
+	std::array<vk::SpecializationMapEntry, std::size(specialization_constants)> specialization_constants_desc;
+	for (uint32_t i = 0; i < specialization_constants_desc.size(); i++)
+	{
+		specialization_constants_desc[i] = {
+		        .constantID = i,
+		        .offset = uint32_t(i * sizeof(int)),
+		        .size = sizeof(int),
+		};
+	}
+
+	vk::SpecializationInfo specialization_info;
+
+	specialization_info.setMapEntries(specialization_constants_desc);
+	specialization_info.setData<int>(specialization_constants);
+
+	vk::pipeline_builder pipeline_info{
+	        .flags = {},
+	        .Stages = {
+	                {
+	                        .stage = vk::ShaderStageFlagBits::eVertex,
+	                        .module = *single_pass_vertex_shader,
+	                        .pName = "main",
+	                        .pSpecializationInfo = &specialization_info,
+	                },
+	                {
+	                        .stage = vk::ShaderStageFlagBits::eFragment,
+	                        .module = *single_pass_fragment_shader,
+	                        .pName = "main",
+	                        .pSpecializationInfo = &specialization_info,
+	                },
+	        },
+	        .VertexInputState = {
+	                .flags = {},
+	        },
+	        .VertexBindingDescriptions = {},
+	        .VertexAttributeDescriptions = {},
+	        .InputAssemblyState = {{
+	                .topology = vk::PrimitiveTopology::eTriangleList,
+	        }},
+	        .ViewportState = {
+	                .flags = {},
+	        },
+	        .Viewports = {{
+	                .x = 0,
+	                .y = 0,
+	                .width = (float)extent.width,
+	                .height = (float)extent.height,
+	                .minDepth = 0,
+	                .maxDepth = 1,
+	        }},
+	        .Scissors = {{
+	                .offset = {.x = 0, .y = 0},
+	                .extent = extent,
+	        }},
+	        .RasterizationState = {{
+	                .polygonMode = vk::PolygonMode::eFill,
+	                .lineWidth = 1,
+	        }},
+	        .MultisampleState = {{
+	                .rasterizationSamples = vk::SampleCountFlagBits::e1,
+	        }},
+	        .ColorBlendState = {.flags = {}},
+	        .ColorBlendAttachments = {{
+	                .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+	        }},
+	        .layout = *pipeline_layout,
+	        .renderPass = *renderpass,
+	        .subpass = 0,
+	};
+
+	vk::raii::Pipeline pipeline(device, application::get_pipeline_cache(), pipeline_info);
+
+	return {std::move(pipeline_layout), std::move(pipeline)};
 }
 
 void stream_reprojection::set_foveation(std::array<wivrn::to_headset::foveation_parameter, 2> foveation)
 {
 	foveation_parameters = foveation;
 }
+
+void stream_reprojection::set_extrapolation(float factor)
+{
+	extrapolation = factor;
+}
+
+void stream_reprojection::transition_depth(vk::raii::CommandBuffer & command_buffer, depth_view & view, vk::ImageLayout layout)
+{
+	bool to_transfer = layout == vk::ImageLayout::eTransferDstOptimal;
+	command_buffer.pipelineBarrier(
+	        to_transfer ? vk::PipelineStageFlagBits::eVertexShader : vk::PipelineStageFlagBits::eTransfer,
+	        to_transfer ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eVertexShader,
+	        {},
+	        {},
+	        {},
+	        vk::ImageMemoryBarrier{
+	                .srcAccessMask = to_transfer ? vk::AccessFlagBits::eShaderRead : vk::AccessFlagBits::eTransferWrite,
+	                .dstAccessMask = to_transfer ? vk::AccessFlagBits::eTransferWrite : vk::AccessFlagBits::eShaderRead,
+	                .oldLayout = view.layout,
+	                .newLayout = layout,
+	                .image = view.image,
+	                .subresourceRange = {
+	                        .aspectMask = vk::ImageAspectFlagBits::eColor,
+	                        .levelCount = 1,
+	                        .layerCount = 1,
+	                },
+	        });
+	view.layout = layout;
+}
+
+void stream_reprojection::set_depth(
+        vk::raii::CommandBuffer & command_buffer,
+        std::span<const uint16_t> values,
+        float min_distance,
+        const std::array<XrPosef, 2> & frame_pose,
+        const std::array<XrFovf, 2> & fov,
+        const std::array<XrPosef, 2> & display_pose)
+{
+	const size_t view_size = depth_extent.width * depth_extent.height;
+	if (depth.empty() or values.size() != depth.size() * view_size)
+		throw std::runtime_error("Invalid depth size");
+
+	disparity_scale = 1 / min_distance;
+
+	for (auto && [index, view]: utils::enumerate(depth))
+	{
+		memcpy(view.staging.map(), values.data() + index * view_size, view_size * sizeof(uint16_t));
+
+		transition_depth(command_buffer, view, vk::ImageLayout::eTransferDstOptimal);
+		command_buffer.copyBufferToImage(
+		        view.staging,
+		        view.image,
+		        vk::ImageLayout::eTransferDstOptimal,
+		        vk::BufferImageCopy{
+		                .imageSubresource = {
+		                        .aspectMask = vk::ImageAspectFlagBits::eColor,
+		                        .layerCount = 1,
+		                },
+		                .imageExtent = {depth_extent.width, depth_extent.height, 1},
+		        });
+		transition_depth(command_buffer, view, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		view.fov_tan = {
+		        std::tan(fov[index].angleLeft),
+		        std::tan(fov[index].angleRight),
+		        std::tan(fov[index].angleUp),
+		        std::tan(fov[index].angleDown),
+		};
+		view.reprojection = projection_matrix(view.fov_tan) * glm::inverse(pose_matrix(display_pose[index])) * pose_matrix(frame_pose[index]);
+	}
+}
+
+void stream_reprojection::clear_depth()
+{
+	for (auto & view: depth)
+		view.reprojection.reset();
+}
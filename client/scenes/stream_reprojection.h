@@ -21,12 +21,18 @@
 
 #include "vk/allocation.h"
 #include "wivrn_packets.h"
+#include <glm/glm.hpp>
+#include <optional>
+#include <span>
 #include <vulkan/vulkan_raii.hpp>
 #include <openxr/openxr.h>
 
 class stream_reprojection
 {
 	struct uniform;
+	struct push_constants;
+
+	vk::raii::Device & device;
 
 	// Uniform buffer
 	buffer_allocation buffer;
@@ -54,7 +60,47 @@ class stream_reprojection
 	// Foveation
 	std::array<wivrn::to_headset::foveation_parameter, 2> foveation_parameters;
 
+	// Fraction of the motion between the two last frames to add
+	float extrapolation = 0;
+
+	// Positional reprojection, only if the server sends depth
+	struct depth_view
+	{
+		image_allocation image;
+		vk::raii::ImageView image_view = nullptr;
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+		buffer_allocation staging;
+		// Set when the depth of the current frame is uploaded
+		std::optional<glm::mat4> reprojection;
+		glm::vec4 fov_tan;
+	};
+	vk::raii::Sampler depth_sampler = nullptr;
+	std::vector<depth_view> depth;
+	vk::Extent2D depth_extent;
+	float disparity_scale = 0;
+
+	// Single pass, pipelines are created for each decoder
+	vk::raii::ShaderModule single_pass_vertex_shader = nullptr;
+	vk::raii::ShaderModule single_pass_fragment_shader = nullptr;
+
+	void begin_render_pass(vk::raii::CommandBuffer & command_buffer, int destination);
+	void transition_depth(vk::raii::CommandBuffer & command_buffer, depth_view & view, vk::ImageLayout layout);
+
 public:
+	// Part of a decoded image to draw in a view
+	struct tile
+	{
+		vk::PipelineLayout layout;
+		vk::Pipeline pipeline;
+		vk::DescriptorSet descriptor_set;
+		// Rectangle of the tile in the foveated view, in uv coordinates
+		std::array<float, 2> view_min;
+		std::array<float, 2> view_max;
+		// Same rectangle in the decoded image
+		std::array<float, 2> image_min;
+		std::array<float, 2> image_max;
+	};
+
 	stream_reprojection(
 	        vk::raii::Device & device,
 	        vk::raii::PhysicalDevice & physical_device,
@@ -62,7 +108,8 @@ public:
 	        std::vector<vk::Image> output_images,
 	        vk::Extent2D extent,
 	        vk::Format format,
-	        const wivrn::to_headset::video_stream_description & description);
+	        const wivrn::to_headset::video_stream_description & description,
+	        std::vector<vk::DescriptorImageInfo> motion_images = {});
 
 	stream_reprojection(const stream_reprojection &) = delete;
 
@@ -71,5 +118,41 @@ public:
 	        int source,
 	        int destination);
 
+	// Pipeline sampling a decoded image directly, image_layout has the image
+	// at binding 0 with the immutable sampler of the decoder
+	std::pair<vk::raii::PipelineLayout, vk::raii::Pipeline> create_single_pass_pipeline(
+	        vk::DescriptorSetLayout image_layout,
+	        bool do_srgb);
+
+	// Unfoveate the decoded images without the intermediate blit
+	void reproject(
+	        vk::raii::CommandBuffer & command_buffer,
+	        std::span<const tile> tiles,
+	        int view,
+	        int destination);
+
 	void set_foveation(std::array<wivrn::to_headset::foveation_parameter, 2> foveation);
+
+	// Only for the two pass reprojection, requires motion images
+	void set_extrapolation(float factor);
+
+	bool has_depth() const
+	{
+		return not depth.empty();
+	}
+
+	// Only for the two pass reprojection, requires depth in the stream
+	// description: values are the grids of both views, quantized with
+	// depth_codec. The frame rendered at frame_pose is drawn as seen from
+	// display_pose, both with the frame fov.
+	void set_depth(
+	        vk::raii::CommandBuffer & command_buffer,
+	        std::span<const uint16_t> values,
+	        float min_distance,
+	        const std::array<XrPosef, 2> & frame_pose,
+	        const std::array<XrFovf, 2> & fov,
+	        const std::array<XrPosef, 2> & display_pose);
+
+	// Disable positional reprojection until the next set_depth
+	void clear_depth();
 };
@@ -87,6 +87,10 @@ void scenes::stream::accumulate_metrics(XrTime predicted_display_time, const std
 	bandwidth_rx = 0.8 * bandwidth_rx + 0.2 * float(rx - bytes_received) / dt;
 	bandwidth_tx = 0.8 * bandwidth_tx + 0.2 * float(tx - bytes_sent) / dt;
 
+	uint64_t packets = input_packets;
+	input_packet_rate = 0.8 * input_packet_rate + 0.2 * float(packets - input_packets_sent) / dt;
+	input_packets_sent = packets;
+
 	last_metric_time = predicted_display_time;
 	bytes_received = rx;
 	bytes_sent = tx;
@@ -146,8 +150,9 @@ XrCompositionLayerQuad scenes::stream::plot_performance_metrics(XrTime predicted
 	        // clang-format off
 	        plot(_("CPU time"), {{"",          &global_metric::cpu_time}},     "s"),
 
-	        plot(_("GPU time"), {{_("Reproject"), &global_metric::gpu_time},
-		                     {_("Blit"),      &global_metric::gpu_barrier}},  "s"),
+	        plot(_("GPU time"), {{_("Reproject"),     &global_metric::gpu_time},
+		                     {_("Extrapolation"), &global_metric::gpu_extrapolation},
+		                     {_("Blit"),          &global_metric::gpu_barrier}},  "s"),
 
 	        plot(("Network"),  {{_("Download"),  &global_metric::bandwidth_rx},
 	                            {_("Upload"),    &global_metric::bandwidth_tx}}, "bit/s"),
@@ -317,6 +322,22 @@ XrCompositionLayerQuad scenes::stream::plot_performance_metrics(XrTime predicted
 		std::lock_guard lock(tracking_control_mutex);
 		ImGui::Text("%s", fmt::format(_F("Estimated motion to photons latency: {}ms"), std::chrono::duration_cast<std::chrono::milliseconds>(tracking_control.offset).count()).c_str());
 	}
+	if (extrapolation)
+	{
+		ImGui::SameLine();
+		ImGui::Text("%s", fmt::format(_F("Extrapolated frames: {}"), extrapolated_frames).c_str());
+	}
+	ImGui::SameLine();
+	ImGui::Text("%s", fmt::format(_F("Input packets: {:.0f}/s"), input_packet_rate).c_str());
+	if (auto stats = audio_handle ? audio_handle->get_sync_stats() : std::nullopt)
+	{
+		ImGui::Text("%s", fmt::format(_F("Audio buffer: {:.1f}ms, clock drift: {:.0f}ppm, correction: {:.0f}ppm"), stats->buffer_level * 1000, stats->drift * 1e6, stats->correction * 1e6).c_str());
+		if (not std::isnan(stats->av_offset))
+		{
+			ImGui::SameLine();
+			ImGui::Text("%s", fmt::format(_F("A/V offset: {:.0f}ms"), stats->av_offset * 1000).c_str());
+		}
+	}
 	ImGui::End();
 
 	return imgui_ctx->end_frame();
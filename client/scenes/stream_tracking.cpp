@@ -252,12 +252,13 @@ void scenes::stream::tracking()
 					if (recenter_requested.exchange(false))
 						packet.state_flags = wivrn::from_headset::tracking::recentered;
 
-					packet.device_poses.clear();
+					std::vector<from_headset::tracking::pose> device_poses;
 					for (auto [device, space]: spaces)
 					{
 						if (enabled(control, device))
-							packet.device_poses.push_back(locate_space(device, space, world_space, t0 + Δt));
+							device_poses.push_back(locate_space(device, space, world_space, t0 + Δt));
 					}
+					packet.device_poses = std::move(device_poses);
 
 					if (application::get_hand_tracking_supported())
 					{
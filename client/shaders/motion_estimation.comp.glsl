@@ -0,0 +1,101 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Block matching between the two last frames, with a three step search:
+// one motion vector per block, in uv units, such that
+// current(uv) ~ previous(uv - motion)
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Size of the blocks in pixels
+layout(constant_id = 0) const int block_size = 32;
+// First step of the search in pixels, motions up to twice this value are found
+layout(constant_id = 1) const int search_step = 16;
+
+layout(set = 0, binding = 0) uniform sampler2D current;
+layout(set = 0, binding = 1) uniform sampler2D previous;
+layout(set = 0, binding = 2, rgba16f) uniform writeonly image2D motion;
+
+// Pixels compared in each block
+const int nb_samples = 8;
+
+float reference[nb_samples * nb_samples];
+vec2 origin;
+vec2 sample_step;
+vec2 texel;
+
+float luma(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Sum of absolute differences with the previous frame, moved by offset pixels
+float sad(vec2 offset)
+{
+	vec2 start = origin - offset * texel;
+	float sum = 0;
+	for (int j = 0; j < nb_samples; j++)
+		for (int i = 0; i < nb_samples; i++)
+			sum += abs(reference[j * nb_samples + i] - luma(textureLod(previous, start + vec2(i, j) * sample_step, 0).rgb));
+	return sum;
+}
+
+void main()
+{
+	ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(block, imageSize(motion))))
+		return;
+
+	texel = 1 / vec2(textureSize(current, 0));
+	sample_step = texel * float(block_size) / nb_samples;
+	origin = vec2(block * block_size) * texel + sample_step / 2;
+
+	for (int j = 0; j < nb_samples; j++)
+		for (int i = 0; i < nb_samples; i++)
+			reference[j * nb_samples + i] = luma(textureLod(current, origin + vec2(i, j) * sample_step, 0).rgb);
+
+	vec2 best = vec2(0);
+	float best_sad = sad(best);
+
+	for (int step = search_step; step > 0; step /= 2)
+	{
+		vec2 center = best;
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int x = -1; x <= 1; x++)
+			{
+				if (x == 0 && y == 0)
+					continue;
+
+				vec2 offset = center + vec2(x, y) * step;
+				float s = sad(offset);
+				// Prefer small motions in flat areas
+				if (s < best_sad * 0.95)
+				{
+					best = offset;
+					best_sad = s;
+				}
+			}
+		}
+	}
+
+	imageStore(motion, block, vec4(best * texel, 0, 0));
+}
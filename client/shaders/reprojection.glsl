@@ -18,6 +18,7 @@
  */
 
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout (constant_id = 0) const bool use_foveation_x = false;
 layout (constant_id = 1) const bool use_foveation_y = false;
@@ -30,28 +31,25 @@ layout(set = 0, binding = 1) uniform UniformBufferObject
 	vec2 b;
 	vec2 lambda;
 	vec2 xc;
+
+	// Fraction of the motion between the two last frames to add
+	float extrapolation;
+
+	// Positional reprojection, 0 when there is no depth:
+	// inverse of the distance matching a disparity of 1
+	float disparity_scale;
+	// Tangents of the left, right, up and down angles of the frame
+	vec4 fov_tan;
+	// From the frame eye space to the clip space of the displayed view
+	mat4 reprojection;
 }
 ubo;
 
+#include "foveation.glslh"
+
 vec2 unfoveate(vec2 uv)
 {
-	uv = 2 * uv - 1;
-	if (use_foveation_x && use_foveation_y)
-	{
-		uv = ubo.lambda * tan(ubo.a * uv + ubo.b) + ubo.xc;
-	}
-	else
-	{
-		if (use_foveation_x)
-		{
-			uv.x = (ubo.lambda * tan(ubo.a * uv + ubo.b) + ubo.xc).y;
-		}
-		if (use_foveation_y)
-		{
-			uv.y = (ubo.lambda * tan(ubo.a * uv + ubo.b) + ubo.xc).y;
-		}
-	}
-	return uv;
+	return unfoveate(uv, ubo.a, ubo.b, ubo.lambda, ubo.xc);
 }
 
 #ifdef VERT_SHADER
@@ -60,8 +58,25 @@ vec2 positions[6] = vec2[](
 	vec2(0, 0), vec2(1, 0), vec2(0, 1),
 	vec2(1, 0), vec2(0, 1), vec2(1, 1));
 
+layout(set = 0, binding = 3) uniform sampler2D depth;
+
 layout(location = 0) out vec2 outUV;
 
+// Bilinear interpolation of the disparity (min_distance / distance), the
+// depth grid is small and may not support linear filtering
+float disparity(vec2 uv)
+{
+	ivec2 size = textureSize(depth, 0);
+	vec2 p = clamp(uv * size - 0.5, vec2(0), vec2(size - 1));
+	ivec2 i = ivec2(p);
+	ivec2 j = min(i + 1, size - 1);
+	vec2 f = p - i;
+	return mix(
+		mix(texelFetch(depth, i, 0).r, texelFetch(depth, ivec2(j.x, i.y), 0).r, f.x),
+		mix(texelFetch(depth, ivec2(i.x, j.y), 0).r, texelFetch(depth, j, 0).r, f.x),
+		f.y);
+}
+
 void main()
 {
 	vec2 quad_size = 1 / vec2(nb_x, nb_y);
@@ -70,12 +85,25 @@ void main()
 	vec2 top_left = quad_size * vec2(cell_id % nb_x, cell_id / nb_x);
 	outUV = top_left + positions[gl_VertexIndex % 6] * quad_size;
 
-	gl_Position = vec4(unfoveate(outUV), 0.0, 1.0);
+	vec2 position = unfoveate(outUV);
+	if (ubo.disparity_scale > 0)
+	{
+		// Move each vertex of the mesh to its position in the displayed view,
+		// points at infinity (disparity 0) are only rotated
+		vec2 t = position * 0.5 + 0.5;
+		vec2 tangent = mix(ubo.fov_tan.xz, ubo.fov_tan.yw, t);
+		gl_Position = ubo.reprojection * vec4(tangent, -1, disparity(t) * ubo.disparity_scale);
+	}
+	else
+	{
+		gl_Position = vec4(position, 0.0, 1.0);
+	}
 }
 #endif
 
 #ifdef FRAG_SHADER
 layout(set = 0, binding = 0) uniform sampler2D texSampler;
+layout(set = 0, binding = 2) uniform sampler2D motion;
 
 layout(location = 0) in vec2 inUV;
 
@@ -83,7 +111,11 @@ layout(location = 0) out vec4 outColor;
 
 void main()
 {
-	outColor = vec4(texture(texSampler, inUV).rgb, 1);
+	vec2 uv = inUV;
+	if (ubo.extrapolation > 0)
+		uv -= ubo.extrapolation * texture(motion, inUV).xy;
+
+	outColor = vec4(texture(texSampler, uv).rgb, 1);
 
 }
 #endif
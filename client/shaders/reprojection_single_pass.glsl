@@ -0,0 +1,97 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Unfoveates a decoded image directly into the swapchain, without the
+// intermediate blit: each draw covers the part of the view from one decoder.
+
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+layout (constant_id = 0) const bool use_foveation_x = false;
+layout (constant_id = 1) const bool use_foveation_y = false;
+layout (constant_id = 2) const int nb_x = 64;
+layout (constant_id = 3) const int nb_y = 64;
+layout (constant_id = 4) const bool do_srgb = true;
+
+layout(push_constant) uniform PushConstants
+{
+	// Foveation parameters
+	vec2 a;
+	vec2 b;
+	vec2 lambda;
+	vec2 xc;
+	// Rectangle of the tile in the foveated view
+	vec2 view_min;
+	vec2 view_max;
+	// Same rectangle in the decoded image
+	vec2 image_min;
+	vec2 image_max;
+}
+pc;
+
+#include "foveation.glslh"
+
+vec2 unfoveate(vec2 uv)
+{
+	return unfoveate(uv, pc.a, pc.b, pc.lambda, pc.xc);
+}
+
+#ifdef VERT_SHADER
+
+vec2 positions[6] = vec2[](
+	vec2(0, 0), vec2(1, 0), vec2(0, 1),
+	vec2(1, 0), vec2(0, 1), vec2(1, 1));
+
+layout(location = 0) out vec2 outUV;
+
+void main()
+{
+	vec2 quad_size = 1 / vec2(nb_x, nb_y);
+	int cell_id = gl_VertexIndex / 6;
+
+	vec2 top_left = quad_size * vec2(cell_id % nb_x, cell_id / nb_x);
+	vec2 position = top_left + positions[gl_VertexIndex % 6] * quad_size;
+
+	outUV = mix(pc.image_min, pc.image_max, position);
+	gl_Position = vec4(unfoveate(mix(pc.view_min, pc.view_max, position)), 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAG_SHADER
+layout(set = 0, binding = 0) uniform sampler2D texSampler;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+float sRGB_to_linear(float x)
+{
+	if (x <= 0.04045)
+		return x / 12.92;
+	return pow((x + 0.055) / 1.055, 2.4);
+}
+
+void main()
+{
+	vec3 color = texture(texSampler, inUV).rgb;
+	if (do_srgb)
+		color = vec3(sRGB_to_linear(color.r), sRGB_to_linear(color.g), sRGB_to_linear(color.b));
+	outColor = vec4(color, 1);
+}
+#endif
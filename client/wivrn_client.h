@@ -65,7 +65,7 @@ public:
 	{
 		pollfd fds[2] = {};
 		fds[0].events = POLLIN;
-		fds[0].fd = stream.get_fd();
+		fds[0].fd = stream.poll_fd();
 		fds[1].events = POLLIN;
 		fds[1].fd = control.get_fd();
 
@@ -3,6 +3,10 @@ function(compile_glsl_aux shader_stage shader_name glsl_filename output)
 
     string(TOUPPER ${shader_stage} shader_stage_upper)
 
+    # Files included by the shaders, next to them
+    cmake_path(GET glsl_filename PARENT_PATH glsl_dir)
+    file(GLOB glsl_includes CONFIGURE_DEPENDS "${glsl_dir}/*.glslh")
+
     add_custom_command(
             OUTPUT ${output}
             COMMAND echo "{ \"${shader_name}\", {"         >> ${output}
@@ -10,7 +14,7 @@ function(compile_glsl_aux shader_stage shader_name glsl_filename output)
             COMMAND echo "}},"                             >> ${output}
 
             COMMAND Vulkan::glslangValidator -V -S ${shader_stage} -D${shader_stage_upper}_SHADER ${in_file} -x -o ${shader_name}.spv
-            DEPENDS ${glsl_filename}
+            DEPENDS ${glsl_filename} ${glsl_includes}
             VERBATIM
             APPEND
         )
@@ -0,0 +1,235 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "audio_resampler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace wivrn
+{
+
+namespace
+{
+// Input frames on each side of the interpolated position
+const size_t half_taps = 16;
+// Number of precomputed fractional positions, others are linearly interpolated
+const size_t phases = 256;
+// Relative to the Nyquist frequency, the ratio is always close to 1 so there is no aliasing concern
+const double cutoff = 0.95;
+const double kaiser_beta = 8;
+
+// Time constant of the buffer level smoothing, the level jumps each time a packet is received
+const double level_smoothing = 0.5;
+// Proportional and integral gains of the controller, critically damped
+const double kp = 0.05;
+const double ki = kp * kp / 4;
+// 1000 ppm is 1.7 cents, not audible
+const double max_correction = 1e-3;
+// The integral term only compensates the error of the drift estimation
+const double max_integral = 5e-4;
+
+// The estimated drift is updated once the stream was received for this long
+const int64_t min_estimation_duration = 10'000'000'000;
+// Start a new estimation after this duration, so that temperature changes are followed
+const int64_t max_estimation_duration = 600'000'000'000;
+// A longer interval between packets means the stream was paused
+const int64_t max_packet_interval = 200'000'000;
+const double max_drift = 1e-3;
+
+double bessel_i0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	for (int k = 1; k < 30; k++)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+using filter_table = std::array<std::array<float, 2 * half_taps>, phases + 1>;
+
+const filter_table & filter()
+{
+	static const filter_table table = []() {
+		filter_table table;
+		for (size_t phase = 0; phase <= phases; phase++)
+		{
+			double sum = 0;
+			std::array<double, 2 * half_taps> taps;
+			for (size_t k = 0; k < 2 * half_taps; k++)
+			{
+				// Distance between the interpolated position and the input frame
+				double d = double(phase) / phases + half_taps - 1 - k;
+				double x = M_PI * cutoff * d;
+				double sinc = x == 0 ? 1 : std::sin(x) / x;
+				double w = d / half_taps;
+				double window = std::abs(w) < 1 ? bessel_i0(kaiser_beta * std::sqrt(1 - w * w)) / bessel_i0(kaiser_beta) : 0;
+				taps[k] = sinc * window;
+				sum += taps[k];
+			}
+			// Unity gain at DC
+			for (size_t k = 0; k < 2 * half_taps; k++)
+				table[phase][k] = taps[k] / sum;
+		}
+		return table;
+	}();
+	return table;
+}
+} // namespace
+
+audio_resampler::audio_resampler(size_t num_channels) :
+        num_channels(num_channels)
+{
+	reset();
+}
+
+void audio_resampler::reset()
+{
+	// Filter history is silence
+	input.assign((half_taps - 1) * num_channels, 0);
+	position = half_taps - 1;
+}
+
+void audio_resampler::reserve(size_t frames)
+{
+	input.reserve((frames + 2 * half_taps) * num_channels);
+}
+
+void audio_resampler::push(std::span<const uint8_t> frames)
+{
+	// Packets are not necessarily aligned
+	size_t count = frames.size() / sizeof(int16_t);
+	size_t offset = input.size();
+	input.resize(offset + count);
+	for (size_t i = 0; i < count; i++)
+	{
+		int16_t sample;
+		memcpy(&sample, frames.data() + i * sizeof(int16_t), sizeof(sample));
+		input[offset + i] = sample;
+	}
+}
+
+double audio_resampler::buffered() const
+{
+	return std::max(0., input_frames() - position);
+}
+
+size_t audio_resampler::pull(std::span<int16_t> frames)
+{
+	const auto & table = filter();
+	size_t count = 0;
+	size_t max_count = frames.size() / num_channels;
+
+	for (; count < max_count; count++)
+	{
+		size_t i = std::floor(position);
+		if (i + half_taps >= input_frames())
+			break;
+
+		double fp = (position - i) * phases;
+		size_t phase = std::min<size_t>(fp, phases - 1);
+		float t = fp - phase;
+
+		const float * in = input.data() + (i + 1 - half_taps) * num_channels;
+		for (size_t c = 0; c < num_channels; c++)
+		{
+			float sum = 0;
+			for (size_t k = 0; k < 2 * half_taps; k++)
+			{
+				float coef = table[phase][k] + t * (table[phase + 1][k] - table[phase][k]);
+				sum += coef * in[k * num_channels + c];
+			}
+			frames[count * num_channels + c] = std::lround(std::clamp(sum, -32768.f, 32767.f));
+		}
+
+		position += ratio;
+	}
+
+	// Only keep the history needed for the next frame
+	size_t floor_position = std::floor(position);
+	if (floor_position >= half_taps)
+	{
+		size_t drop = std::min(floor_position + 1 - half_taps, input_frames());
+		input.erase(input.begin(), input.begin() + drop * num_channels);
+		position -= drop;
+	}
+
+	return count;
+}
+
+audio_drift_controller::audio_drift_controller(std::chrono::duration<double> target) :
+        target_(target.count())
+{
+}
+
+double audio_drift_controller::update(double measured, double dt)
+{
+	dt = std::clamp(dt, 0., 1.);
+	if (level < 0)
+		level = measured;
+	else
+		level += (measured - level) * dt / (level_smoothing + dt);
+
+	// Positive error: too much is buffered, play faster
+	double error = level - target_;
+	integral = std::clamp(integral + ki * error * dt, -max_integral, max_integral);
+	correction_ = std::clamp(kp * error + integral, -max_correction, max_correction);
+	return correction_;
+}
+
+void audio_drift_controller::reset()
+{
+	level = -1;
+	integral = 0;
+	correction_ = 0;
+}
+
+void audio_drift_estimator::add(int64_t timestamp, size_t num_frames)
+{
+	if (start == 0 or timestamp < last or timestamp - last > max_packet_interval)
+	{
+		start = timestamp;
+		last = timestamp;
+		frames = 0;
+		return;
+	}
+
+	// Frames of the first packet were produced before its timestamp
+	frames += num_frames;
+	last = timestamp;
+
+	int64_t elapsed = timestamp - start;
+	if (elapsed < min_estimation_duration)
+		return;
+
+	drift_ = std::clamp(frames / (elapsed * 1e-9 * sample_rate) - 1, -max_drift, max_drift);
+
+	if (elapsed > max_estimation_duration)
+	{
+		start = timestamp;
+		frames = 0;
+	}
+}
+
+} // namespace wivrn
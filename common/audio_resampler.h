@@ -0,0 +1,158 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compensation of the clock drift between the audio devices of the server
+// and of the headset: the side playing the audio received from the network
+// resamples it by a ratio very close to 1, so that its buffer stays at a
+// constant level instead of slowly growing or running dry.
+namespace wivrn
+{
+
+struct audio_sync_stats
+{
+	// Buffered audio, in seconds
+	float buffer_level;
+	// Relative speed of the remote audio clock
+	float drift;
+	// Additional speed correction to hold the buffer level
+	float correction;
+	// Audio playout delay minus video latency in seconds, NaN if not synchronized
+	float av_offset;
+};
+
+// Windowed sinc interpolation of 16 bit interleaved frames
+class audio_resampler
+{
+	size_t num_channels;
+	// Input frames, interleaved, the first ones are only kept for the filter history
+	std::vector<float> input;
+	// Position of the next output frame in input, in frames
+	double position;
+	// Input frames consumed for each output frame
+	double ratio = 1;
+
+	size_t input_frames() const
+	{
+		return input.size() / num_channels;
+	}
+
+public:
+	explicit audio_resampler(size_t num_channels);
+
+	size_t channels() const
+	{
+		return num_channels;
+	}
+
+	void set_ratio(double ratio)
+	{
+		this->ratio = ratio;
+	}
+
+	// Preallocates the input for this many buffered frames, so that push does
+	// not allocate on the audio thread
+	void reserve(size_t frames);
+
+	// frames: 16 bit native endian samples, interleaved
+	void push(std::span<const uint8_t> frames);
+
+	// Input frames that have not been consumed yet
+	double buffered() const;
+
+	// Returns the number of frames written, less than requested if there is not enough input
+	size_t pull(std::span<int16_t> frames);
+
+	void reset();
+};
+
+// Holds the level of a buffer, or the playout delay, at a target by adjusting
+// the playback speed
+class audio_drift_controller
+{
+	double target_;
+	double level = -1;
+	double integral = 0;
+	double correction_ = 0;
+
+public:
+	explicit audio_drift_controller(std::chrono::duration<double> target);
+
+	void set_target(std::chrono::duration<double> target)
+	{
+		target_ = target.count();
+	}
+
+	double target() const
+	{
+		return target_;
+	}
+
+	// level: buffered duration or delay in seconds
+	// dt: time since the previous update in seconds
+	// Returns the relative speed correction to apply on top of the estimated drift
+	double update(double level, double dt);
+
+	// Smoothed level in seconds
+	double measured() const
+	{
+		return level;
+	}
+
+	double correction() const
+	{
+		return correction_;
+	}
+
+	void reset();
+};
+
+// Estimates the rate of a stream from the timestamps of its packets, in the
+// clock of the receiver. Timestamps of the audio packets are converted to the
+// headset clock by the clock offset estimation, so the result is the drift of
+// the server audio clock compared with the headset one.
+class audio_drift_estimator
+{
+	uint32_t sample_rate;
+	int64_t start = 0;
+	int64_t last = 0;
+	uint64_t frames = 0;
+	double drift_ = 0;
+
+public:
+	explicit audio_drift_estimator(uint32_t sample_rate) :
+	        sample_rate(sample_rate) {}
+
+	// timestamp in nanoseconds, num_frames in the packet
+	void add(int64_t timestamp, size_t num_frames);
+
+	// Input frames per output frame, minus 1
+	double drift() const
+	{
+		return drift_;
+	}
+};
+
+} // namespace wivrn
@@ -0,0 +1,106 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "audio_resampler.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace wivrn;
+
+namespace
+{
+const double sample_rate = 48000;
+const size_t num_channels = 2;
+const size_t packet_frames = 480;
+const size_t pull_frames = 256;
+const double amplitude = 10000;
+// Output frames affected by the silent filter history
+const size_t skip_frames = 64;
+// Input frames after the last output frame, for the filter
+const size_t max_pending_frames = 16;
+
+double signal(size_t channel, double frame)
+{
+	double frequency = channel == 0 ? 1000 : 440;
+	return amplitude * std::sin(2 * M_PI * frequency * frame / sample_rate);
+}
+
+// Resamples a sine on each channel and compares the output to the expected
+// sine at the positions of the output frames, returns the worst SNR in dB
+double resample_snr(double ratio)
+{
+	audio_resampler resampler(num_channels);
+	resampler.set_ratio(ratio);
+	resampler.reserve(packet_frames + pull_frames);
+
+	const size_t input_frames = sample_rate;
+	std::vector<int16_t> output;
+	std::vector<int16_t> packet(packet_frames * num_channels);
+	std::vector<int16_t> pulled(pull_frames * num_channels);
+	for (size_t start = 0; start < input_frames; start += packet_frames)
+	{
+		for (size_t i = 0; i < packet_frames; i++)
+			for (size_t c = 0; c < num_channels; c++)
+				packet[i * num_channels + c] = std::lround(signal(c, start + i));
+		resampler.push(std::span((const uint8_t *)packet.data(), packet.size() * sizeof(int16_t)));
+
+		while (size_t count = resampler.pull(pulled))
+			output.insert(output.end(), pulled.begin(), pulled.begin() + count * num_channels);
+	}
+
+	size_t output_frames = output.size() / num_channels;
+	// All the input is consumed, except the frames needed by the filter
+	if (output_frames + max_pending_frames < input_frames / ratio)
+	{
+		fprintf(stderr, "ratio %f: %zu frames out of %zu\n", ratio, output_frames, input_frames);
+		return 0;
+	}
+
+	double snr = INFINITY;
+	for (size_t c = 0; c < num_channels; c++)
+	{
+		double signal_power = 0;
+		double noise_power = 0;
+		for (size_t i = skip_frames; i < output_frames; i++)
+		{
+			double expected = signal(c, i * ratio);
+			double error = output[i * num_channels + c] - expected;
+			signal_power += expected * expected;
+			noise_power += error * error;
+		}
+		snr = std::min(snr, 10 * std::log10(signal_power / noise_power));
+	}
+	return snr;
+}
+} // namespace
+
+int main()
+{
+	int result = 0;
+	for (double ratio: {1., 1.0005, 0.9995, 1.001})
+	{
+		double snr = resample_snr(ratio);
+		printf("ratio %.4f: SNR %.1f dB\n", ratio, snr);
+		// 16 bit quantization of the input and output limits the SNR to about 85 dB
+		if (snr < 75)
+			result = 1;
+	}
+	return result;
+}
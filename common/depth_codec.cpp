@@ -0,0 +1,84 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "depth_codec.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace wivrn::depth_codec
+{
+static uint16_t prediction(std::span<const uint16_t> values, size_t i, size_t width)
+{
+	if (i % width != 0)
+		return values[i - 1];
+	if (i >= width)
+		return values[i - width];
+	return 0;
+}
+
+uint16_t quantize(float distance, float min_distance)
+{
+	if (not(distance > 0))
+		return 0;
+	return std::lround(std::clamp(min_distance / distance, 0.f, 1.f) * 65535);
+}
+
+void encode(std::span<const uint16_t> values, size_t width, std::vector<uint8_t> & out)
+{
+	out.clear();
+	out.reserve(values.size() * 2);
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		int32_t diff = int32_t(values[i]) - prediction(values, i, width);
+		uint32_t zigzag = (uint32_t(diff) << 1) ^ uint32_t(diff >> 31);
+		while (zigzag >= 0x80)
+		{
+			out.push_back(0x80 | (zigzag & 0x7F));
+			zigzag >>= 7;
+		}
+		out.push_back(zigzag);
+	}
+}
+
+bool decode(std::span<const uint8_t> data, size_t width, std::span<uint16_t> values)
+{
+	auto it = data.begin();
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		uint32_t zigzag = 0;
+		for (int shift = 0;; shift += 7)
+		{
+			if (it == data.end() or shift > 14)
+				return false;
+			uint8_t byte = *it++;
+			zigzag |= uint32_t(byte & 0x7F) << shift;
+			if (not(byte & 0x80))
+				break;
+		}
+
+		int32_t diff = int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1);
+		int32_t value = prediction(values, i, width) + diff;
+		if (value < 0 or value > 0xFFFF)
+			return false;
+		values[i] = value;
+	}
+	return it == data.end();
+}
+} // namespace wivrn::depth_codec
@@ -0,0 +1,39 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compression of the depth grids for positional reprojection.
+// Distances are quantized as min_distance / distance on 16 bits, so that the
+// relative precision is the same at all distances and infinity is 0, then
+// each value is coded as the difference with its left neighbour (the value
+// above for the first column), zigzag and LEB128 encoded.
+namespace wivrn::depth_codec
+{
+uint16_t quantize(float distance, float min_distance);
+
+void encode(std::span<const uint16_t> values, size_t width, std::vector<uint8_t> & out);
+
+// Returns false if data does not contain exactly values.size() values
+bool decode(std::span<const uint8_t> data, size_t width, std::span<uint16_t> values);
+} // namespace wivrn::depth_codec
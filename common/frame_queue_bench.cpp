@@ -0,0 +1,239 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares the hand-off of decoded frames to the render thread, as done by
+// scenes::stream, with a mutex shared by all decoders and with one lossy
+// ring buffer per decoder. Decoder threads publish the same frames at a high
+// rate while the render thread selects a common frame, the time taken by
+// both is reported.
+// Not part of the build, compile from the repository root with
+// g++ -std=c++20 -O2 -pthread -Icommon common/frame_queue_bench.cpp
+
+#include "utils/lossy_ring_buffer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const size_t image_buffer_size = 3;
+const size_t num_streams = 3;
+const auto duration = std::chrono::seconds(5);
+// Time between frames of a decoder, and between frames of the render thread
+const int64_t decode_period = 1'000'000;
+const int64_t render_period = 500'000;
+
+struct frame
+{
+	uint64_t frame_index;
+	int64_t display_time;
+};
+
+int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void sleep_until(int64_t t)
+{
+	std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(t)));
+}
+
+struct timings
+{
+	std::vector<int64_t> values;
+
+	void add(int64_t begin)
+	{
+		values.push_back(now_ns() - begin);
+	}
+
+	void print(const char * name)
+	{
+		if (values.empty())
+			return;
+		std::ranges::sort(values);
+		auto percentile = [&](double p) { return values[std::min(values.size() - 1, size_t(p * values.size()))]; };
+		printf("  %-10s %9zu samples, p50 %6ldns, p99 %6ldns, p99.9 %7ldns, max %8ldns\n",
+		       name,
+		       values.size(),
+		       percentile(0.5),
+		       percentile(0.99),
+		       percentile(0.999),
+		       values.back());
+	}
+};
+
+using frames = std::array<std::shared_ptr<frame>, image_buffer_size>;
+
+// Previous implementation: all decoders and the render thread share frames_mutex
+struct locked
+{
+	std::shared_mutex decoder_mutex;
+	std::mutex frames_mutex;
+	std::array<frames, num_streams> latest_frames;
+
+	void push(size_t stream, std::shared_ptr<frame> f)
+	{
+		std::shared_lock lock(decoder_mutex);
+		std::unique_lock frame_lock(frames_mutex);
+		std::swap(f, latest_frames[stream][f->frame_index % image_buffer_size]);
+	}
+
+	std::optional<uint64_t> select(int64_t display_time)
+	{
+		std::shared_lock lock(decoder_mutex);
+		std::unique_lock frame_lock(frames_mutex);
+		thread_local std::vector<frame *> common_frames;
+		common_frames.clear();
+		for (const auto & h: latest_frames[0])
+			if (h)
+				common_frames.push_back(h.get());
+		for (size_t i = 1; i < num_streams; ++i)
+		{
+			std::erase_if(common_frames, [&](auto & left) {
+				return std::none_of(latest_frames[i].begin(), latest_frames[i].end(), [&](auto & right) {
+					return right and left->frame_index == right->frame_index;
+				});
+			});
+		}
+		if (common_frames.empty())
+			return std::nullopt;
+		auto min = std::ranges::min_element(common_frames, {}, [&](frame * f) { return std::abs(f->display_time - display_time); });
+		return (*min)->frame_index;
+	}
+};
+
+// Current implementation: one ring buffer per decoder, frames are only
+// moved to latest_frames by the render thread
+struct lock_free
+{
+	std::shared_mutex decoder_mutex;
+	std::array<std::unique_ptr<utils::lossy_ring_buffer<std::shared_ptr<frame>>>, num_streams> decoded_frames;
+	std::array<frames, num_streams> latest_frames;
+
+	lock_free()
+	{
+		for (auto & i: decoded_frames)
+			i = std::make_unique<utils::lossy_ring_buffer<std::shared_ptr<frame>>>(image_buffer_size);
+	}
+
+	void push(size_t stream, std::shared_ptr<frame> f)
+	{
+		std::shared_lock lock(decoder_mutex);
+		decoded_frames[stream]->write(std::move(f));
+	}
+
+	std::optional<uint64_t> select(int64_t display_time)
+	{
+		std::shared_lock lock(decoder_mutex);
+		for (size_t i = 0; i < num_streams; ++i)
+		{
+			while (auto f = decoded_frames[i]->read())
+			{
+				auto & slot = latest_frames[i][(*f)->frame_index % image_buffer_size];
+				if (not slot or slot->frame_index < (*f)->frame_index)
+					std::swap(slot, *f);
+				// The replaced frame is released by the decoder thread
+				if (*f)
+					decoded_frames[i]->recycle(std::move(*f));
+			}
+		}
+
+		std::optional<uint64_t> frame_index;
+		int64_t min_delta = std::numeric_limits<int64_t>::max();
+		for (size_t slot = 0; slot < image_buffer_size; ++slot)
+		{
+			const auto & candidate = latest_frames[0][slot];
+			if (not candidate)
+				continue;
+			if (not std::all_of(latest_frames.begin() + 1, latest_frames.end(), [&](const frames & i) {
+				    return i[slot] and i[slot]->frame_index == candidate->frame_index;
+			    }))
+				continue;
+			int64_t delta = std::abs(candidate->display_time - display_time);
+			if (delta < min_delta)
+			{
+				min_delta = delta;
+				frame_index = candidate->frame_index;
+			}
+		}
+		return frame_index;
+	}
+};
+
+template <typename T>
+void run(const char * name)
+{
+	T impl;
+	std::array<timings, num_streams> push_timings;
+	timings select_timings;
+	uint64_t found = 0;
+
+	const int64_t start = now_ns();
+	{
+		// Decoders are stopped when leaving the scope
+		std::vector<std::jthread> decoders;
+		for (size_t stream = 0; stream < num_streams; ++stream)
+		{
+			decoders.emplace_back([&, stream](std::stop_token stop) {
+				for (uint64_t i = 0; not stop.stop_requested(); ++i)
+				{
+					// All decoders produce frame i at the same time
+					sleep_until(start + i * decode_period);
+					auto f = std::make_shared<frame>(i, start + i * decode_period);
+					auto begin = now_ns();
+					impl.push(stream, std::move(f));
+					push_timings[stream].add(begin);
+				}
+			});
+		}
+
+		auto end = std::chrono::steady_clock::now() + duration;
+		while (std::chrono::steady_clock::now() < end)
+		{
+			auto begin = now_ns();
+			found += bool(impl.select(begin));
+			select_timings.add(begin);
+			sleep_until(begin + render_period);
+		}
+	}
+
+	printf("%s: common frame found %lu/%zu times\n", name, found, select_timings.values.size());
+	timings all_push;
+	for (auto & t: push_timings)
+		all_push.values.insert(all_push.values.end(), t.values.begin(), t.values.end());
+	all_push.print("decoder");
+	select_timings.print("render");
+}
+} // namespace
+
+int main()
+{
+	run<locked>("mutex");
+	run<lock_free>("ring buffer");
+}
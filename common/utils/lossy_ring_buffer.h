@@ -0,0 +1,152 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace utils
+{
+
+// single writer/single reader ring buffer, lock free and without allocation
+// The writer never waits for the reader: when the buffer is full, the oldest
+// value that was not read is given back to the writer.
+// Values are not always read in the order they were written.
+// The reader can hand values it no longer needs back to the writer with
+// recycle(), so that they are destroyed on the writer thread.
+//
+// Values are stored in a preallocated pool, slots hold the index of a pool
+// entry. Each pool entry is owned by exactly one of: a slot, the writer (its
+// spare entry), the reader (at most two while reading), or the list of free
+// entries the reader gives back to the writer. With capacity + 3 entries the
+// writer always finds a free one.
+template <typename T>
+class lossy_ring_buffer
+{
+	static constexpr uint32_t empty = uint32_t(-1);
+
+	const size_t capacity;
+	const uint32_t pool_size;
+	std::unique_ptr<T[]> pool;
+	// index in pool, or empty if the value was read or given back
+	std::unique_ptr<std::atomic<uint32_t>[]> slots;
+	// number of values written, only modified by the writer
+	std::atomic<size_t> write_count = 0;
+	// only used by the reader
+	size_t read_count = 0;
+
+	// Entries released by the reader, single producer (reader) single consumer (writer)
+	// They may hold a recycled value, destroyed when the writer reuses the entry.
+	std::unique_ptr<std::atomic<uint32_t>[]> free_entries;
+	std::atomic<size_t> free_push = 0;
+	// only used by the writer
+	size_t free_pop = 0;
+	uint32_t spare = 0;
+	// entry of the last value read, for recycle, only used by the reader
+	uint32_t held = empty;
+
+	void release(uint32_t entry)
+	{
+		size_t push = free_push.load(std::memory_order_relaxed);
+		free_entries[push % pool_size].store(entry, std::memory_order_relaxed);
+		free_push.store(push + 1, std::memory_order_release);
+	}
+
+public:
+	explicit lossy_ring_buffer(size_t capacity) :
+	        capacity(capacity),
+	        pool_size(capacity + 3),
+	        pool(new T[pool_size]),
+	        slots(new std::atomic<uint32_t>[capacity]),
+	        free_entries(new std::atomic<uint32_t>[pool_size])
+	{
+		for (size_t i = 0; i < capacity; ++i)
+			slots[i] = empty;
+		// The writer starts with entry 0, all others are free
+		for (uint32_t i = 1; i < pool_size; ++i)
+			free_entries[i - 1] = i;
+		free_push = pool_size - 1;
+	}
+
+	lossy_ring_buffer(const lossy_ring_buffer &) = delete;
+	lossy_ring_buffer & operator=(const lossy_ring_buffer &) = delete;
+
+	// Returns the value that was replaced if it was not read
+	std::optional<T> write(T && t)
+	{
+		pool[spare] = std::move(t);
+		size_t index = write_count.load(std::memory_order_relaxed);
+		uint32_t previous = slots[index % capacity].exchange(spare, std::memory_order_acq_rel);
+		write_count.store(index + 1, std::memory_order_release);
+
+		if (previous != empty)
+		{
+			// The replaced entry becomes the spare one
+			spare = previous;
+			return std::move(pool[spare]);
+		}
+
+		// Never empty: at most capacity entries are in slots and two are held by the reader.
+		// Acquire so that the reader is done with the entry.
+		[[maybe_unused]] size_t pushed = free_push.load(std::memory_order_acquire);
+		assert(pushed > free_pop);
+		spare = free_entries[free_pop++ % pool_size].load(std::memory_order_relaxed);
+		return {};
+	}
+
+	std::optional<T> read()
+	{
+		size_t written = write_count.load(std::memory_order_acquire);
+		// Older values were overwritten
+		if (written - read_count > capacity)
+			read_count = written - capacity;
+
+		while (read_count < written)
+		{
+			uint32_t entry = slots[read_count++ % capacity].exchange(empty, std::memory_order_acq_rel);
+			if (entry == empty)
+				continue;
+
+			std::optional<T> t = std::move(pool[entry]);
+			// Keep the entry for the next recycled value
+			if (held != empty)
+				release(held);
+			held = entry;
+			return t;
+		}
+		return {};
+	}
+
+	// Called by the reader after read(), the value is destroyed by the writer.
+	// Only one value can be recycled per value read, others are left to the caller.
+	void recycle(T && t)
+	{
+		if (held == empty)
+			return;
+		pool[held] = std::move(t);
+		release(held);
+		held = empty;
+	}
+};
+
+} // namespace utils
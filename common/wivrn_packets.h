@@ -86,6 +86,24 @@ enum video_codec
 	av1,
 };
 
+enum class frame_drop_policy : uint8_t
+{
+	// Frames stay in the queue until newer frames push them out
+	drop_oldest,
+	// Frames are also discarded once their display time has passed, if a
+	// newer frame is available
+	drop_late,
+};
+
+// Queue of decoded frames on the headset, waiting to be displayed
+struct decode_queue_settings
+{
+	static constexpr uint8_t max_depth = 8;
+
+	uint8_t depth;
+	frame_drop_policy drop_policy;
+};
+
 struct audio_data
 {
 	XrTime timestamp;
@@ -115,6 +133,7 @@ struct headset_info_packet
 	bool face_tracking2_fb;
 	bool palm_pose;
 	std::vector<video_codec> supported_codecs; // from preferred to least preferred
+	decode_queue_settings decode_queue;        // requested by the user, the server may override it
 };
 
 struct handshake
@@ -162,7 +181,7 @@ struct tracking
 	uint8_t state_flags;
 
 	std::array<view, 2> views;
-	std::vector<pose> device_poses;
+	vector_view<pose> device_poses;
 
 	struct fb_face2
 	{
@@ -242,7 +261,14 @@ struct feedback
 	XrTime blitted;
 	XrTime displayed;
 
+	// Time spent in the queue of decoded frames, until the frame was first
+	// blitted or discarded
+	XrDuration queue_time;
+
 	uint8_t times_displayed;
+
+	// The frame was a recovery point and was decoded
+	bool recovered;
 };
 
 struct battery
@@ -252,7 +278,25 @@ struct battery
 	bool charging;
 };
 
-using packets = std::variant<headset_info_packet, feedback, audio_data, handshake, tracking, trackings, hand_tracking, inputs, timesync_response, battery>;
+// Request retransmission of video shards that were not received
+struct video_nack
+{
+	uint8_t stream_index;
+	uint64_t frame_index;
+	std::vector<uint16_t> shards;
+	// The end of the frame was not received, all shards from this index are missing
+	std::optional<uint16_t> missing_from;
+};
+
+// Sent as soon as a frame is complete, if no frame was lost since the last
+// recovery point: the frame can be used as a reference to recover from a later loss
+struct video_ack
+{
+	uint8_t stream_index;
+	uint64_t frame_index;
+};
+
+using packets = std::variant<headset_info_packet, feedback, audio_data, handshake, tracking, trackings, hand_tracking, inputs, timesync_response, battery, video_nack, video_ack>;
 } // namespace from_headset
 
 namespace to_headset
@@ -303,12 +347,23 @@ struct video_stream_description
 		video_codec codec;
 		std::optional<VkSamplerYcbcrRange> range;
 		std::optional<VkSamplerYcbcrModelConversion> color_model;
+		// The headset sends a video_ack for each frame received since the last recovery point
+		bool ack_frames = false;
 	};
 	uint16_t width;
 	uint16_t height;
 	float fps;
 	std::array<foveation_parameter, 2> foveation;
 	std::vector<item> items;
+	decode_queue_settings decode_queue;
+
+	// Size of the depth grid of each view, if depth is streamed
+	struct depth_grid
+	{
+		uint16_t width;
+		uint16_t height;
+	};
+	std::optional<depth_grid> depth;
 };
 
 class video_stream_data_shard
@@ -320,6 +375,8 @@ public:
 		start_of_slice = 1,
 		end_of_slice = 1 << 1,
 		end_of_frame = 1 << 2,
+		// Picture is fully refreshed after this frame, on first shard
+		recovery_point = 1 << 3,
 	};
 	// Identifier of stream in video_stream_description
 	uint8_t stream_item_idx;
@@ -391,7 +448,21 @@ struct tracking_control
 	std::array<bool, size_t(id::last) + 1> enabled;
 };
 
-using packets = std::variant<handshake, audio_stream_description, video_stream_description, audio_data, video_stream_data_shard, haptics, timesync_query, tracking_control>;
+// Low resolution depth of a video frame, for positional reprojection
+struct video_stream_depth
+{
+	// Same as the video shards of the frame
+	uint64_t frame_idx;
+	// Size of the grid for each view
+	uint16_t width;
+	uint16_t height;
+	// Distance in meters matching the maximum quantized value
+	float min_distance;
+	// Both views, encoded with depth_codec
+	std::vector<uint8_t> data;
+};
+
+using packets = std::variant<handshake, audio_stream_description, video_stream_description, audio_data, video_stream_data_shard, haptics, timesync_query, tracking_control, video_stream_depth>;
 
 } // namespace to_headset
 
@@ -22,6 +22,7 @@
 #include "boost/pfr/core.hpp"
 #include "boost/pfr/tuple_size.hpp"
 #include <array>
+#include <atomic>
 #include <boost/pfr.hpp>
 #include <chrono>
 #include <cstddef>
@@ -144,6 +145,32 @@ public:
 		serialization_traits<T>::serialize(value, *this);
 	}
 
+	size_t size() const
+	{
+		size_t size = buffer.size();
+		for (const auto & span: spans)
+		{
+			if (auto s = std::get_if<std::span<uint8_t>>(&span))
+				size += s->size();
+		}
+		return size;
+	}
+
+	// Copy referenced data in the packet, so that it can be sent later
+	void detach()
+	{
+		if (spans.size() == 1)
+			return;
+
+		thread_local std::vector<uint8_t> data;
+		data.clear();
+		for (const auto & span: operator const std::vector<std::span<uint8_t>> &())
+			data.insert(data.end(), span.begin(), span.end());
+		buffer.swap(data);
+		spans.clear();
+		spans.push_back({buffer.size()});
+	}
+
 	operator const std::vector<std::span<uint8_t>> *()
 	{
 		return &this->operator const std::vector<std::span<uint8_t>> &();
@@ -230,6 +257,54 @@ public:
 	{
 		return std::move(memory);
 	}
+
+	std::shared_ptr<uint8_t[]> share_buffer() const
+	{
+		return memory;
+	}
+};
+
+// Memory for deserialized elements that cannot reference the packet
+// Blocks are reused once no element references them anymore
+class deserialization_arena
+{
+	static constexpr size_t block_size = 64 * 1024;
+	std::shared_ptr<uint8_t[]> block;
+	size_t used = 0;
+
+public:
+	// The memory is valid as long as the returned pointer is held
+	std::pair<std::shared_ptr<const void>, void *> allocate(size_t size, size_t alignment)
+	{
+		if (size > block_size)
+		{
+			std::shared_ptr<uint8_t[]> memory(new uint8_t[size]);
+			return {memory, memory.get()};
+		}
+
+		if (block and block.use_count() == 1)
+		{
+			// synchronize with the release of the last reference
+			std::atomic_thread_fence(std::memory_order_acquire);
+			used = 0;
+		}
+
+		size_t offset = (used + alignment - 1) / alignment * alignment;
+		if (not block or offset + size > block_size)
+		{
+			block.reset(new uint8_t[block_size]);
+			offset = 0;
+		}
+
+		used = offset + size;
+		return {block, block.get() + offset};
+	}
+
+	static deserialization_arena & thread_instance()
+	{
+		thread_local deserialization_arena arena;
+		return arena;
+	}
 };
 
 namespace details
@@ -623,6 +698,83 @@ struct serialization_traits<std::vector<T>>
 	}
 };
 
+template <typename T>
+struct serialization_traits<vector_view<T>>
+{
+	static constexpr void type_hash(details::hash_context & h)
+	{
+		serialization_traits<std::vector<T>>::type_hash(h);
+	}
+
+	static void serialize(const vector_view<T> & value, serialization_packet & packet)
+	{
+		packet.serialize<uint16_t>(value.size());
+
+		if constexpr (serialization_traits<T>::is_trivially_serializable())
+		{
+			packet.write(std::span((uint8_t *)value.data(), value.size() * sizeof(T)));
+		}
+		else
+		{
+			for (const T & i: value)
+				packet.serialize<T>(i);
+		}
+	}
+
+	static vector_view<T> deserialize(deserialization_packet & packet)
+	{
+		size_t size = packet.deserialize<uint16_t>();
+
+		if constexpr (serialization_traits<T>::is_trivially_serializable())
+		{
+			auto bytes = packet.read_span(size * sizeof(T));
+
+			// Reference the packet directly when it is suitably aligned
+			if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) == 0)
+				return {packet.share_buffer(), std::span((const T *)bytes.data(), size)};
+
+			auto [memory, data] = deserialization_arena::thread_instance().allocate(bytes.size(), alignof(T));
+			memcpy(data, bytes.data(), bytes.size());
+			return {std::move(memory), std::span((const T *)data, size)};
+		}
+		else if constexpr (std::is_trivially_copyable_v<T> and std::is_trivially_destructible_v<T>)
+		{
+			// Padding prevents referencing the packet, but elements can be
+			// stored in the arena
+			auto [memory, data] = deserialization_arena::thread_instance().allocate(size * sizeof(T), alignof(T));
+			T * items = (T *)data;
+			for (size_t i = 0; i < size; i++)
+				new (items + i) T(packet.deserialize<T>());
+			return {std::move(memory), std::span((const T *)items, size)};
+		}
+		else
+		{
+			std::vector<T> value;
+			value.reserve(size);
+			for (size_t i = 0; i < size; i++)
+				value.emplace_back(packet.deserialize<T>());
+			return value;
+		}
+	}
+	static bool consteval is_trivially_serializable()
+	{
+		return false;
+	}
+
+	static size_t size(const vector_view<T> & value)
+	{
+		if constexpr (serialization_traits<T>::is_trivially_serializable())
+			return sizeof(uint16_t) + value.size() * sizeof(T);
+		else
+		{
+			size_t res = sizeof(uint16_t);
+			for (const auto & item: value)
+				res += serialized_size(item);
+			return res;
+		}
+	}
+};
+
 template <typename T>
 struct serialization_traits<std::optional<T>>
 {
@@ -829,18 +981,19 @@ struct serialization_traits<std::span<uint8_t>>
 {
 	static constexpr void type_hash(details::hash_context & h)
 	{
-		h.feed("span<uint8_t>");
+		// 32 bits size: whole video slices are sent in a single span over TCP
+		h.feed("span32<uint8_t>");
 	}
 
 	static void serialize(const std::span<uint8_t> & value, serialization_packet & packet)
 	{
-		packet.serialize<uint16_t>(value.size());
+		packet.serialize<uint32_t>(value.size());
 		packet.write(value);
 	}
 
 	static std::span<uint8_t> deserialize(deserialization_packet & packet)
 	{
-		size_t size = packet.deserialize<uint16_t>();
+		size_t size = packet.deserialize<uint32_t>();
 		return packet.read_span(size);
 	}
 	static bool consteval is_trivially_serializable()
@@ -849,7 +1002,7 @@ struct serialization_traits<std::span<uint8_t>>
 	}
 	static size_t size(const std::span<uint8_t> & x)
 	{
-		return 1 + x.size_bytes();
+		return sizeof(uint32_t) + x.size_bytes();
 	}
 };
 
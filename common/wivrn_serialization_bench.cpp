@@ -0,0 +1,147 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures time and allocations to deserialize tracking packets
+// Not part of the build, compile with:
+//   g++ -std=c++20 -O2 -Icommon -I<boost pfr>/include common/wivrn_serialization_bench.cpp
+
+#include "wivrn_packets.h"
+#include "wivrn_serialization.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+using namespace wivrn;
+
+namespace
+{
+std::atomic<size_t> allocations;
+
+// Same wire format as from_headset::tracking, with owning vectors
+struct vector_tracking
+{
+	XrTime production_timestamp;
+	XrTime timestamp;
+	XrViewStateFlags view_flags;
+	uint8_t state_flags;
+	std::array<from_headset::tracking::view, 2> views;
+	std::vector<from_headset::tracking::pose> device_poses;
+	std::optional<from_headset::tracking::fb_face2> face;
+};
+
+struct vector_trackings
+{
+	std::vector<vector_tracking> items;
+};
+
+static_assert(serialization_type_hash<vector_trackings>() == serialization_type_hash<from_headset::trackings>());
+
+deserialization_packet make_packet()
+{
+	from_headset::trackings trackings;
+	for (int i = 0; i < 5; ++i)
+	{
+		std::vector<from_headset::tracking::pose> poses;
+		for (int j = 0; j < 7; ++j)
+			poses.push_back({.device = device_id(j), .flags = 0xff});
+
+		trackings.items.push_back({
+		        .production_timestamp = 1,
+		        .timestamp = 1 + i * 10'000'000,
+		        .device_poses = std::move(poses),
+		});
+	}
+
+	serialization_packet packet;
+	packet.serialize(trackings);
+
+	size_t size = 0;
+	const std::vector<std::span<uint8_t>> & spans = packet;
+	for (const auto & span: spans)
+		size += span.size();
+
+	std::shared_ptr<uint8_t[]> memory(new uint8_t[size]);
+	size_t offset = 0;
+	for (const auto & span: spans)
+	{
+		memcpy(memory.get() + offset, span.data(), span.size());
+		offset += span.size();
+	}
+	return deserialization_packet(memory, std::span(memory.get(), size));
+}
+
+template <typename T>
+void run(const char * name, const deserialization_packet & packet)
+{
+	const int iterations = 100'000;
+	size_t poses = 0;
+
+	// warm up the arena
+	for (int i = 0; i < 100; ++i)
+	{
+		auto copy = packet;
+		copy.deserialize<T>();
+	}
+
+	size_t allocations_before = allocations;
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		auto copy = packet;
+		T value = copy.deserialize<T>();
+		for (const auto & item: value.items)
+			poses += item.device_poses.size();
+	}
+	std::chrono::duration<double, std::nano> duration = std::chrono::steady_clock::now() - begin;
+
+	printf("%-14s %8.1fns/packet %6.2f allocations/packet (%zu poses)\n",
+	       name,
+	       duration.count() / iterations,
+	       double(allocations - allocations_before) / iterations,
+	       poses / iterations);
+}
+} // namespace
+
+void * operator new(size_t size)
+{
+	++allocations;
+	if (void * p = std::malloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	std::free(p);
+}
+
+int main()
+{
+	auto packet = make_packet();
+	run<vector_trackings>("std::vector", packet);
+	run<from_headset::trackings>("vector_view", packet);
+}
@@ -20,6 +20,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <span>
+#include <vector>
 
 namespace wivrn
 {
@@ -37,4 +39,67 @@ struct data_holder
 	std::shared_ptr<uint8_t[]> c;
 };
 
+// Read-only sequence, serialized as a std::vector
+// When deserialized, elements reference the packet memory if possible,
+// or a per-thread arena, instead of a dedicated allocation
+template <typename T>
+class vector_view
+{
+	std::vector<T> storage;
+	// keeps referenced memory alive
+	std::shared_ptr<const void> memory;
+	std::span<const T> items;
+
+public:
+	vector_view() = default;
+	vector_view(std::vector<T> value) :
+	        storage(std::move(value)), items(storage) {}
+	vector_view(std::shared_ptr<const void> memory, std::span<const T> items) :
+	        memory(std::move(memory)), items(items) {}
+
+	vector_view(const vector_view & other) :
+	        storage(other.storage),
+	        memory(other.memory),
+	        items(storage.empty() ? other.items : std::span<const T>(storage)) {}
+	vector_view(vector_view && other) :
+	        storage(std::move(other.storage)),
+	        memory(std::move(other.memory)),
+	        items(storage.empty() ? other.items : std::span<const T>(storage))
+	{
+		other.items = {};
+	}
+	vector_view & operator=(vector_view other)
+	{
+		storage = std::move(other.storage);
+		memory = std::move(other.memory);
+		items = storage.empty() ? other.items : std::span<const T>(storage);
+		return *this;
+	}
+
+	auto begin() const
+	{
+		return items.begin();
+	}
+	auto end() const
+	{
+		return items.end();
+	}
+	const T * data() const
+	{
+		return items.data();
+	}
+	size_t size() const
+	{
+		return items.size();
+	}
+	bool empty() const
+	{
+		return items.empty();
+	}
+	const T & operator[](size_t i) const
+	{
+		return items[i];
+	}
+};
+
 } // namespace wivrn
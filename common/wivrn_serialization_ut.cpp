@@ -41,6 +41,7 @@ static_assert(serialization_type_hash<double>() == hash("float64"));
 static_assert(serialization_type_hash<std::chrono::nanoseconds>() == hash("duration<int64,1/1000000000>"));
 static_assert(serialization_type_hash<std::optional<int>>() == hash("optional<int32>"));
 static_assert(serialization_type_hash<std::vector<int>>() == hash("vector<int32>"));
+static_assert(serialization_type_hash<vector_view<int>>() == hash("vector<int32>"));
 static_assert(serialization_type_hash<std::array<int, 42>>() == hash("array<int32,42>"));
 static_assert(serialization_type_hash<std::string>() == hash("string"));
 static_assert(serialization_type_hash<std::variant<int, float>>() == hash("variant<int32,float32>"));
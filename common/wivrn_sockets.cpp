@@ -19,6 +19,11 @@
 
 #include "wivrn_sockets.h"
 
+#if WIVRN_USE_IO_URING
+#include "wivrn_uring.h"
+#endif
+
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cassert>
 #include <memory>
@@ -66,6 +71,11 @@ wivrn::UDP::UDP(const bool ipv4)
 
 	if (fd < 0)
 		throw std::system_error{errno, std::generic_category()};
+
+#if WIVRN_USE_IO_URING
+	if (uring_udp::enabled())
+		uring = uring_udp::create(fd);
+#endif
 }
 
 wivrn::UDP::UDP(int fd)
@@ -73,6 +83,19 @@ wivrn::UDP::UDP(int fd)
 	this->fd = fd;
 }
 
+wivrn::UDP::UDP(UDP &&) = default;
+wivrn::UDP & wivrn::UDP::operator=(UDP &&) = default;
+wivrn::UDP::~UDP() = default;
+
+int wivrn::UDP::poll_fd() const
+{
+#if WIVRN_USE_IO_URING
+	if (uring)
+		return uring->poll_fd();
+#endif
+	return fd;
+}
+
 void wivrn::UDP::bind(int port)
 {
 	sockaddr_in6 bind_addr{};
@@ -144,6 +167,12 @@ void wivrn::UDP::set_send_buffer_size(int size)
 	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
 }
 
+void wivrn::UDP::set_max_pacing_rate(uint64_t rate)
+{
+	if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == -1)
+		throw std::system_error{errno, std::generic_category()};
+}
+
 void wivrn::UDP::set_tos(int tos)
 {
 	int err = setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
@@ -162,6 +191,13 @@ void wivrn::TCP::init()
 		throw std::system_error{errno, std::generic_category()};
 	}
 
+	// Only queue what is needed to keep the link busy, so that data is
+	// not delayed behind a large kernel buffer, e.g. with adb forwarding
+#ifdef TCP_NOTSENT_LOWAT
+	int lowat = 128 * 1024;
+	setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
+
 	#ifndef MSG_NOSIGNAL
 	int nosigpipe = 1;
 	if (setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe)) < 0)
@@ -329,6 +365,24 @@ wivrn::deserialization_packet wivrn::UDP::receive_raw()
 		return deserialization_packet{buffer, span};
 	}
 
+#if WIVRN_USE_IO_URING
+	if (uring)
+	{
+		uring->receive(buffer, messages);
+		if (messages.empty())
+			return {};
+
+		for (const auto & message: messages)
+			bytes_received_ += message.size();
+
+		// messages are popped from the back
+		std::reverse(messages.begin(), messages.end());
+		auto span = messages.back();
+		messages.pop_back();
+		return deserialization_packet{buffer, span};
+	}
+#endif
+
 	static const size_t message_size = 2048;
 	static const size_t num_messages = 20;
 #if defined(__cpp_lib_smart_ptr_for_overwrite) && __cpp_lib_smart_ptr_for_overwrite >= 202002L
@@ -371,6 +425,8 @@ wivrn::deserialization_packet wivrn::UDP::receive_raw()
 		bytes_received_ += mmsgs[i].msg_len;
 	}
 
+	bytes_received_ += mmsgs[0].msg_len;
+
 	return deserialization_packet{buffer, std::span(buffer.get(), mmsgs[0].msg_len)};
 }
 
@@ -423,38 +479,100 @@ void wivrn::UDP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *
 		        });
 		i += message->size();
 	}
+
+#if WIVRN_USE_IO_URING
+	if (uring)
+	{
+		bytes_sent_ += uring->send(mmsgs);
+		return;
+	}
+#endif
+
 	// sendmmsg may not send all messages, just consider them as lost for UDP
-	if (sendmmsg(fd, mmsgs.data(), mmsgs.size(), 0) < 0)
+	int sent = sendmmsg(fd, mmsgs.data(), mmsgs.size(), 0);
+	if (sent < 0)
 		throw std::system_error{errno, std::generic_category()};
+
+	for (int n = 0; n < sent; ++n)
+		bytes_sent_ += mmsgs[n].msg_len;
 }
 
-wivrn::deserialization_packet wivrn::TCP::receive_raw()
+namespace
+{
+// Messages are prefixed with their size as a LEB128 varint: 1 or 2 bytes
+// for control packets, 3 bytes for whole video slices up to 2MB
+const size_t max_header_size = 5;
+
+// Reads are done in large chunks so that many messages are parsed per syscall
+const size_t tcp_buffer_size = 1024 * 1024;
+
+struct frame_header
 {
-	ssize_t expected_size;
+	std::array<uint8_t, max_header_size> bytes;
+	uint8_t size = 0;
 
-	if (data.size_bytes() < sizeof(uint16_t))
+	frame_header() = default;
+	frame_header(size_t payload_size)
 	{
-		expected_size = sizeof(uint16_t) - data.size_bytes();
+		do
+		{
+			uint8_t byte = payload_size & 0x7f;
+			payload_size >>= 7;
+			bytes[size++] = byte | (payload_size ? 0x80 : 0);
+		} while (payload_size);
 	}
-	else
+};
+
+// Returns the header size and payload size, or nothing if the header is incomplete
+std::optional<std::pair<size_t, size_t>> parse_header(std::span<uint8_t> data)
+{
+	size_t payload_size = 0;
+	for (size_t i = 0; i < std::min(data.size(), max_header_size); ++i)
 	{
-		uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
-		expected_size = payload_size + sizeof(uint16_t) - data.size_bytes();
+		payload_size |= size_t(data[i] & 0x7f) << (7 * i);
+		if ((data[i] & 0x80) == 0)
+		{
+			if (payload_size == 0)
+				throw std::runtime_error("Invalid packet: 0 size");
+			return std::make_pair(i + 1, payload_size);
+		}
 	}
 
-	if (expected_size > capacity_left)
+	if (data.size() >= max_header_size)
+		throw std::runtime_error("Invalid packet: size header too long");
+
+	return std::nullopt;
+}
+} // namespace
+
+wivrn::deserialization_packet wivrn::TCP::receive_raw()
+{
+	size_t expected_size = 1;
+	if (auto header = parse_header(data))
+		expected_size = header->first + header->second - data.size_bytes();
+
+	if (expected_size > capacity_left or capacity_left < tcp_buffer_size / 16)
 	{
-		size_t new_size = std::max<size_t>(data.size_bytes() + expected_size,
-		                                   4096);
-		auto old = std::move(buffer);
+		size_t new_size = std::max(data.size_bytes() + expected_size, tcp_buffer_size);
+		if (buffer and buffer.use_count() == 1 and new_size <= buffer_size)
+		{
+			// No packet references the buffer anymore, reuse it
+			std::atomic_thread_fence(std::memory_order_acquire);
+			memmove(buffer.get(), data.data(), data.size_bytes());
+		}
+		else
+		{
+			auto old = std::move(buffer);
 #if defined(__cpp_lib_smart_ptr_for_overwrite) && __cpp_lib_smart_ptr_for_overwrite >= 202002L
-		buffer = std::make_shared_for_overwrite<uint8_t[]>(new_size);
+			buffer = std::make_shared_for_overwrite<uint8_t[]>(new_size);
 #else
-		buffer.reset(new uint8_t[new_size]);
+			buffer.reset(new uint8_t[new_size]);
 #endif
-		memcpy(buffer.get(), data.data(), data.size_bytes());
+			buffer_size = new_size;
+			memcpy(buffer.get(), data.data(), data.size_bytes());
+		}
 		data = std::span(buffer.get(), data.size());
-		capacity_left = new_size - data.size_bytes();
+		capacity_left = buffer_size - data.size_bytes();
 	}
 
 	ssize_t received = recv(fd, &*data.end(), capacity_left, MSG_DONTWAIT);
@@ -469,35 +587,22 @@ wivrn::deserialization_packet wivrn::TCP::receive_raw()
 
 	data = std::span(data.data(), data.size() + received);
 	capacity_left -= received;
-	if (data.size_bytes() < sizeof(uint16_t))
-		return {};
-
-	uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
-	if (payload_size == 0)
-		throw std::runtime_error("Invalid packet: 0 size");
-
-	if (data.size_bytes() < sizeof(uint16_t) + payload_size)
-		return {};
 
-	auto span = data.subspan(sizeof(uint16_t), payload_size);
-	data = data.subspan(sizeof(uint16_t) + payload_size);
-	return deserialization_packet{buffer, span};
+	return receive_pending();
 }
 
 wivrn::deserialization_packet wivrn::TCP::receive_pending()
 {
-	if (data.size_bytes() < sizeof(uint16_t))
+	auto header = parse_header(data);
+	if (not header)
 		return {};
 
-	uint32_t payload_size = *reinterpret_cast<uint16_t *>(data.data());
-	if (payload_size == 0)
-		throw std::runtime_error("Invalid packet: 0 size");
-
-	if (data.size_bytes() < sizeof(uint16_t) + payload_size)
+	auto [header_size, payload_size] = *header;
+	if (data.size_bytes() < header_size + payload_size)
 		return {};
 
-	auto span = data.subspan(sizeof(uint16_t), payload_size);
-	data = data.subspan(sizeof(uint16_t) + payload_size);
+	auto span = data.subspan(header_size, payload_size);
+	data = data.subspan(header_size + payload_size);
 	return deserialization_packet{buffer, span};
 }
 
@@ -506,75 +611,44 @@ void wivrn::TCP::send_raw(const std::vector<std::span<uint8_t>> & spans)
 	thread_local std::vector<iovec> iovecs;
 	iovecs.clear();
 
-	uint16_t size = 0;
-	iovecs.push_back({&size, sizeof(size)});
+	size_t size = 0;
 	for (const auto & span: spans)
-	{
 		size += span.size_bytes();
-		iovecs.push_back({span.data(), span.size_bytes()});
-	}
-
-	msghdr hdr{
-	        .msg_name = nullptr,
-	        .msg_namelen = 0,
-	        .msg_iov = iovecs.data(),
-	        .msg_iovlen = static_cast<decltype(msghdr::msg_iovlen)>(iovecs.size()),
-	        .msg_control = nullptr,
-	        .msg_controllen = 0,
-	        .msg_flags = 0,
-	};
-
-	std::lock_guard lock(*mutex);
-	while (true)
-	{
-		const auto & data = spans[0];
-		#ifdef MSG_NOSIGNAL
-		ssize_t sent = ::sendmsg(fd, &hdr, MSG_NOSIGNAL);
-		#else
-		ssize_t sent = ::sendmsg(fd, &hdr, 0);
-		#endif
-
-		if (sent == 0)
-			throw socket_shutdown{};
-
-		if (sent < 0)
-			throw std::system_error{errno, std::generic_category()};
 
-		bytes_sent_ += sent;
+	frame_header header(size);
+	iovecs.push_back({header.bytes.data(), header.size});
+	for (const auto & span: spans)
+		iovecs.push_back({span.data(), span.size_bytes()});
 
-		// iov fully consumed
-		while (hdr.msg_iovlen > 0 and sent >= hdr.msg_iov[0].iov_len)
-		{
-			sent -= hdr.msg_iov[0].iov_len;
-			++hdr.msg_iov;
-			--hdr.msg_iovlen;
-		}
-		if (hdr.msg_iovlen == 0)
-			return;
-		hdr.msg_iov[0].iov_base = (void *)((uintptr_t)hdr.msg_iov[0].iov_base + sent);
-		hdr.msg_iov[0].iov_len -= sent;
-	}
+	send_iovecs(iovecs);
 }
 
 void wivrn::TCP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *> data)
 {
 	thread_local std::vector<iovec> iovecs;
-	thread_local std::vector<uint16_t> sizes;
+	thread_local std::vector<frame_header> headers;
 	iovecs.clear();
-	sizes.clear();
+	headers.clear();
 
-	sizes.reserve(data.size());
+	// iovecs point to the headers, they must not be reallocated
+	headers.reserve(data.size());
 	for (const auto & spans: data)
 	{
-		auto & size = sizes.emplace_back(0);
-		iovecs.emplace_back(&size, sizeof(size));
+		size_t size = 0;
 		for (const auto & span: *spans)
-		{
 			size += span.size_bytes();
-			iovecs.emplace_back(span.data(), span.size_bytes());
-		}
+
+		auto & header = headers.emplace_back(size);
+		iovecs.push_back({header.bytes.data(), header.size});
+		for (const auto & span: *spans)
+			iovecs.push_back({span.data(), span.size_bytes()});
 	}
 
+	send_iovecs(iovecs);
+}
+
+void wivrn::TCP::send_iovecs(std::span<iovec> iovecs)
+{
 	msghdr hdr{
 	        .msg_name = nullptr,
 	        .msg_namelen = 0,
@@ -588,7 +662,11 @@ void wivrn::TCP::send_many_raw(std::span<const std::vector<std::span<uint8_t>> *
 	std::lock_guard lock(*mutex);
 	while (true)
 	{
+		#ifdef MSG_NOSIGNAL
 		ssize_t sent = ::sendmsg(fd, &hdr, MSG_NOSIGNAL);
+		#else
+		ssize_t sent = ::sendmsg(fd, &hdr, 0);
+		#endif
 
 		if (sent == 0)
 			throw socket_shutdown{};
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include "wivrn_config.h"
 #include "wivrn_serialization.h"
 
 #include <atomic>
@@ -28,6 +29,7 @@
 #include <mutex>
 #include <netinet/ip.h>
 #include <span>
+#include <sys/uio.h>
 #include <utility>
 #include <vector>
 
@@ -98,14 +100,25 @@ public:
 	}
 };
 
+class uring_udp;
+
 class UDP : public fd_base
 {
 	std::shared_ptr<uint8_t[]> buffer;
 	std::vector<std::span<uint8_t>> messages;
+#if WIVRN_USE_IO_URING
+	std::unique_ptr<uring_udp> uring;
+#endif
 
 public:
 	UDP(bool ipv4);
 	explicit UDP(int fd);
+	UDP(UDP &&);
+	UDP & operator=(UDP &&);
+	~UDP();
+
+	// file descriptor to poll for incoming messages
+	int poll_fd() const;
 
 	deserialization_packet receive_raw();
 	deserialization_packet receive_pending();
@@ -122,16 +135,20 @@ public:
 	void set_receive_buffer_size(int size);
 	void set_send_buffer_size(int size);
 	void set_tos(int type_of_service);
+	// Requires the fq queueing discipline on the interface
+	void set_max_pacing_rate(uint64_t bytes_per_second);
 };
 
 class TCP : public fd_base
 {
 	std::shared_ptr<uint8_t[]> buffer;
-	ssize_t capacity_left = 0;
+	size_t buffer_size = 0;
+	size_t capacity_left = 0;
 	std::span<uint8_t> data;
 	std::unique_ptr<std::mutex> mutex;
 
 	void init();
+	void send_iovecs(std::span<iovec> iovecs);
 
 public:
 	TCP(in6_addr address, int port);
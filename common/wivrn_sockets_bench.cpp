@@ -0,0 +1,148 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures throughput, latency and CPU usage of the UDP stream socket on loopback
+// Video frames are sent as batches of shards at 50, 100 and 200 Mbit/s.
+// Not part of the build, compile after configuring the project in <build>
+// with WIVRN_USE_IO_URING enabled:
+//   g++ -std=c++20 -O2 -Icommon -I<build>/common -I<boost pfr>/include \
+//       common/wivrn_sockets_bench.cpp common/wivrn_sockets.cpp common/wivrn_uring.cpp -luring
+// and run with and without WIVRN_IO_URING=1 to compare the backends.
+// No results are recorded for the io_uring backend yet: it is kept optional
+// and off by default until this shows a gain on real hardware.
+
+#include "wivrn_packets.h"
+#include "wivrn_sockets.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/resource.h>
+#include <thread>
+
+using namespace wivrn;
+
+namespace
+{
+const int port = 9758;
+const int fps = 90;
+const auto duration = std::chrono::seconds(5);
+
+int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::chrono::microseconds cpu_time()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+	       std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+void sender(std::stop_token stop, int bitrate)
+{
+	UDP socket(false);
+	socket.connect(in6addr_loopback, port);
+
+	const size_t shard_size = to_headset::video_stream_data_shard::max_payload_size;
+	const size_t frame_size = bitrate / fps / 8;
+	const size_t num_shards = (frame_size + shard_size - 1) / shard_size;
+
+	std::vector<uint8_t> payload(frame_size);
+	std::vector<std::vector<std::span<uint8_t>>> messages(num_shards);
+	std::vector<const std::vector<std::span<uint8_t>> *> batch;
+	for (size_t i = 0; i < num_shards; ++i)
+	{
+		auto begin = i * shard_size;
+		messages[i] = {std::span(payload).subspan(begin, std::min(shard_size, frame_size - begin))};
+		batch.push_back(&messages[i]);
+	}
+
+	auto next = std::chrono::steady_clock::now();
+	while (not stop.stop_requested())
+	{
+		// Send timestamp is in each shard
+		for (auto & message: messages)
+		{
+			int64_t t = now_ns();
+			memcpy(message[0].data(), &t, sizeof(t));
+		}
+		socket.send_many_raw(batch);
+
+		next += std::chrono::nanoseconds(1'000'000'000 / fps);
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void run(int bitrate)
+{
+	UDP socket(false);
+	socket.bind(port);
+	socket.set_receive_buffer_size(5 * 1024 * 1024);
+
+	std::vector<int64_t> latencies;
+
+	auto cpu_begin = cpu_time();
+	auto begin = std::chrono::steady_clock::now();
+	std::jthread thread(sender, bitrate);
+
+	while (std::chrono::steady_clock::now() < begin + duration)
+	{
+		pollfd fds{.fd = socket.poll_fd(), .events = POLLIN};
+		if (::poll(&fds, 1, 100) <= 0)
+			continue;
+
+		for (auto packet = socket.receive_raw(); not packet.empty(); packet = socket.receive_pending())
+		{
+			auto data = packet.read_span(sizeof(int64_t));
+			int64_t t;
+			memcpy(&t, data.data(), sizeof(t));
+			latencies.push_back(now_ns() - t);
+		}
+	}
+	thread.request_stop();
+	thread.join();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	auto cpu = cpu_time() - cpu_begin;
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p) {
+		return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, size_t(latencies.size() * p))] / 1000.;
+	};
+
+	printf("%4d Mbit/s: received %6.1f Mbit/s, latency p50 %7.1fµs p99 %7.1fµs, cpu %5.1f%%\n",
+	       bitrate / 1'000'000,
+	       socket.bytes_received() * 8 / elapsed.count() / 1e6,
+	       percentile(0.5),
+	       percentile(0.99),
+	       100. * cpu.count() / 1e6 / elapsed.count());
+}
+} // namespace
+
+int main()
+{
+	printf("backend: %s\n", getenv("WIVRN_IO_URING") ? "io_uring" : "poll");
+	for (int bitrate: {50'000'000, 100'000'000, 200'000'000})
+		run(bitrate);
+}
@@ -0,0 +1,203 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "wivrn_uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+namespace wivrn
+{
+
+// Provided buffers for received datagrams, same size as recvmmsg messages
+static const unsigned num_buffers = 256;
+static const size_t buffer_size = 2048;
+static const int buffer_group = 0;
+
+// Maximum number of messages in a single send submission
+static const unsigned send_queue_depth = 128;
+
+bool uring_udp::enabled()
+{
+	static const bool value = [] {
+		const char * env = std::getenv("WIVRN_IO_URING");
+		return env and std::string_view(env) != "0";
+	}();
+	return value;
+}
+
+std::unique_ptr<uring_udp> uring_udp::create(int fd)
+{
+	std::unique_ptr<uring_udp> self(new uring_udp(fd));
+
+	if (io_uring_queue_init(8, &self->recv_ring, 0) < 0)
+		return nullptr;
+	self->recv_ring_init = true;
+
+	int err;
+	self->buf_ring = io_uring_setup_buf_ring(&self->recv_ring, num_buffers, buffer_group, 0, &err);
+	if (not self->buf_ring)
+		return nullptr;
+
+	self->buffers.reset(new uint8_t[num_buffers * buffer_size]);
+	for (unsigned i = 0; i < num_buffers; ++i)
+		io_uring_buf_ring_add(self->buf_ring, self->buffers.get() + i * buffer_size, buffer_size, i, io_uring_buf_ring_mask(num_buffers), i);
+	io_uring_buf_ring_advance(self->buf_ring, num_buffers);
+
+	if (io_uring_queue_init(send_queue_depth, &self->send_ring, 0) < 0)
+		return nullptr;
+	self->send_ring_init = true;
+
+	return self;
+}
+
+uring_udp::~uring_udp()
+{
+	if (buf_ring)
+		io_uring_free_buf_ring(&recv_ring, buf_ring, num_buffers, buffer_group);
+	if (recv_ring_init)
+		io_uring_queue_exit(&recv_ring);
+	if (send_ring_init)
+		io_uring_queue_exit(&send_ring);
+}
+
+void uring_udp::arm()
+{
+	io_uring_sqe * sqe = io_uring_get_sqe(&recv_ring);
+	io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = buffer_group;
+
+	int ret = io_uring_submit(&recv_ring);
+	if (ret < 0)
+		throw std::system_error{-ret, std::generic_category()};
+	armed = true;
+}
+
+void uring_udp::receive(std::shared_ptr<uint8_t[]> & memory, std::vector<std::span<uint8_t>> & messages)
+{
+	struct received_buffer
+	{
+		uint16_t id;
+		uint32_t size;
+	};
+	thread_local std::vector<received_buffer> received;
+	received.clear();
+	messages.clear();
+
+	if (not armed)
+		arm();
+
+	// The caller polls poll_fd() first, like the recvmmsg path this must not
+	// block: the completion of a freshly armed recv may not be posted yet
+	io_uring_cqe * cqe;
+	int ret = io_uring_peek_cqe(&recv_ring, &cqe);
+	if (ret == -EAGAIN)
+		return;
+	if (ret < 0)
+		throw std::system_error{-ret, std::generic_category()};
+
+	int error = 0;
+	size_t total_size = 0;
+	unsigned head;
+	unsigned seen = 0;
+	io_uring_for_each_cqe(&recv_ring, head, cqe)
+	{
+		++seen;
+		// multishot stops when running out of buffers, or on error
+		if (not(cqe->flags & IORING_CQE_F_MORE))
+			armed = false;
+
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{
+			uint32_t size = cqe->res > 0 ? cqe->res : 0;
+			received.push_back({uint16_t(cqe->flags >> IORING_CQE_BUFFER_SHIFT), size});
+			total_size += size;
+		}
+		else if (cqe->res < 0 and cqe->res != -ENOBUFS)
+			error = -cqe->res;
+	}
+	io_uring_cq_advance(&recv_ring, seen);
+
+	// Copy messages so that buffers are immediately given back to the kernel,
+	// packets may keep references to their memory
+	if (total_size)
+		memory.reset(new uint8_t[total_size]);
+
+	size_t offset = 0;
+	for (size_t i = 0; i < received.size(); ++i)
+	{
+		const auto & buffer = received[i];
+		uint8_t * data = buffers.get() + buffer.id * buffer_size;
+		if (buffer.size)
+		{
+			memcpy(memory.get() + offset, data, buffer.size);
+			messages.emplace_back(memory.get() + offset, buffer.size);
+			offset += buffer.size;
+		}
+		io_uring_buf_ring_add(buf_ring, data, buffer_size, buffer.id, io_uring_buf_ring_mask(num_buffers), i);
+	}
+	io_uring_buf_ring_advance(buf_ring, received.size());
+
+	if (not armed)
+		arm();
+
+	if (error and messages.empty())
+		throw std::system_error{error, std::generic_category()};
+}
+
+size_t uring_udp::send(std::span<mmsghdr> messages)
+{
+	std::lock_guard lock(send_mutex);
+
+	size_t bytes_sent = 0;
+	while (not messages.empty())
+	{
+		auto batch = messages.first(std::min<size_t>(messages.size(), send_queue_depth));
+		messages = messages.subspan(batch.size());
+
+		for (auto & message: batch)
+		{
+			io_uring_sqe * sqe = io_uring_get_sqe(&send_ring);
+			io_uring_prep_sendmsg(sqe, fd, &message.msg_hdr, 0);
+		}
+
+		// iovecs must stay valid until the messages are sent
+		int ret = io_uring_submit_and_wait(&send_ring, batch.size());
+		if (ret < 0)
+			throw std::system_error{-ret, std::generic_category()};
+
+		io_uring_cqe * cqe;
+		unsigned head;
+		unsigned seen = 0;
+		io_uring_for_each_cqe(&send_ring, head, cqe)
+		{
+			++seen;
+			if (cqe->res > 0)
+				bytes_sent += cqe->res;
+		}
+		io_uring_cq_advance(&send_ring, seen);
+	}
+	return bytes_sent;
+}
+} // namespace wivrn
@@ -0,0 +1,82 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <liburing.h>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <sys/socket.h>
+#include <vector>
+
+namespace wivrn
+{
+
+// io_uring backend for a connected UDP socket
+// Receive uses a multishot recv with a ring of provided buffers, so that
+// the kernel fills buffers as datagrams arrive without one syscall each.
+// Batches of messages are sent with a single submission.
+// This is not zero copy: the kernel copies each datagram into a provided
+// buffer, and receive() copies it again into memory so that the buffer goes
+// back to the ring at once. Whether it reduces latency or CPU use compared to
+// recvmmsg/sendmmsg has not been measured, see wivrn_sockets_bench.cpp.
+class uring_udp
+{
+	int fd;
+
+	io_uring recv_ring;
+	io_uring_buf_ring * buf_ring = nullptr;
+	std::unique_ptr<uint8_t[]> buffers;
+	bool recv_ring_init = false;
+	bool armed = false;
+
+	std::mutex send_mutex;
+	io_uring send_ring;
+	bool send_ring_init = false;
+
+	explicit uring_udp(int fd) :
+	        fd(fd) {}
+
+	void arm();
+
+public:
+	uring_udp(const uring_udp &) = delete;
+	uring_udp & operator=(const uring_udp &) = delete;
+	~uring_udp();
+
+	// Set WIVRN_IO_URING=1 to use the io_uring backend
+	static bool enabled();
+
+	// Returns nullptr if io_uring is not available
+	static std::unique_ptr<uring_udp> create(int fd);
+
+	int poll_fd() const
+	{
+		return armed ? recv_ring.ring_fd : fd;
+	}
+
+	// Get the messages already received without blocking, messages point to memory
+	void receive(std::shared_ptr<uint8_t[]> & memory, std::vector<std::span<uint8_t>> & messages);
+
+	// Returns the number of bytes sent, failed messages are considered lost
+	size_t send(std::span<mmsghdr> messages);
+};
+} // namespace wivrn
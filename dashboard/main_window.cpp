@@ -31,6 +31,7 @@
 #include "adb.h"
 #include "gui_config.h"
 #include "settings.h"
+#include "telemetry_window.h"
 #include "ui_main_window.h"
 #include "wivrn_server.h"
 #include "wizard.h"
@@ -144,6 +145,7 @@ main_window::main_window()
 	connect(ui->button_disconnect, &QPushButton::clicked, this, &main_window::disconnect_client);
 	connect(ui->button_wizard, &QPushButton::clicked, this, &main_window::on_action_wizard);
 	connect(ui->button_details, &QPushButton::toggled, this, &main_window::on_button_details_toggled);
+	connect(ui->button_statistics, &QPushButton::clicked, this, &main_window::on_action_statistics);
 
 	connect(ui->button_about, &QPushButton::clicked, this, []() { QApplication::aboutQt(); });
 	connect(ui->button_exit, &QPushButton::clicked, this, []() { QApplication::quit(); });
@@ -430,6 +432,7 @@ void main_window::on_headset_connected_changed(bool connected)
 	ui->button_disconnect->setVisible(connected);
 	ui->button_wizard->setHidden(connected);
 	ui->button_details->setVisible(connected);
+	ui->button_statistics->setVisible(connected);
 	ui->button_usb->setHidden(connected);
 	ui->headset_properties->setVisible(connected and ui->button_details->isChecked());
 
@@ -623,6 +626,16 @@ void main_window::on_action_settings()
 	settings_window->exec();
 }
 
+void main_window::on_action_statistics()
+{
+	if (not statistics_window)
+		statistics_window = new telemetry_window(server_interface, this);
+
+	statistics_window->show();
+	statistics_window->raise();
+	statistics_window->activateWindow();
+}
+
 void main_window::on_action_wizard()
 {
 	assert(not wizard_window);
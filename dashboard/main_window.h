@@ -39,6 +39,7 @@ class IoGithubWivrnServerInterface;
 class OrgFreedesktopDBusPropertiesInterface;
 
 class settings;
+class telemetry_window;
 class wivrn_server;
 class wizard;
 
@@ -51,6 +52,7 @@ class main_window : public QMainWindow
 
 	settings * settings_window = nullptr;
 	wizard * wizard_window = nullptr;
+	telemetry_window * statistics_window = nullptr;
 
 	QIcon icon{":/assets/wivrn.png"};
 	QSystemTrayIcon systray{icon};
@@ -105,6 +107,7 @@ private:
 
 	void on_action_settings();
 	void on_action_wizard();
+	void on_action_statistics();
 	void on_action_usb(const std::string & serial);
 	void start_server();
 	void stop_server();
@@ -0,0 +1,195 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry_graph.h"
+
+#include <QDateTime>
+#include <QPainter>
+#include <QPainterPath>
+#include <cmath>
+
+// Duration of the plotted history in seconds
+static const double history = 60;
+// Time between vertical grid lines in seconds
+static const double grid_interval = 10;
+
+static const QColor colors[] = {
+        QColor(31, 119, 180),
+        QColor(255, 127, 14),
+        QColor(44, 160, 44),
+        QColor(214, 39, 40),
+        QColor(148, 103, 189),
+        QColor(140, 86, 75),
+};
+
+// Smallest 1, 2 or 5 times a power of 10 above x
+static double nice_ceil(double x)
+{
+	double power = std::pow(10, std::floor(std::log10(x)));
+	for (double m: {1, 2, 5})
+	{
+		if (m * power >= x)
+			return m * power;
+	}
+	return 10 * power;
+}
+
+telemetry_graph::telemetry_graph(QWidget * parent) :
+        QFrame(parent)
+{
+	setFrameShape(QFrame::StyledPanel);
+	setMinimumHeight(120);
+}
+
+void telemetry_graph::set_unit(const QString & unit, double scale)
+{
+	m_unit = unit;
+	m_scale = scale;
+	update();
+}
+
+void telemetry_graph::add_series(const QString & key, const QString & name)
+{
+	m_series.push_back({
+	        .key = key,
+	        .name = name,
+	        .color = colors[m_series.size() % std::size(colors)],
+	});
+	clear();
+}
+
+void telemetry_graph::add_values(const telemetry_values & values)
+{
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	if (start_time < 0)
+		start_time = now;
+
+	sample s{.time = (now - start_time) / 1000.};
+	for (const auto & item: m_series)
+		s.values.push_back(values.value(item.key, NAN) * m_scale);
+	samples.push_back(std::move(s));
+
+	while (samples.front().time < samples.back().time - history)
+		samples.pop_front();
+
+	update();
+}
+
+void telemetry_graph::clear()
+{
+	samples.clear();
+	start_time = -1;
+	update();
+}
+
+QSize telemetry_graph::sizeHint() const
+{
+	return {400, 160};
+}
+
+void telemetry_graph::paintEvent(QPaintEvent * event)
+{
+	QFrame::paintEvent(event);
+
+	QPainter painter(this);
+	painter.setRenderHint(QPainter::Antialiasing);
+	QFontMetrics metrics = painter.fontMetrics();
+	QRect area = contentsRect().adjusted(4, 4, -4, -4);
+
+	// Legend, with the last value of each series
+	int x = area.left();
+	for (size_t i = 0; i < m_series.size(); ++i)
+	{
+		double last = samples.empty() ? NAN : samples.back().values[i];
+		QString text = std::isnan(last) ? m_series[i].name : QString("%1: %2 %3").arg(m_series[i].name).arg(last, 0, 'f', 1).arg(m_unit);
+
+		painter.fillRect(x, area.top() + metrics.height() / 4, metrics.height() / 2, metrics.height() / 2, m_series[i].color);
+		x += metrics.height();
+		painter.setPen(palette().color(QPalette::WindowText));
+		painter.drawText(x, area.top() + metrics.ascent(), text);
+		x += metrics.horizontalAdvance(text) + metrics.height();
+	}
+
+	double max_value = 0;
+	for (const auto & s: samples)
+	{
+		for (double value: s.values)
+		{
+			if (not std::isnan(value))
+				max_value = std::max(max_value, value);
+		}
+	}
+	max_value = max_value > 0 ? nice_ceil(max_value * 1.1) : 1;
+
+	QString max_label = QString("%1 %2").arg(max_value).arg(m_unit);
+	QRect plot = area.adjusted(metrics.horizontalAdvance(max_label) + 4, metrics.height() + 4, 0, -metrics.height());
+	if (plot.width() <= 0 or plot.height() <= 0)
+		return;
+
+	double now = samples.empty() ? 0 : samples.back().time;
+	auto to_point = [&](double time, double value) {
+		return QPointF(plot.right() - (now - time) / history * plot.width(),
+		               plot.bottom() - value / max_value * plot.height());
+	};
+
+	// Axes and grid, the time axis is relative to the last sample
+	QColor grid = palette().color(QPalette::Mid);
+	painter.setPen(grid);
+	painter.drawRect(plot);
+	painter.drawLine(plot.left(), plot.center().y(), plot.right(), plot.center().y());
+	for (double t = 0; t <= history; t += grid_interval)
+	{
+		double gx = plot.right() - t / history * plot.width();
+		painter.setPen(grid);
+		painter.drawLine(QPointF(gx, plot.top()), QPointF(gx, plot.bottom()));
+
+		QString label = t == 0 ? QString("0") : QString("-%1 s").arg(t);
+		painter.setPen(palette().color(QPalette::WindowText));
+		painter.drawText(QPointF(gx - metrics.horizontalAdvance(label) / 2., plot.bottom() + metrics.ascent() + 2), label);
+	}
+	painter.setPen(palette().color(QPalette::WindowText));
+	painter.drawText(area.left(), plot.top() + metrics.ascent(), max_label);
+	painter.drawText(area.left(), plot.bottom(), QString("0"));
+
+	// Series, interrupted by missing values
+	painter.setClipRect(plot);
+	for (size_t i = 0; i < m_series.size(); ++i)
+	{
+		QPainterPath path;
+		bool drawing = false;
+		for (const auto & s: samples)
+		{
+			if (std::isnan(s.values[i]))
+			{
+				drawing = false;
+				continue;
+			}
+
+			if (drawing)
+				path.lineTo(to_point(s.time, s.values[i]));
+			else
+				path.moveTo(to_point(s.time, s.values[i]));
+			drawing = true;
+		}
+		painter.setPen(QPen(m_series[i].color, 2));
+		painter.drawPath(path);
+	}
+}
+
+#include "moc_telemetry_graph.cpp"
@@ -0,0 +1,71 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QColor>
+#include <QFrame>
+#include <QString>
+#include <deque>
+#include <vector>
+
+#include "wivrn_qdbus_types.h"
+
+// Plot of some of the telemetry values over the last minute
+class telemetry_graph : public QFrame
+{
+	Q_OBJECT
+
+	struct series
+	{
+		QString key;
+		QString name;
+		QColor color;
+	};
+
+	struct sample
+	{
+		// Seconds since the first sample
+		double time;
+		// NaN if missing, one per series
+		std::vector<double> values;
+	};
+
+	QString m_unit;
+	double m_scale = 1;
+	std::vector<series> m_series;
+	std::deque<sample> samples;
+	qint64 start_time = -1;
+
+public:
+	explicit telemetry_graph(QWidget * parent = nullptr);
+
+	// Values are multiplied by scale before being displayed in unit
+	void set_unit(const QString & unit, double scale = 1);
+	// key: name of the value in the telemetry
+	void add_series(const QString & key, const QString & name);
+
+	void add_values(const telemetry_values &);
+	void clear();
+
+	QSize sizeHint() const override;
+
+protected:
+	void paintEvent(QPaintEvent *) override;
+};
@@ -0,0 +1,108 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry_window.h"
+
+#include <cmath>
+
+#include "telemetry_graph.h"
+#include "ui_telemetry_window.h"
+#include "wivrn_server.h"
+
+telemetry_window::telemetry_window(wivrn_server * server_interface, QWidget * parent) :
+        QWidget(parent, Qt::Window),
+        server_interface(server_interface)
+{
+	ui = new Ui::Telemetry;
+	ui->setupUi(this);
+
+	ui->graph_latency->set_unit(tr("ms"), 1000);
+	ui->graph_latency->add_series("EncodeTime", tr("Encode"));
+	ui->graph_latency->add_series("NetworkTime", tr("Network"));
+	ui->graph_latency->add_series("DecodeTime", tr("Decode"));
+	ui->graph_latency->add_series("HeadsetQueueTime", tr("Decoded queue"));
+	ui->graph_latency->add_series("DisplayTime", tr("Display"));
+	ui->graph_latency->add_series("Latency", tr("Total"));
+
+	ui->graph_pacer->set_unit(tr("ms"), 1000);
+	ui->graph_pacer->add_series("PacerWakeUpToPresent", tr("Wake up to present"));
+	ui->graph_pacer->add_series("PacerPresentToDecoded", tr("Present to decoded"));
+	ui->graph_pacer->add_series("PacerRenderToDisplay", tr("Render to display"));
+	ui->graph_pacer->add_series("VideoQueueTime", tr("Transmit queue"));
+
+	ui->graph_bitrate->set_unit(tr("Mbit/s"), 1e-6);
+	ui->graph_bitrate->add_series("Bitrate", tr("Video"));
+
+	ui->graph_frame_rate->set_unit(tr("fps"));
+	ui->graph_frame_rate->add_series("FrameRate", tr("Displayed"));
+
+	ui->graph_loss->set_unit("%", 100);
+	ui->graph_loss->add_series("FrameLoss", tr("Lost frames"));
+
+	ui->graph_encoder_queue->set_unit(tr("frames"));
+	ui->graph_encoder_queue->add_series("EncoderQueue", tr("Mean"));
+	ui->graph_encoder_queue->add_series("EncoderQueueMax", tr("Max"));
+
+	connect(server_interface, &wivrn_server::telemetryChanged, this, &telemetry_window::on_telemetry_changed);
+	on_telemetry_changed(server_interface->telemetry());
+}
+
+telemetry_window::~telemetry_window()
+{
+	delete ui;
+	ui = nullptr;
+}
+
+std::vector<telemetry_graph *> telemetry_window::graphs()
+{
+	return {
+	        ui->graph_latency,
+	        ui->graph_pacer,
+	        ui->graph_bitrate,
+	        ui->graph_frame_rate,
+	        ui->graph_loss,
+	        ui->graph_encoder_queue,
+	};
+}
+
+void telemetry_window::on_telemetry_changed(const telemetry_values & values)
+{
+	if (values.isEmpty())
+	{
+		for (auto graph: graphs())
+			graph->clear();
+
+		ui->label_status->setText(tr("No headset connected"));
+		return;
+	}
+
+	for (auto graph: graphs())
+		graph->add_values(values);
+
+	auto text = [&](const QString & key, double scale) {
+		double value = values.value(key, NAN);
+		return std::isnan(value) ? QString("-") : QString::number(value * scale, 'f', 1);
+	};
+	ui->label_status->setText(tr("Maximum latency: %1 ms, maximum encode time: %2 ms, retransmitted shards: %3/s")
+	                                  .arg(text("LatencyMax", 1000))
+	                                  .arg(text("EncodeTimeMax", 1000))
+	                                  .arg(text("Retransmissions", 1)));
+}
+
+#include "moc_telemetry_window.cpp"
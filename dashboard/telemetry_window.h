@@ -0,0 +1,49 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QWidget>
+
+#include "wivrn_qdbus_types.h"
+
+namespace Ui
+{
+class Telemetry;
+}
+class telemetry_graph;
+class wivrn_server;
+
+// Live graphs of the statistics published by the server during a session
+class telemetry_window : public QWidget
+{
+	Q_OBJECT
+
+	Ui::Telemetry * ui;
+	wivrn_server * server_interface;
+
+	std::vector<telemetry_graph *> graphs();
+
+public:
+	telemetry_window(wivrn_server * server_interface, QWidget * parent = nullptr);
+	~telemetry_window();
+
+private:
+	void on_telemetry_changed(const telemetry_values &);
+};
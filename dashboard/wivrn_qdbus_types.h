@@ -1,5 +1,8 @@
 #pragma once
 
+#include <QMap>
+#include <QString>
+
 // Same as XrFovf
 struct field_of_view
 {
@@ -8,3 +11,6 @@ struct field_of_view
 	float angleUp;
 	float angleDown;
 };
+
+// Content of the io.github.wivrn.Telemetry Statistics property
+using telemetry_values = QMap<QString, double>;
@@ -69,6 +69,12 @@ void wivrn_server::on_server_dbus_unregistered()
 
 	if (isHeadsetConnected())
 		headsetConnectedChanged(m_headsetConnected = false);
+
+	if (not m_telemetry.isEmpty())
+	{
+		m_telemetry.clear();
+		telemetryChanged(m_telemetry);
+	}
 }
 
 void wivrn_server::refresh_server_properties()
@@ -89,6 +95,19 @@ void wivrn_server::refresh_server_properties()
 
 void wivrn_server::on_server_properties_changed(const QString & interface_name, const QVariantMap & changed_properties, const QStringList & invalidated_properties)
 {
+	if (interface_name == IoGithubWivrnTelemetryInterface::staticInterfaceName())
+	{
+		if (changed_properties.contains("Statistics"))
+		{
+			const auto arg = qvariant_cast<QDBusArgument>(changed_properties["Statistics"]);
+
+			m_telemetry.clear();
+			arg >> m_telemetry;
+			telemetryChanged(m_telemetry);
+		}
+		return;
+	}
+
 	if (interface_name != IoGithubWivrnServerInterface::staticInterfaceName())
 		return;
 
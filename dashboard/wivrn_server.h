@@ -19,6 +19,7 @@
 #pragma once
 
 #include <QDBusPendingCallWatcher>
+#include <QMap>
 #include <QDBusServiceWatcher>
 #include <QObject>
 #include <QSize>
@@ -63,6 +64,9 @@ public:
 	Q_PROPERTY(QStringList supportedCodecs READ supportedCodecs NOTIFY supportedCodecsChanged)
 	Q_PROPERTY(QString steamCommand READ steamCommand NOTIFY steamCommandChanged)
 
+	// Session statistics, updated every second while a headset is connected
+	Q_PROPERTY(telemetry_values telemetry READ telemetry NOTIFY telemetryChanged)
+
 	// hostnamed
 	Q_PROPERTY(QString hostname READ hostname())
 
@@ -148,6 +152,11 @@ public:
 		return m_steamCommand;
 	}
 
+	const telemetry_values & telemetry() const
+	{
+		return m_telemetry;
+	}
+
 	QString hostname();
 
 	void disconnect_headset();
@@ -176,6 +185,7 @@ private:
 	int m_speakerSampleRate{};
 	QStringList m_supportedCodecs{};
 	QString m_steamCommand{};
+	telemetry_values m_telemetry{};
 
 Q_SIGNALS:
 	void serverRunningChanged(bool);
@@ -194,4 +204,5 @@ Q_SIGNALS:
 	void speakerSampleRateChanged(int);
 	void supportedCodecsChanged(QStringList);
 	void steamCommandChanged(QString);
+	void telemetryChanged(const telemetry_values &);
 };
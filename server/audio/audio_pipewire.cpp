@@ -58,7 +58,7 @@ struct pipewire_device : public audio_device
 
 	utils::ring_buffer<audio_data, 100> mic_samples;
 	std::atomic<size_t> mic_buffer_size_bytes;
-	audio_data mic_current;
+	std::optional<mic_sync> mic_sync_state;
 	std::unique_ptr<pw_stream, deleter> microphone;
 	pw_stream_events mic_events{
 	        .version = PW_VERSION_STREAM_EVENTS,
@@ -147,6 +147,7 @@ struct pipewire_device : public audio_device
 			        .num_channels = info.microphone->num_channels,
 			        .sample_rate = info.microphone->sample_rate,
 			};
+			mic_sync_state.emplace(desc.microphone->num_channels, desc.microphone->sample_rate);
 
 			microphone.reset(pw_stream_new_simple(
 			        pw_main_loop_get_loop(pw_loop.get()),
@@ -225,39 +226,34 @@ void pipewire_device::mic_process(void * self_v)
 	{
 		num_frames = data.maxsize / frame_size;
 	}
-	data.chunk->offset = 0;
-	data.chunk->size = 0;
-	data.chunk->stride = frame_size;
+	num_frames = std::min<size_t>(num_frames, data.maxsize / frame_size);
 
-	while (num_frames != 0)
+	auto & sync = *self->mic_sync_state;
+	sync.update(double(self->mic_buffer_size_bytes / frame_size) / self->desc.microphone->sample_rate, self->session.get_offset());
+
+	std::span<int16_t> output((int16_t *)data_ptr, num_frames * self->desc.microphone->num_channels);
+	size_t written = 0;
+	while (true)
 	{
-		// remaining bytes in existing buffer
-		auto & current = self->mic_current;
-		ptrdiff_t tmp_remain = current.payload.size_bytes();
-		// limit to requested frames
-		tmp_remain = std::min<ptrdiff_t>(tmp_remain, num_frames * frame_size);
-		if (tmp_remain)
-		{
-			memcpy(data_ptr, current.payload.data(), tmp_remain);
-			current.payload = current.payload.subspan(tmp_remain);
-			data_ptr += tmp_remain;
-			data.chunk->size += tmp_remain;
-			num_frames -= tmp_remain / frame_size;
-			self->mic_buffer_size_bytes -= tmp_remain;
-		}
-		else
-		{
-			auto tmp = self->mic_samples.read();
-			if (not tmp)
-				break;
-			self->mic_current = std::move(*tmp);
-		}
+		written += sync.resampler.pull(output.subspan(written * self->desc.microphone->num_channels));
+		if (written == num_frames)
+			break;
+
+		auto tmp = self->mic_samples.read();
+		if (not tmp)
+			break;
+		sync.resampler.push(tmp->payload);
+		self->mic_buffer_size_bytes -= tmp->payload.size_bytes();
 	}
+
+	data.chunk->offset = 0;
+	data.chunk->size = written * frame_size;
+	data.chunk->stride = frame_size;
 	pw_stream_queue_buffer(self->microphone.get(), buffer);
 
-	// discard excess data, so we don't accumulate latency
-	size_t target_buffer_size = frame_size * self->desc.microphone->sample_rate * 0.08;
-	while (self->mic_buffer_size_bytes > target_buffer_size and self->mic_samples.size() > 1)
+	// The resampler only corrects small drifts, discard excess data after an interruption
+	size_t max_buffer_size = frame_size * self->desc.microphone->sample_rate * 0.1;
+	while (self->mic_buffer_size_bytes > max_buffer_size and self->mic_samples.size() > 1)
 	{
 		auto tmp = self->mic_samples.read();
 		if (not tmp)
@@ -4,26 +4,29 @@
 #include "driver/wivrn_session.h"
 #include "os/os_time.h"
 #include "util/u_logging.h"
-#include "utils/sync_queue.h"
+#include "utils/ring_buffer.h"
 #include "utils/wrap_lambda.h"
 
 #include <pulse/context.h>
+#include <pulse/error.h>
 #include <pulse/ext-device-manager.h>
 #include <pulse/introspect.h>
 #include <pulse/proplist.h>
+#include <pulse/stream.h>
 #include <pulse/thread-mainloop.h>
 
+#include <algorithm>
 #include <atomic>
-#include <fcntl.h>
-#include <filesystem>
 #include <future>
 #include <iostream>
-#include <sys/poll.h>
 
-static const char * source_name = "WiVRn-mic";
-static const char * sink_name = "WiVRn";
-static const char * source_pipe = "wivrn-source";
-static const char * sink_pipe = "wivrn-sink";
+// Duration of the chunks read from the sink monitor
+static const std::chrono::milliseconds speaker_fragment{5};
+// Data written in advance to the microphone sink, the network jitter is absorbed before
+static const std::chrono::milliseconds mic_target_length{20};
+// Microphone data is discarded above this level, when the stream was interrupted
+static const double mic_max_buffer = 0.1;
+static const std::chrono::seconds latency_log_interval{30};
 
 namespace wivrn
 {
@@ -32,7 +35,6 @@ struct module_entry
 {
 	uint32_t module;
 	uint32_t device;
-	std::filesystem::path socket;
 };
 
 void wait_connected(std::atomic<pa_context_state> & state)
@@ -111,82 +113,79 @@ std::optional<module_entry> get_source(pa_context * ctx, const char * name)
 	return result;
 }
 
-std::filesystem::path get_socket_path()
+uint32_t load_module(pa_context * ctx, const char * name, const std::string & params)
 {
-	const char * path = std::getenv("XDG_RUNTIME_DIR");
-	if (path)
-		return path;
-	path = "/tmp/wivrn";
-	std::filesystem::create_directories(path);
-	U_LOG_W("XDG_RUNTIME_DIR is not set, using %s instead", path);
-	return path;
+	std::promise<uint32_t> module_index;
+	wrap_lambda cb = [&module_index](pa_context *, uint32_t index) {
+		module_index.set_value(index);
+	};
+	auto op = pa_context_load_module(ctx, name, params.c_str(), cb, cb);
+	pa_operation_unref(op);
+	uint32_t index = module_index.get_future().get();
+	if (index == PA_INVALID_INDEX)
+		throw std::runtime_error("failed to load " + std::string(name));
+
+	add_cleanup_function(unload_module, index);
+	return index;
 }
 
-module_entry ensure_sink(pa_context * ctx, const char * name, const std::string & description, int channels, int sample_rate)
+// The speaker is a null sink, its monitor is recorded
+module_entry ensure_sink(pa_context * ctx, const std::string & name, const std::string & description, int channels, int sample_rate)
 {
-	auto sink = get_sink(ctx, name);
+	auto sink = get_sink(ctx, name.c_str());
 	if (sink)
 		unload_module(ctx, sink->module);
 
-	std::promise<uint32_t> module_index;
-	wrap_lambda cb = [&module_index](pa_context *, uint32_t index) {
-		module_index.set_value(index);
-	};
-	std::filesystem::path fifo = get_socket_path() / sink_pipe;
 	std::stringstream params;
 	params << "sink_name=" << std::quoted(name)
-	       << " file=" << std::quoted(fifo.string())
 	       << " channels=" << channels
 	       << " rate=" << sample_rate
-	       << " use_system_clock_for_timing=yes"
 	       << " sink_properties=" << PA_PROP_DEVICE_DESCRIPTION << "=" << std::quoted(description)
 	       << PA_PROP_DEVICE_ICON_NAME << "=network-wireless";
-	;
-	auto op = pa_context_load_module(ctx, "module-pipe-sink", params.str().c_str(), cb, cb);
-	pa_operation_unref(op);
-	module_index.get_future().wait();
+	load_module(ctx, "module-null-sink", params.str());
 
-	sink = get_sink(ctx, name);
+	sink = get_sink(ctx, name.c_str());
 	if (not sink)
-		throw std::runtime_error("failed to create audio sink " + std::string(name));
-	sink->socket = fifo;
-
-	add_cleanup_function(unload_module, sink->module);
+		throw std::runtime_error("failed to create audio sink " + name);
 
 	return *sink;
 }
 
-module_entry ensure_source(pa_context * ctx, const char * name, const std::string & description, int channels, int sample_rate)
+// The microphone is the monitor of a null sink where headset data is played,
+// remapped so that it appears as a regular source
+std::pair<module_entry, module_entry> ensure_source(pa_context * ctx, const std::string & name, const std::string & description, int channels, int sample_rate)
 {
-	auto source = get_source(ctx, name);
-	if (source)
-		unload_module(ctx, source->module);
+	std::string sink_name = name + "-sink";
+	for (const auto & existing: {get_source(ctx, name.c_str()), get_sink(ctx, sink_name.c_str())})
+	{
+		if (existing)
+			unload_module(ctx, existing->module);
+	}
 
-	std::promise<uint32_t> module_index;
-	wrap_lambda cb = [&module_index](pa_context *, uint32_t index) {
-		module_index.set_value(index);
-	};
-	std::filesystem::path fifo = get_socket_path() / source_pipe;
-	std::stringstream params;
-	params << "source_name=" << std::quoted(name)
-	       << " file=" << std::quoted(fifo.string())
-	       << " channels=" << channels
-	       << " rate=" << sample_rate
-	       << " source_properties=" << PA_PROP_DEVICE_DESCRIPTION << "=" << std::quoted(description)
-	       << PA_PROP_DEVICE_ICON_NAME << "=network-wireless";
-	;
-	auto op = pa_context_load_module(ctx, "module-pipe-source", params.str().c_str(), cb, cb);
-	pa_operation_unref(op);
-	module_index.get_future().wait();
+	std::stringstream sink_params;
+	sink_params << "sink_name=" << std::quoted(sink_name)
+	            << " channels=" << channels
+	            << " rate=" << sample_rate
+	            << " sink_properties=" << PA_PROP_DEVICE_DESCRIPTION << "=" << std::quoted(description + " (input)");
+	load_module(ctx, "module-null-sink", sink_params.str());
 
-	source = get_source(ctx, name);
-	if (not source)
-		throw std::runtime_error("failed to create audio source " + std::string(name));
-	source->socket = fifo;
+	auto sink = get_sink(ctx, sink_name.c_str());
+	if (not sink)
+		throw std::runtime_error("failed to create audio sink " + sink_name);
+
+	std::stringstream source_params;
+	source_params << "source_name=" << std::quoted(name)
+	              << " master=" << std::quoted(sink_name + ".monitor")
+	              << " channels=" << channels
+	              << " source_properties=" << PA_PROP_DEVICE_DESCRIPTION << "=" << std::quoted(description)
+	              << PA_PROP_DEVICE_ICON_NAME << "=network-wireless";
+	load_module(ctx, "module-remap-source", source_params.str());
 
-	add_cleanup_function(unload_module, source->module);
+	auto source = get_source(ctx, name.c_str());
+	if (not source)
+		throw std::runtime_error("failed to create audio source " + name);
 
-	return *source;
+	return {*source, *sink};
 }
 
 struct pa_deleter
@@ -239,43 +238,80 @@ public:
 	{
 		return ctx.get();
 	}
+
+	pa_threaded_mainloop * mainloop()
+	{
+		return main_loop.get();
+	}
+};
+
+class pa_lock
+{
+	pa_threaded_mainloop * loop;
+
+public:
+	pa_lock(pa_threaded_mainloop * loop) :
+	        loop(loop)
+	{
+		pa_threaded_mainloop_lock(loop);
+	}
+	~pa_lock()
+	{
+		pa_threaded_mainloop_unlock(loop);
+	}
 };
 
 struct pulse_device : public audio_device
 {
 	wivrn::to_headset::audio_stream_description desc;
 
-	std::thread mic_thread;
-	std::thread speaker_thread;
-	std::atomic<bool> quit;
-
 	std::optional<module_entry> speaker;
 	std::optional<module_entry> microphone;
+	std::optional<module_entry> microphone_sink;
 
-	utils::sync_queue<audio_data> mic_buffer;
+	// Streams run in the mainloop thread of this connection
+	std::optional<pa_connection> cnx;
+	pa_stream * speaker_stream = nullptr;
+	pa_stream * mic_stream = nullptr;
 
-	wivrn::fd_base speaker_pipe;
-	wivrn::fd_base mic_pipe;
+	utils::ring_buffer<audio_data, 100> mic_samples;
+	std::atomic<size_t> mic_buffer_size_bytes = 0;
+	std::optional<mic_sync> mic_sync_state;
+
+	// Time between the production of a sample in the sink and its transmission
+	int64_t speaker_latency = 0;
+	// Time between the capture of a sample on the headset and its availability in the source
+	int64_t mic_latency = 0;
+	std::chrono::steady_clock::time_point next_log;
 
 	wivrn::wivrn_session & session;
 
 	~pulse_device()
 	{
-		quit = true;
-		mic_buffer.close();
-		if (mic_thread.joinable())
-			mic_thread.join();
-		if (speaker_thread.joinable())
-			speaker_thread.join();
-		if (speaker or microphone)
+		if (cnx)
+		{
+			pa_lock lock(cnx->mainloop());
+			for (auto stream: {speaker_stream, mic_stream})
+			{
+				if (stream)
+				{
+					pa_stream_disconnect(stream);
+					pa_stream_unref(stream);
+				}
+			}
+		}
+		cnx.reset();
+
+		if (speaker or microphone or microphone_sink)
 		{
 			try
 			{
-				pa_connection cnx("WiVRn");
-				if (speaker)
-					unload_module(cnx, speaker->module);
-				if (microphone)
-					unload_module(cnx, microphone->module);
+				pa_connection unload_cnx("WiVRn");
+				for (const auto & module: {speaker, microphone, microphone_sink})
+				{
+					if (module)
+						unload_module(unload_cnx, module->module);
+				}
 			}
 			catch (const std::exception & e)
 			{
@@ -290,118 +326,144 @@ struct pulse_device : public audio_device
 		return desc;
 	};
 
-	void run_speaker()
+	static void stream_state(pa_stream *, void * userdata)
 	{
-		assert(desc.speaker);
-		pthread_setname_np(pthread_self(), "speaker_thread");
-
-		U_LOG_I("started speaker thread, sample rate %dHz, %d channels", desc.speaker->sample_rate, desc.speaker->num_channels);
-
-		const size_t sample_size = desc.speaker->num_channels * sizeof(int16_t);
-		// use buffers of up to 2ms
-		// read buffers must be smaller than buffer size on client or we will discard chunks often
-		const size_t buffer_size = (desc.speaker->sample_rate * sample_size * 2) / 1000;
-		wivrn::audio_data packet;
-		std::vector<uint8_t> buffer(buffer_size, 0);
-		size_t remainder = 0;
+		auto self = (pulse_device *)userdata;
+		pa_threaded_mainloop_signal(self->cnx->mainloop(), 0);
+	}
 
-		// Flush existing data, but keep alignment
+	void wait_ready(pa_stream * stream)
+	{
+		while (true)
 		{
-			char sewer[1024];
-			while (true)
+			switch (pa_stream_get_state(stream))
 			{
-				int size = read(speaker_pipe.get_fd(), sewer, sizeof(sewer));
-				if (size <= 0)
-					break;
-				remainder = (remainder + size) % sample_size;
+				case PA_STREAM_READY:
+					return;
+				case PA_STREAM_FAILED:
+				case PA_STREAM_TERMINATED:
+					throw std::runtime_error(std::string("failed to connect stream: ") + pa_strerror(pa_context_errno(*cnx)));
+				default:
+					pa_threaded_mainloop_wait(cnx->mainloop());
 			}
 		}
+	}
 
-		try
+	void log_latency()
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (now < next_log)
+			return;
+		next_log = now + latency_log_interval;
+		if (speaker_stream)
+			U_LOG_I("Audio latency: speaker %.1fms from sink to network", speaker_latency * 1e-6);
+		if (mic_stream)
+			U_LOG_I("Audio latency: microphone %.1fms from headset capture to source", mic_latency * 1e-6);
+	}
+
+	static void speaker_read(pa_stream * stream, size_t, void * userdata)
+	{
+		auto self = (pulse_device *)userdata;
+		const size_t frame_size = self->desc.speaker->num_channels * sizeof(int16_t);
+
+		while (pa_stream_readable_size(stream) > 0)
 		{
-			while (not quit)
+			const void * data;
+			size_t size;
+			if (pa_stream_peek(stream, &data, &size) < 0 or size == 0)
+				break;
+
+			// data is null when there is a hole in the stream
+			if (data)
 			{
-				pollfd pfd{};
-				pfd.fd = speaker_pipe.get_fd();
-				pfd.events = POLL_IN;
-
-				int r = poll(&pfd, 1, 100);
-				if (r < 0)
-					throw std::system_error(errno, std::system_category());
-				if (pfd.revents & (POLLHUP | POLLERR))
-					throw std::runtime_error("Error on speaker pipe");
-				if (pfd.revents & POLLIN)
+				// Latency includes this chunk, its last sample was produced when the rest was
+				pa_usec_t latency = 0;
+				int negative = 0;
+				if (pa_stream_get_latency(stream, &latency, &negative) < 0 or negative)
+					latency = 0;
+				int64_t duration = int64_t(size / frame_size) * 1'000'000'000 / self->desc.speaker->sample_rate;
+				self->speaker_latency = std::max<int64_t>(0, latency * 1000 - duration);
+
+				wivrn::audio_data packet{
+				        .timestamp = self->session.get_offset().to_headset(os_monotonic_get_ns() - self->speaker_latency),
+				        .payload = std::span((uint8_t *)data, size),
+				};
+				try
 				{
-					int size = read(pfd.fd, buffer.data() + remainder, buffer_size - remainder);
-					if (size < 0)
-						throw std::system_error(errno, std::system_category());
-					size += remainder;              // full size of available data
-					remainder = size % sample_size; // data to keep for next iteration
-					size -= remainder;              // size of data to send
-					packet.payload = std::span<uint8_t>(buffer.begin(), size);
-					packet.timestamp = session.get_offset().to_headset(os_monotonic_get_ns());
-
-					try
-					{
-						session.send_control(packet);
-					}
-					catch (std::exception & e)
-					{
-						U_LOG_D("Failed to send audio data: %s", e.what());
-					}
-
-					// put the remaining data at the beginning of the buffer
-					memmove(buffer.data(), buffer.data() + size, remainder);
+					self->session.send_control(packet);
+				}
+				catch (std::exception & e)
+				{
+					U_LOG_D("Failed to send audio data: %s", e.what());
 				}
 			}
+			pa_stream_drop(stream);
 		}
-		catch (const std::exception & e)
-		{
-			U_LOG_D("Error in audio thread: %s", e.what());
-		}
+		self->log_latency();
 	}
 
-	void run_mic()
+	static void mic_write(pa_stream * stream, size_t nbytes, void * userdata)
 	{
-		assert(desc.microphone);
-		pthread_setname_np(pthread_self(), "mic_thread");
-
-		const size_t sample_size = desc.microphone->num_channels * sizeof(int16_t);
-		try
+		auto self = (pulse_device *)userdata;
+		const size_t num_channels = self->desc.microphone->num_channels;
+		const size_t frame_size = num_channels * sizeof(int16_t);
+		const uint32_t sample_rate = self->desc.microphone->sample_rate;
+
+		void * data;
+		if (pa_stream_begin_write(stream, &data, &nbytes) < 0 or not data)
+			return;
+		size_t num_frames = nbytes / frame_size;
+
+		auto & sync = *self->mic_sync_state;
+		auto offset = self->session.get_offset();
+		sync.update(double(self->mic_buffer_size_bytes / frame_size) / sample_rate, offset);
+
+		pa_usec_t latency = 0;
+		int negative = 0;
+		if (pa_stream_get_latency(stream, &latency, &negative) < 0 or negative)
+			latency = 0;
+
+		std::span<int16_t> output((int16_t *)data, num_frames * num_channels);
+		size_t written = 0;
+		while (true)
 		{
-			while (not quit)
-			{
-				pollfd pfd{};
-				pfd.fd = mic_pipe.get_fd();
-				pfd.events = POLLOUT;
-
-				int r = poll(&pfd, 1, 100);
-				if (r < 0)
-					throw std::system_error(errno, std::system_category());
-				if (pfd.revents & (POLLHUP | POLLERR))
-					throw std::runtime_error("Error on mic pipe");
-				if (pfd.revents & POLLOUT)
-				{
-					auto packet = mic_buffer.pop();
-					auto & buffer = packet.payload;
+			written += sync.resampler.pull(output.subspan(written * num_channels));
+			if (written == num_frames)
+				break;
+
+			auto tmp = self->mic_samples.read();
+			if (not tmp)
+				break;
+			sync.resampler.push(tmp->payload);
+			self->mic_buffer_size_bytes -= tmp->payload.size_bytes();
+
+			// The last sample of this packet is played after what is already in the resampler and in the sink
+			if (offset)
+				self->mic_latency = os_monotonic_get_ns() - offset.from_headset(tmp->timestamp) + int64_t(sync.resampler.buffered() * 1e9 / sample_rate) + latency * 1000;
+		}
 
-					int written = write(mic_pipe.get_fd(), buffer.data(), buffer.size());
-					if (written < 0)
-						throw std::system_error(errno, std::system_category());
+		// Keep the stream running on underruns, so that timing stays consistent
+		std::ranges::fill(output.subspan(written * num_channels), 0);
+		pa_stream_write(stream, data, num_frames * frame_size, nullptr, 0, PA_SEEK_RELATIVE);
 
-					// Discard anything that didn't fit the buffer
-				}
-			}
-		}
-		catch (const std::exception & e)
+		// The resampler only corrects small drifts, discard excess data after an interruption
+		size_t max_buffer_size = frame_size * sample_rate * mic_max_buffer;
+		while (self->mic_buffer_size_bytes > max_buffer_size and self->mic_samples.size() > 1)
 		{
-			U_LOG_E("Error in audio thread: %s", e.what());
+			auto tmp = self->mic_samples.read();
+			if (not tmp)
+				break;
+			self->mic_buffer_size_bytes -= tmp->payload.size_bytes();
+			U_LOG_D("Audio sync: discard %ld bytes", tmp->payload.size_bytes());
 		}
+		self->log_latency();
 	}
 
 	void process_mic_data(wivrn::audio_data && mic_data) override
 	{
-		mic_buffer.push(std::move(mic_data));
+		auto size = mic_data.payload.size_bytes();
+		if (mic_samples.write(std::move(mic_data)))
+			mic_buffer_size_bytes += size;
 	}
 
 	pulse_device(
@@ -413,33 +475,76 @@ struct pulse_device : public audio_device
 	        wivrn::wivrn_session & session) :
 	        session(session)
 	{
-		pa_connection cnx("WiVRn");
+		cnx.emplace("WiVRn");
 
 		if (info.microphone)
 		{
-			microphone = ensure_source(cnx, source_name.c_str(), source_description, info.microphone->num_channels, info.microphone->sample_rate);
+			std::tie(microphone, microphone_sink) = ensure_source(*cnx, source_name, source_description, info.microphone->num_channels, info.microphone->sample_rate);
 			desc.microphone = {
 			        .num_channels = info.microphone->num_channels,
 			        .sample_rate = info.microphone->sample_rate};
-
-			mic_pipe = open(microphone->socket.c_str(), O_WRONLY | O_NONBLOCK);
-			if (not mic_pipe)
-				throw std::system_error(errno, std::system_category(), "failed to open mic pipe " + microphone->socket.string());
-			mic_thread = std::thread([this]() { run_mic(); });
+			mic_sync_state.emplace(desc.microphone->num_channels, desc.microphone->sample_rate);
+
+			pa_sample_spec spec{
+			        .format = PA_SAMPLE_S16NE,
+			        .rate = desc.microphone->sample_rate,
+			        .channels = desc.microphone->num_channels,
+			};
+			pa_buffer_attr attr{
+			        .maxlength = uint32_t(-1),
+			        .tlength = uint32_t(pa_usec_to_bytes(std::chrono::microseconds(mic_target_length).count(), &spec)),
+			        // Never stop playback, silence is written on underruns
+			        .prebuf = 0,
+			        .minreq = uint32_t(-1),
+			        .fragsize = uint32_t(-1),
+			};
+
+			pa_lock lock(cnx->mainloop());
+			mic_stream = pa_stream_new(*cnx, "WiVRn microphone", &spec, nullptr);
+			pa_stream_set_state_callback(mic_stream, &stream_state, this);
+			pa_stream_set_write_callback(mic_stream, &mic_write, this);
+			pa_stream_connect_playback(
+			        mic_stream,
+			        (source_name + "-sink").c_str(),
+			        &attr,
+			        pa_stream_flags_t(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_DONT_MOVE),
+			        nullptr,
+			        nullptr);
+			wait_ready(mic_stream);
+			U_LOG_I("pulseaudio microphone stream created");
 		}
 
 		if (info.speaker)
 		{
-			speaker = ensure_sink(cnx, sink_name.c_str(), sink_description, info.speaker->num_channels, info.speaker->sample_rate);
+			speaker = ensure_sink(*cnx, sink_name, sink_description, info.speaker->num_channels, info.speaker->sample_rate);
 			desc.speaker = {
 			        .num_channels = info.speaker->num_channels,
 			        .sample_rate = info.speaker->sample_rate};
 
-			speaker_pipe = open(speaker->socket.c_str(), O_RDONLY | O_NONBLOCK);
-			if (not speaker_pipe)
-				throw std::system_error(errno, std::system_category(), "failed to open speaker pipe " + speaker->socket.string());
-
-			speaker_thread = std::thread([this]() { run_speaker(); });
+			pa_sample_spec spec{
+			        .format = PA_SAMPLE_S16NE,
+			        .rate = desc.speaker->sample_rate,
+			        .channels = desc.speaker->num_channels,
+			};
+			pa_buffer_attr attr{
+			        .maxlength = uint32_t(-1),
+			        .tlength = uint32_t(-1),
+			        .prebuf = uint32_t(-1),
+			        .minreq = uint32_t(-1),
+			        .fragsize = uint32_t(pa_usec_to_bytes(std::chrono::microseconds(speaker_fragment).count(), &spec)),
+			};
+
+			pa_lock lock(cnx->mainloop());
+			speaker_stream = pa_stream_new(*cnx, "WiVRn speaker", &spec, nullptr);
+			pa_stream_set_state_callback(speaker_stream, &stream_state, this);
+			pa_stream_set_read_callback(speaker_stream, &speaker_read, this);
+			pa_stream_connect_record(
+			        speaker_stream,
+			        (sink_name + ".monitor").c_str(),
+			        &attr,
+			        pa_stream_flags_t(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_DONT_MOVE));
+			wait_ready(speaker_stream);
+			U_LOG_I("pulseaudio speaker stream created, sample rate %dHz, %d channels", desc.speaker->sample_rate, desc.speaker->num_channels);
 		}
 	}
 };
@@ -19,6 +19,7 @@
 
 #include "audio_setup.h"
 
+#include "driver/clock_offset.h"
 #include "util/u_logging.h"
 #include "wivrn_config.h"
 
@@ -30,6 +31,45 @@
 #include "audio_pipewire.h"
 #endif
 
+// Level of the microphone buffer held by adjusting the playback speed
+static const std::chrono::milliseconds mic_target_buffer{40};
+// Preallocated resampler input, more than a callback and a packet
+static const std::chrono::milliseconds mic_max_resampler_input{500};
+static const std::chrono::seconds sync_log_interval{30};
+
+wivrn::mic_sync::mic_sync(size_t num_channels, uint32_t sample_rate) :
+        sample_rate(sample_rate),
+        resampler(num_channels),
+        controller(mic_target_buffer)
+{
+	resampler.reserve(sample_rate * mic_max_resampler_input.count() / 1000);
+}
+
+void wivrn::mic_sync::update(double level, const clock_offset & offset)
+{
+	auto now = std::chrono::steady_clock::now();
+	double dt = std::chrono::duration<double>(now - last_update).count();
+	last_update = now;
+
+	level += resampler.buffered() / sample_rate;
+	double correction = controller.update(level, dt);
+
+	// The headset audio clock runs at the same speed as its system clock,
+	// which is 1 + a times faster than the server one
+	if (offset)
+		drift = offset.a;
+	resampler.set_ratio((1 + drift) * (1 + correction));
+
+	if (now > next_log)
+	{
+		next_log = now + sync_log_interval;
+		U_LOG_I("Audio sync: microphone buffer %.1fms, clock drift %.0fppm, correction %.0fppm",
+		        controller.measured() * 1000,
+		        drift * 1e6,
+		        correction * 1e6);
+	}
+}
+
 std::shared_ptr<wivrn::audio_device> wivrn::audio_device::create(
         const std::string & source_name,
         const std::string & source_description,
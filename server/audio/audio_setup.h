@@ -19,14 +19,33 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 
+#include "audio_resampler.h"
 #include "wivrn_packets.h"
 
 namespace wivrn
 {
 class wivrn_session;
+struct clock_offset;
+
+// Plays the microphone data at the rate of the server audio clock
+struct mic_sync
+{
+	uint32_t sample_rate;
+	audio_resampler resampler;
+	audio_drift_controller controller;
+	double drift = 0;
+	std::chrono::steady_clock::time_point last_update;
+	std::chrono::steady_clock::time_point next_log;
+
+	mic_sync(size_t num_channels, uint32_t sample_rate);
+
+	// level: buffered duration in seconds, not including the resampler
+	void update(double level, const clock_offset &);
+};
 
 struct audio_device
 {
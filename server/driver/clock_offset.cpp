@@ -19,32 +19,58 @@
 
 #include "clock_offset.h"
 
-#include "driver/wivrn_connection.h"
+#include "driver/transmit_scheduler.h"
 #include "os/os_time.h"
 #include "util/u_logging.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace wivrn
 {
 
-static const size_t num_samples = 100;
+// Only the sample with the lowest round trip time of each group is used:
+// its midpoint is the closest to the actual time of the response
+static const size_t samples_per_point = 8;
+// Weight of previous points when a new point is added
+static const double forget_factor = 0.98;
+// Number of consecutive points where the estimate moves by less than
+// max_step before the offset is considered stable
+static const size_t min_points = 4;
+static const int64_t max_step = 1'000'000;
+// Drift is only estimated when points span enough time (variance in s²)
+static const double min_x_variance = 1;
+// Crystal oscillators are within a few tens of ppm
+static const double max_drift = 500e-6;
+// Once stable, points further than this from the fit (plus a multiple of the
+// residual) are ignored, unless there are max_outliers of them in a row:
+// a single delayed response does not reset the convergence
+static const int64_t outlier_threshold = 2'000'000;
+static const double outlier_residuals = 4;
+static const size_t max_outliers = 4;
 
 void clock_offset_estimator::reset()
 {
 	std::lock_guard lock(mutex);
-	sample_index = 0;
-	samples.clear();
+	group_size = 0;
+	points = 0;
+	converged_points = 0;
+	residual = 0;
+	outliers = 0;
+	sum_w = sum_x = sum_y = sum_xx = sum_xy = sum_yy = 0;
 	offset = clock_offset();
 	next_sample = {};
 	sample_interval = std::chrono::milliseconds(10);
 }
 
-void clock_offset_estimator::request_sample(wivrn_connection & connection)
+void clock_offset_estimator::request_sample(transmit_scheduler & transmitter)
 {
 	if (std::chrono::steady_clock::now() < next_sample)
 		return;
 
 	next_sample = std::chrono::steady_clock::now() + sample_interval.load();
-	connection.send_stream(
+	// Urgent: a queueing delay before the query is sent would bias the offset
+	transmitter.send_stream(
 	        wivrn::to_headset::timesync_query{
 	                .query = XrTime(os_monotonic_get_ns()),
 	        });
@@ -54,78 +80,111 @@ void clock_offset_estimator::add_sample(const wivrn::from_headset::timesync_resp
 {
 	XrTime now = os_monotonic_get_ns();
 	clock_offset_estimator::sample sample{base_sample, now};
+	if (sample.received < sample.query)
+		return;
+
 	std::lock_guard lock(mutex);
-	if (samples.size() < num_samples)
-	{
-		samples.push_back(sample);
-	}
-	else
+	if (group_size == 0 or sample.received - sample.query < best.received - best.query)
+		best = sample;
+
+	if (++group_size < samples_per_point)
 	{
-		sample_interval = std::chrono::milliseconds(100);
-		int64_t latency = 0;
-		for (const auto & s: samples)
-			latency += s.received - s.query;
-		latency /= samples.size();
-		// packets with too high latency are likely to be retransmitted
-		if (sample.received - sample.query > 3 * latency)
+		if (points == 0)
 		{
-			U_LOG_D("drop packet for latency %ldµs > %ldµs", (sample.received - sample.query) / 1000, latency / 1000);
-			return;
+			// Rough estimate until the first group is complete
+			offset.x0 = (best.query + best.received) / 2;
+			offset.b = best.response - offset.x0;
+			offset.uncertainty = (best.received - best.query) / 2;
 		}
-
-		samples[sample_index] = sample;
-		sample_index = (sample_index + 1) % num_samples;
+		return;
 	}
 
-	// Linear regression
-	// X = time on server
-	// Y = time on headset
-	// in order to maintain accuracy, use x = X-x0, y = Y-y0
-	// where x0 and y0 are means of X an Y
-	size_t n = samples.size();
-	double inv_n = 1. / n;
-	double x0 = 0;
-	double y0 = 0;
-	for (const auto & s: samples)
-	{
-		x0 += (s.query + s.received) * 0.5;
-		y0 += s.response;
-	}
-	x0 *= inv_n;
-	y0 *= inv_n;
+	group_size = 0;
+	add_point(best);
+}
 
-	if (samples.size() < num_samples)
+void clock_offset_estimator::add_point(const sample & s)
+{
+	// assume symmetrical latency, the error is at most half the round trip time
+	XrTime x = (s.query + s.received) / 2;
+	int64_t y = s.response - x;
+
+	if (offset.stable)
 	{
-		offset.b = y0 - x0;
-		return;
+		int64_t error = std::abs(offset.to_headset(x) - s.response);
+		if (error > outlier_threshold + outlier_residuals * residual and ++outliers < max_outliers)
+		{
+			U_LOG_D("clock offset: ignoring outlier %ldµs from the estimate", error / 1000);
+			return;
+		}
 	}
+	outliers = 0;
 
-	double sum_x = 0;
-	double sum_y = 0;
-	for (const auto & s: samples)
+	if (points++ == 0)
 	{
-#if 1
-		// assume symmetrical latency
-		double x = (s.query + s.received) * 0.5 - x0;
-#else
-		// assume latency is only on server -> headset link
-		double x = s.received - x0;
-#endif
-		double y = s.response - y0;
-		sum_x += x;
-		sum_y += y;
+		x_ref = x;
+		y_ref = y;
 	}
 
-	double mean_x = sum_x * inv_n;
-	double mean_y = sum_y * inv_n;
+	sum_w *= forget_factor;
+	sum_x *= forget_factor;
+	sum_y *= forget_factor;
+	sum_xx *= forget_factor;
+	sum_xy *= forget_factor;
+	sum_yy *= forget_factor;
+
+	// Move the origin to the new point, so that sums are centered on
+	// recent points and keep their precision
+	double dx = (x - x_ref) * 1e-9;
+	double dy = y - y_ref;
+	sum_xx += -2 * dx * sum_x + dx * dx * sum_w;
+	sum_xy += -dx * sum_y - dy * sum_x + dx * dy * sum_w;
+	sum_yy += -2 * dy * sum_y + dy * dy * sum_w;
+	sum_x -= dx * sum_w;
+	sum_y -= dy * sum_w;
+	x_ref = x;
+	y_ref = y;
+
+	// The new point is at the origin
+	sum_w += 1;
+
+	double mean_x = sum_x / sum_w;
+	double mean_y = sum_y / sum_w;
+	double var_x = sum_xx / sum_w - mean_x * mean_x;
+	double cov_xy = sum_xy / sum_w - mean_x * mean_y;
+	double var_y = sum_yy / sum_w - mean_y * mean_y;
+
+	// slope in ns/s
+	double slope = 0;
+	if (var_x > min_x_variance)
+		slope = std::clamp(cov_xy / var_x, -max_drift * 1e9, max_drift * 1e9);
+
+	double new_residual = std::sqrt(std::max(0., var_y - 2 * slope * cov_xy + slope * slope * var_x));
+
+	// The estimate has converged when new points no longer move it, whatever
+	// the round trip time: the uncertainty is reported separately
+	int64_t previous_b = offset.b + std::llround(offset.a * (x_ref - offset.x0));
+	int64_t new_b = y_ref + std::llround(mean_y - slope * mean_x);
+	if (points > 1 and std::abs(new_b - previous_b) < max_step and std::abs(new_residual - residual) < max_step)
+		++converged_points;
+	else
+		converged_points = 0;
+	residual = new_residual;
 
-	double b = y0 + (mean_y - mean_x) - x0;
+	offset.x0 = x_ref;
+	offset.b = new_b;
+	offset.a = slope * 1e-9;
+	offset.uncertainty = (s.received - s.query) / 2 + std::llround(residual);
+	offset.stable = converged_points >= min_points;
 
-	// b changed less than 20ms
-	offset.stable = std::abs((b - (double)offset.b)) < 20'000'000;
+	if (points >= min_points)
+		sample_interval = std::chrono::milliseconds(100);
 
-	offset.b = b;
-	U_LOG_D("clock relations: headset = x+b where b=%ldµs", offset.b / 1000);
+	U_LOG_D("clock relations: headset = x+b+a(x-x0) where b=%ldµs, a=%.1fppm, uncertainty %ldµs%s",
+	        offset.b / 1000,
+	        offset.a * 1e6,
+	        offset.uncertainty / 1000,
+	        offset.stable ? "" : " (not converged)");
 }
 
 clock_offset clock_offset_estimator::get_offset()
@@ -136,11 +195,12 @@ clock_offset clock_offset_estimator::get_offset()
 
 XrTime clock_offset::from_headset(XrTime ts) const
 {
-	return ts - b;
+	// a is small enough for the first order approximation
+	return ts - b - std::llround(a * (ts - b - x0));
 }
 
 XrTime clock_offset::to_headset(XrTime timestamp_ns) const
 {
-	return timestamp_ns + b;
+	return timestamp_ns + b + std::llround(a * (timestamp_ns - x0));
 }
 } // namespace wivrn
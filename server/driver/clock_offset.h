@@ -29,14 +29,19 @@
 namespace wivrn
 {
 
-class wivrn_connection;
+class transmit_scheduler;
 
 struct clock_offset
 {
 	// y: headset time
 	// x: server time
-	// y = x+b
+	// y = x + b + a(x - x0)
 	int64_t b = 0;
+	XrTime x0 = 0;
+	// relative drift of the headset clock
+	double a = 0;
+	// estimated error on y, in nanoseconds
+	int64_t uncertainty = 0;
 	bool stable = false;
 
 	operator bool() const
@@ -57,8 +62,30 @@ class clock_offset_estimator
 	};
 
 	std::mutex mutex;
-	std::vector<sample> samples;
-	size_t sample_index = 0;
+
+	// sample with the lowest round trip time in the current group
+	sample best;
+	size_t group_size = 0;
+
+	// exponentially weighted sums for the linear regression of the offset
+	// x: server time relative to x_ref, in seconds
+	// y: offset relative to y_ref, in nanoseconds
+	size_t points = 0;
+	// consecutive points that did not move the estimate
+	size_t converged_points = 0;
+	// residual of the fit at the last point, in nanoseconds
+	double residual = 0;
+	// consecutive points rejected as outliers
+	size_t outliers = 0;
+	XrTime x_ref = 0;
+	int64_t y_ref = 0;
+	double sum_w = 0;
+	double sum_x = 0;
+	double sum_y = 0;
+	double sum_xx = 0;
+	double sum_xy = 0;
+	double sum_yy = 0;
+
 	clock_offset offset;
 
 	std::chrono::steady_clock::time_point next_sample{};
@@ -66,9 +93,12 @@ class clock_offset_estimator
 
 public:
 	void reset();
-	void request_sample(wivrn_connection & connection);
+	void request_sample(transmit_scheduler &);
 	void add_sample(const wivrn::from_headset::timesync_response & sample);
 
 	clock_offset get_offset();
+
+private:
+	void add_point(const sample &);
 };
 } // namespace wivrn
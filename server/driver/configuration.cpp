@@ -50,6 +50,23 @@ NLOHMANN_JSON_SERIALIZE_ENUM(
                 {av1, "AV1"},
         })
 
+NLOHMANN_JSON_SERIALIZE_ENUM(
+        configuration::pacing_mode,
+        {
+                {configuration::pacing_mode(-1), ""},
+                {configuration::pacing_mode::off, "off"},
+                {configuration::pacing_mode::user, "user"},
+                {configuration::pacing_mode::kernel, "kernel"},
+        })
+
+NLOHMANN_JSON_SERIALIZE_ENUM(
+        frame_drop_policy,
+        {
+                {frame_drop_policy(-1), ""},
+                {frame_drop_policy::drop_oldest, "drop_oldest"},
+                {frame_drop_policy::drop_late, "drop_late"},
+        })
+
 void configuration::set_config_file(const std::filesystem::path & path)
 {
 	config_file = path;
@@ -126,6 +143,54 @@ configuration configuration::read_user_configuration()
 		{
 			result.tcp_only = json["tcp_only"];
 		}
+
+		if (json.contains("adaptive_foveation"))
+		{
+			result.adaptive_foveation = json["adaptive_foveation"];
+		}
+
+		if (json.contains("pacing"))
+		{
+			result.pacing = json["pacing"];
+			if (result.pacing == pacing_mode(-1))
+				throw std::runtime_error("invalid pacing value " + json["pacing"].get<std::string>());
+		}
+
+		if (json.contains("pacing_fraction"))
+		{
+			result.pacing_fraction = json["pacing_fraction"];
+			if (result.pacing_fraction <= 0)
+				throw std::runtime_error("pacing_fraction must be positive");
+		}
+
+		if (json.contains("pacing_rate"))
+		{
+			result.pacing_rate = json["pacing_rate"];
+		}
+
+		if (json.contains("reference_invalidation"))
+		{
+			result.reference_invalidation = json["reference_invalidation"];
+		}
+
+		if (json.contains("depth_stream"))
+		{
+			result.depth_stream = json["depth_stream"];
+		}
+
+		if (json.contains("decode_queue_depth"))
+		{
+			result.decode_queue_depth = json["decode_queue_depth"];
+			if (*result.decode_queue_depth < 1 or *result.decode_queue_depth > decode_queue_settings::max_depth)
+				throw std::runtime_error("decode_queue_depth must be between 1 and " + std::to_string(decode_queue_settings::max_depth));
+		}
+
+		if (json.contains("frame_drop_policy"))
+		{
+			result.frame_drop_policy = json["frame_drop_policy"];
+			if (result.frame_drop_policy == wivrn::frame_drop_policy(-1))
+				throw std::runtime_error("invalid frame_drop_policy value " + json["frame_drop_policy"].get<std::string>());
+		}
 	}
 	catch (const std::exception & e)
 	{
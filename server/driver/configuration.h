@@ -32,6 +32,13 @@ namespace wivrn
 
 struct configuration
 {
+	enum class pacing_mode
+	{
+		off,
+		user,   // token bucket in the transmit thread
+		kernel, // SO_MAX_PACING_RATE, requires the fq queueing discipline
+	};
+
 	struct encoder
 	{
 		std::string name;
@@ -50,6 +57,16 @@ struct configuration
 	std::optional<std::array<double, 2>> scale;
 	std::vector<std::string> application;
 	bool tcp_only = false;
+	bool adaptive_foveation = false;
+	pacing_mode pacing = pacing_mode::user;
+	// video is paced at bitrate / pacing_fraction, or at pacing_rate if set (bit/s)
+	double pacing_fraction = 0.5;
+	std::optional<uint64_t> pacing_rate;
+	bool reference_invalidation = false;
+	bool depth_stream = false;
+	// Override the queue of decoded frames requested by the headset
+	std::optional<int> decode_queue_depth;
+	std::optional<wivrn::frame_drop_policy> frame_drop_policy;
 
 	static void set_config_file(const std::filesystem::path &);
 	static const std::filesystem::path & get_config_file();
@@ -0,0 +1,100 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Measures the accuracy and time of the table based foveation solver
+// against the exact one
+// Not part of the build, compile with:
+//   g++ -std=c++20 -O2 server/driver/foveation_bench.cpp
+
+#include "foveation_solver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace wivrn;
+
+namespace
+{
+struct sample
+{
+	float scale;
+	float center;
+};
+
+// Scales and centers covered by the table
+std::vector<sample> make_samples()
+{
+	std::vector<sample> samples;
+	for (int i = 0; i <= 450; ++i)
+	{
+		for (int j = -99; j <= 99; ++j)
+			samples.push_back({0.05f + 0.9f * i / 450, j / 100.f});
+	}
+	return samples;
+}
+
+template <typename F>
+double time_ns(const std::vector<sample> & samples, F && solve)
+{
+	// Keep the results alive so that the calls are not optimized out
+	volatile float sink = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (const auto & s: samples)
+	{
+		auto [a, b] = solve(s.scale, s.center);
+		sink = sink + a + b;
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+	return elapsed.count() / samples.size();
+}
+} // namespace
+
+int main()
+{
+	const auto samples = make_samples();
+
+	auto begin = std::chrono::steady_clock::now();
+	const foveation_table table;
+	std::chrono::duration<double, std::milli> build_time = std::chrono::steady_clock::now() - begin;
+	printf("table built in %.1f ms\n", build_time.count());
+
+	// Foveated position error in [-1, 1] coordinates
+	double max_error = 0;
+	sample worst{};
+	for (const auto & s: samples)
+	{
+		auto [a, b] = solve_foveation(s.scale, s.center);
+		auto [fast_a, fast_b] = table.solve(s.scale, s.center);
+		for (int k = -50; k <= 50; ++k)
+		{
+			double x = k / 50.;
+			double error = std::abs(foveate(fast_a, fast_b, s.scale, s.center, x) - foveate(a, b, s.scale, s.center, x));
+			if (error > max_error)
+			{
+				max_error = error;
+				worst = s;
+			}
+		}
+	}
+	printf("max position error %.2e at scale %.3f, center %.2f\n", max_error, worst.scale, worst.center);
+
+	printf("exact solver: %6.1f ns\n", time_ns(samples, solve_foveation));
+	printf("table solver: %6.1f ns\n", time_ns(samples, [&](float λ, float c) { return table.solve(λ, c); }));
+}
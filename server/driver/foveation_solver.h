@@ -0,0 +1,178 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <tuple>
+
+namespace wivrn
+{
+
+inline double foveate(double a, double b, double λ, double c, double x)
+{
+	// In order to save encoding, transmit and decoding time, only a portion of the image is encoded in full resolution.
+	// on each axis, foveated coordinates are defined by the following formula.
+	return λ / a * tan(a * x + b) + c;
+	// a and b are defined such as:
+	// edges of the image are not moved
+	// f(-1) = -1
+	// f( 1) =  1
+	// the function also enforces pixel ratio 1:1 at fovea
+	// df⁻¹(x)/dx = 1/scale for x = c
+}
+
+inline std::tuple<float, float> solve_foveation(float λ, float c)
+{
+	// Compute a and b for the foveation function such that:
+	//   foveate(a, b, scale, c, -1) = -1   (eq. 1)
+	//   foveate(a, b, scale, c,  1) =  1   (eq. 2)
+	//
+	// Use eq. 2 to express a as function of b, then replace in eq. 1
+	// equation that needs to be null is:
+	auto b = [λ, c](double a) { return atan(a * (1 - c) / λ) - a; };
+	auto eq = [λ, c](double a) { return atan(a * (1 - c) / λ) + atan(a * (1 + c) / λ) - 2 * a; }; // (eq. 3)
+
+	// function starts positive, reaches a maximum then decreases to -∞
+	double a0 = 0;
+	// Find a negative value by computing eq(2^n)
+	double a1 = 1;
+	while (eq(a1) > 0)
+		a1 *= 2;
+
+	// last computed values for f(a0) and f(a1)
+	std::optional<double> f_a0;
+	double f_a1 = eq(a1);
+
+	int n = 0;
+	double a = 0;
+	while (std::abs(a1 - a0) > 0.0000001 && n++ < 100)
+	{
+		if (not f_a0)
+		{
+			// use binary search
+			a = 0.5 * (a0 + a1);
+			double val = eq(a);
+			if (val > 0)
+			{
+				a0 = a;
+				f_a0 = val;
+			}
+			else
+			{
+				a1 = a;
+				f_a1 = val;
+			}
+		}
+		else
+		{
+			// f(a1) is always defined
+			// when f(a0) is defined, use secant method
+			a = a1 - f_a1 * (a1 - a0) / (f_a1 - *f_a0);
+			a0 = a1;
+			a1 = a;
+			f_a0 = f_a1;
+			f_a1 = eq(a);
+		}
+	}
+
+	return {a, b(a)};
+}
+
+// Values of a from solve_foveation, sampled on a regular (scale, center) grid.
+// With a bilinear interpolation and two Newton steps on eq. 3,
+// the foveated position is within 2e-5 of the exact solution
+// (see server/driver/foveation_bench.cpp).
+// a goes to 0 when scale goes to 1 and is poorly interpolated there,
+// such values use the exact solver.
+// Building the table takes a few ms, construct it outside of the frame loop.
+class foveation_table
+{
+	static constexpr int scale_count = 64;
+	static constexpr int center_count = 129;
+	static constexpr float min_scale = 0.05;
+	static constexpr float max_scale = 0.95;
+
+	std::array<float, scale_count * center_count> a;
+
+	float at(int i, int j) const
+	{
+		return a[i * center_count + j];
+	}
+
+	std::optional<std::tuple<float, float>> interpolate(float λ, float c) const
+	{
+		if (λ < min_scale or λ > max_scale or c < -1 or c > 1)
+			return std::nullopt;
+
+		float x = (λ - min_scale) / (max_scale - min_scale) * (scale_count - 1);
+		float y = (c + 1) / 2 * (center_count - 1);
+		int i = std::min<int>(x, scale_count - 2);
+		int j = std::min<int>(y, center_count - 2);
+		float fx = x - i;
+		float fy = y - j;
+
+		double a0 = (1 - fy) * at(i, j) + fy * at(i, j + 1);
+		double a1 = (1 - fy) * at(i + 1, j) + fy * at(i + 1, j + 1);
+		double a = (1 - fx) * a0 + fx * a1;
+
+		// Refine with Newton's method on eq. 3, a single step leaves errors
+		// up to 5e-4 for small scales and centers close to the edges
+		double u = (1 - c) / λ;
+		double v = (1 + c) / λ;
+		for (int n = 0; n < 2; ++n)
+		{
+			double f = atan(a * u) + atan(a * v) - 2 * a;
+			double df = u / (1 + a * a * u * u) + v / (1 + a * a * v * v) - 2;
+			if (df != 0)
+				a -= f / df;
+		}
+
+		if (not(a > 0))
+			return std::nullopt;
+
+		return std::tuple<float, float>{a, atan(a * u) - a};
+	}
+
+public:
+	foveation_table()
+	{
+		for (int i = 0; i < scale_count; ++i)
+		{
+			float λ = min_scale + (max_scale - min_scale) * i / (scale_count - 1);
+			for (int j = 0; j < center_count; ++j)
+			{
+				float c = -1 + 2.f * j / (center_count - 1);
+				a[i * center_count + j] = std::get<0>(solve_foveation(λ, c));
+			}
+		}
+	}
+
+	// Same result as solve_foveation
+	std::tuple<float, float> solve(float λ, float c) const
+	{
+		if (auto res = interpolate(λ, c))
+			return *res;
+		return solve_foveation(λ, c);
+	}
+};
+} // namespace wivrn
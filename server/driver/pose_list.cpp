@@ -62,15 +62,19 @@ xrt_space_relation pose_list::extrapolate(const xrt_space_relation & a, const xr
 	return res;
 }
 
-bool pose_list::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+tracked_poses::tracked_poses(const from_headset::tracking & tracking)
 {
 	for (const auto & pose: tracking.device_poses)
 	{
-		if (pose.device != device)
-			continue;
-
-		return add_sample(tracking.production_timestamp, tracking.timestamp, convert_pose(pose), offset);
+		if (size_t(pose.device) < poses.size())
+			poses[size_t(pose.device)] = &pose;
 	}
+}
+
+bool pose_list::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
+{
+	if (auto pose = poses[device])
+		return add_sample(tracking.production_timestamp, tracking.timestamp, convert_pose(*pose), offset);
 	return true;
 }
 
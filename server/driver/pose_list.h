@@ -23,10 +23,26 @@
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <array>
+
 namespace wivrn
 {
 struct clock_offset;
 
+// Poses of a tracking packet, indexed by device
+class tracked_poses
+{
+	std::array<const from_headset::tracking::pose *, size_t(device_id::EYE_GAZE) + 1> poses{};
+
+public:
+	explicit tracked_poses(const from_headset::tracking &);
+
+	const from_headset::tracking::pose * operator[](device_id id) const
+	{
+		return poses[size_t(id)];
+	}
+};
+
 class pose_list : public history<pose_list, xrt_space_relation>
 {
 public:
@@ -38,7 +54,7 @@ public:
 	pose_list(wivrn::device_id id) :
 	        device(id) {}
 
-	bool update_tracking(const wivrn::from_headset::tracking &, const clock_offset & offset);
+	bool update_tracking(const wivrn::from_headset::tracking &, const tracked_poses &, const clock_offset & offset);
 
 	static xrt_space_relation convert_pose(const wivrn::from_headset::tracking::pose &);
 };
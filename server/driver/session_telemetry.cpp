@@ -0,0 +1,175 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "session_telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace wivrn
+{
+
+namespace
+{
+const std::array<std::string_view, 9> event_names = {
+        "encode_begin",
+        "encode_end",
+        "send_begin",
+        "receive_end",
+        "decode_begin",
+        "decode_end",
+        "dequeue",
+        "display",
+        "lost",
+};
+} // namespace
+
+void session_telemetry::stage::add(const frame & f, event begin, event end)
+{
+	if (f.times[begin] == 0 or f.times[end] < f.times[begin])
+		return;
+
+	int64_t duration = f.times[end] - f.times[begin];
+	count++;
+	total += duration;
+	max = std::max(max, duration);
+}
+
+from_monado::telemetry::stage session_telemetry::stage::get() const
+{
+	if (count == 0)
+		return {NAN, NAN};
+	return {
+	        .mean = float(total / count * 1e-9),
+	        .max = float(max * 1e-9),
+	};
+}
+
+void session_telemetry::add_event(std::string_view name, uint64_t frame_idx, uint8_t stream_idx, int64_t time)
+{
+	static_assert(event_names.size() == num_events);
+	auto it = std::ranges::find(event_names, name);
+	// Events of the compositor and of the transmit scheduler are not per stream
+	if (it == event_names.end() or stream_idx == uint8_t(-1))
+		return;
+	auto e = event(it - event_names.begin());
+
+	std::lock_guard lock(mutex);
+	if (stream_idx >= frames.size())
+		frames.resize(stream_idx + 1);
+
+	auto & f = frames[stream_idx][frame_idx % max_frames];
+	if (f.frame_idx != frame_idx)
+		f = {.frame_idx = frame_idx};
+
+	// Feedback is sent again when a frame is displayed several times
+	if (f.times[e])
+		return;
+	f.times[e] = time;
+
+	switch (e)
+	{
+		case decode_begin:
+			decoded++;
+			break;
+		case lost:
+			lost_frames++;
+			break;
+		case dequeue:
+			// Also sent for frames that were discarded without being displayed
+			queue.add(f, decode_end, dequeue);
+			break;
+		case display:
+			if (stream_idx == 0)
+				displayed++;
+			encode.add(f, encode_begin, encode_end);
+			network.add(f, send_begin, receive_end);
+			decode.add(f, decode_begin, decode_end);
+			present.add(f, decode_end, display);
+			latency.add(f, encode_begin, display);
+			break;
+		default:
+			break;
+	}
+}
+
+void session_telemetry::add_encoded_frame(size_t size)
+{
+	std::lock_guard lock(mutex);
+	encoded_bytes += size;
+}
+
+void session_telemetry::add_encoder_queue(size_t frames)
+{
+	std::lock_guard lock(mutex);
+	encoder_queue_samples++;
+	encoder_queue_total += frames;
+	encoder_queue_max = std::max<uint32_t>(encoder_queue_max, frames);
+}
+
+from_monado::telemetry session_telemetry::collect(const transmit_scheduler::stats & transmit, const transmit_scheduler::nack_stats & nack)
+{
+	std::lock_guard lock(mutex);
+	auto now = std::chrono::steady_clock::now();
+	float period = std::chrono::duration<float>(now - period_start).count();
+
+	const auto & video = transmit[size_t(transmit_scheduler::priority::video)];
+	stage video_queue{
+	        .count = video.packets,
+	        .total = video.total.count(),
+	        .max = video.max.count(),
+	};
+
+	from_monado::telemetry result{
+	        .period = period,
+	        .encode = encode.get(),
+	        .network = network.get(),
+	        .decode = decode.get(),
+	        .display = present.get(),
+	        .queue = queue.get(),
+	        .latency = latency.get(),
+	        .video_queue = video_queue.get(),
+	        .frame_rate = displayed / period,
+	        .bitrate = encoded_bytes * 8 / period,
+	        .loss = decoded + lost_frames ? float(lost_frames) / (decoded + lost_frames) : 0,
+	        .retransmitted = (nack.shards_resent - last_shards_resent) / period,
+	        .encoder_queue = encoder_queue_samples ? float(encoder_queue_total) / encoder_queue_samples : NAN,
+	        .encoder_queue_max = encoder_queue_max,
+	};
+
+	period_start = now;
+	encode = {};
+	network = {};
+	decode = {};
+	present = {};
+	queue = {};
+	latency = {};
+	displayed = 0;
+	decoded = 0;
+	lost_frames = 0;
+	encoded_bytes = 0;
+	encoder_queue_samples = 0;
+	encoder_queue_total = 0;
+	encoder_queue_max = 0;
+	last_shards_resent = nack.shards_resent;
+
+	return result;
+}
+
+} // namespace wivrn
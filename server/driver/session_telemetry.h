@@ -0,0 +1,106 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "transmit_scheduler.h"
+#include "wivrn_ipc.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace wivrn
+{
+
+// Aggregates the timings of the video pipeline over short periods, for the
+// live statistics of the dashboard. Timings are the same events as the ones
+// written with WIVRN_DUMP_TIMINGS, all in server time.
+class session_telemetry
+{
+	enum event
+	{
+		encode_begin,
+		encode_end,
+		send_begin,
+		receive_end,
+		decode_begin,
+		decode_end,
+		dequeue,
+		display,
+		lost,
+		num_events,
+	};
+
+	struct frame
+	{
+		uint64_t frame_idx = -1;
+		// 0 if the event was not received
+		std::array<int64_t, num_events> times{};
+	};
+
+	struct stage
+	{
+		uint64_t count = 0;
+		int64_t total = 0;
+		int64_t max = 0;
+
+		void add(const frame &, event begin, event end);
+		from_monado::telemetry::stage get() const;
+	};
+
+	// Feedback for a frame arrives a few frames after it was encoded
+	static const size_t max_frames = 32;
+
+	std::mutex mutex;
+	// Recent frames of each stream
+	std::vector<std::array<frame, max_frames>> frames;
+
+	std::chrono::steady_clock::time_point period_start = std::chrono::steady_clock::now();
+	stage encode;
+	stage network;
+	stage decode;
+	stage present;
+	stage queue;
+	stage latency;
+	uint64_t displayed = 0;
+	uint64_t decoded = 0;
+	uint64_t lost_frames = 0;
+	uint64_t encoded_bytes = 0;
+	uint64_t encoder_queue_samples = 0;
+	uint64_t encoder_queue_total = 0;
+	uint32_t encoder_queue_max = 0;
+
+	uint64_t last_shards_resent = 0;
+
+public:
+	void add_event(std::string_view event, uint64_t frame_idx, uint8_t stream_idx, int64_t time);
+	void add_encoded_frame(size_t size);
+	// Number of frames presented to the encoders and not encoded yet
+	void add_encoder_queue(size_t frames);
+
+	// Statistics since the previous call, pacer fields are not set
+	// transmit statistics are for the same period, nack statistics since the session started
+	from_monado::telemetry collect(const transmit_scheduler::stats &, const transmit_scheduler::nack_stats &);
+};
+
+} // namespace wivrn
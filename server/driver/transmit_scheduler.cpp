@@ -0,0 +1,469 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "transmit_scheduler.h"
+
+#include "os/os_time.h"
+#include "util/u_logging.h"
+#include "wivrn_session.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <magic_enum.hpp>
+#include <pthread.h>
+#include <string>
+#include <utility>
+
+namespace wivrn
+{
+
+// Maximum number of video packets sent at once, so that other classes are not delayed
+static const size_t max_video_burst = 16;
+
+// Token bucket size, allows a burst of about max_video_burst shards
+static const double max_tokens = max_video_burst * 1500;
+
+// Period to write queueing delays in the timing trace
+static const auto stats_period = std::chrono::seconds(1);
+
+// Retransmission cache, for all streams
+static const size_t max_cached_frames = 16;
+static const size_t max_nacked_frames = 64;
+
+transmit_scheduler::transmit_scheduler(wivrn_connection & connection, wivrn_session & session, const configuration & config) :
+        connection(connection),
+        session(session),
+        pacing_mode(config.pacing),
+        pacing_fraction(config.pacing_fraction),
+        link_rate(config.pacing_rate),
+        last_refill(std::chrono::steady_clock::now())
+{
+	thread = std::jthread([this](std::stop_token stop) { run(stop); });
+	pthread_setname_np(thread.native_handle(), "transmit");
+}
+
+serialization_packet transmit_scheduler::get_packet()
+{
+	std::lock_guard lock(mutex);
+	if (free_packets.empty())
+		return {};
+
+	serialization_packet packet = std::move(free_packets.back());
+	free_packets.pop_back();
+	return packet;
+}
+
+void transmit_scheduler::push(priority p, serialization_packet && packet)
+{
+	std::lock_guard lock(mutex);
+	auto & queue = p == priority::audio   ? audio_queue
+	               : p == priority::depth ? depth_queue
+	                                      : control_queue;
+	if (p == priority::depth and not queue.empty())
+	{
+		free_packets.push_back(std::move(queue.front().packet));
+		queue.pop_front();
+	}
+	queue.push_back({
+	        .packet = std::move(packet),
+	        .queued = std::chrono::steady_clock::now(),
+	});
+	cv.notify_all();
+}
+
+void transmit_scheduler::set_video_rate(uint64_t bitrate, std::chrono::nanoseconds frame_period)
+{
+	// in bytes/s
+	uint64_t rate = link_rate.value_or(bitrate / pacing_fraction) / 8;
+
+	switch (pacing_mode)
+	{
+		case configuration::pacing_mode::off:
+			U_LOG_I("Video pacing disabled");
+			rate = 0;
+			break;
+		case configuration::pacing_mode::user:
+			U_LOG_I("Video pacing at %.1fMbit/s", rate * 8 / 1e6);
+			break;
+		case configuration::pacing_mode::kernel:
+			U_LOG_I("Video pacing at %.1fMbit/s by the kernel", rate * 8 / 1e6);
+			connection.set_pacing_rate(rate);
+			rate = 0;
+			break;
+	}
+
+	std::lock_guard lock(mutex);
+	pacing_rate = rate;
+	this->frame_period = frame_period;
+}
+
+void transmit_scheduler::on_nack(const from_headset::video_nack & nack)
+{
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard lock(mutex);
+	++nack_stats_.requests;
+
+	auto frame = std::find_if(retransmit_cache.begin(), retransmit_cache.end(), [&](const sent_frame & f) {
+		return f.stream_idx == nack.stream_index and f.frame_idx == nack.frame_index;
+	});
+	if (frame == retransmit_cache.end() or frame->deadline < now)
+	{
+		++nack_stats_.expired;
+		return;
+	}
+
+	auto resend = [&](size_t idx) {
+		if (idx >= frame->shards.size() or frame->shards[idx].size() == 0)
+			return;
+		retransmit_queue.push_back({
+		        .packet = std::move(frame->shards[idx]),
+		        .queued = now,
+		});
+		frame->shards[idx].clear();
+		++nack_stats_.shards_resent;
+	};
+
+	for (auto idx: nack.shards)
+		resend(idx);
+	if (nack.missing_from)
+	{
+		for (size_t idx = *nack.missing_from; idx < frame->shards.size(); ++idx)
+			resend(idx);
+	}
+
+	frame_id id{nack.stream_index, nack.frame_index};
+	if (std::find(nacked_frames.begin(), nacked_frames.end(), id) == nacked_frames.end())
+	{
+		nacked_frames.push_back(id);
+		if (nacked_frames.size() > max_nacked_frames)
+			nacked_frames.pop_front();
+	}
+	cv.notify_all();
+}
+
+void transmit_scheduler::on_feedback(const from_headset::feedback & feedback)
+{
+	std::lock_guard lock(mutex);
+	auto it = std::find(nacked_frames.begin(), nacked_frames.end(), frame_id{feedback.stream_index, feedback.frame_index});
+	if (it == nacked_frames.end())
+		return;
+
+	if (feedback.sent_to_decoder)
+		++nack_stats_.recovered;
+	else
+		++nack_stats_.lost;
+	nacked_frames.erase(it);
+}
+
+void transmit_scheduler::send_video(std::span<serialization_packet> packets, const video_info & info)
+{
+	for (auto & packet: packets)
+		packet.detach();
+
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard lock(mutex);
+	auto & batch = video_queue.emplace_back();
+	batch.info = info;
+	batch.queued = now;
+	batch.packets.reserve(packets.size());
+	for (auto & packet: packets)
+	{
+		auto & item = batch.packets.emplace_back();
+		if (not free_packets.empty())
+		{
+			item = std::move(free_packets.back());
+			free_packets.pop_back();
+		}
+		std::swap(item, packet);
+		queued_video_bytes += item.size();
+	}
+	last_frame_idx = info.frame_idx;
+	cv.notify_all();
+}
+
+void transmit_scheduler::clear()
+{
+	std::unique_lock lock(mutex);
+	for (auto queue: {&control_queue, &retransmit_queue, &audio_queue, &depth_queue})
+	{
+		for (auto & item: *queue)
+			free_packets.push_back(std::move(item.packet));
+		queue->clear();
+	}
+	for (auto & batch: video_queue)
+		recycle(batch.packets);
+	video_queue.clear();
+	queued_video_bytes = 0;
+
+	// The batch being sent is added to the retransmission cache when done
+	cv.wait(lock, [this] { return not busy; });
+	recycle(sending);
+	for (auto & frame: retransmit_cache)
+		recycle(frame.shards);
+	retransmit_cache.clear();
+	nacked_frames.clear();
+}
+
+transmit_scheduler::stats transmit_scheduler::take_telemetry_stats()
+{
+	std::lock_guard lock(mutex);
+	return std::exchange(telemetry_stats, {});
+}
+
+transmit_scheduler::nack_stats transmit_scheduler::get_nack_stats()
+{
+	std::lock_guard lock(mutex);
+	return nack_stats_;
+}
+
+void transmit_scheduler::recycle(std::vector<serialization_packet> & packets)
+{
+	for (auto & packet: packets)
+		free_packets.push_back(std::move(packet));
+	packets.clear();
+}
+
+void transmit_scheduler::cache(const video_info & info, size_t first_packet, std::chrono::steady_clock::time_point now)
+{
+	// Evict frames that can no longer be retransmitted
+	while (not retransmit_cache.empty() and
+	       (retransmit_cache.front().deadline < now or retransmit_cache.size() > max_cached_frames))
+	{
+		recycle(retransmit_cache.front().shards);
+		retransmit_cache.pop_front();
+	}
+
+	// No loss on TCP
+	if (connection.is_tcp_only() or frame_period.count() == 0)
+	{
+		recycle(sending);
+		return;
+	}
+
+	auto frame = std::find_if(retransmit_cache.rbegin(), retransmit_cache.rend(), [&](const sent_frame & f) {
+		return f.stream_idx == info.stream_idx and f.frame_idx == info.frame_idx;
+	});
+	sent_frame & item = frame == retransmit_cache.rend()
+	                            ? retransmit_cache.emplace_back(sent_frame{.stream_idx = info.stream_idx, .frame_idx = info.frame_idx})
+	                            : *frame;
+
+	size_t idx = info.first_shard_idx + first_packet;
+	if (item.shards.size() < idx + sending.size())
+		item.shards.resize(idx + sending.size());
+	for (auto & packet: sending)
+		std::swap(item.shards[idx++], packet);
+	sending.clear();
+
+	// The headset gives up on a frame when the next one is received
+	if (info.end_of_frame and idx == item.shards.size())
+		item.deadline = now + frame_period;
+}
+
+void transmit_scheduler::add_stats(priority p, std::chrono::steady_clock::time_point queued, std::chrono::steady_clock::time_point sent, size_t count)
+{
+	std::chrono::nanoseconds delay = sent - queued;
+	for (auto s: {&period_stats, &telemetry_stats})
+	{
+		auto & item = (*s)[size_t(p)];
+		item.packets += count;
+		item.total += delay * int64_t(count);
+		item.max = std::max(item.max, delay);
+	}
+}
+
+void transmit_scheduler::dump_stats()
+{
+	int64_t now = os_monotonic_get_ns();
+	for (size_t i = 0; i < num_priorities; ++i)
+	{
+		const auto & item = period_stats[i];
+		if (item.packets == 0)
+			continue;
+
+		// queue_<class>,frame,time,255,packets,mean delay (ns),max delay (ns)
+		std::string extra = "," + std::to_string(item.packets) +
+		                    "," + std::to_string(item.total.count() / item.packets) +
+		                    "," + std::to_string(item.max.count());
+		session.dump_time("queue_" + std::string(magic_enum::enum_name(priority(i))), last_frame_idx, now, -1, extra.c_str());
+	}
+	period_stats = {};
+
+	if (nack_stats_.requests != logged_nack.requests)
+	{
+		U_LOG_D("NACK: %" PRIu64 " requests, %" PRIu64 " expired, %" PRIu64 " shards resent, %" PRIu64 " frames recovered, %" PRIu64 " lost",
+		        nack_stats_.requests - logged_nack.requests,
+		        nack_stats_.expired - logged_nack.expired,
+		        nack_stats_.shards_resent - logged_nack.shards_resent,
+		        nack_stats_.recovered - logged_nack.recovered,
+		        nack_stats_.lost - logged_nack.lost);
+
+		// nack,frame,time,255,requests,expired,shards resent,recovered,lost since the session started
+		std::string extra = "," + std::to_string(nack_stats_.requests) +
+		                    "," + std::to_string(nack_stats_.expired) +
+		                    "," + std::to_string(nack_stats_.shards_resent) +
+		                    "," + std::to_string(nack_stats_.recovered) +
+		                    "," + std::to_string(nack_stats_.lost);
+		session.dump_time("nack", last_frame_idx, now, -1, extra.c_str());
+		logged_nack = nack_stats_;
+	}
+}
+
+void transmit_scheduler::transmit(std::unique_lock<std::mutex> & lock, std::deque<entry> & queue, priority p)
+{
+	entry item = std::move(queue.front());
+	queue.pop_front();
+
+	busy = true;
+	lock.unlock();
+	try
+	{
+		if (p == priority::retransmit)
+			connection.send_stream_many(std::span(&item.packet, 1));
+		else
+			connection.send_control_many(std::span(&item.packet, 1));
+	}
+	catch (std::exception & e)
+	{
+		U_LOG_W("Failed to send %s packet: %s", std::string(magic_enum::enum_name(p)).c_str(), e.what());
+	}
+	auto now = std::chrono::steady_clock::now();
+	lock.lock();
+	busy = false;
+	cv.notify_all();
+
+	add_stats(p, item.queued, now);
+	free_packets.push_back(std::move(item.packet));
+}
+
+bool transmit_scheduler::transmit_video(std::unique_lock<std::mutex> & lock)
+{
+	auto & batch = video_queue.front();
+	const size_t size = batch.packets.size();
+
+	// TCP is paced by the kernel
+	const bool paced = pacing_rate > 0 and not connection.is_tcp_only();
+	if (paced)
+	{
+		auto now = std::chrono::steady_clock::now();
+		tokens = std::min(max_tokens, tokens + video_rate() * std::chrono::duration<double>(now - last_refill).count());
+		last_refill = now;
+	}
+
+	// A packet can be sent if there are tokens left, the bucket may go in debt
+	sending.clear();
+	while (sending.size() < max_video_burst and batch.sent + sending.size() < size and (not paced or tokens > 0))
+	{
+		auto & packet = batch.packets[batch.sent + sending.size()];
+		if (paced)
+			tokens -= packet.size();
+		queued_video_bytes -= packet.size();
+		sending.push_back(std::move(packet));
+	}
+	if (sending.empty())
+		return false;
+
+	const size_t count = sending.size();
+
+	const size_t first_packet = batch.sent;
+	const bool first = batch.sent == 0;
+	batch.sent += count;
+	const bool last = batch.sent == size;
+	const video_info info = batch.info;
+	const auto queued = batch.queued;
+	if (last)
+		video_queue.pop_front();
+
+	busy = true;
+	lock.unlock();
+	if (first and info.begin_of_frame)
+		session.dump_time("transmit_begin", info.frame_idx, os_monotonic_get_ns(), info.stream_idx);
+	try
+	{
+		if (not info.drop)
+			connection.send_stream_many(sending);
+	}
+	catch (...)
+	{
+		// Ignore network errors
+	}
+	if (last and info.end_of_frame)
+		session.dump_time("transmit_end", info.frame_idx, os_monotonic_get_ns(), info.stream_idx);
+	auto now = std::chrono::steady_clock::now();
+	lock.lock();
+	busy = false;
+	cv.notify_all();
+
+	add_stats(priority::video, queued, now, count);
+	cache(info, first_packet, now);
+	return true;
+}
+
+double transmit_scheduler::video_rate() const
+{
+	// The rate from the bitrate is an average: large frames (IDR, intra
+	// refresh) must still be sent within a frame period, or the following
+	// frames queue up behind them
+	if (pacing_rate == 0 or frame_period.count() == 0)
+		return pacing_rate;
+	return std::max(pacing_rate, queued_video_bytes / std::chrono::duration<double>(frame_period).count());
+}
+
+std::chrono::steady_clock::time_point transmit_scheduler::next_tokens()
+{
+	std::chrono::duration<double> wait(-tokens / video_rate());
+	return last_refill + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+}
+
+void transmit_scheduler::run(std::stop_token stop)
+{
+	auto next_dump = std::chrono::steady_clock::now() + stats_period;
+	std::unique_lock lock(mutex);
+	while (not stop.stop_requested())
+	{
+		if (auto now = std::chrono::steady_clock::now(); now > next_dump)
+		{
+			next_dump = now + stats_period;
+			dump_stats();
+		}
+
+		if (not control_queue.empty())
+			transmit(lock, control_queue, priority::control);
+		else if (not retransmit_queue.empty())
+			transmit(lock, retransmit_queue, priority::retransmit);
+		else if (not audio_queue.empty())
+			transmit(lock, audio_queue, priority::audio);
+		else if (not depth_queue.empty())
+			transmit(lock, depth_queue, priority::depth);
+		else if (video_queue.empty())
+		{
+			cv.wait_until(lock, stop, next_dump, [this] {
+				return not(control_queue.empty() and retransmit_queue.empty() and audio_queue.empty() and depth_queue.empty() and video_queue.empty());
+			});
+		}
+		else if (not transmit_video(lock))
+		{
+			// Wait for tokens, unless something else is submitted
+			cv.wait_until(lock, stop, std::min(next_tokens(), next_dump), [this] {
+				return not(control_queue.empty() and retransmit_queue.empty() and audio_queue.empty() and depth_queue.empty());
+			});
+		}
+	}
+}
+
+} // namespace wivrn
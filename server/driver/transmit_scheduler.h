@@ -0,0 +1,229 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "configuration.h"
+#include "wivrn_connection.h"
+#include "wivrn_packets.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace wivrn
+{
+
+class wivrn_session;
+
+// Sends packets to the headset from a single thread, by priority class.
+// Urgent packets (haptics) are sent immediately by the caller,
+// other packets are queued and the highest priority queue is sent first.
+// Only the latest depth packet is kept, an older one is useless once the
+// next frame is ready.
+// Video is paced with a token bucket so that a large frame is not sent as a
+// line rate burst, which overflows access point queues, and does not delay
+// everything sent after it.
+// Sent video shards are kept until the frame deadline, and retransmitted when
+// the headset reports them missing.
+class transmit_scheduler
+{
+public:
+	enum class priority
+	{
+		urgent,
+		control,
+		retransmit,
+		audio,
+		depth,
+		video,
+	};
+	static constexpr size_t num_priorities = size_t(priority::video) + 1;
+
+	struct class_stats
+	{
+		uint64_t packets = 0;
+		// time between the packet is submitted and sent
+		std::chrono::nanoseconds total{};
+		std::chrono::nanoseconds max{};
+	};
+	using stats = std::array<class_stats, num_priorities>;
+
+	struct nack_stats
+	{
+		uint64_t requests = 0;
+		// the frame was not in the cache or past its deadline
+		uint64_t expired = 0;
+		uint64_t shards_resent = 0;
+		// frames decoded or not after shards were resent
+		uint64_t recovered = 0;
+		uint64_t lost = 0;
+	};
+
+	struct video_info
+	{
+		uint64_t frame_idx;
+		uint8_t stream_idx;
+		uint16_t first_shard_idx;
+		bool begin_of_frame;
+		bool end_of_frame;
+		// do not send the packets, only keep them for retransmission
+		bool drop;
+	};
+
+private:
+	struct entry
+	{
+		serialization_packet packet;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	struct video_batch
+	{
+		std::vector<serialization_packet> packets;
+		size_t sent = 0;
+		video_info info;
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	struct sent_frame
+	{
+		uint8_t stream_idx;
+		uint64_t frame_idx;
+		// indexed by shard index, empty if not available
+		std::vector<serialization_packet> shards;
+		// retransmissions after this time would arrive too late,
+		// set when the end of the frame is sent
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	};
+
+	struct frame_id
+	{
+		uint8_t stream_idx;
+		uint64_t frame_idx;
+		bool operator==(const frame_id &) const = default;
+	};
+
+	wivrn_connection & connection;
+	wivrn_session & session;
+
+	std::mutex mutex;
+	std::condition_variable_any cv;
+	std::deque<entry> control_queue;
+	std::deque<entry> retransmit_queue;
+	std::deque<entry> audio_queue;
+	std::deque<entry> depth_queue;
+	std::deque<video_batch> video_queue;
+	// packets are recycled to keep their buffers
+	std::vector<serialization_packet> free_packets;
+	// a packet is being sent outside of the lock
+	bool busy = false;
+	std::vector<serialization_packet> sending;
+
+	const configuration::pacing_mode pacing_mode;
+	const double pacing_fraction;
+	const std::optional<uint64_t> link_rate;
+	// Token bucket for video, rate in bytes/s (0 if not paced in userspace), tokens in bytes
+	double pacing_rate = 0;
+	double tokens = 0;
+	// bytes in video_queue not sent yet
+	size_t queued_video_bytes = 0;
+	std::chrono::steady_clock::time_point last_refill;
+
+	std::chrono::nanoseconds frame_period{};
+	std::deque<sent_frame> retransmit_cache;
+	// frames with retransmitted shards, waiting for feedback
+	std::deque<frame_id> nacked_frames;
+	nack_stats nack_stats_;
+	nack_stats logged_nack;
+
+	// for the timing trace
+	stats period_stats;
+	stats telemetry_stats;
+	uint64_t last_frame_idx = 0;
+
+	std::jthread thread;
+
+	void run(std::stop_token stop);
+	void transmit(std::unique_lock<std::mutex> & lock, std::deque<entry> & queue, priority p);
+	// returns false if there are not enough tokens to send a video packet
+	bool transmit_video(std::unique_lock<std::mutex> & lock);
+	std::chrono::steady_clock::time_point next_tokens();
+	double video_rate() const;
+	void add_stats(priority p, std::chrono::steady_clock::time_point queued, std::chrono::steady_clock::time_point sent, size_t count = 1);
+	void dump_stats();
+	void cache(const video_info & info, size_t first_packet, std::chrono::steady_clock::time_point now);
+	void recycle(std::vector<serialization_packet> & packets);
+
+	serialization_packet get_packet();
+	void push(priority p, serialization_packet && packet);
+
+public:
+	transmit_scheduler(wivrn_connection & connection, wivrn_session & session, const configuration & config);
+
+	template <typename T>
+	void send_stream(T && packet)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		connection.send_stream(std::forward<T>(packet));
+
+		std::lock_guard lock(mutex);
+		add_stats(priority::urgent, begin, std::chrono::steady_clock::now());
+	}
+
+	template <typename T>
+	void send_control(T && packet)
+	{
+		using U = std::decay_t<T>;
+		constexpr priority p = std::is_same_v<U, audio_data>                       ? priority::audio
+		                       : std::is_same_v<U, to_headset::video_stream_depth> ? priority::depth
+		                                                                           : priority::control;
+
+		serialization_packet serialized = get_packet();
+		wivrn_connection::serialize(serialized, packet);
+		serialized.detach();
+		push(p, std::move(serialized));
+	}
+
+	// Packets are swapped with empty packets
+	void send_video(std::span<serialization_packet> packets, const video_info & info);
+
+	// Total bitrate of the video streams in bit/s, used for pacing, and
+	// frame period from the pacer, for the retransmission deadline
+	void set_video_rate(uint64_t bitrate, std::chrono::nanoseconds frame_period);
+
+	void on_nack(const from_headset::video_nack &);
+	void on_feedback(const from_headset::feedback &);
+
+	// Drop queued packets and wait for the packet being sent, before the connection is reset
+	void clear();
+
+	// since the previous call
+	stats take_telemetry_stats();
+	// since the session started
+	nack_stats get_nack_stats();
+};
+
+} // namespace wivrn
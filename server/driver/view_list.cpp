@@ -38,26 +38,23 @@ tracked_views view_list::extrapolate(const tracked_views & a, const tracked_view
 	return result;
 }
 
-bool view_list::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+bool view_list::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
 {
-	for (const auto & pose: tracking.device_poses)
-	{
-		if (pose.device != device_id::HEAD)
-			continue;
-
-		tracked_views view{};
+	auto pose = poses[device_id::HEAD];
+	if (not pose)
+		return true;
 
-		view.relation = pose_list::convert_pose(pose);
-		view.flags = tracking.view_flags;
+	tracked_views view{};
 
-		for (size_t eye = 0; eye < 2; ++eye)
-		{
-			view.poses[eye] = xrt_cast(tracking.views[eye].pose);
-			view.fovs[eye] = xrt_cast(tracking.views[eye].fov);
-		}
+	view.relation = pose_list::convert_pose(*pose);
+	view.flags = tracking.view_flags;
 
-		return add_sample(tracking.production_timestamp, tracking.timestamp, view, offset);
+	for (size_t eye = 0; eye < 2; ++eye)
+	{
+		view.poses[eye] = xrt_cast(tracking.views[eye].pose);
+		view.fovs[eye] = xrt_cast(tracking.views[eye].fov);
 	}
-	return true;
+
+	return add_sample(tracking.production_timestamp, tracking.timestamp, view, offset);
 }
 } // namespace wivrn
@@ -19,15 +19,18 @@
 
 #include "wivrn_comp_target.h"
 
+#include "driver/configuration.h"
 #include "driver/wivrn_session.h"
 #include "encoder/video_encoder.h"
 #include "utils/scoped_lock.h"
+#include "wivrn_depth.h"
 #include "wivrn_foveation.h"
 
 #include "main/comp_compositor.h"
 #include "math/m_space.h"
 #include "xrt_cast.h"
 
+#include <algorithm>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_core.h>
@@ -114,11 +117,21 @@ static void create_encoders(wivrn_comp_target * cn)
 	desc.width = cn->width;
 	desc.height = cn->height;
 	desc.foveation = cn->cnx.set_foveated_size(desc.width, desc.height);
+	desc.depth.reset();
+	if (cn->depth_renderer)
+	{
+		desc.depth = {
+		        .width = wivrn_depth_renderer::width,
+		        .height = wivrn_depth_renderer::height,
+		};
+	}
 
 	std::map<int, std::vector<std::shared_ptr<VideoEncoder>>> thread_params;
 
+	uint64_t bitrate = 0;
 	for (auto & settings: cn->settings)
 	{
+		bitrate += settings.bitrate;
 		uint8_t stream_index = cn->encoders.size();
 		auto & encoder = cn->encoders.emplace_back(
 		        VideoEncoder::Create(*cn->wivrn_bundle, settings, stream_index, desc.width, desc.height, desc.fps));
@@ -135,6 +148,7 @@ static void create_encoders(wivrn_comp_target * cn)
 		pthread_setname_np(thread.native_handle(), name.c_str());
 	}
 	cn->pacer.set_stream_count(cn->encoders.size());
+	cn->cnx.set_video_rate(bitrate, std::chrono::nanoseconds(cn->pacer.frame_duration_ns));
 	cn->cnx.send_control(desc);
 }
 
@@ -279,6 +293,29 @@ static bool comp_wivrn_init_post_vulkan(struct comp_target * ct, uint32_t prefer
 		cn->foveation_renderer = std::make_unique<wivrn_foveation_renderer>(*cn->wivrn_bundle, cn->command_pool);
 	}
 
+	auto config = configuration::read_user_configuration();
+
+	const auto & requested = cn->cnx.get_info().decode_queue;
+	cn->desc.decode_queue = {
+	        .depth = uint8_t(std::clamp<int>(config.decode_queue_depth.value_or(requested.depth), 1, decode_queue_settings::max_depth)),
+	        .drop_policy = config.frame_drop_policy.value_or(requested.drop_policy),
+	};
+	U_LOG_I("Headset decoded frames queue: %d frames, %s",
+	        cn->desc.decode_queue.depth,
+	        cn->desc.decode_queue.drop_policy == frame_drop_policy::drop_late ? "drop late" : "drop oldest");
+
+	if (config.depth_stream)
+	{
+		try
+		{
+			cn->depth_renderer = std::make_unique<wivrn_depth_renderer>(*cn->wivrn_bundle);
+		}
+		catch (const std::exception & e)
+		{
+			U_LOG_W("Failed to create depth renderer, depth will not be streamed: %s", e.what());
+		}
+	}
+
 	return true;
 }
 
@@ -294,8 +331,10 @@ static bool comp_wivrn_check_ready(struct comp_target * ct)
 	for (int eye = 0; eye < 2; ++eye)
 	{
 		const auto & layer_accum = cn->c->base.layer_accum;
+		// Depth is only used when it matches the color image
 		if (layer_accum.layer_count > 1 or
-		    layer_accum.layers[0].data.type != XRT_LAYER_PROJECTION)
+		    (layer_accum.layers[0].data.type != XRT_LAYER_PROJECTION and
+		     (layer_accum.layers[0].data.type != XRT_LAYER_PROJECTION_DEPTH or not cn->depth_renderer)))
 		{
 			// We are not in the trivial single stereo projection layer
 			// reprojection must be done
@@ -426,6 +465,11 @@ static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_tar
 
 		auto res = vk.device.waitForFences(*cn->psc.fence, true, UINT64_MAX);
 
+		// The depth buffer is reused once all threads are done
+		std::optional<to_headset::video_stream_depth> depth;
+		if (index == 0 and cn->psc.has_depth)
+			depth = cn->depth_renderer->read(frame_index);
+
 		// Update encoder status, release image
 		if ((cn->psc.status &= ~status_bit) == 0)
 		{
@@ -442,6 +486,10 @@ static void comp_wivrn_present_thread(std::stop_token stop_token, wivrn_comp_tar
 
 		try
 		{
+			// Too large for a datagram, queued after audio
+			if (depth)
+				cn->cnx.send_control(std::move(*depth));
+
 			for (auto & encoder: encoders)
 			{
 				encoder->Encode(cn->cnx, view_info, frame_index);
@@ -500,10 +548,16 @@ static VkResult comp_wivrn_present(struct comp_target * ct,
 	cn->wivrn_bundle->device.resetFences(*cn->psc.fence);
 	cn->psc.images[index].status = pseudo_swapchain::status_t::encoding;
 
+	size_t queued_frames = 0;
 	for (auto & encoder: cn->encoders)
 	{
 		encoder->PresentImage(cn->psc.images[index].image, command_buffer);
+		queued_frames = std::max(queued_frames, encoder->QueuedFrames());
 	}
+	cn->cnx.add_encoder_queue(queued_frames);
+	// Without reprojection, the color image is the projection layer of the application
+	cn->psc.has_depth = cn->depth_renderer and cn->c->debug.atw_off and
+	                    cn->depth_renderer->record(command_buffer, cn->c->base.layer_accum.layers[0]);
 	command_buffer.end();
 	submit_info.setCommandBuffers(*command_buffer);
 
@@ -528,8 +582,11 @@ static VkResult comp_wivrn_present(struct comp_target * ct,
 		view_info.pose[eye] = xrt_cast(frame_params.poses[eye]);
 		if (cn->c->debug.atw_off)
 		{
-			const auto & proj = cn->c->base.layer_accum.layers[0].data.proj;
-			view_info.pose[eye] = xrt_cast(proj.v[eye].pose);
+			const auto & layer = cn->c->base.layer_accum.layers[0].data;
+			if (layer.type == XRT_LAYER_PROJECTION_DEPTH)
+				view_info.pose[eye] = xrt_cast(layer.depth.v[eye].pose);
+			else
+				view_info.pose[eye] = xrt_cast(layer.proj.v[eye].pose);
 		}
 		else
 		{
@@ -558,7 +615,7 @@ static void comp_wivrn_flush(struct comp_target * ct)
 #endif
 
 	// apply foveation for current frame
-	if (cn->cnx.apply_dynamic_foveation())
+	if (cn->cnx.apply_dynamic_foveation(cn->c->frame.rendering.predicted_display_time_ns))
 		// foveation renderer already signaled the semaphore; nothing to do
 		return;
 
@@ -652,12 +709,16 @@ void wivrn_comp_target::on_feedback(const from_headset::feedback & feedback, con
 	if (not o)
 		return;
 	pacer.on_feedback(feedback, o);
-	if (not feedback.sent_to_decoder)
-	{
-		if (encoders.size() < feedback.stream_index)
-			return;
-		encoders[feedback.stream_index]->SyncNeeded();
-	}
+	if (feedback.stream_index >= encoders.size())
+		return;
+	encoders[feedback.stream_index]->on_feedback(feedback);
+}
+
+void wivrn_comp_target::on_ack(const from_headset::video_ack & ack)
+{
+	if (ack.stream_index >= encoders.size())
+		return;
+	encoders[ack.stream_index]->on_ack(ack);
 }
 
 void wivrn_comp_target::reset_encoders()
@@ -665,7 +726,7 @@ void wivrn_comp_target::reset_encoders()
 	pacer.reset();
 	for (auto & encoder: encoders)
 	{
-		encoder->SyncNeeded();
+		encoder->IdrNeeded();
 	}
 	cnx.send_control(desc);
 }
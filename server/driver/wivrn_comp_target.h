@@ -37,6 +37,7 @@
 namespace wivrn
 {
 
+class wivrn_depth_renderer;
 class wivrn_foveation_renderer;
 class wivrn_session;
 class VideoEncoder;
@@ -73,6 +74,8 @@ struct pseudo_swapchain
 	vk::raii::CommandBuffer command_buffer = nullptr;
 	int64_t frame_index;
 	to_headset::video_stream_data_shard::view_info_t view_info{};
+	// The command buffer also downsamples the depth layer
+	bool has_depth = false;
 };
 
 struct wivrn_comp_target : public comp_target
@@ -100,11 +103,13 @@ struct wivrn_comp_target : public comp_target
 
 	wivrn::wivrn_session & cnx;
 	std::unique_ptr<wivrn_foveation_renderer> foveation_renderer = nullptr;
+	std::unique_ptr<wivrn_depth_renderer> depth_renderer = nullptr;
 
 	wivrn_comp_target(wivrn::wivrn_session & cnx, struct comp_compositor * c, float fps);
 	~wivrn_comp_target();
 
 	void on_feedback(const from_headset::feedback &, const clock_offset &);
+	void on_ack(const from_headset::video_ack &);
 	void reset_encoders();
 
 	void render_dynamic_foveation(std::array<to_headset::foveation_parameter, 2> foveation);
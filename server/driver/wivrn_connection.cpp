@@ -104,6 +104,7 @@ void wivrn::wivrn_connection::init()
 				stream.connect(peer_addr.sin6_addr, client_port);
 				U_LOG_D("Stream socket connected, client port %d", client_port);
 				stream.set_send_buffer_size(1024 * 1024 * 5);
+				apply_pacing_rate();
 				break;
 			}
 		}
@@ -141,9 +142,32 @@ void wivrn::wivrn_connection::init()
 	}
 	control.send(to_headset::handshake{.stream_port = port});
 
+	tcp_only = not stream;
 	active = true;
 }
 
+void wivrn::wivrn_connection::set_pacing_rate(uint64_t rate)
+{
+	pacing_rate = rate;
+	if (stream)
+		apply_pacing_rate();
+}
+
+void wivrn::wivrn_connection::apply_pacing_rate()
+{
+	if (not pacing_rate)
+		return;
+
+	try
+	{
+		stream.set_max_pacing_rate(pacing_rate);
+	}
+	catch (const std::exception & e)
+	{
+		U_LOG_W("Failed to set pacing rate on stream socket: %s", e.what());
+	}
+}
+
 void wivrn::wivrn_connection::reset(TCP && tcp)
 {
 	control = std::move(tcp);
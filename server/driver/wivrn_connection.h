@@ -37,8 +37,12 @@ class wivrn_connection
 	typed_socket<TCP, from_headset::packets, to_headset::packets> control;
 	typed_socket<UDP, from_headset::packets, to_headset::packets> stream;
 	std::atomic<bool> active = false;
+	std::atomic<bool> tcp_only = false;
+	// kernel pacing rate of the stream socket in bytes/s, 0 if disabled
+	std::atomic<uint64_t> pacing_rate = 0;
 
 	void init();
+	void apply_pacing_rate();
 
 public:
 	wivrn_connection(TCP && tcp);
@@ -49,8 +53,16 @@ public:
 	{
 		return active;
 	}
+	// stream packets are sent on the control socket
+	bool is_tcp_only()
+	{
+		return tcp_only;
+	}
 	void reset(TCP && tcp);
 
+	// Pace the stream socket in the kernel, kept across reconnections
+	void set_pacing_rate(uint64_t bytes_per_second);
+
 	template <typename T>
 	void send_control(T && packet)
 	{
@@ -82,6 +94,43 @@ public:
 		}
 	}
 
+	// Serialize packets to be sent with send_stream_many or send_control_many
+	template <typename T>
+	static void serialize(serialization_packet & p, const T & packet)
+	{
+		decltype(stream)::serialize(p, packet);
+	}
+
+	void send_control_many(std::span<serialization_packet> packets)
+	{
+		try
+		{
+			if (active)
+				control.send(packets);
+		}
+		catch (...)
+		{
+			active = false;
+			throw;
+		}
+	}
+
+	void send_stream_many(std::span<serialization_packet> packets)
+	{
+		try
+		{
+			if (active and stream)
+				stream.send(packets);
+			else
+				control.send(packets);
+		}
+		catch (...)
+		{
+			active = false;
+			throw;
+		}
+	}
+
 	std::optional<from_headset::packets> poll_control(int timeout);
 
 	template <typename T>
@@ -89,7 +138,7 @@ public:
 	{
 		pollfd fds[3] = {};
 		fds[0].events = POLLIN;
-		fds[0].fd = stream.get_fd();
+		fds[0].fd = stream.poll_fd();
 		fds[1].events = POLLIN;
 		fds[1].fd = control.get_fd();
 		fds[2].fd = wivrn_ipc_socket_monado->get_fd();
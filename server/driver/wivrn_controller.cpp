@@ -21,6 +21,8 @@
 #include "wivrn_session.h"
 
 #include "util/u_logging.h"
+#include <algorithm>
+#include <span>
 #include <stdio.h>
 
 #include "xrt/xrt_defines.h"
@@ -224,6 +226,7 @@ wivrn_controller::wivrn_controller(int hand_id,
 	haptic_output.name = XRT_OUTPUT_NAME_TOUCH_HAPTIC;
 
 	inputs_staging = inputs_array;
+	last_change_times.resize(inputs_array.size());
 
 	switch (hand_id)
 	{
@@ -249,6 +252,18 @@ wivrn_controller::wivrn_controller(int hand_id,
 			throw std::runtime_error("Invalid hand ID");
 	}
 
+	std::span<const wivrn_to_wivrn_controller_input> hand_bindings;
+	if (device_type == XRT_DEVICE_TYPE_LEFT_HAND_CONTROLLER)
+		hand_bindings = {left_hand_bindings, left_hand_bindings_count};
+	else
+		hand_bindings = {right_hand_bindings, right_hand_bindings_count};
+
+	for (const auto & binding: hand_bindings)
+	{
+		if (not bindings[size_t(binding.wivrn_id)])
+			bindings[size_t(binding.wivrn_id)] = &binding;
+	}
+
 	binding_profile_count = std::size(wivrn_binding_profiles);
 	binding_profiles = wivrn_binding_profiles;
 }
@@ -256,6 +271,14 @@ wivrn_controller::wivrn_controller(int hand_id,
 void wivrn_controller::update_inputs()
 {
 	std::lock_guard _{mutex};
+	if (cnx)
+	{
+		for (size_t i = 0; i < inputs_staging.size(); i++)
+		{
+			if (inputs_staging[i].timestamp != inputs_array[i].timestamp)
+				cnx->dump_input_read(inputs_staging[i].name, inputs_staging[i].timestamp);
+		}
+	}
 	inputs_array = inputs_staging;
 }
 
@@ -264,53 +287,44 @@ void wivrn_controller::set_inputs(const from_headset::inputs & inputs, const clo
 	std::lock_guard lock{mutex};
 	for (const auto & input: inputs.values)
 	{
-		set_inputs(input.id, input.value, input.last_change_time ? clock_offset.from_headset(input.last_change_time) : 0);
+		const auto * binding = bindings[size_t(input.id)];
+		if (not binding)
+			continue;
+
+		// Values are repeated and packets may be reordered: only keep the most recent
+		auto & last_change_time = last_change_times[binding->input_id];
+		if (input.last_change_time < last_change_time)
+			continue;
+		last_change_time = input.last_change_time;
+
+		set_input(*binding, input.value, input.last_change_time ? clock_offset.from_headset(input.last_change_time) : 0);
 	}
 }
 
-void wivrn_controller::set_inputs(device_id input_id, float value, int64_t last_change_time)
+void wivrn_controller::reset_inputs()
 {
-	const struct wivrn_to_wivrn_controller_input * bindings;
-	size_t bindings_count;
-	if (device_type == XRT_DEVICE_TYPE_LEFT_HAND_CONTROLLER)
-	{
-		bindings = left_hand_bindings;
-		bindings_count = left_hand_bindings_count;
-	}
-	else
-	{
-		bindings = right_hand_bindings;
-		bindings_count = right_hand_bindings_count;
-	}
+	std::lock_guard lock{mutex};
+	std::ranges::fill(last_change_times, 0);
+}
 
-	const struct wivrn_to_wivrn_controller_input * binding = NULL;
-	for (size_t i = 0; i < bindings_count; i++)
+void wivrn_controller::set_input(const wivrn_to_wivrn_controller_input & binding, float value, int64_t last_change_time)
+{
+	auto & input = inputs_staging[binding.input_id];
+	input.timestamp = last_change_time;
+	switch (binding.input_type)
 	{
-		if (bindings[i].wivrn_id == input_id)
-		{
-			binding = &bindings[i];
+		case wivrn_input_type::BOOL:
+			input.value.boolean = (value != 0);
+			break;
+		case wivrn_input_type::FLOAT:
+			input.value.vec1.x = value;
+			break;
+		case wivrn_input_type::VEC2_X:
+			input.value.vec2.x = value;
+			break;
+		case wivrn_input_type::VEC2_Y:
+			input.value.vec2.y = value;
 			break;
-		}
-	}
-
-	if (binding)
-	{
-		inputs_staging[binding->input_id].timestamp = last_change_time;
-		switch (binding->input_type)
-		{
-			case wivrn_input_type::BOOL:
-				inputs_staging[binding->input_id].value.boolean = (value != 0);
-				break;
-			case wivrn_input_type::FLOAT:
-				inputs_staging[binding->input_id].value.vec1.x = value;
-				break;
-			case wivrn_input_type::VEC2_X:
-				inputs_staging[binding->input_id].value.vec2.x = value;
-				break;
-			case wivrn_input_type::VEC2_Y:
-				inputs_staging[binding->input_id].value.vec2.y = value;
-				break;
-		}
 	}
 }
 
@@ -358,13 +372,13 @@ std::pair<xrt_hand_joint_set, int64_t> wivrn_controller::get_hand_tracking(xrt_i
 	}
 }
 
-void wivrn_controller::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_controller::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
 {
-	if (not aim.update_tracking(tracking, offset))
+	if (not aim.update_tracking(tracking, poses, offset))
 		cnx->set_enabled(aim.device, false);
-	if (not grip.update_tracking(tracking, offset))
+	if (not grip.update_tracking(tracking, poses, offset))
 		cnx->set_enabled(grip.device, false);
-	if (not palm.update_tracking(tracking, offset))
+	if (not palm.update_tracking(tracking, poses, offset))
 		cnx->set_enabled(palm.device, false);
 }
 
@@ -24,12 +24,14 @@
 #include "hand_joints_list.h"
 #include "pose_list.h"
 
+#include <array>
 #include <mutex>
 #include <vector>
 
 namespace wivrn
 {
 class wivrn_session;
+struct wivrn_to_wivrn_controller_input;
 
 class wivrn_controller : public xrt_device
 {
@@ -42,6 +44,10 @@ class wivrn_controller : public xrt_device
 
 	std::vector<xrt_input> inputs_staging;
 	std::vector<xrt_input> inputs_array;
+	// Bindings of this hand, indexed by device_id
+	std::array<const wivrn_to_wivrn_controller_input *, 256> bindings{};
+	// Headset time of the last change of each input, to discard reordered packets
+	std::vector<int64_t> last_change_times;
 	xrt_output haptic_output;
 
 	wivrn::wivrn_session * cnx;
@@ -61,11 +67,13 @@ public:
 	void set_output(xrt_output_name name, const xrt_output_value * value);
 
 	void set_inputs(const from_headset::inputs &, const clock_offset &);
+	// The headset clock restarts on reconnection
+	void reset_inputs();
 
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const from_headset::tracking &, const tracked_poses &, const clock_offset &);
 	void update_hand_tracking(const from_headset::hand_tracking &, const clock_offset &);
 
 private:
-	void set_inputs(device_id input_id, float value, int64_t last_change_time);
+	void set_input(const wivrn_to_wivrn_controller_input & binding, float value, int64_t last_change_time);
 };
 } // namespace wivrn
@@ -0,0 +1,240 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "wivrn_depth.h"
+
+#include "depth_codec.h"
+#include "utils/wivrn_vk_bundle.h"
+
+#include "util/comp_layer_accum.h"
+#include "util/comp_swapchain.h"
+
+#include <map>
+#include <string>
+
+extern const std::map<std::string, std::vector<uint32_t>> shaders;
+
+// Distance matching the maximum quantized value, nearer points are clamped
+static const float min_distance = 0.1;
+
+namespace wivrn
+{
+
+struct DepthPcs
+{
+	float offset[2];
+	float extent[2];
+	float min_depth;
+	float max_depth;
+	float inverse_near;
+	float inverse_far;
+	uint32_t width;
+	uint32_t height;
+	uint32_t first;
+};
+
+static const std::array pool_sizes{
+        vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount = 2,
+        },
+        vk::DescriptorPoolSize{
+                .type = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 2,
+        },
+};
+
+static const std::array layout_bindings{
+        vk::DescriptorSetLayoutBinding{
+                .binding = 0,
+                .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        },
+        vk::DescriptorSetLayoutBinding{
+                .binding = 1,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        },
+};
+
+wivrn_depth_renderer::wivrn_depth_renderer(wivrn_vk_bundle & vk) :
+        vk(vk),
+        sampler(vk.device,
+                vk::SamplerCreateInfo{
+                        // Depth formats may not support linear filtering
+                        .magFilter = vk::Filter::eNearest,
+                        .minFilter = vk::Filter::eNearest,
+                        .mipmapMode = vk::SamplerMipmapMode::eNearest,
+                        .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+                        .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+                }),
+        ds_layout(vk.device, vk::DescriptorSetLayoutCreateInfo{.bindingCount = layout_bindings.size(), .pBindings = layout_bindings.data()}),
+        dp(vk.device,
+           vk::DescriptorPoolCreateInfo{
+                   .maxSets = 2,
+                   .poolSizeCount = pool_sizes.size(),
+                   .pPoolSizes = pool_sizes.data(),
+           }),
+        buffer(vk.device,
+               {
+                       .size = 2 * width * height * sizeof(float),
+                       .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+               },
+               {
+                       .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+                       .usage = VMA_MEMORY_USAGE_AUTO,
+               }),
+        values(2 * width * height)
+{
+	vk::PushConstantRange push_constant_range{
+	        .stageFlags = vk::ShaderStageFlagBits::eCompute,
+	        .offset = 0,
+	        .size = sizeof(DepthPcs),
+	};
+	layout = vk.device.createPipelineLayout({
+	        .setLayoutCount = 1,
+	        .pSetLayouts = &*ds_layout,
+	        .pushConstantRangeCount = 1,
+	        .pPushConstantRanges = &push_constant_range,
+	});
+
+	auto & spirv = shaders.at("depth_downsample.comp");
+	vk::raii::ShaderModule shader(vk.device, {
+	                                                 .codeSize = spirv.size() * sizeof(uint32_t),
+	                                                 .pCode = spirv.data(),
+	                                         });
+
+	pipeline = vk::raii::Pipeline(vk.device, nullptr, vk::ComputePipelineCreateInfo{
+	                                                          .stage = {
+	                                                                  .stage = vk::ShaderStageFlagBits::eCompute,
+	                                                                  .module = *shader,
+	                                                                  .pName = "main",
+	                                                          },
+	                                                          .layout = *layout,
+	                                                  });
+
+	std::array<vk::DescriptorSetLayout, 2> layouts = {*ds_layout, *ds_layout};
+	auto my_ds = vk.device.allocateDescriptorSets({
+	        .descriptorPool = *dp,
+	        .descriptorSetCount = layouts.size(),
+	        .pSetLayouts = layouts.data(),
+	});
+
+	ds = {
+	        my_ds[0].release(),
+	        my_ds[1].release(),
+	};
+}
+
+bool wivrn_depth_renderer::record(vk::raii::CommandBuffer & command_buffer, const comp_layer & layer)
+{
+	if (layer.data.type != XRT_LAYER_PROJECTION_DEPTH)
+		return false;
+
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		const auto & depth = layer.data.depth.d[eye];
+		const comp_swapchain * sc = comp_layer_get_depth_swapchain(&layer, eye);
+		if (not sc)
+			return false;
+
+		// Monado keeps released swapchain images in shader read only layout
+		vk::DescriptorImageInfo image_info{
+		        .sampler = *sampler,
+		        .imageView = sc->images[depth.sub.image_index].views.no_alpha[depth.sub.array_index],
+		        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+		};
+		vk::DescriptorBufferInfo buffer_info{
+		        .buffer = buffer,
+		        .offset = 0,
+		        .range = vk::WholeSize,
+		};
+
+		vk.device.updateDescriptorSets(
+		        {
+		                vk::WriteDescriptorSet{
+		                        .dstSet = ds[eye],
+		                        .dstBinding = 0,
+		                        .descriptorCount = 1,
+		                        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+		                        .pImageInfo = &image_info,
+		                },
+		                vk::WriteDescriptorSet{
+		                        .dstSet = ds[eye],
+		                        .dstBinding = 1,
+		                        .descriptorCount = 1,
+		                        .descriptorType = vk::DescriptorType::eStorageBuffer,
+		                        .pBufferInfo = &buffer_info,
+		                },
+		        },
+		        nullptr);
+
+		DepthPcs pcs{
+		        .offset = {depth.sub.norm_rect.x, depth.sub.norm_rect.y},
+		        .extent = {depth.sub.norm_rect.w, depth.sub.norm_rect.h},
+		        .min_depth = depth.min_depth,
+		        .max_depth = depth.max_depth,
+		        // far_z may be infinite
+		        .inverse_near = 1 / depth.near_z,
+		        .inverse_far = 1 / depth.far_z,
+		        .width = width,
+		        .height = height,
+		        .first = uint32_t(eye * width * height),
+		};
+
+		command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *layout, 0, ds[eye], {});
+		command_buffer.pushConstants<DepthPcs>(*layout, vk::ShaderStageFlagBits::eCompute, 0, pcs);
+		command_buffer.dispatch((width + 7) / 8, (height + 7) / 8, 1);
+	}
+
+	command_buffer.pipelineBarrier(
+	        vk::PipelineStageFlagBits::eComputeShader,
+	        vk::PipelineStageFlagBits::eHost,
+	        {},
+	        vk::MemoryBarrier{
+	                .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+	                .dstAccessMask = vk::AccessFlagBits::eHostRead,
+	        },
+	        nullptr,
+	        nullptr);
+
+	return true;
+}
+
+to_headset::video_stream_depth wivrn_depth_renderer::read(uint64_t frame_index)
+{
+	const float * inverse_distance = (const float *)buffer.map();
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = depth_codec::quantize(1 / inverse_distance[i], min_distance);
+
+	to_headset::video_stream_depth result{
+	        .frame_idx = frame_index,
+	        .width = width,
+	        .height = height,
+	        .min_distance = min_distance,
+	};
+	depth_codec::encode(values, width, result.data);
+	return result;
+}
+} // namespace wivrn
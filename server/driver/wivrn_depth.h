@@ -0,0 +1,67 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "vk/allocation.h"
+#include "wivrn_packets.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan_raii.hpp>
+
+struct comp_layer;
+
+namespace wivrn
+{
+
+struct wivrn_vk_bundle;
+
+// Downsamples the depth layers submitted by the application to a grid of
+// distances per eye, sent to the headset for positional reprojection
+class wivrn_depth_renderer
+{
+	wivrn_vk_bundle & vk;
+
+	vk::raii::Sampler sampler = nullptr;
+	vk::raii::DescriptorSetLayout ds_layout = nullptr;
+	vk::raii::DescriptorPool dp = nullptr;
+	vk::raii::PipelineLayout layout = nullptr;
+	vk::raii::Pipeline pipeline = nullptr;
+	std::array<vk::DescriptorSet, 2> ds;
+
+	// Inverse distances for both eyes, written by the GPU
+	buffer_allocation buffer;
+	std::vector<uint16_t> values;
+
+public:
+	static const uint16_t width = 48;
+	static const uint16_t height = 48;
+
+	wivrn_depth_renderer(wivrn_vk_bundle & vk);
+
+	// Returns false if the layer has no depth, command_buffer must not be
+	// submitted again before the result is read
+	bool record(vk::raii::CommandBuffer & command_buffer, const comp_layer & layer);
+
+	// Once the command buffer has completed
+	to_headset::video_stream_depth read(uint64_t frame_index);
+};
+} // namespace wivrn
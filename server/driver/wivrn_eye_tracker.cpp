@@ -89,9 +89,9 @@ xrt_space_relation wivrn_eye_tracker::get_tracked_pose(xrt_input_name name, int6
 	return {};
 }
 
-void wivrn_eye_tracker::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_eye_tracker::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
 {
-	gaze.update_tracking(tracking, offset);
+	gaze.update_tracking(tracking, poses, offset);
 }
 
 /*
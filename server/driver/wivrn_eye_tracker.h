@@ -41,7 +41,7 @@ public:
 	wivrn_eye_tracker(xrt_device * hmd);
 
 	void update_inputs();
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const from_headset::tracking &, const tracked_poses &, const clock_offset &);
 	xrt_space_relation get_tracked_pose(xrt_input_name name, int64_t at_timestamp_ns);
 };
 } // namespace wivrn
@@ -20,15 +20,19 @@
 
 #include "wivrn_foveation.h"
 
+#include "driver/pose_list.h"
 #include "driver/xrt_cast.h"
+#include "encoder/video_encoder.h"
 #include "math/m_api.h"
 #include "utils/wivrn_vk_bundle.h"
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <map>
+#include <numbers>
 #include <vulkan/vulkan_raii.hpp>
 #include <vulkan/vulkan_structs.hpp>
 #include <openxr/openxr.h>
@@ -40,6 +44,37 @@ namespace wivrn
 
 const uint32_t dispatch_group_count = RENDER_DISTORTION_IMAGE_DIMENSIONS / 8;
 
+// Gaze angular speed above which the eye is considered to be in a saccade
+static const float saccade_threshold = 100 * std::numbers::pi / 180; // rad/s
+// Time window used to estimate gaze velocity
+static const XrDuration velocity_window = 10'000'000;
+// Maximum duration the gaze is extrapolated for
+static const XrDuration max_prediction = 50'000'000;
+// Saccades rarely exceed this amplitude
+static const float max_saccade_amplitude = 20 * std::numbers::pi / 180; // rad
+// Gaze is considered lost when there is no newer sample
+static const XrDuration gaze_timeout = 100'000'000;
+// Foveal region widening per radian of prediction uncertainty
+static const float widening_per_radian = 2;
+static const float max_widening = 0.5;
+// Fraction of the widening kept on each frame when the prediction is reliable again
+static const float widening_decay = 0.9;
+
+// Normalized quantization parameter above which the encoder is starved,
+// and below which it has headroom
+static const float qp_high = 0.65;
+static const float qp_low = 0.5;
+// Same thresholds on the encoded size relative to the budget, for encoders
+// that do not report the quantization parameter
+static const float size_ratio_high = 1.2;
+static const float size_ratio_low = 0.6;
+static const float size_ratio_smoothing = 0.1;
+// Strength change per frame, relaxing is slower to avoid oscillations
+static const float strength_increase = 0.01;
+static const float strength_decrease = 0.005;
+// Scale factor at maximum strength
+static const float min_scale_factor = 0.7;
+
 struct FoveationParamsPcs
 {
 	float a[2];
@@ -258,58 +293,134 @@ xrt_vec2 yaw_pitch(xrt_quat q)
 	        pitch};
 }
 
-std::array<xrt_vec2, 2> wivrn_foveation::get_center()
+wivrn_foveation::wivrn_foveation()
 {
-	std::lock_guard lock(mutex);
+	if (auto dump_file = std::getenv("WIVRN_DUMP_GAZE"))
+	{
+		gaze_csv.open(dump_file);
+		dump_gaze = bool(gaze_csv);
+	}
+}
+
+wivrn_foveation::center wivrn_foveation::get_center(XrTime display_time)
+{
+	std::unique_lock lock(mutex);
+
+	xrt_vec2 gaze{};
+	float uncertainty = 0;
+	std::optional<XrTime> gaze_time;
 
-	std::array<xrt_vec2, 2> uvs;
-	auto e = yaw_pitch(last_gaze);
+	if (gaze_count == 0)
+	{
+		uncertainty = max_widening / widening_per_radian;
+	}
+	else
+	{
+		const auto & last = gaze_history[(gaze_count - 1) % gaze_history.size()];
+		gaze = last.angles;
+		gaze_time = last.time;
+
+		// Oldest sample in the velocity window
+		const gaze_sample * first = nullptr;
+		for (size_t i = 2; i <= std::min(gaze_count, gaze_history.size()); ++i)
+		{
+			const auto & sample = gaze_history[(gaze_count - i) % gaze_history.size()];
+			if (last.time - sample.time > velocity_window)
+				break;
+			first = &sample;
+		}
+
+		XrDuration horizon = std::clamp<XrDuration>(display_time - last.time, 0, max_prediction);
+
+		if (display_time - last.time > gaze_timeout)
+		{
+			uncertainty = max_widening / widening_per_radian;
+		}
+		else if (first and last.time > first->time)
+		{
+			float dt = (last.time - first->time) * 1e-9;
+			xrt_vec2 velocity{
+			        (last.angles.x - first->angles.x) / dt,
+			        (last.angles.y - first->angles.y) / dt,
+			};
+			float speed = std::hypot(velocity.x, velocity.y);
+
+			// During fixations, velocity is mostly noise: do not extrapolate
+			if (speed > saccade_threshold)
+			{
+				float amplitude = std::min(speed * horizon * 1e-9f, max_saccade_amplitude);
+				gaze.x += velocity.x / speed * amplitude;
+				gaze.y += velocity.y / speed * amplitude;
+
+				// Landing point of the saccade is unknown
+				uncertainty = amplitude / 2;
+			}
+		}
+	}
 
+	widening = std::max(std::min(uncertainty * widening_per_radian, max_widening), widening * widening_decay);
+
+	center res{.widening = widening};
 	for (int i = 0; i < 2; i++)
 	{
-		uvs[i].x = (e.x - views[i].fov.angleLeft) / (views[i].fov.angleRight - views[i].fov.angleLeft) * 2 - 1 + center_offset[i].x;
-		uvs[i].y = (e.y - views[i].fov.angleDown) / (views[i].fov.angleUp - views[i].fov.angleDown) * 2 - 1 + center_offset[i].y;
+		res.uv[i].x = (gaze.x - views[i].fov.angleLeft) / (views[i].fov.angleRight - views[i].fov.angleLeft) * 2 - 1 + center_offset[i].x;
+		res.uv[i].y = (gaze.y - views[i].fov.angleDown) / (views[i].fov.angleUp - views[i].fov.angleDown) * 2 - 1 + center_offset[i].y;
+	}
+	lock.unlock();
+
+	if (dump_gaze and gaze_time)
+	{
+		std::lock_guard dump_lock(gaze_csv_mutex);
+		gaze_csv << "\"predict\"," << *gaze_time << "," << display_time << ","
+		         << gaze.x << "," << gaze.y << "," << uncertainty << '\n';
 	}
 
-	return uvs;
+	return res;
 }
 
-void wivrn_foveation::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_foveation::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
 {
-	std::lock_guard lock(mutex);
+	std::unique_lock lock(mutex);
 
 	const uint8_t orientation_ok = from_headset::tracking::orientation_valid | from_headset::tracking::orientation_tracked;
 
 	views = tracking.views;
 
-	std::optional<xrt_quat> head;
-
-	for (const auto & pose: tracking.device_poses)
-	{
-		if (pose.device != device_id::HEAD)
-			continue;
-
-		if ((pose.flags & orientation_ok) != orientation_ok)
-			return;
-
-		head = xrt_cast(pose.pose.orientation);
-		break;
-	}
+	// Only use measured gaze, not the runtime's predictions
+	if (tracking.timestamp != tracking.production_timestamp)
+		return;
 
-	if (!head.has_value())
+	auto head_pose = poses[device_id::HEAD];
+	if (not head_pose or (head_pose->flags & orientation_ok) != orientation_ok)
 		return;
 
-	for (const auto & pose: tracking.device_poses)
+	xrt_quat head = xrt_cast(head_pose->pose.orientation);
+
+	if (auto gaze_pose = poses[device_id::EYE_GAZE])
 	{
-		if (pose.device != device_id::EYE_GAZE)
-			continue;
+		const auto & pose = *gaze_pose;
 
 		if ((pose.flags & orientation_ok) != orientation_ok)
 			return;
 
+		if (gaze_count > 0 and tracking.timestamp <= gaze_history[(gaze_count - 1) % gaze_history.size()].time)
+			return;
+
 		xrt_quat qgaze = xrt_cast(pose.pose.orientation);
-		math_quat_unrotate(&qgaze, &head.value(), &last_gaze);
-		break;
+		xrt_quat gaze;
+		math_quat_unrotate(&qgaze, &head, &gaze);
+
+		auto & sample = gaze_history[gaze_count++ % gaze_history.size()];
+		sample.time = tracking.timestamp;
+		sample.angles = yaw_pitch(gaze);
+
+		if (dump_gaze)
+		{
+			gaze_sample dumped = sample;
+			lock.unlock();
+			std::lock_guard dump_lock(gaze_csv_mutex);
+			gaze_csv << "\"gaze\"," << dumped.time << "," << dumped.angles.x << "," << dumped.angles.y << '\n';
+		}
 	}
 }
 
@@ -320,4 +431,38 @@ void wivrn_foveation::set_initial_parameters(std::array<to_headset::foveation_pa
 	center_offset[0] = {p[0].x.center, p[0].y.center};
 	center_offset[1] = {p[1].x.center, p[1].y.center};
 }
+
+void wivrn_foveation_controller::on_encoded_frame(const encoded_frame_stats & stats)
+{
+	// IDR frames are expected to be larger
+	if (stats.idr or stats.budget == 0)
+		return;
+
+	std::lock_guard lock(mutex);
+
+	size_ratio = std::lerp(size_ratio, float(stats.size) / stats.budget, size_ratio_smoothing);
+
+	bool starved, headroom;
+	if (stats.qp)
+	{
+		starved = *stats.qp > qp_high;
+		headroom = *stats.qp < qp_low;
+	}
+	else
+	{
+		starved = size_ratio > size_ratio_high;
+		headroom = size_ratio < size_ratio_low;
+	}
+
+	if (starved)
+		strength = std::min(strength + strength_increase, 1.f);
+	else if (headroom)
+		strength = std::max(strength - strength_decrease, 0.f);
+}
+
+float wivrn_foveation_controller::get_scale_factor()
+{
+	std::lock_guard lock(mutex);
+	return std::lerp(1.f, min_scale_factor, strength);
+}
 } // namespace wivrn
@@ -21,29 +21,81 @@
 #include "wivrn_packets.h"
 #include "xrt/xrt_defines.h"
 
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <optional>
 #include <vulkan/vulkan_raii.hpp>
 
 namespace wivrn
 {
 
 struct clock_offset;
+struct encoded_frame_stats;
+class tracked_poses;
 struct wivrn_vk_bundle;
 
 // Calculates the center parameter from the received eye tracking data.
+// The gaze is predicted to the display time of the frame: during saccades
+// it is extrapolated from its current velocity, and the foveal region is
+// widened according to the uncertainty of the prediction.
 class wivrn_foveation
 {
+public:
+	struct center
+	{
+		std::array<xrt_vec2, 2> uv;
+		// 0 for the nominal foveation, foveation is weaker for higher values
+		float widening;
+	};
+
+private:
 	std::mutex mutex;
 
 	std::array<xrt_vec2, 2> center_offset = {};
 	std::array<from_headset::tracking::view, 2> views = {};
-	xrt_quat last_gaze = {};
+
+	// Measured gaze (yaw, pitch) relative to the head, in headset time
+	struct gaze_sample
+	{
+		XrTime time;
+		xrt_vec2 angles;
+	};
+	std::array<gaze_sample, 32> gaze_history = {};
+	size_t gaze_count = 0;
+
+	float widening = 0;
+
+	// Written outside of mutex, so that the file I/O does not block the tracking
+	bool dump_gaze = false;
+	std::mutex gaze_csv_mutex;
+	std::ofstream gaze_csv;
 
 public:
-	wivrn_foveation() {}
+	wivrn_foveation();
 
 	void set_initial_parameters(std::array<to_headset::foveation_parameter, 2> p);
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
-	std::array<xrt_vec2, 2> get_center();
+	void update_tracking(const from_headset::tracking &, const tracked_poses &, const clock_offset &);
+	// display_time is in headset time
+	center get_center(XrTime display_time);
+};
+
+// Adjusts the foveation strength from encoder statistics: foveation is made
+// stronger when the encoder is starved, and relaxed back to the configured
+// value when it has headroom.
+class wivrn_foveation_controller
+{
+	std::mutex mutex;
+
+	// 0 for the configured foveation, 1 for the strongest
+	float strength = 0;
+	// Moving average of the encoded size relative to the budget
+	float size_ratio = 1;
+
+public:
+	void on_encoded_frame(const encoded_frame_stats &);
+	// Factor to apply to the configured foveation scale
+	float get_scale_factor();
 };
 
 // Renders foveation parameters to Monado's distortion images using a compute shader
@@ -23,6 +23,7 @@
 #include "xrt/xrt_defines.h"
 #include "xrt/xrt_device.h"
 
+#include "render/render_interface.h"
 #include "util/u_device.h"
 #include "util/u_logging.h"
 
@@ -30,6 +31,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <optional>
 #include <stdio.h>
 #include <openxr/openxr.h>
 
@@ -64,19 +66,6 @@ static xrt_result_t wivrn_hmd_get_battery_status(struct xrt_device * xdev,
                                                  bool * out_charging,
                                                  float * out_charge);
 
-static double foveate(double a, double b, double λ, double c, double x)
-{
-	// In order to save encoding, transmit and decoding time, only a portion of the image is encoded in full resolution.
-	// on each axis, foveated coordinates are defined by the following formula.
-	return λ / a * tan(a * x + b) + c;
-	// a and b are defined such as:
-	// edges of the image are not moved
-	// f(-1) = -1
-	// f( 1) =  1
-	// the function also enforces pixel ratio 1:1 at fovea
-	// df⁻¹(x)/dx = 1/scale for x = c
-}
-
 static double foveate_lod(double a, double b, double /*λ*/, double /*c*/, double x)
 {
 	// derivate of foveate * scale
@@ -84,104 +73,43 @@ static double foveate_lod(double a, double b, double /*λ*/, double /*c*/, doubl
 	return std::max(0., log2(1 / (cos(a * x + b) * cos(a * x + b)) - 0.5));
 }
 
-static std::tuple<float, float> solve_foveation(float λ, float c)
+// Returns the foveated position and LOD for one axis, in [0, 1] coordinates
+static xrt_vec2 foveate_axis(const to_headset::foveation_parameter_item & param, float u)
 {
-	// Compute a and b for the foveation function such that:
-	//   foveate(a, b, scale, c, -1) = -1   (eq. 1)
-	//   foveate(a, b, scale, c,  1) =  1   (eq. 2)
-	//
-	// Use eq. 2 to express a as function of b, then replace in eq. 1
-	// equation that needs to be null is:
-	auto b = [λ, c](double a) { return atan(a * (1 - c) / λ) - a; };
-	auto eq = [λ, c](double a) { return atan(a * (1 - c) / λ) + atan(a * (1 + c) / λ) - 2 * a; }; // (eq. 3)
-
-	// function starts positive, reaches a maximum then decreases to -∞
-	double a0 = 0;
-	// Find a negative value by computing eq(2^n)
-	double a1 = 1;
-	while (eq(a1) > 0)
-		a1 *= 2;
-
-	// last computed values for f(a0) and f(a1)
-	std::optional<double> f_a0;
-	double f_a1 = eq(a1);
-
-	int n = 0;
-	double a = 0;
-	while (std::abs(a1 - a0) > 0.0000001 && n++ < 100)
-	{
-		if (not f_a0)
-		{
-			// use binary search
-			a = 0.5 * (a0 + a1);
-			double val = eq(a);
-			if (val > 0)
-			{
-				a0 = a;
-				f_a0 = val;
-			}
-			else
-			{
-				a1 = a;
-				f_a1 = val;
-			}
-		}
-		else
-		{
-			// f(a1) is always defined
-			// when f(a0) is defined, use secant method
-			a = a1 - f_a1 * (a1 - a0) / (f_a1 - *f_a0);
-			a0 = a1;
-			a1 = a;
-			f_a0 = f_a1;
-			f_a1 = eq(a);
-		}
-	}
+	if (param.scale >= 1)
+		return {u, 0};
 
-	return {a, b(a)};
+	u = 2 * u - 1;
+	float out = foveate(param.a, param.b, param.scale, param.center, u);
+	float lod = foveate_lod(param.a, param.b, param.scale, param.center, u);
+	return {std::clamp<float>((1 + out) / 2, 0, 1), lod};
 }
 
 bool wivrn_hmd::wivrn_hmd_compute_distortion(xrt_device * xdev, uint32_t view_index, float u, float v, xrt_uv_triplet * result)
 {
 	// u,v are in the output coordinates (sent to the encoder)
 	// result is in the input coordinates (from the application)
-	const auto & param = ((wivrn_hmd *)xdev)->foveation_parameters[view_index];
-	xrt_vec2 out;
-	xrt_vec2 lod;
-
-	if (param.x.scale < 1)
-	{
-		u = 2 * u - 1;
-
-		out.x = foveate(param.x.a, param.x.b, param.x.scale, param.x.center, u);
-		lod.x = foveate_lod(param.x.a, param.x.b, param.x.scale, param.x.center, u);
-		out.x = std::clamp<float>((1 + out.x) / 2, 0, 1);
-	}
-	else
-	{
-		out.x = u;
-		lod.x = 0;
-	}
-
-	if (param.y.scale < 1)
-	{
-		v = 2 * v - 1;
-
-		out.y = foveate(param.y.a, param.y.b, param.y.scale, param.y.center, v);
-		lod.y = foveate_lod(param.y.a, param.y.b, param.y.scale, param.y.center, v);
-		out.y = std::clamp<float>((1 + out.y) / 2, 0, 1);
-	}
-	else
-	{
-		out.y = v;
-		lod.y = 0;
-	}
+	auto self = (wivrn_hmd *)xdev;
+	const auto & param = self->foveation_parameters[view_index];
+	const auto & view_samples = self->distortion_samples[view_index];
+	const bool samples_valid = self->distortion_samples_valid.load(std::memory_order_acquire);
+
+	// Monado samples the distortion on a regular grid, each axis only depends
+	// on one coordinate: use the values precomputed in set_foveated_size
+	auto sample = [samples_valid](const std::vector<xrt_vec2> & samples, const to_headset::foveation_parameter_item & param, float u) {
+		float x = u * (RENDER_DISTORTION_IMAGE_DIMENSIONS - 1);
+		long i = std::lround(x);
+		if (samples_valid and i >= 0 and i < samples.size() and std::abs(x - i) < 0.001)
+			return samples[i];
+		return foveate_axis(param, u);
+	};
 
-	U_LOG_D("distortion parameters: %f %f (%f %f)", lod.x, lod.y, u, v);
+	xrt_vec2 x = sample(view_samples[0], param.x, u);
+	xrt_vec2 y = sample(view_samples[1], param.y, v);
 
-	result->r = out;
-	result->g = lod;
-	result->b = out;
+	result->r = {x.x, y.x};
+	result->g = {x.y, y.y};
+	result->b = result->r;
 
 	return true;
 }
@@ -267,9 +195,9 @@ xrt_space_relation wivrn_hmd::get_tracked_pose(xrt_input_name name, int64_t at_t
 	return res.relation;
 }
 
-void wivrn_hmd::update_tracking(const from_headset::tracking & tracking, const clock_offset & offset)
+void wivrn_hmd::update_tracking(const from_headset::tracking & tracking, const tracked_poses & poses, const clock_offset & offset)
 {
-	views.update_tracking(tracking, offset);
+	views.update_tracking(tracking, poses, offset);
 }
 
 void wivrn_hmd::update_battery(const from_headset::battery & new_battery)
@@ -339,9 +267,12 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 	        double(height) / hmd->views[0].display.h_pixels,
 	};
 
+	foveated_scale = scale;
+
 	hmd->screens[0].w_pixels = width;
 	hmd->screens[0].h_pixels = height;
 
+	distortion_samples_valid.store(false, std::memory_order_relaxed);
 	for (int i = 0; i < 2; ++i)
 	{
 		auto & view = hmd->views[i];
@@ -374,7 +305,17 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 
 			std::tie(foveation_parameters[i].y.a, foveation_parameters[i].y.b) = solve_foveation(scale[1], cv);
 		}
+
+		for (int axis = 0; axis < 2; ++axis)
+		{
+			const auto & param = axis == 0 ? foveation_parameters[i].x : foveation_parameters[i].y;
+			auto & samples = distortion_samples[i][axis];
+			samples.resize(RENDER_DISTORTION_IMAGE_DIMENSIONS);
+			for (size_t j = 0; j < samples.size(); ++j)
+				samples[j] = foveate_axis(param, float(j) / (RENDER_DISTORTION_IMAGE_DIMENSIONS - 1));
+		}
 	}
+	distortion_samples_valid.store(true, std::memory_order_release);
 
 	// Distortion information
 	compute_distortion = wivrn_hmd_compute_distortion;
@@ -383,22 +324,33 @@ decltype(wivrn_hmd::foveation_parameters) wivrn_hmd::set_foveated_size(uint32_t
 	return foveation_parameters;
 }
 
-void wivrn_hmd::set_foveation_center(std::array<xrt_vec2, 2> center)
+void wivrn_hmd::set_foveation_center(std::array<xrt_vec2, 2> center, float widening, float scale_factor)
 {
+	// Keep scale below 1, foveation cannot be disabled at runtime
+	widening = std::clamp<float>(widening, 0, 0.9);
+	// Precomputed samples are only valid for the initial center
+	distortion_samples_valid.store(false, std::memory_order_relaxed);
 	for (int i = 0; i < 2; ++i)
 	{
 		foveation_parameters[i].x.center = center[i].x;
 		foveation_parameters[i].y.center = center[i].y;
 
+		// A scale closer to 1 has a lower resolution at the center but a wider foveal region,
+		// a smaller scale has a lower resolution in the periphery
+		if (foveated_scale[0] < 1)
+			foveation_parameters[i].x.scale = std::lerp(foveated_scale[0] * scale_factor, 1., widening);
+		if (foveated_scale[1] < 1)
+			foveation_parameters[i].y.scale = std::lerp(foveated_scale[1] * scale_factor, 1., widening);
+
 		if (foveation_parameters[i].x.scale < 1)
 		{
 			std::tie(foveation_parameters[i].x.a, foveation_parameters[i].x.b) =
-			        solve_foveation(foveation_parameters[i].x.scale, foveation_parameters[i].x.center);
+			        foveation_solver.solve(foveation_parameters[i].x.scale, foveation_parameters[i].x.center);
 		}
 		if (foveation_parameters[i].y.scale < 1)
 		{
 			std::tie(foveation_parameters[i].y.a, foveation_parameters[i].y.b) =
-			        solve_foveation(foveation_parameters[i].y.scale, foveation_parameters[i].y.center);
+			        foveation_solver.solve(foveation_parameters[i].y.scale, foveation_parameters[i].y.center);
 		}
 	}
 }
@@ -22,11 +22,14 @@
 #include "xrt/xrt_device.h"
 #include "xrt/xrt_tracking.h"
 
+#include "foveation_solver.h"
 #include "view_list.h"
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <mutex>
+#include <vector>
 
 namespace wivrn
 {
@@ -48,6 +51,16 @@ class wivrn_hmd : public xrt_device
 
 	view_list views;
 	std::array<to_headset::foveation_parameter, 2> foveation_parameters{};
+	// Scale for the nominal foveation, per axis
+	std::array<double, 2> foveated_scale{1, 1};
+	// Foveated position (x) and LOD (y) on the distortion image grid, per view and axis
+	// Written once in set_foveated_size, only valid for the initial center:
+	// set_foveation_center clears the flag instead of the vectors, which may
+	// be read concurrently by compute_distortion
+	std::array<std::array<std::vector<xrt_vec2>, 2>, 2> distortion_samples;
+	std::atomic<bool> distortion_samples_valid = false;
+	// Built with the device, not on the first foveation update
+	const foveation_table foveation_solver;
 	from_headset::battery battery{};
 
 	wivrn::wivrn_session * cnx;
@@ -76,10 +89,12 @@ public:
 	                                float * out_charge);
 
 	void update_battery(const from_headset::battery &);
-	void update_tracking(const from_headset::tracking &, const clock_offset &);
+	void update_tracking(const from_headset::tracking &, const tracked_poses &, const clock_offset &);
 
 	decltype(foveation_parameters) set_foveated_size(uint32_t width, uint32_t height);
-	void set_foveation_center(std::array<xrt_vec2, 2> center);
+	// widening: 0 for nominal foveation, foveation is weaker for higher values
+	// scale_factor: multiplies the nominal scale, foveation is stronger for lower values
+	void set_foveation_center(std::array<xrt_vec2, 2> center, float widening = 0, float scale_factor = 1);
 
 	std::array<to_headset::foveation_parameter, 2> get_foveation_parameters()
 	{
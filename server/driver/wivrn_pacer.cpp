@@ -179,6 +179,16 @@ wivrn_pacer::frame_info wivrn_pacer::present_to_info(int64_t present)
 	return {};
 }
 
+wivrn_pacer::stats wivrn_pacer::get_stats()
+{
+	std::lock_guard lock(mutex);
+	return {
+	        .wake_up_to_present = mean_wake_up_to_present_ns,
+	        .present_to_decoded = safe_present_to_decoded_ns,
+	        .render_to_display = mean_render_to_display_ns,
+	};
+}
+
 void wivrn_pacer::reset()
 {
 	std::lock_guard lock(mutex);
@@ -42,6 +42,13 @@ public:
 		int64_t predicted_display_time;
 	};
 
+	struct stats
+	{
+		int64_t wake_up_to_present;
+		int64_t present_to_decoded;
+		int64_t render_to_display;
+	};
+
 private:
 	std::mutex mutex;
 	int64_t last_ns = 0;
@@ -89,6 +96,8 @@ public:
 
 	frame_info present_to_info(int64_t present);
 
+	stats get_stats();
+
 	void reset();
 };
 } // namespace wivrn
@@ -25,12 +25,15 @@
 #include "main/comp_main_interface.h"
 #include "main/comp_target.h"
 #include "math/m_api.h"
+#include "os/os_time.h"
 #include "util/u_builders.h"
 #include "util/u_logging.h"
 #include "util/u_system.h"
 #include "utils/scoped_lock.h"
 
 #include "audio/audio_setup.h"
+#include "configuration.h"
+#include "encoder/video_encoder.h"
 #include "wivrn_comp_target.h"
 #include "wivrn_config.h"
 #include "wivrn_eye_tracker.h"
@@ -39,6 +42,7 @@
 #include "wivrn_ipc.h"
 
 #include "xrt/xrt_session.h"
+#include <cinttypes>
 #include <cmath>
 #include <magic_enum.hpp>
 #include <stdexcept>
@@ -55,6 +59,14 @@
 namespace wivrn
 {
 
+// period of the tracking statistics in debug logs
+static const auto tracking_stats_period = std::chrono::seconds(10);
+// Tracking packets waiting for the tracking thread, the oldest are dropped
+// if it falls behind: newer packets supersede them
+static const size_t max_pending_tracking = 32;
+// Statistics are published on D-Bus at this interval
+static const auto telemetry_period = std::chrono::seconds(1);
+
 struct wivrn_comp_target_factory : public comp_target_factory
 {
 	wivrn_session & session;
@@ -92,12 +104,12 @@ struct wivrn_comp_target_factory : public comp_target_factory
 	}
 };
 
-void wivrn::tracking_control_t::send(wivrn_connection & connection)
+void wivrn::tracking_control_t::send(transmit_scheduler & transmitter)
 {
 	if (std::chrono::steady_clock::now() < next_sample)
 		return;
 
-	connection.send_stream(to_headset::tracking_control{
+	transmitter.send_control(to_headset::tracking_control{
 	        .offset = std::chrono::nanoseconds(max.exchange(0)),
 	        .enabled = enabled,
 	});
@@ -131,7 +143,8 @@ wivrn::wivrn_session::wivrn_session(wivrn::TCP && tcp, u_system & system) :
         xrt_system(system),
         hmd(this, info),
         left_hand(0, &hmd, this),
-        right_hand(1, &hmd, this)
+        right_hand(1, &hmd, this),
+        transmitter(connection, *this, configuration::read_user_configuration())
 {
 	try
 	{
@@ -196,6 +209,9 @@ wivrn::wivrn_session::wivrn_session(wivrn::TCP && tcp, u_system & system) :
 		static_roles.eyes = eye_tracker.get();
 		xdevs[xdev_count++] = eye_tracker.get();
 	}
+	if (configuration::read_user_configuration().adaptive_foveation)
+		foveation_controller = std::make_unique<wivrn_foveation_controller>();
+
 	if (info.face_tracking2_fb)
 	{
 		fb_face2_tracker = std::make_unique<wivrn_fb_face2_tracker>(&hmd, *this);
@@ -267,6 +283,12 @@ xrt_result_t wivrn::wivrn_session::create_session(wivrn::TCP && tcp,
 		self->feedback_csv.open(dump_file);
 	}
 
+	if (auto inputs_file = std::getenv("WIVRN_DUMP_INPUTS"))
+	{
+		self->inputs_csv.open(inputs_file);
+	}
+
+	self->tracking_thread = std::jthread(&wivrn_session::run_tracking, self.get());
 	self->thread = std::jthread(&wivrn_session::run, self.get());
 	*out_xsysd = self.release();
 	return XRT_SUCCESS;
@@ -288,24 +310,43 @@ void wivrn_session::operator()(from_headset::headset_info_packet &&)
 }
 void wivrn_session::operator()(from_headset::trackings && tracking)
 {
+	std::lock_guard lock(tracking_mutex);
 	for (auto & item: tracking.items)
-		(*this)(item);
+		pending_tracking.push_back(std::move(item));
+	trim_pending_tracking();
+	tracking_cv.notify_one();
 }
 void wivrn_session::operator()(const from_headset::tracking & tracking)
 {
+	std::lock_guard lock(tracking_mutex);
+	pending_tracking.push_back(tracking);
+	trim_pending_tracking();
+	tracking_cv.notify_one();
+}
+
+void wivrn_session::trim_pending_tracking()
+{
+	if (pending_tracking.size() <= max_pending_tracking)
+		return;
+	size_t excess = pending_tracking.size() - max_pending_tracking;
+	pending_tracking.erase(pending_tracking.begin(), pending_tracking.begin() + excess);
+	tracking_stats_.dropped += excess;
+}
+
+void wivrn_session::process_tracking(const from_headset::tracking & tracking)
+{
+	const tracked_poses poses(tracking);
+
 	if (tracking.state_flags & from_headset::tracking::state_flags::recentered)
 	{
-		for (const auto & pose: tracking.device_poses)
+		if (auto pose = poses[device_id::HEAD])
 		{
-			if (pose.device != device_id::HEAD)
-				continue;
-
 			xrt_pose offset;
 			auto tracking_origin = static_cast<xrt_device &>(hmd).tracking_origin;
 			space_overseer->get_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &offset);
 
-			xrt_vec3 hmd_pos = xrt_cast(pose.pose.position);
-			xrt_quat hmd_quat = xrt_cast(pose.pose.orientation);
+			xrt_vec3 hmd_pos = xrt_cast(pose->pose.position);
+			xrt_quat hmd_quat = xrt_cast(pose->pose.orientation);
 			xrt_vec3 unit_z = XRT_VEC3_UNIT_Z;
 			xrt_vec3 unit_y = XRT_VEC3_UNIT_Y;
 
@@ -323,24 +364,89 @@ void wivrn_session::operator()(const from_headset::tracking & tracking)
 			auto res = space_overseer->set_reference_space_offset(space_overseer, xrt_reference_space_type::XRT_SPACE_REFERENCE_TYPE_STAGE, &offset);
 			if (res != XRT_SUCCESS)
 				U_LOG_W("could not recenter: offset failed to apply!");
-
-			break;
 		}
 	}
 
 	auto offset = offset_est.get_offset();
 
-	hmd.update_tracking(tracking, offset);
-	left_hand.update_tracking(tracking, offset);
-	right_hand.update_tracking(tracking, offset);
+	hmd.update_tracking(tracking, poses, offset);
+	left_hand.update_tracking(tracking, poses, offset);
+	right_hand.update_tracking(tracking, poses, offset);
 	if (eye_tracker)
-		eye_tracker->update_tracking(tracking, offset);
+		eye_tracker->update_tracking(tracking, poses, offset);
 	if (foveation)
-		foveation->update_tracking(tracking, offset);
+		foveation->update_tracking(tracking, poses, offset);
 	if (fb_face2_tracker)
 		fb_face2_tracker->update_tracking(tracking, offset);
 }
 
+void wivrn_session::run_tracking(std::stop_token stop)
+{
+	std::vector<from_headset::tracking> items;
+	tracking_stats logged;
+	auto next_log = std::chrono::steady_clock::now() + tracking_stats_period;
+
+	while (not stop.stop_requested())
+	{
+		items.clear();
+		{
+			std::unique_lock lock(tracking_mutex);
+			if (not tracking_cv.wait(lock, stop, [this] { return not pending_tracking.empty(); }))
+				return;
+			std::swap(items, pending_tracking);
+		}
+
+		// Published once per batch, to take the lock only once
+		std::chrono::nanoseconds total{};
+		std::chrono::nanoseconds max{};
+		for (const auto & item: items)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			try
+			{
+				process_tracking(item);
+			}
+			catch (const std::exception & e)
+			{
+				U_LOG_E("Exception in tracking thread: %s", e.what());
+			}
+			std::chrono::nanoseconds duration = std::chrono::steady_clock::now() - begin;
+			total += duration;
+			max = std::max(max, duration);
+		}
+
+		{
+			std::lock_guard lock(tracking_mutex);
+			tracking_stats_.packets += items.size();
+			tracking_stats_.total += total;
+			tracking_stats_.max = std::max(tracking_stats_.max, max);
+			tracking_stats_.max_queue = std::max(tracking_stats_.max_queue, items.size());
+		}
+
+		if (auto now = std::chrono::steady_clock::now(); now > next_log)
+		{
+			next_log = now + tracking_stats_period;
+			auto stats = get_tracking_stats();
+			if (auto packets = stats.packets - logged.packets)
+			{
+				U_LOG_D("Tracking: %" PRIu64 " packets, %.1fµs average, %.1fµs max, %zu max queued, %" PRIu64 " dropped",
+				        packets,
+				        std::chrono::duration<float, std::micro>(stats.total - logged.total).count() / packets,
+				        std::chrono::duration<float, std::micro>(stats.max).count(),
+				        stats.max_queue,
+				        stats.dropped - logged.dropped);
+			}
+			logged = stats;
+		}
+	}
+}
+
+tracking_stats wivrn_session::get_tracking_stats()
+{
+	std::lock_guard lock(tracking_mutex);
+	return tracking_stats_;
+}
+
 void wivrn_session::operator()(from_headset::hand_tracking && hand_tracking)
 {
 	auto offset = offset_est.get_offset();
@@ -352,6 +458,12 @@ void wivrn_session::operator()(from_headset::inputs && inputs)
 {
 	auto offset = get_offset();
 
+	if (inputs_csv)
+	{
+		std::lock_guard lock(csv_mutex);
+		inputs_csv << "\"packet\"," << os_monotonic_get_ns() << "," << inputs.values.size() << std::endl;
+	}
+
 	left_hand.set_inputs(inputs, offset);
 	right_hand.set_inputs(inputs, offset);
 }
@@ -392,11 +504,14 @@ void wivrn_session::set_enabled(device_id id, bool enabled)
 void wivrn_session::operator()(from_headset::feedback && feedback)
 {
 	assert(comp_target);
+	transmitter.on_feedback(feedback);
 	clock_offset o = offset_est.get_offset();
 	if (not o)
 		return;
 	comp_target->on_feedback(feedback, o);
 
+	if (not feedback.sent_to_decoder)
+		dump_time("lost", feedback.frame_index, os_monotonic_get_ns(), feedback.stream_index);
 	if (feedback.received_first_packet)
 		dump_time("receive_begin", feedback.frame_index, o.from_headset(feedback.received_first_packet), feedback.stream_index);
 	if (feedback.received_last_packet)
@@ -405,12 +520,25 @@ void wivrn_session::operator()(from_headset::feedback && feedback)
 		dump_time("decode_begin", feedback.frame_index, o.from_headset(feedback.sent_to_decoder), feedback.stream_index);
 	if (feedback.received_from_decoder)
 		dump_time("decode_end", feedback.frame_index, o.from_headset(feedback.received_from_decoder), feedback.stream_index);
+	if (feedback.received_from_decoder and feedback.queue_time)
+		dump_time("dequeue", feedback.frame_index, o.from_headset(feedback.received_from_decoder + feedback.queue_time), feedback.stream_index);
 	if (feedback.blitted)
 		dump_time("blit", feedback.frame_index, o.from_headset(feedback.blitted), feedback.stream_index);
 	if (feedback.displayed)
 		dump_time("display", feedback.frame_index, o.from_headset(feedback.displayed), feedback.stream_index);
 }
 
+void wivrn_session::operator()(from_headset::video_nack && nack)
+{
+	transmitter.on_nack(nack);
+}
+
+void wivrn_session::operator()(from_headset::video_ack && ack)
+{
+	assert(comp_target);
+	comp_target->on_ack(ack);
+}
+
 void wivrn_session::operator()(from_headset::battery && battery)
 {
 	hmd.update_battery(battery);
@@ -433,9 +561,15 @@ void wivrn_session::run(std::stop_token stop)
 	{
 		try
 		{
-			offset_est.request_sample(connection);
-			tracking_control.send(connection);
+			offset_est.request_sample(transmitter);
+			tracking_control.send(transmitter);
 			connection.poll(*this, 20);
+
+			if (auto now = std::chrono::steady_clock::now(); now > next_telemetry)
+			{
+				next_telemetry = now + telemetry_period;
+				send_telemetry();
+			}
 		}
 		catch (const std::exception & e)
 		{
@@ -448,6 +582,7 @@ void wivrn_session::run(std::stop_token stop)
 std::array<to_headset::foveation_parameter, 2> wivrn_session::set_foveated_size(uint32_t width, uint32_t height)
 {
 	auto p = hmd.set_foveated_size(width, height);
+	foveation_scale_factor = 1;
 
 	if (foveation)
 		foveation->set_initial_parameters(p);
@@ -455,16 +590,37 @@ std::array<to_headset::foveation_parameter, 2> wivrn_session::set_foveated_size(
 	return p;
 }
 
-bool wivrn_session::apply_dynamic_foveation()
+bool wivrn_session::apply_dynamic_foveation(int64_t predicted_display_time)
 {
-	if (!foveation)
-		return false;
+	float scale_factor = foveation_controller ? foveation_controller->get_scale_factor() : 1;
+
+	if (foveation)
+	{
+		auto center = foveation->get_center(get_offset().to_headset(predicted_display_time));
+		hmd.set_foveation_center(center.uv, center.widening, scale_factor);
+	}
+	else
+	{
+		// Distortion images only need to be updated when the strength changes
+		if (scale_factor == foveation_scale_factor)
+			return false;
+
+		auto p = hmd.get_foveation_parameters();
+		hmd.set_foveation_center({xrt_vec2{p[0].x.center, p[0].y.center}, xrt_vec2{p[1].x.center, p[1].y.center}}, 0, scale_factor);
+	}
+	foveation_scale_factor = scale_factor;
 
-	hmd.set_foveation_center(foveation->get_center());
 	comp_target->render_dynamic_foveation(hmd.get_foveation_parameters());
 	return true;
 }
 
+void wivrn_session::on_encoded_frame(const encoded_frame_stats & stats)
+{
+	telemetry.add_encoded_frame(stats.size);
+	if (foveation_controller)
+		foveation_controller->on_encoded_frame(stats);
+}
+
 std::array<to_headset::foveation_parameter, 2> wivrn_session::get_foveation_parameters()
 {
 	return hmd.get_foveation_parameters();
@@ -472,6 +628,7 @@ std::array<to_headset::foveation_parameter, 2> wivrn_session::get_foveation_para
 
 void wivrn_session::dump_time(const std::string & event, uint64_t frame, int64_t time, uint8_t stream, const char * extra)
 {
+	telemetry.add_event(event, frame, stream, time);
 	if (feedback_csv)
 	{
 		std::lock_guard lock(csv_mutex);
@@ -479,6 +636,34 @@ void wivrn_session::dump_time(const std::string & event, uint64_t frame, int64_t
 	}
 }
 
+void wivrn_session::dump_input_read(xrt_input_name input, int64_t change_time)
+{
+	if (inputs_csv)
+	{
+		std::lock_guard lock(csv_mutex);
+		inputs_csv << "\"read\"," << os_monotonic_get_ns() << "," << (uint32_t)input << "," << change_time << std::endl;
+	}
+}
+
+void wivrn_session::send_telemetry()
+{
+	auto t = telemetry.collect(transmitter.take_telemetry_stats(), transmitter.get_nack_stats());
+	if (comp_target)
+	{
+		auto pacer = comp_target->pacer.get_stats();
+		t.wake_up_to_present = pacer.wake_up_to_present * 1e-9;
+		t.present_to_decoded = pacer.present_to_decoded * 1e-9;
+		t.render_to_display = pacer.render_to_display * 1e-9;
+	}
+	else
+	{
+		t.wake_up_to_present = NAN;
+		t.present_to_decoded = NAN;
+		t.render_to_display = NAN;
+	}
+	send_to_main(t);
+}
+
 static bool quit_if_no_client(u_system & xrt_system)
 {
 	scoped_lock lock(xrt_system.sessions.mutex);
@@ -514,6 +699,14 @@ void wivrn_session::reconnect()
 	try
 	{
 		offset_est.reset();
+		transmitter.clear();
+		{
+			// Poses from the previous connection use its clock offset
+			std::lock_guard lock(tracking_mutex);
+			pending_tracking.clear();
+		}
+		left_hand.reset_inputs();
+		right_hand.reset_inputs();
 		connection.reset(std::move(*tcp));
 		std::optional<wivrn::from_headset::packets> control;
 		while (not(control = connection.poll_control(100)))
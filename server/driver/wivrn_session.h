@@ -20,6 +20,8 @@
 #pragma once
 
 #include "clock_offset.h"
+#include "session_telemetry.h"
+#include "transmit_scheduler.h"
 #include "wivrn_connection.h"
 #include "wivrn_controller.h"
 #include "wivrn_hmd.h"
@@ -27,10 +29,12 @@
 #include "xrt/xrt_results.h"
 #include "xrt/xrt_system.h"
 #include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 struct u_system;
 struct xrt_space_overseer;
@@ -41,7 +45,9 @@ namespace wivrn
 class wivrn_eye_tracker;
 class wivrn_fb_face2_tracker;
 class wivrn_foveation;
+class wivrn_foveation_controller;
 class wivrn_foveation_renderer;
+struct encoded_frame_stats;
 struct audio_device;
 struct wivrn_comp_target;
 struct wivrn_comp_target_factory;
@@ -68,11 +74,21 @@ public:
 		{
 		}
 	}
-	void send(wivrn_connection & connection);
+	void send(transmit_scheduler &);
 
 	void set_enabled(to_headset::tracking_control::id id, bool enabled);
 };
 
+struct tracking_stats
+{
+	uint64_t packets = 0;
+	std::chrono::nanoseconds total{};
+	std::chrono::nanoseconds max{};
+	size_t max_queue = 0;
+	// packets dropped because the queue was full
+	uint64_t dropped = 0;
+};
+
 class wivrn_session : public xrt_system_devices
 {
 	friend wivrn_comp_target_factory;
@@ -97,6 +113,8 @@ class wivrn_session : public xrt_system_devices
 	std::unique_ptr<wivrn_eye_tracker> eye_tracker;
 	std::unique_ptr<wivrn_fb_face2_tracker> fb_face2_tracker;
 	std::unique_ptr<wivrn_foveation> foveation;
+	std::unique_ptr<wivrn_foveation_controller> foveation_controller;
+	float foveation_scale_factor = 1;
 	wivrn_comp_target * comp_target;
 
 	clock_offset_estimator offset_est;
@@ -107,9 +125,24 @@ class wivrn_session : public xrt_system_devices
 
 	std::mutex csv_mutex;
 	std::ofstream feedback_csv;
+	std::ofstream inputs_csv;
 
 	std::shared_ptr<audio_device> audio_handle;
 
+	session_telemetry telemetry;
+	std::chrono::steady_clock::time_point next_telemetry;
+
+	transmit_scheduler transmitter;
+
+	// tracking packets are processed outside of the network thread
+	std::mutex tracking_mutex;
+	std::condition_variable_any tracking_cv;
+	std::vector<from_headset::tracking> pending_tracking;
+	// called with tracking_mutex held
+	void trim_pending_tracking();
+	tracking_stats tracking_stats_;
+	std::jthread tracking_thread;
+
 	std::jthread thread;
 
 	wivrn_session(TCP && tcp, u_system &);
@@ -123,6 +156,10 @@ public:
 
 	clock_offset get_offset();
 	bool connected();
+	bool is_tcp_only()
+	{
+		return connection.is_tcp_only();
+	}
 	const from_headset::headset_info_packet & get_info()
 	{
 		return info;
@@ -148,6 +185,8 @@ public:
 	void operator()(from_headset::inputs &&);
 	void operator()(from_headset::timesync_response &&);
 	void operator()(from_headset::feedback &&);
+	void operator()(from_headset::video_nack &&);
+	void operator()(from_headset::video_ack &&);
 	void operator()(from_headset::battery &&);
 	void operator()(audio_data &&);
 
@@ -156,28 +195,57 @@ public:
 	template <typename T>
 	void send_stream(T && packet)
 	{
-		connection.send_stream(std::forward<T>(packet));
+		transmitter.send_stream(std::forward<T>(packet));
 	}
 
 	template <typename T>
 	void send_control(T && packet)
 	{
-		connection.send_control(std::forward<T>(packet));
+		transmitter.send_control(std::forward<T>(packet));
+	}
+
+	void send_video(std::span<serialization_packet> packets, const transmit_scheduler::video_info & info)
+	{
+		transmitter.send_video(packets, info);
+	}
+
+	void set_video_rate(uint64_t bitrate, std::chrono::nanoseconds frame_period)
+	{
+		transmitter.set_video_rate(bitrate, frame_period);
 	}
 
 	std::array<to_headset::foveation_parameter, 2> set_foveated_size(uint32_t width, uint32_t height);
 	std::array<to_headset::foveation_parameter, 2> get_foveation_parameters();
-	bool apply_dynamic_foveation();
+	// predicted_display_time is in server time
+	bool apply_dynamic_foveation(int64_t predicted_display_time);
 	bool has_dynamic_foveation()
 	{
-		return (bool)foveation;
+		return foveation or foveation_controller;
+	}
+	void on_encoded_frame(const encoded_frame_stats &);
+	void add_encoder_queue(size_t frames)
+	{
+		telemetry.add_encoder_queue(frames);
 	}
 
 	void dump_time(const std::string & event, uint64_t frame, int64_t time, uint8_t stream = -1, const char * extra = "");
+	// Input value read by the application, change_time is the time it changed on the headset
+	void dump_input_read(xrt_input_name input, int64_t change_time);
+
+	// tracking packet processing, since the session started
+	tracking_stats get_tracking_stats();
+	// video retransmissions, since the session started
+	transmit_scheduler::nack_stats get_nack_stats()
+	{
+		return transmitter.get_nack_stats();
+	}
 
 private:
 	void run(std::stop_token stop);
+	void run_tracking(std::stop_token stop);
+	void process_tracking(const from_headset::tracking &);
 	void reconnect();
+	void send_telemetry();
 
 	// xrt_system implementation
 	xrt_result_t get_roles(xrt_system_roles * out_roles);
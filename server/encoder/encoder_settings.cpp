@@ -33,6 +33,9 @@
 #if WIVRN_USE_NVENC
 #include "video_encoder_nvenc.h"
 #endif
+#if WIVRN_USE_FFMPEG
+#include "ffmpeg/video_encoder_sw.h"
+#endif
 #if WIVRN_USE_VAAPI
 #include "ffmpeg/video_encoder_va.h"
 #endif
@@ -116,8 +119,9 @@ static void check_scale(std::string_view encoder_name, video_codec codec, uint16
 #endif
 }
 
-#if WIVRN_USE_VAAPI
-static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & bundle, const std::vector<wivrn::video_codec> & codecs)
+#if WIVRN_USE_FFMPEG
+template <typename Encoder>
+static std::optional<wivrn::video_codec> filter_codecs_ffmpeg(wivrn_vk_bundle & bundle, const std::string & name, const std::vector<wivrn::video_codec> & codecs)
 {
 	VideoEncoderFFMPEG::mute_logs mute;
 	encoder_settings s{
@@ -127,7 +131,7 @@ static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & b
 	                .video_width = 800,
 	                .video_height = 600,
 	        },
-	        "vaapi",
+	        name,
 	        default_bitrate,
 	};
 	for (auto codec: codecs)
@@ -135,7 +139,7 @@ static std::optional<wivrn::video_codec> filter_codecs_vaapi(wivrn_vk_bundle & b
 		try
 		{
 			s.codec = codec;
-			video_encoder_va test(bundle, s, 60);
+			Encoder test(bundle, s, 60);
 			return codec;
 		}
 		catch (...)
@@ -181,16 +185,29 @@ static void fill_defaults(wivrn_vk_bundle & bundle, const std::vector<wivrn::vid
 #if WIVRN_USE_VAAPI
 	if (config.name == encoder_vaapi and not config.codec)
 	{
-		config.codec = filter_codecs_vaapi(bundle, headset_codecs);
+		config.codec = filter_codecs_ffmpeg<video_encoder_va>(bundle, encoder_vaapi, headset_codecs);
 		if (not config.codec)
 		{
 			U_LOG_W("Failed to initialize vaapi, fallback to software encoding");
+#if WIVRN_USE_X264
 			config.name = encoder_x264;
 			config.codec = h264;
+#else
+			config.name = encoder_ffmpeg;
+#endif
 		}
 	}
 #endif
 
+#if WIVRN_USE_FFMPEG
+	if (config.name == encoder_ffmpeg and not config.codec)
+	{
+		config.codec = filter_codecs_ffmpeg<video_encoder_sw>(bundle, encoder_ffmpeg, headset_codecs);
+		if (not config.codec)
+			U_LOG_E("No software encoder available in ffmpeg (libx264, libx265 or libsvtav1)");
+	}
+#endif
+
 #if WIVRN_USE_X264
 	if (config.name == encoder_x264)
 		config.codec = h264;
@@ -327,6 +344,7 @@ std::vector<encoder_settings> get_encoder_settings(wivrn_vk_bundle & bundle, uin
 		}
 		settings.options = encoder.options;
 		settings.device = encoder.device;
+		settings.reference_invalidation = config.reference_invalidation;
 
 		res.push_back(settings);
 	}
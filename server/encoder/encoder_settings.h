@@ -39,6 +39,8 @@ struct encoder_settings : public to_headset::video_stream_description::item
 	// encoders in the same group are executed in sequence
 	int group = 0;
 	std::optional<std::string> device;
+	// after a loss, predict from a frame the headset decoded if the encoder supports it
+	bool reference_invalidation = true;
 };
 
 std::vector<encoder_settings> get_encoder_settings(wivrn_vk_bundle &, uint32_t & width, uint32_t & height, const from_headset::headset_info_packet & info);
@@ -18,9 +18,13 @@
  */
 
 #include "ffmpeg_helper.h"
-#include <libdrm/drm_fourcc.h>
+#include "wivrn_config.h"
 #include <vulkan/vulkan.h>
 
+#if WIVRN_USE_VAAPI
+#include <libdrm/drm_fourcc.h>
+#endif
+
 extern "C"
 {
 #include <libavcodec/avcodec.h>
@@ -69,6 +73,7 @@ vk_format_to_av_format(VkFormat vk_fmt)
 	throw std::runtime_error("unsupported vulkan pixel format " + std::to_string((VkFormat)vk_fmt));
 }
 
+#if WIVRN_USE_VAAPI
 uint32_t
 vk_format_to_fourcc(VkFormat vk_fmt)
 {
@@ -83,6 +88,7 @@ vk_format_to_fourcc(VkFormat vk_fmt)
 	}
 	throw std::runtime_error("unsupported vulkan pixel format " + std::to_string((VkFormat)vk_fmt));
 }
+#endif
 
 void AvDeleter::operator()(AVBufferRef * x)
 {
@@ -20,10 +20,12 @@
 #include "video_encoder_ffmpeg.h"
 #include "util/u_logging.h"
 #include <stdexcept>
+#include <thread>
 
 extern "C"
 {
 #include <libavcodec/avcodec.h>
+#include <libavutil/intreadwrite.h>
 #include <libavutil/log.h>
 }
 
@@ -71,8 +73,18 @@ std::optional<wivrn::VideoEncoder::data> VideoEncoderFFMPEG::encode(bool idr, st
 	push_frame(idr, target_timestamp, slot);
 	std::shared_ptr<AVPacket> enc_pkt(av_packet_alloc(), [](AVPacket * d) { av_packet_free(&d); });
 	int err = avcodec_receive_packet(encoder_ctx.get(), enc_pkt.get());
+	auto deadline = std::chrono::steady_clock::now() + receive_timeout;
+	while (err == AVERROR(EAGAIN) and std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+		err = avcodec_receive_packet(encoder_ctx.get(), enc_pkt.get());
+	}
 	if (err == 0)
 	{
+		size_t stats_size;
+		if (auto stats = av_packet_get_side_data(enc_pkt.get(), AV_PKT_DATA_QUALITY_STATS, &stats_size); stats and stats_size >= 4)
+			frame_qp = float(AV_RL32(stats)) / FF_QP2LAMBDA;
+
 		return data{
 		        .encoder = this,
 		        .span = std::span(enc_pkt->data, enc_pkt->size),
@@ -44,6 +44,8 @@ protected:
 	virtual void push_frame(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot) = 0;
 
 	av_codec_context_ptr encoder_ctx;
+	// How long to wait for the packet after the frame is sent, for asynchronous encoders
+	std::chrono::nanoseconds receive_timeout{0};
 
 private:
 	static bool once;
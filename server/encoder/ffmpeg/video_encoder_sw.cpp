@@ -0,0 +1,317 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "video_encoder_sw.h"
+
+#include "encoder/encoder_settings.h"
+
+#include "util/u_logging.h"
+#include "utils/wivrn_vk_bundle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+namespace wivrn
+{
+
+namespace
+{
+const char * encoder(video_codec codec)
+{
+	switch (codec)
+	{
+		case video_codec::h264:
+			return "libx264";
+		case video_codec::h265:
+			return "libx265";
+		case video_codec::av1:
+			return "libsvtav1";
+	}
+	throw std::runtime_error("invalid codec " + std::to_string(int(codec)));
+}
+
+// Number of slices (h264, h265) so that all cores are used without lookahead or frame threads
+int slice_count()
+{
+	return std::clamp<int>(std::thread::hardware_concurrency(), 1, 16);
+}
+} // namespace
+
+video_encoder_sw::video_encoder_sw(wivrn_vk_bundle & vk, wivrn::encoder_settings & settings, float fps)
+{
+	// encoder requires width and height to be even
+	settings.video_width += settings.video_width % 2;
+	settings.video_height += settings.video_height % 2;
+	video_width = settings.video_width;
+	video_height = settings.video_height;
+
+	rect = vk::Rect2D{
+	        .offset = {
+	                .x = settings.offset_x,
+	                .y = settings.offset_y,
+	        },
+	        .extent = {
+	                .width = settings.width,
+	                .height = settings.height,
+	        },
+	};
+
+	const char * encoder_name = encoder(settings.codec);
+	const AVCodec * codec = avcodec_find_encoder_by_name(encoder_name);
+	if (codec == nullptr)
+	{
+		throw std::runtime_error(std::string("Failed to find encoder ") + encoder_name);
+	}
+
+	encoder_ctx = av_codec_context_ptr(avcodec_alloc_context3(codec));
+	if (not encoder_ctx)
+	{
+		throw std::runtime_error(std::string("failed to allocate ") + encoder_name + " encoder");
+	}
+
+	// Intra refresh replaces keyframes: there is no large I frame, and the
+	// stream recovers from losses within one refresh period.
+	// Explicit IDR requests are still honoured.
+	refresh_period = std::max<int>(fps, 1);
+	const std::string slices = std::to_string(slice_count());
+
+	AVDictionary * opts = nullptr;
+	switch (settings.codec)
+	{
+		case video_codec::h264:
+			encoder_ctx->profile = FF_PROFILE_H264_CONSTRAINED_BASELINE;
+			encoder_ctx->gop_size = refresh_period;
+			encoder_ctx->slices = slice_count();
+			av_dict_set(&opts, "preset", "ultrafast", 0);
+			av_dict_set(&opts, "tune", "zerolatency", 0);
+			av_dict_set(&opts, "intra-refresh", "1", 0);
+			av_dict_set(&opts, "forced-idr", "1", 0);
+			break;
+		case video_codec::h265:
+			encoder_ctx->profile = FF_PROFILE_HEVC_MAIN;
+			encoder_ctx->gop_size = refresh_period;
+			av_dict_set(&opts, "preset", "ultrafast", 0);
+			av_dict_set(&opts, "tune", "zerolatency", 0);
+			av_dict_set(&opts, "forced-idr", "1", 0);
+			av_dict_set(&opts, "x265-params", ("log-level=warning:intra-refresh=1:frame-threads=1:slices=" + slices).c_str(), 0);
+			break;
+		case video_codec::av1:
+			// svt-av1 has no intra refresh, use tiles for parallelism and
+			// low delay prediction structure
+			encoder_ctx->profile = FF_PROFILE_AV1_MAIN;
+			encoder_ctx->gop_size = std::numeric_limits<decltype(encoder_ctx->gop_size)>::max();
+			av_dict_set(&opts, "preset", "12", 0);
+			av_dict_set(&opts, "svtav1-params", "pred-struct=1:tile-columns=2:tile-rows=1:fast-decode=1", 0);
+			break;
+	}
+	for (auto option: settings.options)
+	{
+		av_dict_set(&opts, option.first.c_str(), option.second.c_str(), 0);
+	}
+
+	// Options may have disabled intra refresh
+	auto refresh_option = [&](const char * key, const char * value) {
+		auto entry = av_dict_get(opts, key, nullptr, 0);
+		return entry and strstr(entry->value, value);
+	};
+	switch (settings.codec)
+	{
+		case video_codec::h264:
+			if (not refresh_option("intra-refresh", "1"))
+				refresh_period = 0;
+			break;
+		case video_codec::h265:
+			if (not refresh_option("x265-params", "intra-refresh=1"))
+				refresh_period = 0;
+			break;
+		case video_codec::av1:
+			refresh_period = 0;
+			break;
+	}
+
+	encoder_ctx->width = settings.video_width;
+	encoder_ctx->height = settings.video_height;
+	encoder_ctx->time_base = {std::chrono::steady_clock::duration::period::num,
+	                          std::chrono::steady_clock::duration::period::den};
+	encoder_ctx->framerate = AVRational{(int)fps, 1};
+	encoder_ctx->sample_aspect_ratio = AVRational{1, 1};
+	encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+	encoder_ctx->color_range = AVCOL_RANGE_JPEG;
+	encoder_ctx->colorspace = AVCOL_SPC_BT709;
+	encoder_ctx->color_trc = AVCOL_TRC_BT709;
+	encoder_ctx->color_primaries = AVCOL_PRI_BT709;
+	settings.range = VK_SAMPLER_YCBCR_RANGE_ITU_FULL;
+	settings.color_model = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709;
+	encoder_ctx->max_b_frames = 0;
+	// Constant bitrate, with a buffer of a single frame
+	encoder_ctx->bit_rate = settings.bitrate;
+	encoder_ctx->rc_max_rate = settings.bitrate;
+	encoder_ctx->rc_buffer_size = settings.bitrate / fps;
+	encoder_ctx->thread_count = 0;
+
+	int err = avcodec_open2(encoder_ctx.get(), codec, &opts);
+	av_dict_free(&opts);
+	if (err < 0)
+	{
+		throw std::system_error(err, av_error_category(), "Cannot open video encoder codec");
+	}
+
+	if (encoder_ctx->delay != 0)
+	{
+		U_LOG_W("Encoder %d reports a %d frame delay, reprojection will fail", stream_idx, encoder_ctx->delay);
+	}
+
+	// svt-av1 processes frames asynchronously, libx264 and libx265 return
+	// the packet from avcodec_send_frame
+	if (settings.codec == video_codec::av1)
+		receive_timeout = std::chrono::nanoseconds(int64_t(1'000'000'000 / fps));
+
+	frame = make_av_frame();
+	frame->format = AV_PIX_FMT_YUV420P;
+	frame->width = settings.video_width;
+	frame->height = settings.video_height;
+	frame->color_range = AVCOL_RANGE_JPEG;
+	frame->colorspace = AVCOL_SPC_BT709;
+	frame->color_primaries = AVCOL_PRI_BT709;
+	frame->color_trc = AVCOL_TRC_BT709;
+	err = av_frame_get_buffer(frame.get(), 0);
+	if (err < 0)
+	{
+		throw std::system_error(err, av_error_category(), "Cannot allocate frame");
+	}
+
+	for (auto & i: in)
+	{
+		i.luma = buffer_allocation(
+		        vk.device,
+		        {
+		                .size = vk::DeviceSize(settings.video_width * settings.video_height),
+		                .usage = vk::BufferUsageFlagBits::eTransferDst,
+		        },
+		        {
+		                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+		                .usage = VMA_MEMORY_USAGE_AUTO,
+		        });
+		i.chroma = buffer_allocation(
+		        vk.device,
+		        {
+		                .size = vk::DeviceSize(settings.video_width * settings.video_height / 2),
+		                .usage = vk::BufferUsageFlagBits::eTransferDst,
+		        },
+		        {
+		                .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+		                .usage = VMA_MEMORY_USAGE_AUTO,
+		        });
+	}
+}
+
+void video_encoder_sw::present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot)
+{
+	cmd_buf.copyImageToBuffer(
+	        y_cbcr,
+	        vk::ImageLayout::eTransferSrcOptimal,
+	        in[slot].luma,
+	        vk::BufferImageCopy{
+	                .bufferRowLength = video_width,
+	                .imageSubresource = {
+	                        .aspectMask = vk::ImageAspectFlagBits::ePlane0,
+	                        .layerCount = 1,
+	                },
+	                .imageOffset = {
+	                        .x = rect.offset.x,
+	                        .y = rect.offset.y,
+	                },
+	                .imageExtent = {
+	                        .width = rect.extent.width,
+	                        .height = rect.extent.height,
+	                        .depth = 1,
+	                }});
+	cmd_buf.copyImageToBuffer(
+	        y_cbcr,
+	        vk::ImageLayout::eTransferSrcOptimal,
+	        in[slot].chroma,
+	        vk::BufferImageCopy{
+	                .bufferRowLength = video_width / 2,
+	                .imageSubresource = {
+	                        .aspectMask = vk::ImageAspectFlagBits::ePlane1,
+	                        .layerCount = 1,
+	                },
+	                .imageOffset = {
+	                        .x = rect.offset.x / 2,
+	                        .y = rect.offset.y / 2,
+	                },
+	                .imageExtent = {
+	                        .width = rect.extent.width / 2,
+	                        .height = rect.extent.height / 2,
+	                        .depth = 1,
+	                }});
+}
+
+int video_encoder_sw::intra_refresh()
+{
+	// ffmpeg cannot trigger a refresh, the next complete one starts
+	// at most one period from now
+	return 2 * refresh_period;
+}
+
+void video_encoder_sw::push_frame(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot)
+{
+	// The encoder may still reference the previous frame
+	int err = av_frame_make_writable(frame.get());
+	if (err < 0)
+	{
+		throw std::system_error(err, av_error_category(), "av_frame_make_writable failed");
+	}
+
+	auto luma = in[slot].luma.data<uint8_t>();
+	for (uint32_t y = 0; y < video_height; ++y)
+		memcpy(frame->data[0] + y * frame->linesize[0], luma + y * video_width, video_width);
+
+	// Software encoders do not take NV12, split the chroma planes
+	auto chroma = in[slot].chroma.data<uint8_t>();
+	for (uint32_t y = 0; y < video_height / 2; ++y)
+	{
+		const uint8_t * uv = chroma + y * video_width;
+		uint8_t * u = frame->data[1] + y * frame->linesize[1];
+		uint8_t * v = frame->data[2] + y * frame->linesize[2];
+		for (uint32_t x = 0; x < video_width / 2; ++x)
+		{
+			u[x] = uv[2 * x];
+			v[x] = uv[2 * x + 1];
+		}
+	}
+
+	frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+	frame->pts = pts.time_since_epoch().count();
+	err = avcodec_send_frame(encoder_ctx.get(), frame.get());
+	if (err)
+	{
+		throw std::system_error(err, av_error_category(), "avcodec_send_frame failed");
+	}
+}
+} // namespace wivrn
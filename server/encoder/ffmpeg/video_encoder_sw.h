@@ -0,0 +1,60 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ffmpeg_helper.h"
+#include "video_encoder_ffmpeg.h"
+#include "vk/allocation.h"
+
+#include <array>
+#include <chrono>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace wivrn
+{
+struct encoder_settings;
+struct wivrn_vk_bundle;
+
+// Software encoding through ffmpeg: libx264, libx265 or libsvtav1
+class video_encoder_sw : public VideoEncoderFFMPEG
+{
+	struct in_t
+	{
+		buffer_allocation luma;
+		buffer_allocation chroma;
+	};
+	std::array<in_t, num_slots> in;
+	av_frame_ptr frame;
+	vk::Rect2D rect;
+	uint32_t video_width;
+	uint32_t video_height;
+	// Period of the intra refresh, 0 if disabled
+	int refresh_period = 0;
+
+public:
+	video_encoder_sw(wivrn_vk_bundle &, wivrn::encoder_settings & settings, float fps);
+
+	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) override;
+
+protected:
+	void push_frame(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot) override;
+	int intra_refresh() override;
+};
+} // namespace wivrn
@@ -32,6 +32,9 @@
 #if WIVRN_USE_NVENC
 #include "video_encoder_nvenc.h"
 #endif
+#if WIVRN_USE_FFMPEG
+#include "ffmpeg/video_encoder_sw.h"
+#endif
 #if WIVRN_USE_VAAPI
 #include "ffmpeg/video_encoder_va.h"
 #endif
@@ -128,11 +131,26 @@ std::unique_ptr<VideoEncoder> VideoEncoder::Create(
 		res = std::make_unique<video_encoder_va>(wivrn_vk, settings, fps);
 #else
 		throw std::runtime_error("vaapi support not enabled");
+#endif
+	}
+	if (settings.encoder_name == encoder_ffmpeg)
+	{
+#if WIVRN_USE_FFMPEG
+		res = std::make_unique<video_encoder_sw>(wivrn_vk, settings, fps);
+#else
+		throw std::runtime_error("ffmpeg support not enabled");
 #endif
 	}
 	if (not res)
 		throw std::runtime_error("Failed to create encoder " + settings.encoder_name);
 	res->stream_idx = stream_idx;
+	res->codec = settings.codec;
+	res->frame_budget = settings.bitrate / fps / 8;
+	// Acknowledgements are only used to invalidate references
+	settings.ack_frames = res->max_reference_age() > 0;
+
+	if (auto induced_loss = std::getenv("WIVRN_INDUCED_LOSS"))
+		res->induced_loss = std::stoul(induced_loss);
 
 	auto wivrn_dump_video = std::getenv("WIVRN_DUMP_VIDEO");
 	if (wivrn_dump_video)
@@ -174,6 +192,42 @@ void VideoEncoder::SyncNeeded()
 	sync_needed = true;
 }
 
+void VideoEncoder::IdrNeeded()
+{
+	idr_needed = true;
+}
+
+void VideoEncoder::on_ack(const from_headset::video_ack & ack)
+{
+	uint64_t good = last_good_frame;
+	while ((good == uint64_t(-1) or ack.frame_index > good) and
+	       not last_good_frame.compare_exchange_weak(good, ack.frame_index))
+	{
+	}
+}
+
+void VideoEncoder::on_feedback(const from_headset::feedback & feedback)
+{
+	if (not feedback.sent_to_decoder)
+	{
+		// Frames encoded before the last refresh are already repaired
+		if (feedback.frame_index >= refresh_start)
+			SyncNeeded();
+		int64_t expected = 0;
+		loss_time.compare_exchange_strong(expected, os_monotonic_get_ns());
+	}
+	else if (feedback.recovered and feedback.frame_index >= recovery_frame)
+	{
+		if (int64_t t = loss_time.exchange(0))
+		{
+			int64_t now = os_monotonic_get_ns();
+			U_LOG_I("Stream %d recovered in %.1fms, peak frame size %zu bytes", stream_idx, (now - t) / 1e6, peak_frame_size.exchange(0));
+			if (cnx)
+				cnx->dump_time("recovered", feedback.frame_index, now, stream_idx);
+		}
+	}
+}
+
 void VideoEncoder::PresentImage(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf)
 {
 	// Wait for encoder to be done
@@ -184,6 +238,14 @@ void VideoEncoder::PresentImage(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_
 	next_present = (next_present + 1) % num_slots;
 }
 
+size_t VideoEncoder::QueuedFrames() const
+{
+	size_t count = 0;
+	for (const auto & slot: busy)
+		count += slot.load();
+	return count;
+}
+
 void VideoEncoder::Encode(wivrn_session & cnx,
                           const to_headset::video_stream_data_shard::view_info_t & view_info,
                           uint64_t frame_index)
@@ -192,18 +254,66 @@ void VideoEncoder::Encode(wivrn_session & cnx,
 	if (shared_sender)
 		shared_sender->wait_idle(this);
 	this->cnx = &cnx;
+
+	// Previous frame is fully sent
+	size_t size = frame_size.exchange(0);
+	if (size)
+	{
+		std::optional<float> qp;
+		if (frame_qp)
+			qp = *frame_qp / (codec == av1 ? 255 : 51);
+		cnx.on_encoded_frame({
+		        .size = size,
+		        .budget = frame_budget,
+		        .qp = qp,
+		        .idr = frame_idr,
+		});
+	}
+	if (loss_time)
+		peak_frame_size = std::max<size_t>(peak_frame_size, size);
+	frame_qp.reset();
+
 	auto target_timestamp = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(view_info.display_time));
-	bool idr = sync_needed.exchange(false);
+	bool idr = idr_needed.exchange(false);
+	bool refresh = false;
+	bool invalidate = false;
+	if (sync_needed.exchange(false) and not idr)
+	{
+		// Predicting from a frame the headset has is cheaper than any refresh
+		if (try_invalidate_references(frame_index))
+		{
+			U_LOG_D("Reference invalidation: stream %d frame %ld, last good frame %ld", stream_idx, frame_index, last_good_frame.load());
+			refresh_start = frame_index;
+			recovery_frame = frame_index;
+			invalidate = true;
+		}
+		// Intra refresh avoids the burst of an IDR
+		else if (int frames = intra_refresh(); frames > 0)
+		{
+			U_LOG_D("Intra refresh: stream %d frame %ld, %d frames", stream_idx, frame_index, frames);
+			refresh_start = frame_index;
+			recovery_frame = frame_index + frames - 1;
+			refresh = true;
+		}
+		else
+			idr = true;
+	}
 	// Throttle idr to prevent overloading the decoder
 	if (idr and frame_index < last_idr_frame + idr_throttle)
 	{
 		U_LOG_D("Throttle IDR: stream %d frame %ld", stream_idx, frame_index);
-		sync_needed = true;
+		idr_needed = true;
 		idr = false;
 	}
 	if (idr)
+	{
 		last_idr_frame = frame_index;
-	const char * extra = idr ? ",idr" : ",p";
+		refresh_start = frame_index;
+		recovery_frame = frame_index;
+	}
+	frame_idr = idr;
+	frame_recovery_point = frame_index == recovery_frame;
+	const char * extra = idr ? ",idr" : refresh ? ",refresh" : invalidate ? ",invalidate" : ",p";
 	clock = cnx.get_offset();
 
 	timing_info = {
@@ -218,6 +328,12 @@ void VideoEncoder::Encode(wivrn_session & cnx,
 	shard.view_info = view_info;
 	shard.timing_info.reset();
 
+	if (idr)
+		encoded_frames.clear();
+	encoded_frames.emplace_back(frame_index, target_timestamp);
+	if (encoded_frames.size() > size_t(max_reference_age()) + 1)
+		encoded_frames.pop_front();
+
 	std::exception_ptr ex;
 	try
 	{
@@ -241,6 +357,27 @@ void VideoEncoder::Encode(wivrn_session & cnx,
 		std::rethrow_exception(ex);
 }
 
+bool VideoEncoder::try_invalidate_references(uint64_t frame_index)
+{
+	uint64_t good = last_good_frame;
+	int age = max_reference_age();
+	// The headset never decoded a frame, or it is no longer a reference
+	if (age == 0 or good == uint64_t(-1) or good >= frame_index or frame_index - good > uint64_t(age))
+		return false;
+
+	if (std::ranges::none_of(encoded_frames, [&](auto & f) { return f.first == good; }))
+		return false;
+
+	std::vector<std::chrono::steady_clock::time_point> invalid;
+	for (const auto & [index, pts]: encoded_frames)
+	{
+		if (index > good)
+			invalid.push_back(pts);
+	}
+	invalidate_references(invalid);
+	return true;
+}
+
 void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 {
 	std::lock_guard lock(mutex);
@@ -252,6 +389,7 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 	}
 	if (video_dump)
 		video_dump.write((char *)data.data(), data.size());
+	frame_size += data.size();
 	if (shard.shard_idx == 0)
 	{
 		cnx->dump_time("send_begin", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
@@ -259,13 +397,23 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 	}
 
 	shard.flags = to_headset::video_stream_data_shard::start_of_slice;
+	if (shard.shard_idx == 0 and frame_recovery_point)
+		shard.flags |= to_headset::video_stream_data_shard::recovery_point;
+	bool drop = induced_loss > 1 and shard.frame_idx % induced_loss == induced_loss - 1;
+	// TCP handles fragmentation, send whole slices
+	const bool tcp_only = cnx->is_tcp_only();
+	// Shards of a slice are sent in a single batch
+	const bool begin_of_frame = shard.shard_idx == 0;
+	const uint16_t first_shard_idx = shard.shard_idx;
+	thread_local std::vector<serialization_packet> packets;
+	size_t num_packets = 0;
 	auto begin = data.begin();
 	auto end = data.end();
 	while (begin != end)
 	{
 		const size_t view_info_size = sizeof(to_headset::video_stream_data_shard::view_info_t);
 		const size_t max_payload_size = to_headset::video_stream_data_shard::max_payload_size - (shard.view_info ? view_info_size : 0);
-		auto next = std::min(end, begin + max_payload_size);
+		auto next = tcp_only ? end : std::min(end, begin + max_payload_size);
 		if (next == end)
 		{
 			shard.flags |= to_headset::video_stream_data_shard::end_of_slice;
@@ -276,19 +424,25 @@ void VideoEncoder::SendData(std::span<uint8_t> data, bool end_of_frame)
 			}
 		}
 		shard.payload = {begin, next};
-		try
-		{
-			cnx->send_stream(shard);
-		}
-		catch (...)
-		{
-			// Ignore network errors
-		}
+		if (packets.size() == num_packets)
+			packets.emplace_back();
+		wivrn_connection::serialize(packets[num_packets++], shard);
 		++shard.shard_idx;
 		shard.flags = 0;
 		shard.view_info.reset();
 		begin = next;
 	}
+	// Dropped packets are still given to the scheduler, so that they can be retransmitted
+	cnx->send_video(
+	        std::span(packets.data(), num_packets),
+	        {
+	                .frame_idx = shard.frame_idx,
+	                .stream_idx = stream_idx,
+	                .first_shard_idx = first_shard_idx,
+	                .begin_of_frame = begin_of_frame,
+	                .end_of_frame = end_of_frame,
+	                .drop = drop,
+	        });
 	if (end_of_frame)
 		cnx->dump_time("send_end", shard.frame_idx, os_monotonic_get_ns(), stream_idx);
 }
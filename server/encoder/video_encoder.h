@@ -29,6 +29,7 @@
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vulkan/vulkan_raii.hpp>
 
@@ -42,6 +43,17 @@ class wivrn_session;
 inline const char * encoder_nvenc = "nvenc";
 inline const char * encoder_vaapi = "vaapi";
 inline const char * encoder_x264 = "x264";
+inline const char * encoder_ffmpeg = "ffmpeg";
+
+struct encoded_frame_stats
+{
+	size_t size;
+	// Bytes per frame allowed by the bitrate
+	size_t budget;
+	// Average quantization parameter, normalized to [0, 1]
+	std::optional<float> qp;
+	bool idr;
+};
 
 class VideoEncoder
 {
@@ -71,8 +83,12 @@ private:
 
 protected:
 	uint8_t stream_idx;
+	video_codec codec;
 	static const uint8_t num_slots = 2;
 
+	// Average quantization parameter of the last encoded frame, for encoders that report it
+	std::optional<float> frame_qp;
+
 private:
 	std::mutex mutex;
 	std::array<std::atomic<bool>, num_slots> busy = {false, false};
@@ -80,7 +96,7 @@ private:
 	uint8_t next_encode = 0;
 
 	// temporary data
-	wivrn_session * cnx;
+	wivrn_session * cnx = nullptr;
 
 	// shard to send
 	to_headset::video_stream_data_shard shard;
@@ -88,9 +104,30 @@ private:
 	to_headset::video_stream_data_shard::timing_info_t timing_info;
 	clock_offset clock;
 
-	std::atomic_bool sync_needed = true;
+	std::atomic_bool idr_needed = true;
+	std::atomic_bool sync_needed = false;
 	uint64_t last_idr_frame;
 
+	// Recovery from losses: first frame of the last refresh, and frame at which the picture is fully refreshed
+	std::atomic<uint64_t> refresh_start = 0;
+	std::atomic<uint64_t> recovery_frame = 0;
+	bool frame_recovery_point = false;
+	// Last frame decoded by the headset from valid references, -1 if none
+	std::atomic<uint64_t> last_good_frame = -1;
+	// Frame index and timestamp of the last encoded frames, to invalidate references
+	std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> encoded_frames;
+	// Time the first loss was reported, 0 if not recovering
+	std::atomic<int64_t> loss_time = 0;
+	std::atomic<size_t> peak_frame_size = 0;
+	// Drop one frame every induced_loss frames, for testing
+	uint64_t induced_loss = 0;
+
+	// Statistics of the last encoded frame
+	size_t frame_budget; // bytes per frame for the target bitrate
+	// Written by the encoder threads while the frame is being sent
+	std::atomic<size_t> frame_size = 0;
+	bool frame_idr = false;
+
 	std::ofstream video_dump;
 
 	std::shared_ptr<sender> shared_sender;
@@ -108,9 +145,16 @@ public:
 	virtual ~VideoEncoder();
 
 	void PresentImage(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf);
+	// Frames presented and not encoded yet
+	size_t QueuedFrames() const;
 
-	// The other end lost a frame and needs to resynchronize
+	// The other end lost a frame and needs to resynchronize,
+	// with intra refresh if supported by the encoder
 	void SyncNeeded();
+	// The other end needs an IDR to start decoding
+	void IdrNeeded();
+	void on_feedback(const from_headset::feedback &);
+	void on_ack(const from_headset::video_ack &);
 
 	void Encode(wivrn_session & cnx,
 	            const to_headset::video_stream_data_shard::view_info_t & view_info,
@@ -121,8 +165,27 @@ protected:
 	virtual void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) = 0;
 	// called when command buffer finished executing
 	virtual std::optional<data> encode(bool idr, std::chrono::steady_clock::time_point target_timestamp, uint8_t slot) = 0;
+	// called before encode to start an intra refresh cycle on the next frame, returns the number
+	// of frames (including the next one) until the picture is fully refreshed,
+	// 0 if not supported: an IDR is used instead
+	virtual int intra_refresh()
+	{
+		return 0;
+	}
+	// number of past frames the encoder can predict from if references can be invalidated,
+	// 0 if not supported
+	virtual int max_reference_age()
+	{
+		return 0;
+	}
+	// called before encode after a loss, frames with these timestamps must not be used as references:
+	// the next frame is predicted from an older frame the headset decoded
+	virtual void invalidate_references(std::span<const std::chrono::steady_clock::time_point>) {}
 
 	void SendData(std::span<uint8_t> data, bool end_of_frame);
+
+private:
+	bool try_invalidate_references(uint64_t frame_index);
 };
 
 } // namespace wivrn
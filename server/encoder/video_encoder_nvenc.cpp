@@ -24,6 +24,7 @@
 #include "util/u_logging.h"
 #include "utils/wivrn_vk_bundle.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 #define NVENC_CHECK_NOENCODER(x)                                          \
@@ -134,6 +135,10 @@ static auto encode_guid(video_codec codec)
 	throw std::out_of_range("Invalid codec " + std::to_string(codec));
 }
 
+// Frames kept in the DPB for reference invalidation, at 90 fps the headset
+// reports a loss within a few frames
+static const uint32_t num_reference_frames = 4;
+
 VideoEncoderNvenc::VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & settings, float fps) :
         VideoEncoder(true),
         vk(vk),
@@ -207,19 +212,63 @@ VideoEncoderNvenc::VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & se
 	params.gopLength = NVENC_INFINITE_GOPLENGTH;
 	params.frameIntervalP = 1;
 
+	// Slow periodic intra refresh, and a faster one is forced after a loss
+	const uint32_t refresh_period = std::max<uint32_t>(fps, 2);
+	if (settings.codec != video_codec::av1)
+	{
+		NV_ENC_CAPS_PARAM cap_param{
+		        .version = NV_ENC_CAPS_PARAM_VER,
+		        .capsToQuery = NV_ENC_CAPS_SUPPORT_INTRA_REFRESH,
+		};
+		int supported = 0;
+		NVENC_CHECK(fn.nvEncGetEncodeCaps(session_handle, encodeGUID, &cap_param, &supported));
+		if (supported)
+			refresh_frames = std::max<uint32_t>(fps / 10, 1);
+		else
+			U_LOG_W("nvenc: intra refresh is not supported, IDR frames will be used after a loss");
+	}
+	const bool enable_refresh = refresh_frames > 0;
+
+	// Keep older frames in the DPB to predict from them after a loss
+	if (settings.reference_invalidation)
+	{
+		NV_ENC_CAPS_PARAM cap_param{
+		        .version = NV_ENC_CAPS_PARAM_VER,
+		        .capsToQuery = NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION,
+		};
+		int supported = 0;
+		NVENC_CHECK(fn.nvEncGetEncodeCaps(session_handle, encodeGUID, &cap_param, &supported));
+		if (supported)
+			reference_frames = num_reference_frames;
+		else
+			U_LOG_W("nvenc: reference invalidation is not supported");
+	}
+
 	switch (settings.codec)
 	{
 		case video_codec::h264:
 			params.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
-			params.encodeCodecConfig.h264Config.maxNumRefFrames = 0;
+			params.encodeCodecConfig.h264Config.maxNumRefFrames = reference_frames;
 			params.encodeCodecConfig.h264Config.idrPeriod = NVENC_INFINITE_GOPLENGTH;
 			params.encodeCodecConfig.h264Config.h264VUIParameters.videoFullRangeFlag = 1;
+			if (enable_refresh)
+			{
+				params.encodeCodecConfig.h264Config.enableIntraRefresh = 1;
+				params.encodeCodecConfig.h264Config.intraRefreshPeriod = refresh_period;
+				params.encodeCodecConfig.h264Config.intraRefreshCnt = refresh_period / 2;
+			}
 			break;
 		case video_codec::h265:
 			params.encodeCodecConfig.hevcConfig.repeatSPSPPS = 1;
-			params.encodeCodecConfig.hevcConfig.maxNumRefFramesInDPB = 0;
+			params.encodeCodecConfig.hevcConfig.maxNumRefFramesInDPB = reference_frames;
 			params.encodeCodecConfig.hevcConfig.idrPeriod = NVENC_INFINITE_GOPLENGTH;
 			params.encodeCodecConfig.hevcConfig.hevcVUIParameters.videoFullRangeFlag = 1;
+			if (enable_refresh)
+			{
+				params.encodeCodecConfig.hevcConfig.enableIntraRefresh = 1;
+				params.encodeCodecConfig.hevcConfig.intraRefreshPeriod = refresh_period;
+				params.encodeCodecConfig.hevcConfig.intraRefreshCnt = refresh_period / 2;
+			}
 			break;
 		case video_codec::av1:
 			break;
@@ -387,12 +436,27 @@ std::optional<VideoEncoder::data> VideoEncoderNvenc::encode(bool idr, std::chron
 	        .inputPitch = width,
 	        .encodePicFlags = uint32_t(idr ? NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS : 0),
 	        .frameIdx = 0,
-	        .inputTimeStamp = 0,
+	        .inputTimeStamp = uint64_t(pts.time_since_epoch().count()),
 	        .inputBuffer = param4.mappedResource,
 	        .outputBitstream = bitstreamBuffer,
 	        .bufferFmt = param4.mappedBufferFmt,
 	        .pictureStruct = NV_ENC_PIC_STRUCT_FRAME,
 	};
+	if (refresh_pending and not idr)
+	{
+		switch (codec)
+		{
+			case video_codec::h264:
+				param.codecPicParams.h264PicParams.forceIntraRefreshWithFrameCnt = refresh_frames;
+				break;
+			case video_codec::h265:
+				param.codecPicParams.hevcPicParams.forceIntraRefreshWithFrameCnt = refresh_frames;
+				break;
+			case video_codec::av1:
+				break;
+		}
+	}
+	refresh_pending = false;
 	NVENC_CHECK(fn.nvEncEncodePicture(session_handle, &param));
 
 	NV_ENC_LOCK_BITSTREAM param2{
@@ -401,6 +465,7 @@ std::optional<VideoEncoder::data> VideoEncoderNvenc::encode(bool idr, std::chron
 	        .outputBitstream = bitstreamBuffer,
 	};
 	NVENC_CHECK(fn.nvEncLockBitstream(session_handle, &param2));
+	frame_qp = param2.frameAvgQP;
 
 	CU_CHECK(cuda_fn->cuCtxPopCurrent(NULL));
 	return data{
@@ -414,6 +479,26 @@ std::optional<VideoEncoder::data> VideoEncoderNvenc::encode(bool idr, std::chron
 	};
 }
 
+int VideoEncoderNvenc::intra_refresh()
+{
+	// No intra refresh for AV1, or not supported by the GPU
+	if (refresh_frames == 0)
+		return 0;
+	refresh_pending = true;
+	return refresh_frames;
+}
+
+int VideoEncoderNvenc::max_reference_age()
+{
+	return reference_frames;
+}
+
+void VideoEncoderNvenc::invalidate_references(std::span<const std::chrono::steady_clock::time_point> frames)
+{
+	for (auto pts: frames)
+		NVENC_CHECK(fn.nvEncInvalidateRefFrames(session_handle, pts.time_since_epoch().count()));
+}
+
 std::array<int, 2> VideoEncoderNvenc::get_max_size(video_codec codec)
 {
 	auto [cuda_fn, nvenc_fn, fn, cuda, session_handle] = init();
@@ -63,12 +63,21 @@ private:
 	float fps;
 	int bitrate;
 
+	// Number of frames for a refresh requested after a loss, 0 if intra refresh is not supported
+	uint32_t refresh_frames = 0;
+	bool refresh_pending = false;
+	// Number of reference frames kept for invalidation, 0 if not supported
+	uint32_t reference_frames = 0;
+
 public:
 	VideoEncoderNvenc(wivrn_vk_bundle & vk, encoder_settings & settings, float fps);
 	~VideoEncoderNvenc();
 
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) override;
 	std::optional<data> encode(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot) override;
+	int intra_refresh() override;
+	int max_reference_age() override;
+	void invalidate_references(std::span<const std::chrono::steady_clock::time_point> frames) override;
 
 	static std::array<int, 2> get_max_size(video_codec);
 };
@@ -23,11 +23,15 @@
 #include "util/u_logging.h"
 #include "utils/wivrn_vk_bundle.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace wivrn
 {
 
+// Frames kept as references for invalidation
+static const int num_reference_frames = 4;
+
 void VideoEncoderX264::ProcessCb(x264_t * h, x264_nal_t * nal, void * opaque)
 {
 	VideoEncoderX264 * self = (VideoEncoderX264 *)opaque;
@@ -126,7 +130,20 @@ VideoEncoderX264::VideoEncoderX264(
 	param.i_fps_den = 1'000'000;
 	param.b_repeat_headers = 1;
 	param.b_aud = 0;
-	param.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+	if (settings.reference_invalidation)
+	{
+		// x264 does not support invalidation with intra refresh: keep older
+		// frames as references and predict from them after a loss
+		param.i_frame_reference = num_reference_frames;
+		param.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+	}
+	else
+	{
+		// Periodic intra refresh instead of keyframes, a refresh wave sweeps
+		// the picture every keyint frames
+		param.b_intra_refresh = 1;
+		param.i_keyint_max = std::max<int>(fps / 2, 1);
+	}
 
 	// colour definitions, actually ignored by decoder
 	param.vui.b_fullrange = 1;
@@ -243,9 +260,34 @@ std::optional<VideoEncoder::data> VideoEncoderX264::encode(bool idr, std::chrono
 	{
 		U_LOG_W("x264_encoder_encode failed: %d", size);
 	}
+	else
+	{
+		frame_qp = pic_out.i_qpplus1 - 1;
+	}
 	return {};
 }
 
+int VideoEncoderX264::intra_refresh()
+{
+	if (not param.b_intra_refresh)
+		return 0;
+	// Start a new refresh wave on the next frame
+	x264_encoder_intra_refresh(enc);
+	return param.i_keyint_max;
+}
+
+int VideoEncoderX264::max_reference_age()
+{
+	return param.b_intra_refresh ? 0 : param.i_frame_reference;
+}
+
+void VideoEncoderX264::invalidate_references(std::span<const std::chrono::steady_clock::time_point> frames)
+{
+	// All frames from this timestamp are invalidated
+	if (not frames.empty() and x264_encoder_invalidate_reference(enc, frames.front().time_since_epoch().count()) < 0)
+		U_LOG_W("x264_encoder_invalidate_reference failed");
+}
+
 VideoEncoderX264::~VideoEncoderX264()
 {
 	x264_encoder_close(enc);
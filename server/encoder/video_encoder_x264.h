@@ -66,6 +66,9 @@ public:
 	void present_image(vk::Image y_cbcr, vk::raii::CommandBuffer & cmd_buf, uint8_t slot) override;
 
 	std::optional<data> encode(bool idr, std::chrono::steady_clock::time_point pts, uint8_t slot) override;
+	int intra_refresh() override;
+	int max_reference_age() override;
+	void invalidate_references(std::span<const std::chrono::steady_clock::time_point> frames) override;
 
 	~VideoEncoderX264();
 
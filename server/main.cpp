@@ -192,6 +192,7 @@ bool do_fork;
 guint listener_watch;
 
 WivrnServer * dbus_server;
+WivrnTelemetry * dbus_telemetry;
 
 /* TODO: Document FSM
  */
@@ -201,6 +202,8 @@ std::optional<avahi_publisher> publisher;
 gboolean headset_connected(gint fd, GIOCondition condition, gpointer user_data);
 void stop_listening();
 void on_headset_info_packet(const wivrn::from_headset::headset_info_packet & info);
+void on_telemetry(const from_monado::telemetry &);
+void clear_telemetry();
 
 void start_publishing();
 void stop_publishing();
@@ -404,6 +407,7 @@ void update_fsm()
 			start_listening();
 			start_publishing();
 			wivrn_server_set_headset_connected(dbus_server, false);
+			clear_telemetry();
 		}
 	}
 }
@@ -456,6 +460,11 @@ gboolean control_received(gint fd, GIOCondition condition, gpointer user_data)
 		{
 			start_publishing();
 			wivrn_server_set_headset_connected(dbus_server, false);
+			clear_telemetry();
+		}
+		else if (std::holds_alternative<from_monado::telemetry>(*packet))
+		{
+			on_telemetry(std::get<from_monado::telemetry>(*packet));
 		}
 	}
 
@@ -555,6 +564,43 @@ void on_headset_info_packet(const wivrn::from_headset::headset_info_packet & inf
 	wivrn_server_set_supported_codecs(dbus_server, codecs.data());
 }
 
+void on_telemetry(const from_monado::telemetry & t)
+{
+	GVariantBuilder * builder = g_variant_builder_new(G_VARIANT_TYPE("a{sd}"));
+
+	auto add_stage = [&](const char * name, const from_monado::telemetry::stage & stage) {
+		g_variant_builder_add(builder, "{sd}", name, stage.mean);
+		g_variant_builder_add(builder, "{sd}", (std::string(name) + "Max").c_str(), stage.max);
+	};
+	add_stage("EncodeTime", t.encode);
+	add_stage("NetworkTime", t.network);
+	add_stage("DecodeTime", t.decode);
+	add_stage("DisplayTime", t.display);
+	add_stage("Latency", t.latency);
+	add_stage("VideoQueueTime", t.video_queue);
+	add_stage("HeadsetQueueTime", t.queue);
+
+	g_variant_builder_add(builder, "{sd}", "FrameRate", t.frame_rate);
+	g_variant_builder_add(builder, "{sd}", "Bitrate", t.bitrate);
+	g_variant_builder_add(builder, "{sd}", "FrameLoss", t.loss);
+	g_variant_builder_add(builder, "{sd}", "Retransmissions", t.retransmitted);
+	g_variant_builder_add(builder, "{sd}", "EncoderQueue", t.encoder_queue);
+	g_variant_builder_add(builder, "{sd}", "EncoderQueueMax", double(t.encoder_queue_max));
+	g_variant_builder_add(builder, "{sd}", "PacerWakeUpToPresent", t.wake_up_to_present);
+	g_variant_builder_add(builder, "{sd}", "PacerPresentToDecoded", t.present_to_decoded);
+	g_variant_builder_add(builder, "{sd}", "PacerRenderToDisplay", t.render_to_display);
+
+	GVariant * value = g_variant_new("a{sd}", builder);
+	g_variant_builder_unref(builder);
+	wivrn_telemetry_set_statistics(dbus_telemetry, value);
+}
+
+void clear_telemetry()
+{
+	if (dbus_telemetry)
+		wivrn_telemetry_set_statistics(dbus_telemetry, g_variant_new("a{sd}", nullptr));
+}
+
 void on_name_acquired(GDBusConnection * connection, const gchar * name, gpointer user_data)
 {
 	dbus_server = wivrn_server_skeleton_new();
@@ -584,6 +630,13 @@ void on_name_acquired(GDBusConnection * connection, const gchar * name, gpointer
 	                                 connection,
 	                                 "/io/github/wivrn/Server",
 	                                 NULL);
+
+	dbus_telemetry = wivrn_telemetry_skeleton_new();
+	clear_telemetry();
+	g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON(dbus_telemetry),
+	                                 connection,
+	                                 "/io/github/wivrn/Server",
+	                                 NULL);
 }
 
 } // namespace
@@ -0,0 +1,78 @@
+/*
+ * WiVRn VR streaming
+ * Copyright (C) 2024  Guillaume Meunier <guillaume.meunier@centraliens.net>
+ * Copyright (C) 2024  Patrick Nicolas <patricknicolas@laposte.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// Downsamples the depth layer of one eye to a grid of inverse distances (1/m),
+// keeping the nearest sample of each cell so that foreground objects are not
+// eroded by the reprojection.
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D depth;
+layout(set = 0, binding = 1) writeonly buffer Output
+{
+	float inverse_distance[];
+};
+
+layout(push_constant) uniform PushConstants
+{
+	// Rectangle of the eye in the depth image, in uv
+	vec2 offset;
+	vec2 extent;
+	// From XrCompositionLayerDepthInfoKHR, infinite distances have an inverse of 0
+	float min_depth;
+	float max_depth;
+	float inverse_near;
+	float inverse_far;
+	// Size of the grid
+	uint width;
+	uint height;
+	// Index of the first cell of the eye in the output
+	uint first;
+}
+pc;
+
+// Samples in each cell
+const int nb_samples = 4;
+
+void main()
+{
+	uvec2 cell = gl_GlobalInvocationID.xy;
+	if (cell.x >= pc.width || cell.y >= pc.height)
+		return;
+
+	vec2 cell_size = pc.extent / vec2(pc.width, pc.height);
+	vec2 origin = pc.offset + vec2(cell) * cell_size + cell_size / (2 * nb_samples);
+
+	float nearest = 0;
+	for (int j = 0; j < nb_samples; j++)
+	{
+		for (int i = 0; i < nb_samples; i++)
+		{
+			float d = textureLod(depth, origin + vec2(i, j) * cell_size / nb_samples, 0).r;
+			float t = clamp((d - pc.min_depth) / (pc.max_depth - pc.min_depth), 0, 1);
+			// Perspective depth is linear in the inverse distance
+			nearest = max(nearest, mix(pc.inverse_near, pc.inverse_far, t));
+		}
+	}
+
+	inverse_distance[pc.first + cell.y * pc.width + cell.x] = nearest;
+}
@@ -36,7 +36,45 @@ struct headsdet_connected
 struct headsdet_disconnected
 {};
 
-using packets = std::variant<wivrn::from_headset::headset_info_packet, headsdet_connected, headsdet_disconnected>;
+// Statistics of the streaming session over the last period, for the dashboard
+struct telemetry
+{
+	struct stage
+	{
+		// In seconds, NaN if there was no sample
+		float mean;
+		float max;
+	};
+
+	float period;
+
+	// Video pipeline, for the frames displayed during the period
+	stage encode;  // encoder
+	stage network; // server send to headset reception
+	stage decode;  // headset decoder
+	stage display; // decoded to displayed
+	stage queue;   // time in the headset queue of decoded frames, including discarded frames
+	stage latency; // encoder start to display
+
+	// Queueing delay of video packets in the transmit scheduler
+	stage video_queue;
+
+	float frame_rate;    // frames displayed per second, first stream
+	float bitrate;       // encoded video, bit/s
+	float loss;          // fraction of the frames lost
+	float retransmitted; // video shards resent per second
+
+	// Frames waiting in the encoders when a new one is presented
+	float encoder_queue;
+	uint32_t encoder_queue_max;
+
+	// Frame pacer estimations, in seconds
+	float wake_up_to_present;
+	float present_to_decoded;
+	float render_to_display;
+};
+
+using packets = std::variant<wivrn::from_headset::headset_info_packet, headsdet_connected, headsdet_disconnected, telemetry>;
 } // namespace from_monado
 
 namespace to_monado
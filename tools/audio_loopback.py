@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+
+# Measures the end to end audio latency through the headset
+#
+# Beeps are played to the WiVRn sink and recorded from the WiVRn microphone:
+# the headset microphone must hear its speakers, for instance with the volume
+# up and the headset lying on a table. Requires pacat and parec (pulseaudio
+# or pipewire-pulse).
+#
+#   audio_loopback.py
+#
+# The time to start the processes and the buffering of the tools themselves
+# are measured by recording the monitor of the sink first and subtracted. The
+# result is the round trip: server to headset speaker, through the air, then
+# headset microphone to server.
+
+import argparse
+import array
+import statistics
+import subprocess
+import threading
+import time
+
+RATE = 48000
+BEEP = 0.01
+FREQUENCY = 1000
+
+
+def signal(count, period):
+    "Beeps of BEEP seconds every period seconds, 16 bits mono"
+    samples = array.array("h", bytes(2 * int(RATE * period * count)))
+    length = int(RATE * BEEP)
+    for i in range(count):
+        start = int(RATE * (period * i + period / 2))
+        for j in range(length):
+            phase = 2 * 3.141592653589793 * FREQUENCY * j / RATE
+            samples[start + j] = int(16000 * (1 if (phase % 6.283185307179586) < 3.141592653589793 else -1))
+    return samples
+
+
+def onsets(samples, threshold, period):
+    "First sample above threshold, then skip half a period"
+    result = []
+    i = 0
+    skip = int(RATE * period / 2)
+    while i < len(samples):
+        if abs(samples[i]) > threshold:
+            result.append(i / RATE)
+            i += skip
+        else:
+            i += 1
+    return result
+
+
+def measure(sink, source, count, period, threshold):
+    "Median delay between the beeps and their recording, including process start"
+    fmt = ["--raw", "--format=s16le", f"--rate={RATE}", "--channels=1", "--latency-msec=5"]
+    recorder = subprocess.Popen(["parec", "-d", source] + fmt, stdout=subprocess.PIPE)
+    record_start = time.monotonic()
+
+    # Read while recording, the pipe only holds 64KiB
+    chunks = []
+    reader = threading.Thread(target=lambda: chunks.extend(iter(lambda: recorder.stdout.read1(65536), b"")))
+    reader.start()
+    time.sleep(0.5)
+
+    player = subprocess.Popen(["pacat", "-d", sink] + fmt, stdin=subprocess.PIPE)
+    play_start = time.monotonic()
+    player.stdin.write(signal(count, period).tobytes())
+    player.stdin.close()
+    player.wait()
+    time.sleep(1)
+
+    recorder.terminate()
+    recorder.wait()
+    reader.join()
+    data = b"".join(chunks)
+    recorded = array.array("h", data[: len(data) // 2 * 2])
+
+    delays = []
+    for t in onsets(recorded, threshold, period):
+        t += record_start - play_start
+        i = round((t - period / 2) / period)
+        if 0 <= i < count:
+            delays.append(t - period * i - period / 2)
+    return delays
+
+
+def summary(name, delays, count):
+    if not delays:
+        print(f"{name:>10}: no beep detected")
+        return None
+    print(
+        f"{name:>10}: {len(delays)}/{count} beeps, median {statistics.median(delays) * 1000:7.1f}ms, "
+        f"min {min(delays) * 1000:7.1f}ms, max {max(delays) * 1000:7.1f}ms"
+    )
+    return statistics.median(delays)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Measure the audio round trip latency through the headset")
+    parser.add_argument("--sink", default="WiVRn", help="sink playing on the headset")
+    parser.add_argument("--source", default="WiVRn-mic", help="source recording the headset microphone")
+    parser.add_argument("--count", type=int, default=10, help="number of beeps")
+    parser.add_argument("--period", type=float, default=1, help="time between beeps in seconds")
+    parser.add_argument("--threshold", type=int, default=2000, help="detection threshold of the recording")
+    args = parser.parse_args()
+
+    local = summary("monitor", measure(args.sink, args.sink + ".monitor", args.count, args.period, args.threshold), args.count)
+    headset = summary("headset", measure(args.sink, args.source, args.count, args.period, args.threshold), args.count)
+    if local is not None and headset is not None:
+        print(f"Round trip latency: {(headset - local) * 1000:.1f}ms")
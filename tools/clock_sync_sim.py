@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+
+# Simulates the clock synchronization between server and headset
+#
+# Timesync queries are sent through a link with asymmetric jitter and the
+# headset clock drifts from the server clock. The estimator used in
+# clock_offset.cpp is compared to the previous one (mean offset over the last
+# 100 samples) on the error of the headset time computed from server time.
+#   clock_sync_sim.py --drift 50 --jitter-up 5 --jitter-down 0.5
+
+import argparse
+import math
+import random
+
+
+class MeanEstimator:
+    "Mean of the offsets of the last 100 samples, symmetric latency"
+
+    def __init__(self):
+        self.samples = []
+        self.index = 0
+        self.b = 0
+        self.stable = False
+        self.interval = 10_000_000
+
+    def add_sample(self, query, response, received):
+        sample = (query, response, received)
+        if len(self.samples) < 100:
+            self.samples.append(sample)
+        else:
+            self.interval = 100_000_000
+            latency = sum(s[2] - s[0] for s in self.samples) / len(self.samples)
+            if received - query > 3 * latency:
+                return
+            self.samples[self.index] = sample
+            self.index = (self.index + 1) % 100
+        b = sum(s[1] - (s[0] + s[2]) / 2 for s in self.samples) / len(self.samples)
+        self.stable = len(self.samples) == 100 and abs(b - self.b) < 20_000_000
+        self.b = b
+
+    def to_headset(self, x):
+        return x + self.b
+
+
+class DriftEstimator:
+    "Same algorithm as clock_offset_estimator"
+
+    def __init__(self, args):
+        self.samples_per_point = args.samples_per_point
+        self.forget_factor = args.forget_factor
+        self.min_points = 4
+        self.max_step = 1_000_000
+        self.converged_points = 0
+        self.residual = 0
+        self.min_x_variance = 1
+        self.max_drift = 500e-6
+        self.group = []
+        self.points = 0
+        self.sums = [0.0] * 6  # w, x, y, xx, xy, yy
+        self.x_ref = 0
+        self.y_ref = 0
+        self.b = 0
+        self.x0 = 0
+        self.a = 0
+        self.uncertainty = 0
+        self.stable = False
+        self.interval = 10_000_000
+
+    def add_sample(self, query, response, received):
+        if received < query:
+            return
+        self.group.append((query, response, received))
+        best = min(self.group, key=lambda s: s[2] - s[0])
+        if len(self.group) < self.samples_per_point:
+            if self.points == 0:
+                self.x0 = (best[0] + best[2]) // 2
+                self.b = best[1] - self.x0
+                self.uncertainty = (best[2] - best[0]) // 2
+            return
+        self.group = []
+        self.add_point(best)
+
+    def add_point(self, s):
+        x = (s[0] + s[2]) // 2
+        y = s[1] - x
+        if self.points == 0:
+            self.x_ref, self.y_ref = x, y
+        self.points += 1
+
+        w, sx, sy, sxx, sxy, syy = (v * self.forget_factor for v in self.sums)
+        dx = (x - self.x_ref) * 1e-9
+        dy = y - self.y_ref
+        sxx += -2 * dx * sx + dx * dx * w
+        sxy += -dx * sy - dy * sx + dx * dy * w
+        syy += -2 * dy * sy + dy * dy * w
+        sx -= dx * w
+        sy -= dy * w
+        self.x_ref, self.y_ref = x, y
+        w += 1
+        self.sums = [w, sx, sy, sxx, sxy, syy]
+
+        mean_x, mean_y = sx / w, sy / w
+        var_x = sxx / w - mean_x * mean_x
+        cov_xy = sxy / w - mean_x * mean_y
+        var_y = syy / w - mean_y * mean_y
+        slope = 0
+        if var_x > self.min_x_variance:
+            slope = min(max(cov_xy / var_x, -self.max_drift * 1e9), self.max_drift * 1e9)
+        residual = math.sqrt(max(0, var_y - 2 * slope * cov_xy + slope * slope * var_x))
+
+        previous_b = self.b + round(self.a * (self.x_ref - self.x0))
+        b = self.y_ref + round(mean_y - slope * mean_x)
+        if self.points > 1 and abs(b - previous_b) < self.max_step and abs(residual - self.residual) < self.max_step:
+            self.converged_points += 1
+        else:
+            self.converged_points = 0
+        self.residual = residual
+
+        self.x0 = self.x_ref
+        self.b = b
+        self.a = slope * 1e-9
+        self.uncertainty = (s[2] - s[0]) // 2 + round(residual)
+        self.stable = self.converged_points >= self.min_points
+        if self.points >= self.min_points:
+            self.interval = 100_000_000
+
+    def to_headset(self, x):
+        return x + self.b + round(self.a * (x - self.x0))
+
+
+def latency(base, jitter, loss_burst):
+    # Wifi latency: exponential jitter with occasional retransmission bursts
+    value = base + random.expovariate(1 / jitter) if jitter > 0 else base
+    if random.random() < loss_burst:
+        value += random.uniform(5, 50)
+    return int(value * 1_000_000)
+
+
+def simulate(estimator, args):
+    drift = args.drift * 1e-6
+    offset = random.randint(-10**12, 10**12)
+
+    def headset(x):
+        return x + offset + round(drift * x)
+
+    errors = []
+    uncertainties = []
+    next_query = 0
+    x = 0
+    end = int(args.duration * 1e9)
+    stable_time = None
+    while x < end:
+        if x >= next_query:
+            next_query = x + estimator.interval
+            query = x
+            arrival = query + latency(args.latency / 2, args.jitter_down, args.burst)
+            received = arrival + latency(args.latency / 2, args.jitter_up, args.burst)
+            # Responses are delivered in the future, process them in order
+            estimator.add_sample(query, headset(arrival), received)
+        if estimator.stable:
+            if stable_time is None:
+                stable_time = x
+            errors.append(abs(estimator.to_headset(x) - headset(x)) / 1_000_000)
+            if hasattr(estimator, "uncertainty"):
+                uncertainties.append(estimator.uncertainty / 1_000_000)
+        x += 10_000_000
+    return stable_time, errors, uncertainties
+
+
+def summary(name, stable_time, errors, uncertainties):
+    if not errors:
+        print(f"{name:>6}: never stable")
+        return
+    if uncertainties:
+        covered = sum(e <= u for e, u in zip(errors, uncertainties)) / len(errors)
+    errors = sorted(errors)
+    mean = sum(errors) / len(errors)
+    p95 = errors[min(len(errors) - 1, int(len(errors) * 0.95))]
+    print(f"{name:>6}: stable after {stable_time / 1e9:5.2f}s, error mean {mean:6.3f}ms p95 {p95:6.3f}ms max {errors[-1]:6.3f}ms")
+    if uncertainties:
+        print(f"{'':>6}  uncertainty mean {sum(uncertainties) / len(uncertainties):6.3f}ms, covers the error {covered * 100:5.1f}% of the time")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Simulate clock synchronization with drift and asymmetric jitter")
+    parser.add_argument("--duration", type=float, default=600, help="simulated duration (s)")
+    parser.add_argument("--drift", type=float, default=50, help="headset clock drift (ppm)")
+    parser.add_argument("--latency", type=float, default=2, help="round trip time without jitter (ms)")
+    parser.add_argument("--jitter-up", type=float, default=3, help="mean jitter from headset to server (ms)")
+    parser.add_argument("--jitter-down", type=float, default=0.5, help="mean jitter from server to headset (ms)")
+    parser.add_argument("--burst", type=float, default=0.02, help="probability of a 5-50ms latency spike")
+    parser.add_argument("--samples-per-point", type=int, default=8, help="samples in each min-RTT group")
+    parser.add_argument("--forget-factor", type=float, default=0.98, help="weight of previous points")
+    parser.add_argument("--seed", type=int, default=0)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    summary("mean", *simulate(MeanEstimator(), args))
+    random.seed(args.seed)
+    summary("drift", *simulate(DriftEstimator(args), args))
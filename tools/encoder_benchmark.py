@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+# Compares encoders on latency and bits per frame
+#
+# For each encoder, record a session with the same content and bitrate:
+#   WIVRN_DUMP_TIMINGS=x264.csv WIVRN_DUMP_VIDEO=x264 wivrn-server
+#   WIVRN_DUMP_TIMINGS=x265.csv WIVRN_DUMP_VIDEO=x265 wivrn-server
+# then run
+#   encoder_benchmark.py x264 x265
+# Each name is used as the prefix of the timings file (<name>.csv) and of the
+# video dumps (<name>-<stream>.<codec>).
+
+import argparse
+import glob
+import os
+
+import process_timings
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def summary(name, values, unit):
+    if not values:
+        print(f"{name:>16}: no data")
+        return
+    mean = sum(values) / len(values)
+    print(f"{name:>16}: mean {mean:8.2f}{unit}  p95 {percentile(values, 0.95):8.2f}{unit}  max {max(values):8.2f}{unit}")
+
+
+def benchmark(name, skip):
+    with open(name + ".csv") as file:
+        frames = process_timings.read(file, skip=skip)
+
+    streams = sorted({stream for frame in frames for stream in frame.streams})
+    for stream in streams:
+        encode = process_timings.durations(frames, stream, None, "encode_begin", "encode_end")
+        send = process_timings.durations(frames, stream, None, "encode_begin", "send_end")
+        idr = process_timings.durations(frames, stream, "idr", "encode_begin", "encode_end")
+
+        print(f"{name}, stream {stream} ({len(encode)} frames, {len(idr)} IDR)")
+        summary("encode", encode, "ms")
+        summary("encode + send", send, "ms")
+
+        size = sum(os.path.getsize(f) for f in glob.glob(f"{name}-{stream}.*"))
+        if size and encode:
+            # Dump also contains the skipped frames
+            total = len([f for f in frames if stream in f.streams]) + skip
+            print(f"{'bits per frame':>16}: {size * 8 / total:8.0f}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare encoder latency and bits per frame")
+    parser.add_argument("names", nargs="+", help="prefix of the files recorded with WIVRN_DUMP_TIMINGS and WIVRN_DUMP_VIDEO")
+    parser.add_argument("--skip", type=int, default=0, help="number of frames to ignore at the beginning")
+    args = parser.parse_args()
+
+    for name in args.names:
+        benchmark(name, args.skip)
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+# Evaluates gaze prediction for dynamic foveation
+#
+# Record a session with WIVRN_DUMP_GAZE=gaze.csv, then run
+#   gaze_prediction.py gaze.csv
+# Measured gaze is replayed through the predictor used in wivrn_foveation,
+# predictions are compared to the measured gaze at the display time of each frame.
+
+import argparse
+import bisect
+import csv
+import math
+
+
+class Predictor:
+    def __init__(self, args):
+        self.saccade_threshold = math.radians(args.saccade_threshold)
+        self.velocity_window = args.velocity_window * 1_000_000
+        self.max_prediction = args.max_prediction * 1_000_000
+        self.max_saccade_amplitude = math.radians(args.max_saccade_amplitude)
+
+    def predict(self, samples, display_time):
+        last_time, last_x, last_y = samples[-1]
+        first = None
+        for sample in reversed(samples[:-1]):
+            if last_time - sample[0] > self.velocity_window:
+                break
+            first = sample
+
+        if first is None or last_time <= first[0]:
+            return last_x, last_y
+
+        dt = (last_time - first[0]) * 1e-9
+        vx = (last_x - first[1]) / dt
+        vy = (last_y - first[2]) / dt
+        speed = math.hypot(vx, vy)
+        if speed <= self.saccade_threshold:
+            return last_x, last_y
+
+        horizon = min(max(display_time - last_time, 0), self.max_prediction)
+        amplitude = min(speed * horizon * 1e-9, self.max_saccade_amplitude)
+        return last_x + vx / speed * amplitude, last_y + vy / speed * amplitude
+
+
+def read(file):
+    gaze = []
+    predictions = []
+    for event, *values in csv.reader(file):
+        if event == "gaze":
+            gaze.append((int(values[0]), float(values[1]), float(values[2])))
+        elif event == "predict":
+            predictions.append((int(values[0]), int(values[1]), float(values[2]), float(values[3])))
+    gaze.sort()
+    return gaze, predictions
+
+
+def gaze_at(gaze, times, t):
+    i = bisect.bisect_left(times, t)
+    if i == 0 or i == len(gaze):
+        return None
+    t0, x0, y0 = gaze[i - 1]
+    t1, x1, y1 = gaze[i]
+    k = (t - t0) / (t1 - t0)
+    return x0 + k * (x1 - x0), y0 + k * (y1 - y0)
+
+
+def error(a, b):
+    return math.degrees(math.hypot(a[0] - b[0], a[1] - b[1]))
+
+
+def summary(name, errors):
+    if not errors:
+        print(f"{name:>13}: no data")
+        return
+    errors = sorted(errors)
+    mean = sum(errors) / len(errors)
+    p95 = errors[min(len(errors) - 1, int(len(errors) * 0.95))]
+    print(f"{name:>13}: mean {mean:6.2f}°  p95 {p95:6.2f}°  max {errors[-1]:6.2f}°")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Evaluate gaze prediction error at display time")
+    parser.add_argument("file", type=argparse.FileType("r"), help="CSV file recorded with WIVRN_DUMP_GAZE")
+    parser.add_argument("--saccade-threshold", type=float, default=100, help="saccade detection threshold (°/s)")
+    parser.add_argument("--velocity-window", type=float, default=10, help="velocity estimation window (ms)")
+    parser.add_argument("--max-prediction", type=float, default=50, help="maximum prediction horizon (ms)")
+    parser.add_argument("--max-saccade-amplitude", type=float, default=20, help="maximum extrapolated saccade amplitude (°)")
+    args = parser.parse_args()
+
+    gaze, predictions = read(args.file)
+    times = [t for t, _, _ in gaze]
+    predictor = Predictor(args)
+    saccade_threshold = math.radians(args.saccade_threshold)
+
+    results = {"all": ([], [], []), "fixation": ([], [], []), "saccade": ([], [], [])}
+    horizons = []
+    for last_time, display_time, x, y in predictions:
+        actual = gaze_at(gaze, times, display_time)
+        if actual is None:
+            continue
+        end = bisect.bisect_right(times, last_time)
+        if end == 0:
+            continue
+        samples = gaze[max(0, end - 32) : end]
+        latest = samples[-1][1:]
+        replayed = predictor.predict(samples, display_time)
+
+        horizons.append((display_time - last_time) / 1_000_000)
+        moving = error(latest, actual) / max((display_time - last_time) * 1e-9, 1e-3)
+        kind = "saccade" if math.radians(moving) > saccade_threshold else "fixation"
+        for key in ("all", kind):
+            results[key][0].append(error(latest, actual))
+            results[key][1].append(error((x, y), actual))
+            results[key][2].append(error(replayed, actual))
+
+    if not horizons:
+        print("No prediction can be evaluated")
+        exit(1)
+
+    print(f"{len(horizons)} frames, mean prediction horizon {sum(horizons) / len(horizons):.1f}ms")
+    for key, (latest, recorded, replayed) in results.items():
+        print(f"{key} ({len(latest)} frames)")
+        summary("no prediction", latest)
+        summary("recorded", recorded)
+        summary("replayed", replayed)
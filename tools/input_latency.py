@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+
+# Compares input packet rate and latency between recordings
+#
+# Record a session for each client build, pressing buttons and moving the
+# thumbsticks in the same way:
+#   WIVRN_DUMP_INPUTS=before.csv wivrn-server
+#   WIVRN_DUMP_INPUTS=after.csv wivrn-server
+# then run
+#   input_latency.py before.csv after.csv
+# Latency is the time between the change of an input on the headset and the
+# first time the application reads the new value on the server.
+
+import argparse
+import csv
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def summary(name, values, unit):
+    if not values:
+        print(f"{name:>16}: no data")
+        return
+    mean = sum(values) / len(values)
+    print(
+        f"{name:>16}: mean {mean:8.2f}{unit}  p50 {percentile(values, 0.5):8.2f}{unit}  "
+        f"p95 {percentile(values, 0.95):8.2f}{unit}  max {max(values):8.2f}{unit}"
+    )
+
+
+def benchmark(name):
+    packets = []
+    latencies = []
+    with open(name) as file:
+        for row in csv.reader(file):
+            if row[0] == "packet":
+                packets.append((int(row[1]), int(row[2])))
+            elif row[0] == "read":
+                time, change_time = int(row[1]), int(row[3])
+                # Inputs that never changed have no timestamp
+                if change_time:
+                    latencies.append((time - change_time) / 1e6)
+
+    print(name)
+    if len(packets) > 1:
+        duration = (packets[-1][0] - packets[0][0]) / 1e9
+        values = sum(n for _, n in packets)
+        print(f"{'packets':>16}: {len(packets) / duration:8.1f}/s")
+        print(f"{'values/packet':>16}: {values / len(packets):8.1f}")
+    summary("latency", latencies, "ms")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare input packet rate and latency of input files")
+    parser.add_argument("files", nargs="+", help="files recorded with WIVRN_DUMP_INPUTS")
+    args = parser.parse_args()
+
+    for name in args.files:
+        benchmark(name)
@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+
+# Emulates a lossy network link between the server and the headset
+#
+# Runs as a proxy for the control (TCP) and stream (UDP) sockets:
+#   network_emulator.py --listen 9767 --server 127.0.0.1 \
+#       --delay 3 --jitter 2 --gilbert 0.01 0.3 --loss-bad 0.5 --rate 150 --log fate.csv
+# then connect the headset to wivrn://<proxy address>:9767.
+# The stream port in the server handshake is replaced with the proxy port, so
+# that the headset sends its UDP packets to the proxy.
+#
+# Loss follows the Gilbert-Elliott model: for each packet the link goes from
+# the good to the bad state with probability p and back with probability r,
+# packets are lost with probability --loss-good or --loss-bad in each state.
+# Only UDP packets are lost or reordered, TCP messages are delayed in order.
+# With --rate, packets are serialized at this rate and UDP packets are dropped
+# when they would wait more than --queue ms, as in an access point queue.
+#
+# Each packet is logged in CSV with its fate:
+#   time (ns),direction (down: to headset, up: from headset),protocol,
+#   type (variant index),size,fate (sent, lost, dropped),delay (ns)
+# The seed makes loss patterns reproducible between runs.
+
+import argparse
+import asyncio
+import collections
+import csv
+import functools
+import random
+import sys
+import time
+
+
+class Link:
+    "Impairments of one direction"
+
+    def __init__(self, name, args, rng, log, impaired):
+        self.name = name
+        self.rng = rng
+        self.log = log
+        self.delay = args.delay / 1000 if impaired else 0
+        self.jitter = args.jitter / 1000 if impaired else 0
+        self.reorder = args.reorder if impaired else 0
+        self.reorder_delay = args.reorder_delay / 1000
+        self.rate = args.rate * 1e6 / 8 if impaired and args.rate else None
+        self.queue = args.queue / 1000
+        self.p, self.r = args.gilbert if impaired else (0, 0)
+        self.loss_good = args.loss_good if impaired else 0
+        self.loss_bad = args.loss_bad if impaired else 0
+
+        self.bad = False
+        # end of transmission of the queued packets, for the rate limit
+        self.busy_until = 0
+        # packets are delivered in order, except when reordered
+        self.last_delivery = 0
+        # callbacks of the packets delivered in order: timers with the same
+        # deadline may run in any order
+        self.in_order = collections.deque()
+        self.stats = {"sent": 0, "lost": 0, "dropped": 0}
+
+    def lost(self):
+        if self.bad:
+            self.bad = self.rng.random() >= self.r
+        else:
+            self.bad = self.rng.random() < self.p
+        return self.rng.random() < (self.loss_bad if self.bad else self.loss_good)
+
+    def schedule(self, now, protocol, data):
+        "Returns the delivery time, or None if the packet is lost, and whether it is reordered"
+        reliable = protocol == "tcp"
+        fate = "sent"
+        delivery = None
+        reordered = False
+
+        if not reliable and self.lost():
+            fate = "lost"
+        else:
+            start = max(now, self.busy_until)
+            if self.rate and not reliable and start - now > self.queue:
+                fate = "dropped"
+            else:
+                if self.rate:
+                    self.busy_until = start + len(data) / self.rate
+                    start = self.busy_until
+                delivery = start + self.delay + self.rng.uniform(0, self.jitter)
+                if not reliable and self.rng.random() < self.reorder:
+                    delivery = max(delivery, self.last_delivery) + self.reorder_delay
+                    reordered = True
+                else:
+                    delivery = max(delivery, self.last_delivery)
+                    self.last_delivery = delivery
+
+        self.stats[fate] += 1
+        if self.log:
+            self.log.writerow([
+                time.monotonic_ns(),
+                self.name,
+                protocol,
+                data[0] if data else "",
+                len(data),
+                fate,
+                int((delivery - now) * 1e9) if delivery is not None else "",
+            ])
+        return delivery, reordered
+
+    def forward(self, loop, protocol, payload, callback):
+        "Calls callback when the packet is delivered"
+        delivery, reordered = self.schedule(loop.time(), protocol, payload)
+        if delivery is None:
+            return
+        if reordered:
+            loop.call_at(delivery, callback)
+        else:
+            self.in_order.append(callback)
+            loop.call_at(delivery, self.deliver_next)
+
+    def deliver_next(self):
+        self.in_order.popleft()()
+
+    def after(self, loop, callback):
+        "Calls callback after all the packets in order are delivered"
+        self.in_order.append(callback)
+        loop.call_at(self.last_delivery, self.deliver_next)
+
+
+def split_frame(buffer):
+    "Returns the header and payload size of the first message, None if incomplete"
+    # Messages are prefixed with their size as a LEB128 varint
+    size = 0
+    for i in range(min(len(buffer), 5)):
+        size |= (buffer[i] & 0x7F) << (7 * i)
+        if not buffer[i] & 0x80:
+            if len(buffer) < i + 1 + size:
+                return None
+            return i + 1, size
+    return None
+
+
+class Datagram(asyncio.DatagramProtocol):
+    def __init__(self, callback):
+        self.callback = callback
+
+    def datagram_received(self, data, addr):
+        self.callback(data, addr)
+
+
+class Emulator:
+    def __init__(self, args):
+        self.args = args
+        rng = random.Random(args.seed)
+        self.log_file = open(args.log, "w", newline="") if args.log else None
+        log = csv.writer(self.log_file) if self.log_file else None
+        self.down = Link("down", args, rng, log, args.impair in ("down", "both"))
+        self.up = Link("up", args, rng, log, args.impair in ("up", "both"))
+
+        self.headset_udp = None
+        self.server_udp = None
+        self.headset_addr = None
+        self.session = None
+
+    async def run(self):
+        loop = asyncio.get_running_loop()
+        self.headset_udp, _ = await loop.create_datagram_endpoint(
+            lambda: Datagram(self.from_headset), local_addr=(self.args.bind or "::", self.args.listen)
+        )
+        server = await asyncio.start_server(self.on_control, self.args.bind, self.args.listen)
+        print(f"Listening on port {self.args.listen}, server {self.args.server}:{self.args.server_port}")
+        async with server:
+            await server.serve_forever()
+
+    async def on_control(self, headset_reader, headset_writer):
+        # A single headset at a time
+        if self.session:
+            self.session.cancel()
+        self.session = asyncio.current_task()
+
+        loop = asyncio.get_running_loop()
+        print("Headset connected from", headset_writer.get_extra_info("peername"))
+        try:
+            server_reader, server_writer = await asyncio.open_connection(self.args.server, self.args.server_port)
+        except OSError as e:
+            print("Cannot connect to server:", e)
+            headset_writer.close()
+            return
+
+        # The server accepts UDP packets from the address of the control connection
+        if self.server_udp:
+            self.server_udp.close()
+        self.headset_addr = None
+        self.server_udp, _ = await loop.create_datagram_endpoint(
+            lambda: Datagram(self.from_server), remote_addr=(self.args.server, self.args.server_port)
+        )
+
+        try:
+            await asyncio.gather(
+                self.pipe(headset_reader, server_writer, self.up, False),
+                self.pipe(server_reader, headset_writer, self.down, True),
+            )
+        except (asyncio.CancelledError, ConnectionError):
+            pass
+        finally:
+            headset_writer.close()
+            server_writer.close()
+            self.print_stats()
+
+    async def pipe(self, reader, writer, link, rewrite):
+        loop = asyncio.get_running_loop()
+        buffer = bytearray()
+        while data := await reader.read(65536):
+            buffer += data
+            while frame := split_frame(buffer):
+                header_size, size = frame
+                message = bytes(buffer[: header_size + size])
+                del buffer[: header_size + size]
+                if rewrite:
+                    message = self.rewrite_handshake(message, header_size)
+                link.forward(loop, "tcp", message[header_size:], functools.partial(writer.write, message))
+        link.after(loop, writer.close)
+
+    def rewrite_handshake(self, message, header_size):
+        # to_headset::handshake is the first variant type, with an int32 stream port
+        payload = message[header_size:]
+        if len(payload) != 5 or payload[0] != 0:
+            return message
+        port = int.from_bytes(payload[1:], "little", signed=True)
+        if port <= 0:
+            return message
+        return message[:header_size] + b"\0" + self.args.listen.to_bytes(4, "little", signed=True)
+
+    def from_headset(self, data, addr):
+        self.headset_addr = addr
+        if not self.server_udp:
+            return
+        loop = asyncio.get_running_loop()
+        self.up.forward(loop, "udp", data, functools.partial(self.send, self.server_udp, data, None))
+
+    def from_server(self, data, addr):
+        if not self.headset_addr:
+            return
+        loop = asyncio.get_running_loop()
+        self.down.forward(loop, "udp", data, functools.partial(self.send, self.headset_udp, data, self.headset_addr))
+
+    @staticmethod
+    def send(transport, data, addr):
+        if not transport.is_closing():
+            transport.sendto(data, addr)
+
+    def print_stats(self):
+        for link in (self.down, self.up):
+            total = sum(link.stats.values())
+            if total:
+                print(
+                    f"{link.name:>4}: {total} packets, "
+                    + ", ".join(f"{n} {fate} ({n / total * 100:.2f}%)" for fate, n in link.stats.items())
+                )
+        if self.log_file:
+            self.log_file.flush()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Proxy between server and headset with loss, delay and rate limit")
+    parser.add_argument("--listen", type=int, default=9767, help="port for the headset (TCP and UDP)")
+    parser.add_argument("--bind", help="address for the headset, all by default")
+    parser.add_argument("--server", default="127.0.0.1", help="server address")
+    parser.add_argument("--server-port", type=int, default=9757, help="server port")
+    parser.add_argument("--impair", choices=["down", "up", "both"], default="both", help="directions to impair")
+    parser.add_argument("--delay", type=float, default=0, help="one way delay in ms")
+    parser.add_argument("--jitter", type=float, default=0, help="additional uniform random delay in ms")
+    parser.add_argument("--reorder", type=float, default=0, help="probability of delaying a UDP packet after the next ones")
+    parser.add_argument("--reorder-delay", type=float, default=2, help="delay of reordered packets in ms")
+    parser.add_argument("--rate", type=float, help="link rate in Mbit/s")
+    parser.add_argument("--queue", type=float, default=20, help="maximum queueing delay in ms with --rate")
+    parser.add_argument("--gilbert", type=float, nargs=2, metavar=("P", "R"), default=(0, 0),
+                        help="probabilities to go to the bad state and back to the good state")
+    parser.add_argument("--loss-good", type=float, default=0, help="loss probability in the good state")
+    parser.add_argument("--loss-bad", type=float, default=1, help="loss probability in the bad state")
+    parser.add_argument("--seed", type=int, default=0, help="random seed")
+    parser.add_argument("--log", help="CSV file for the fate of each packet")
+    args = parser.parse_args()
+
+    emulator = Emulator(args)
+    try:
+        asyncio.run(emulator.run())
+    except KeyboardInterrupt:
+        emulator.print_stats()
+        sys.exit(0)
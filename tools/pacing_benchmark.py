@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+
+# Compares video pacing settings on frame loss and receive duration
+#
+# Record a session for each setting with the same content and bitrate:
+#   WIVRN_DUMP_TIMINGS=off.csv wivrn-server     # "pacing": "off"
+#   WIVRN_DUMP_TIMINGS=user.csv wivrn-server    # "pacing": "user"
+# then run
+#   pacing_benchmark.py off.csv user.csv
+# Receive duration is the time between the first and last packet of a frame
+# on the headset, lost frames are the ones that could not be decoded.
+
+import argparse
+
+import process_timings
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def summary(name, values, unit):
+    if not values:
+        print(f"{name:>16}: no data")
+        return
+    mean = sum(values) / len(values)
+    print(f"{name:>16}: mean {mean:8.2f}{unit}  p95 {percentile(values, 0.95):8.2f}{unit}  max {max(values):8.2f}{unit}")
+
+
+def benchmark(name, skip):
+    with open(name) as file:
+        frames = process_timings.read(file, skip=skip)
+
+    streams = sorted({stream for frame in frames for stream in frame.streams})
+    for stream in streams:
+        sent = [f for f in frames if stream in f.streams and "transmit_end" in f.streams[stream]]
+        lost = [f for f in sent if "lost" in f.streams[stream]]
+        receive = process_timings.durations(frames, stream, None, "receive_begin", "receive_end")
+        transmit = process_timings.durations(frames, stream, None, "transmit_begin", "transmit_end")
+
+        print(f"{name}, stream {stream} ({len(sent)} frames)")
+        if sent:
+            print(f"{'lost frames':>16}: {len(lost)} ({len(lost) / len(sent) * 100:.2f}%)")
+        summary("transmit", transmit, "ms")
+        summary("receive", receive, "ms")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare frame loss and receive duration of timing files")
+    parser.add_argument("files", nargs="+", help="files recorded with WIVRN_DUMP_TIMINGS")
+    parser.add_argument("--skip", type=int, default=0, help="number of frames to ignore at the beginning")
+    args = parser.parse_args()
+
+    for name in args.files:
+        benchmark(name, args.skip)
@@ -78,3 +78,16 @@ def durations(frames, stream=None, flag=None, *args, **kwargs):
         return flag in frame.flags.get(stream, ())
     res = [frame.duration(*args, stream=stream, **kwargs) for frame in frames if filter(frame)]
     return [d for d in res if d is not None]
+
+def recoveries(frames, stream):
+    """Time in ms between a lost frame and the frame that repairs the picture, as reported by the headset"""
+    res = []
+    lost = None
+    for frame in frames:
+        events = frame.streams.get(stream, {})
+        if lost is None and "lost" in events:
+            lost = events["lost"]
+        if lost is not None and "recovered" in events:
+            res.append((events["recovered"] - lost) / 1_000_000)
+            lost = None
+    return res
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+
+# Measures the error of the positional reprojection on a synthetic scene
+#
+#   reprojection_error.py --translation 2 0 -1 --rotation 1
+#
+# A frame is rendered from the origin, then displayed after the head moved by
+# --translation (cm) and turned by --rotation (degrees, yaw). For each vertex
+# of the reprojection mesh, the position where it is drawn is compared with
+# the ground truth: the projection in the displayed view of the surface point
+# seen in the frame, obtained by ray casting.
+#
+# The depth grid is built as on the server (nearest of 4x4 samples per cell,
+# quantized as min_distance / distance on 16 bits) and interpolated as in
+# reprojection.glsl. Rotation only is what the runtime does without depth,
+# exact depth uses the distance of each vertex without downsampling.
+
+import argparse
+import math
+
+MIN_DISTANCE = 0.1
+
+
+class Scene:
+    "Floor, a back wall and two boxes, infinity elsewhere"
+
+    def __init__(self):
+        # (axis, position, bounds on the two other axes)
+        self.planes = [
+            (1, -1.5, ((-50, 50), (-50, 50))),
+            (2, -6.0, ((-4, 4), (-1.5, 3))),
+            (2, -1.0, ((-0.3, 0.1), (-0.4, 0.2))),
+            (2, -2.5, ((0.2, 1.0), (-1.5, 0.5))),
+        ]
+
+    def cast(self, origin, direction):
+        "Distance along the ray to the nearest surface, inf if none"
+        nearest = math.inf
+        for axis, position, bounds in self.planes:
+            if direction[axis] == 0:
+                continue
+            t = (position - origin[axis]) / direction[axis]
+            if t <= 0 or t >= nearest:
+                continue
+            others = [i for i in range(3) if i != axis]
+            if all(lo <= origin[i] + t * direction[i] <= hi for i, (lo, hi) in zip(others, bounds)):
+                nearest = t
+        return nearest
+
+
+def rotate_y(v, angle):
+    c, s = math.cos(angle), math.sin(angle)
+    return (c * v[0] + s * v[2], v[1], -s * v[0] + c * v[2])
+
+
+class View:
+    "Eye looking towards -z, turned by yaw around y"
+
+    def __init__(self, position, yaw, tangents):
+        self.position = position
+        self.yaw = yaw
+        # left, right, up, down
+        self.l, self.r, self.u, self.d = tangents
+
+    def ray(self, ndc):
+        "Direction in world space of the ray through ndc (y down, as in Vulkan)"
+        t = ((ndc[0] + 1) / 2, (ndc[1] + 1) / 2)
+        tangent = (self.l + t[0] * (self.r - self.l), self.u + t[1] * (self.d - self.u))
+        return rotate_y((tangent[0], tangent[1], -1), self.yaw)
+
+    def project(self, point, w=1):
+        """ndc of the homogeneous point (point, w) in world space, None if behind
+        w = 0 for directions"""
+        p = tuple(point[i] - self.position[i] * w for i in range(3))
+        p = rotate_y(p, -self.yaw)
+        if p[2] >= 0:
+            return None
+        tangent = (p[0] / -p[2], p[1] / -p[2])
+        return (
+            (tangent[0] - self.l) / (self.r - self.l) * 2 - 1,
+            (tangent[1] - self.u) / (self.d - self.u) * 2 - 1,
+        )
+
+
+def quantize(distance):
+    return round(65535 * min(1, MIN_DISTANCE / distance))
+
+
+def depth_grid(scene, view, width, height, samples=4):
+    "Quantized disparities as sent by the server"
+    grid = []
+    for y in range(height):
+        for x in range(width):
+            nearest = math.inf
+            for j in range(samples):
+                for i in range(samples):
+                    u = (x + (i + 0.5) / samples) / width
+                    v = (y + (j + 0.5) / samples) / height
+                    nearest = min(nearest, scene.cast(view.position, view.ray((u * 2 - 1, v * 2 - 1))))
+            grid.append(quantize(nearest))
+    return grid
+
+
+def disparity(grid, width, height, t):
+    "Same as reprojection.glsl"
+    px = min(max(t[0] * width - 0.5, 0), width - 1)
+    py = min(max(t[1] * height - 0.5, 0), height - 1)
+    ix, iy = int(px), int(py)
+    jx, jy = min(ix + 1, width - 1), min(iy + 1, height - 1)
+    fx, fy = px - ix, py - iy
+
+    def at(x, y):
+        return grid[y * width + x] / 65535
+
+    top = at(ix, iy) * (1 - fx) + at(jx, iy) * fx
+    bottom = at(ix, jy) * (1 - fx) + at(jx, jy) * fx
+    return top * (1 - fy) + bottom * fy
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100 * len(values)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Reprojection error with and without the depth stream")
+    parser.add_argument("--translation", type=float, nargs=3, default=(2, 0, -1), metavar=("X", "Y", "Z"),
+                        help="head movement between rendering and display in cm")
+    parser.add_argument("--rotation", type=float, default=1, help="head rotation (yaw) in degrees")
+    parser.add_argument("--fov", type=float, default=45, help="half field of view in degrees")
+    parser.add_argument("--pixels", type=int, default=2000, help="width of the view in pixels")
+    parser.add_argument("--grid", type=int, default=48, help="size of the depth grid")
+    parser.add_argument("--mesh", type=int, default=128, help="size of the reprojection mesh")
+    args = parser.parse_args()
+
+    tan = math.tan(math.radians(args.fov))
+    tangents = (-tan, tan, tan, -tan)
+    scene = Scene()
+    frame = View((0, 0, 0), 0, tangents)
+    display = View(tuple(x / 100 for x in args.translation), math.radians(args.rotation), tangents)
+
+    grid = depth_grid(scene, frame, args.grid, args.grid)
+
+    errors = {"rotation only": [], "depth grid": [], "exact depth": []}
+    for y in range(args.mesh + 1):
+        for x in range(args.mesh + 1):
+            t = (x / args.mesh, y / args.mesh)
+            ndc = (t[0] * 2 - 1, t[1] * 2 - 1)
+            direction = frame.ray(ndc)
+            distance = scene.cast(frame.position, direction)
+
+            # The ray direction has a z of -1 in the frame: distances along the
+            # ray are distances along the view axis, as in the depth buffer
+            if math.isinf(distance):
+                truth = display.project(direction, 0)
+            else:
+                truth = display.project(tuple(i * distance for i in direction))
+            if truth is None:
+                continue
+
+            def error(d):
+                p = display.project(direction, d / MIN_DISTANCE)
+                if p is None:
+                    return math.inf
+                return math.hypot(p[0] - truth[0], p[1] - truth[1]) / 2 * args.pixels
+
+            exact = quantize(distance) / 65535
+            errors["rotation only"].append(error(0))
+            errors["depth grid"].append(error(disparity(grid, args.grid, args.grid, t)))
+            errors["exact depth"].append(error(exact))
+
+    print(f"Head movement: {tuple(args.translation)} cm, {args.rotation}°")
+    print(f"Error in pixels over {len(errors['rotation only'])} mesh vertices, {args.pixels} px per view")
+    print(f"{'':>15} {'mean':>8} {'median':>8} {'p95':>8} {'max':>8}")
+    for name, values in errors.items():
+        finite = [i for i in values if math.isfinite(i)]
+        print(
+            f"{name:>15} {sum(finite) / len(finite):8.2f} {percentile(finite, 50):8.2f} "
+            f"{percentile(finite, 95):8.2f} {max(finite):8.2f}"
+            + (f" ({len(values) - len(finite)} behind the view)" if len(finite) < len(values) else "")
+        )
+
+
+if __name__ == "__main__":
+    main()
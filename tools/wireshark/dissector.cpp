@@ -38,6 +38,11 @@ static inline uint16_t get_uint16(tvbuff_t * tvb, const int offset, const unsign
 	return tvb_get_uint16(tvb, offset, encoding);
 }
 
+static inline uint32_t get_uint32(tvbuff_t * tvb, const int offset, const unsigned encoding)
+{
+	return tvb_get_uint32(tvb, offset, encoding);
+}
+
 static inline uint16_t get_uint8(tvbuff_t * tvb, const int offset)
 {
 	return tvb_get_uint8(tvb, offset);
@@ -48,6 +53,11 @@ static inline uint16_t get_uint16(tvbuff_t * tvb, const int offset, const unsign
 	return tvb_get_guint16(tvb, offset, encoding);
 }
 
+static inline uint32_t get_uint32(tvbuff_t * tvb, const int offset, const unsigned encoding)
+{
+	return tvb_get_guint32(tvb, offset, encoding);
+}
+
 static inline uint16_t get_uint8(tvbuff_t * tvb, const int offset)
 {
 	return tvb_get_guint8(tvb, offset);
@@ -456,6 +466,11 @@ struct tree_traits<abbrev, std::vector<T>>
 	}
 };
 
+// Same wire format as std::vector
+template <details::fixed_string abbrev, typename T>
+struct tree_traits<abbrev, vector_view<T>> : tree_traits<abbrev, std::vector<T>>
+{};
+
 template <details::fixed_string abbrev, typename T>
 struct tree_traits<abbrev, std::optional<T>>
 {
@@ -668,8 +683,8 @@ struct tree_traits<abbrev, std::span<uint8_t>>
 
 	static void dissect(proto_tree * tree, tvbuff_t * tvb, int & start)
 	{
-		size_t span_size = get_uint16(tvb, start, ENC_LITTLE_ENDIAN);
-		start += sizeof(uint16_t);
+		size_t span_size = get_uint32(tvb, start, ENC_LITTLE_ENDIAN);
+		start += sizeof(uint32_t);
 
 		proto_tree_add_item(tree, field_handle, tvb, start, span_size, ENC_NA);
 
@@ -678,11 +693,11 @@ struct tree_traits<abbrev, std::span<uint8_t>>
 
 	static size_t size(tvbuff_t * tvb, int & start)
 	{
-		size_t span_size = get_uint16(tvb, start, ENC_LITTLE_ENDIAN);
-		start += sizeof(uint16_t);
+		size_t span_size = get_uint32(tvb, start, ENC_LITTLE_ENDIAN);
+		start += sizeof(uint32_t);
 		start += span_size;
 
-		return sizeof(uint16_t) + span_size;
+		return sizeof(uint32_t) + span_size;
 	}
 };
 
@@ -714,7 +729,14 @@ int dissect_wivrn(tvbuff_t * tvb, packet_info * pinfo, proto_tree * tree _U_, vo
 	int start = 0;
 
 	if (tcp)
-		start += sizeof(uint16_t);
+	{
+		// Messages are prefixed with their size as a LEB128 varint
+		for (int i = 0; i < 5; ++i)
+		{
+			if (not(get_uint8(tvb, start++) & 0x80))
+				break;
+		}
+	}
 
 	if (pinfo->destport == wivrn::default_port)
 		tree_traits<"wivrn.from_headset", from_headset::packets>::dissect(subtree, tvb, start);